@@ -157,6 +157,13 @@ typedef struct _st_stack {
     char *stk_bottom;           /* Lowest address of stack's usable portion */
     char *stk_top;              /* Highest address of stack's usable portion */
     void *sp;                   /* Stack pointer from C's point of view */
+    int  painted;               /* Whether the stack is painted by canary */
+    int  guarded;               /* Whether the redzones are protected */
+    int  slab;                  /* The type of arena carved from, never unmapped if set */
+    struct _st_shared_stack *shared; /* The execution stack in copy-stack mode, or NULL */
+    char *save_buf;             /* The frames saved from the shared stack */
+    int  save_size;             /* Size of the saved frames */
+    int  save_cap;              /* Capacity of the save buffer */
     /* merge from https://github.com/toffaletti/state-threads/commit/7f57fc9acc05e657bca1223f1e5b9b1a45ed929b */
 #ifndef NVALGRIND
     /* id returned by VALGRIND_STACK_REGISTER */
@@ -175,6 +182,7 @@ typedef struct _st_thread _st_thread_t;
 struct _st_thread {
     int state;                  /* Thread's state */
     int flags;                  /* Thread's flags */
+    int prio;                   /* Priority class, the index of run queue */
 
     void *(*start)(void *arg);  /* The start function of the thread */
     void *arg;                  /* Argument of the start function */
@@ -189,6 +197,8 @@ struct _st_thread {
 #endif
 
     st_utime_t due;             /* Wakeup time when thread is sleeping */
+    st_utime_t due_early;       /* Earliest wakeup time, due minus the timer slack */
+    st_utime_t slack;           /* Timer slack of thread, if _ST_FL_SLACK is set */
     _st_thread_t *left;         /* For putting in timeout heap */
     _st_thread_t *right;          /* -- see docs/timeout_heap.txt for details */
     int heap_index;
@@ -198,6 +208,13 @@ struct _st_thread {
     _st_cond_t *term;           /* Termination condition variable for join */
 
     _st_jmp_buf_t context;            /* Thread's context */
+
+    unsigned long long ready_at;    /* Cycles when made runnable, for stat */
+    unsigned long long run_at;      /* Cycles when switched in, for stat */
+    unsigned long long cpu;         /* Cycles on CPU */
+    unsigned long long delay;       /* Cycles from runnable to running */
+    unsigned long long max_delay;
+    unsigned long long nn_switches; /* Times switched in */
 };
 
 
@@ -207,34 +224,93 @@ typedef struct _st_mutex {
 } _st_mutex_t;
 
 
+typedef struct _st_rwlock {
+    int readers;                /* Number of readers holding the lock */
+    _st_thread_t *writer;       /* The writer holding the lock */
+    _st_clist_t rwait_q;        /* Readers wait queue */
+    _st_clist_t wwait_q;        /* Writers wait queue */
+} _st_rwlock_t;
+
+
+typedef struct _st_sema {
+    int value;                  /* Number of available permits */
+    _st_clist_t wait_q;         /* Semaphore wait queue */
+} _st_sema_t;
+
+
+typedef struct _st_pollfd_link {
+    struct _st_pollfd_link *next;   /* For putting on the waiters of a descriptor */
+    struct _st_pollfd_link *prev;
+    struct _st_pollq *pq;           /* The pollq waiting on the descriptor */
+} _st_pollfd_link_t;
+
+
 typedef struct _st_pollq {
     _st_clist_t links;          /* For putting on io queue */
     _st_thread_t  *thread;      /* Polling thread */
     struct pollfd *pds;         /* Array of poll descriptors */
     int npds;                   /* Length of the array */
     int on_ioq;                 /* Is it on ioq? */
+    _st_pollfd_link_t *fdlinks; /* Link of each descriptor, for event system to find pollq by fd */
 } _st_pollq_t;
 
 
+/*
+ * The native I/O operations of event system, done by netfd_io after the
+ * non-blocking syscall fails with EAGAIN.
+ */
+#define _ST_IO_RECV     1   /* Like recv, the buf and len */
+#define _ST_IO_SEND     2   /* Like send, the buf and len */
+#define _ST_IO_ACCEPT   3   /* Like accept, the buf is addr, the arg is addrlen */
+#define _ST_IO_RECVMSG  4   /* Like recvmsg, the buf is msghdr, the len is flags */
+#define _ST_IO_SENDMSG  5   /* Like sendmsg, the buf is msghdr, the len is flags */
+
 typedef struct _st_eventsys_ops {
     const char *name;                          /* Name of this event system */
     int  val;                                  /* Type of this event system */
     int  (*init)(void);                        /* Initialization */
     void (*dispatch)(void);                    /* Dispatch function */
-    int  (*pollset_add)(struct pollfd *, int); /* Add descriptor set */
-    void (*pollset_del)(struct pollfd *, int); /* Delete descriptor set */
+    int  (*pollset_add)(_st_pollq_t *);        /* Add descriptor set of pollq */
+    void (*pollset_del)(_st_pollq_t *);        /* Delete descriptor set of pollq */
     int  (*fd_new)(int);                       /* New descriptor allocated */
     int  (*fd_close)(int);                     /* Descriptor closed */
     int  (*fd_getlimit)(void);                 /* Descriptor hard limit */
     void (*destroy)(void);                     /* Destroy the event object */
+    int  (*netfd_add)(struct _st_netfd *);     /* Register descriptor persistently, optional */
+    void (*netfd_del)(struct _st_netfd *);     /* Unregister the persistent descriptor */
+    /* Do the I/O natively and wait for it, optional, fails with EAGAIN to wait for readiness */
+    ssize_t (*netfd_io)(struct _st_netfd *, int, void *, size_t, void *, st_utime_t);
 } _st_eventsys_t;
 
 
+/*
+ * Hierarchical timing wheel, an optional sleep queue with O(1) insert and
+ * delete, see st_set_timer_wheel(). The level 0 has 256 slots of one tick,
+ * and each upper level has 64 slots, each slot covers a round of the lower
+ * level, so the wheel covers 2^32 ticks. Sleeping threads are linked to the
+ * slots by thread->links, with the slot index in thread->heap_index.
+ */
+#define _ST_WHEEL_L0_BITS   8
+#define _ST_WHEEL_LN_BITS   6
+#define _ST_WHEEL_LEVELS    5
+#define _ST_WHEEL_L0_SIZE   (1 << _ST_WHEEL_L0_BITS)
+#define _ST_WHEEL_LN_SIZE   (1 << _ST_WHEEL_LN_BITS)
+#define _ST_WHEEL_SLOTS     (_ST_WHEEL_L0_SIZE + (_ST_WHEEL_LEVELS - 1) * _ST_WHEEL_LN_SIZE)
+
+typedef struct _st_wheel {
+    st_utime_t tick;                /* Resolution of the wheel */
+    unsigned long long base;        /* The next tick to expire */
+    _st_clist_t slots[_ST_WHEEL_SLOTS];
+    unsigned long long bitmap[_ST_WHEEL_SLOTS / 64]; /* Non-empty slots */
+} _st_wheel_t;
+
+
 typedef struct _st_vp {
     _st_thread_t *idle_thread;  /* Idle thread for this vp */
     st_utime_t last_clock;      /* The last time we went into vp_check_clock() */
 
-    _st_clist_t run_q;          /* run queue for this vp */
+    _st_clist_t run_q[ST_PRIO_LEVELS]; /* run queue of each priority class for this vp */
+    int runq_size;              /* number of threads on all run queues */
     _st_clist_t io_q;           /* io queue for this vp */
     _st_clist_t zombie_q;       /* zombie queue for this vp */
 #ifdef DEBUG
@@ -244,6 +320,16 @@ typedef struct _st_vp {
 
     _st_thread_t *sleep_q;      /* sleep queue for this vp */
     int sleepq_size;          /* number of threads on sleep queue */
+    _st_wheel_t *wheel;         /* timing wheel replaces the sleep_q heap if set */
+
+    st_vp_stats_t *vstats;      /* The stat of event loop */
+    int nn_events;              /* The events of last dispatch, set by event system */
+    unsigned long long nn_ctls; /* The requests to change the interests, set by event system */
+    unsigned long long nn_ios;  /* The native I/O operations, set by event system */
+
+    int stats;                  /* Account the time of threads if set */
+    unsigned long long stats_since; /* Cycles when stats enabled, older stamps are stale */
+    unsigned long long stats_ns;    /* Monotonic clock when stats enabled, to calibrate cycles */
 
 #ifdef ST_SWITCH_CB
     st_switch_cb_t switch_out_cb;    /* called when a thread is switched out */
@@ -255,6 +341,9 @@ typedef struct _st_vp {
 typedef struct _st_netfd {
     int osfd;                   /* Underlying OS file descriptor */
     int inuse;                  /* In-use flag */
+    int persistent;             /* Registered to event system until closed */
+    int revents;                /* Readiness of persistent descriptor, set by event system */
+    int native;                 /* Do I/O by event system natively, see netfd_io */
     void *private_data;         /* Per descriptor private data */
     _st_destructor_t destructor; /* Private data destructor function */
     void *aux_data;             /* Auxiliary data for internal use */
@@ -275,7 +364,8 @@ extern __thread _st_eventsys_t *_st_eventsys;
 
 #define _ST_LAST_CLOCK                  (_st_this_vp.last_clock)
 
-#define _ST_RUNQ                        (_st_this_vp.run_q)
+#define _ST_RUNQ(_prio)                 (_st_this_vp.run_q[_prio])
+#define _ST_RUNQ_SIZE                   (_st_this_vp.runq_size)
 #define _ST_IOQ                         (_st_this_vp.io_q)
 #define _ST_ZOMBIEQ                     (_st_this_vp.zombie_q)
 #ifdef DEBUG
@@ -286,6 +376,7 @@ extern __thread _st_eventsys_t *_st_eventsys;
 
 #define _ST_SLEEPQ                      (_st_this_vp.sleep_q)
 #define _ST_SLEEPQ_SIZE                 (_st_this_vp.sleepq_size)
+#define _ST_WHEEL                       (_st_this_vp.wheel)
 
 #define _ST_VP_IDLE()                   (*_st_eventsys->dispatch)()
 
@@ -294,12 +385,31 @@ extern __thread _st_eventsys_t *_st_eventsys;
  * vp queues operations
  */
 
-#define _ST_ADD_IOQ(_pq)    ST_APPEND_LINK(&_pq.links, &_ST_IOQ)
-#define _ST_DEL_IOQ(_pq)    ST_REMOVE_LINK(&_pq.links)
+#define _ST_ADD_IOQ(_pq)    ST_APPEND_LINK(&(_pq).links, &_ST_IOQ)
+#define _ST_DEL_IOQ(_pq)    ST_REMOVE_LINK(&(_pq).links)
 
-#define _ST_ADD_RUNQ(_thr)  ST_APPEND_LINK(&(_thr)->links, &_ST_RUNQ)
-#define _ST_INSERT_RUNQ(_thr)  ST_INSERT_LINK(&(_thr)->links, &_ST_RUNQ)
-#define _ST_DEL_RUNQ(_thr)  ST_REMOVE_LINK(&(_thr)->links)
+/* Stamp the thread when made runnable, for the delay until it runs */
+#define _ST_STAT_READY(_thr)            \
+    if (_st_this_vp.stats)              \
+        (_thr)->ready_at = _st_md_cycles()
+
+#define _ST_ADD_RUNQ(_thr)     \
+    ST_BEGIN_MACRO             \
+    _ST_STAT_READY(_thr);      \
+    ST_APPEND_LINK(&(_thr)->links, &_ST_RUNQ((_thr)->prio)); \
+    _ST_RUNQ_SIZE++;           \
+    ST_END_MACRO
+#define _ST_INSERT_RUNQ(_thr)  \
+    ST_BEGIN_MACRO             \
+    _ST_STAT_READY(_thr);      \
+    ST_INSERT_LINK(&(_thr)->links, &_ST_RUNQ((_thr)->prio)); \
+    _ST_RUNQ_SIZE++;           \
+    ST_END_MACRO
+#define _ST_DEL_RUNQ(_thr)     \
+    ST_BEGIN_MACRO             \
+    ST_REMOVE_LINK(&(_thr)->links); \
+    _ST_RUNQ_SIZE--;           \
+    ST_END_MACRO
 
 #define _ST_ADD_SLEEPQ(_thr, _timeout)  _st_add_sleep_q(_thr, _timeout)
 #define _ST_DEL_SLEEPQ(_thr)        _st_del_sleep_q(_thr)
@@ -331,6 +441,8 @@ extern __thread _st_eventsys_t *_st_eventsys;
 #define _ST_FL_ON_SLEEPQ    0x04
 #define _ST_FL_INTERRUPT    0x08
 #define _ST_FL_TIMEDOUT     0x10
+#define _ST_FL_SLACK        0x20
+#define _ST_FL_GRANTED      0x40
 
 
 /*****************************************
@@ -409,8 +521,18 @@ extern __thread _st_eventsys_t *_st_eventsys;
 
 /*
  * Switch away from the current thread context by saving its state and
- * calling the thread scheduler
+ * calling the thread scheduler, or by switching to the next thread directly
+ * if the platform supports MD_SWITCH
  */
+#ifdef MD_HAVE_SWITCH
+#define _ST_SWITCH_CONTEXT(_thread)       \
+    ST_BEGIN_MACRO                        \
+    ST_SWITCH_OUT_CB(_thread);            \
+    _st_vp_switch(_thread);               \
+    ST_DEBUG_ITERATE_THREADS();           \
+    ST_SWITCH_IN_CB(_thread);             \
+    ST_END_MACRO
+#else
 #define _ST_SWITCH_CONTEXT(_thread)       \
     ST_BEGIN_MACRO                        \
     ST_SWITCH_OUT_CB(_thread);            \
@@ -420,6 +542,7 @@ extern __thread _st_eventsys_t *_st_eventsys;
     ST_DEBUG_ITERATE_THREADS();           \
     ST_SWITCH_IN_CB(_thread);             \
     ST_END_MACRO
+#endif
 
 /*
  * Restore a thread context that was saved by _ST_SWITCH_CONTEXT or
@@ -451,14 +574,18 @@ extern __thread _st_eventsys_t *_st_eventsys;
  */
 
 void _st_vp_schedule(void);
+void _st_vp_switch(_st_thread_t *me);
 void _st_vp_check_clock(void);
 void *_st_idle_thread_start(void *arg);
 void _st_thread_main(void);
 void _st_thread_cleanup(_st_thread_t *thread);
 void _st_add_sleep_q(_st_thread_t *thread, st_utime_t timeout);
 void _st_del_sleep_q(_st_thread_t *thread);
+st_utime_t _st_vp_min_timeout(void);
+void _st_stack_init(void);
 _st_stack_t *_st_stack_new(int stack_size);
 void _st_stack_free(_st_stack_t *ts);
+void _st_stack_switch_in(_st_thread_t *thread);
 int _st_io_init(void);
 
 st_utime_t st_utime(void);
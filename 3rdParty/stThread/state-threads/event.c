@@ -48,6 +48,15 @@
 #ifdef MD_HAVE_EPOLL
 #include <sys/epoll.h>
 #endif
+#ifdef MD_HAVE_IOURING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+/* The headers before linux 5.11 miss the wait with timeout, which we require */
+#ifndef IORING_FEAT_EXT_ARG
+#undef MD_HAVE_IOURING
+#endif
+#endif
 
 // Global stat.
 #if defined(DEBUG) && defined(DEBUG_STATS)
@@ -57,13 +66,13 @@ __thread unsigned long long _st_stat_epoll_shake = 0;
 __thread unsigned long long _st_stat_epoll_spin = 0;
 #endif
 
-#if !defined(MD_HAVE_KQUEUE) && !defined(MD_HAVE_EPOLL) && !defined(MD_HAVE_SELECT)
+#if !defined(MD_HAVE_KQUEUE) && !defined(MD_HAVE_EPOLL) && !defined(MD_HAVE_SELECT) && !defined(MD_HAVE_IOURING)
     #error Only support epoll(for Linux), kqueue(for Darwin) or select(for Cygwin)
 #endif
 
 
 #ifdef MD_HAVE_SELECT
-static struct _st_seldata {
+static __thread struct _st_seldata {
     fd_set fd_read_set, fd_write_set, fd_exception_set;
     int fd_ref_cnts[FD_SETSIZE][3];
     int maxfd;
@@ -117,6 +126,8 @@ typedef struct _epoll_fd_data {
     int wr_ref_cnt;
     int ex_ref_cnt;
     int revents;
+    _st_pollfd_link_t *waiters; /* The pollqs waiting on this descriptor, in FIFO order */
+    _st_netfd_t *netfd;         /* The netfd registered persistently(edge-triggered) */
 } _epoll_fd_data_t;
 
 static __thread struct _st_epolldata {
@@ -138,6 +149,8 @@ static __thread struct _st_epolldata {
 #define _ST_EPOLL_WRITE_CNT(fd)  (_st_epoll_data->fd_data[fd].wr_ref_cnt)
 #define _ST_EPOLL_EXCEP_CNT(fd)  (_st_epoll_data->fd_data[fd].ex_ref_cnt)
 #define _ST_EPOLL_REVENTS(fd)    (_st_epoll_data->fd_data[fd].revents)
+#define _ST_EPOLL_WAITERS(fd)    (_st_epoll_data->fd_data[fd].waiters)
+#define _ST_EPOLL_NETFD(fd)      (_st_epoll_data->fd_data[fd].netfd)
 
 #define _ST_EPOLL_READ_BIT(fd)   (_ST_EPOLL_READ_CNT(fd) ? EPOLLIN : 0)
 #define _ST_EPOLL_WRITE_BIT(fd)  (_ST_EPOLL_WRITE_CNT(fd) ? EPOLLOUT : 0)
@@ -147,9 +160,123 @@ static __thread struct _st_epolldata {
 
 #endif  /* MD_HAVE_EPOLL */
 
+
+#ifdef MD_HAVE_IOURING
+typedef struct _uring_fd_data {
+    int rd_ref_cnt;
+    int wr_ref_cnt;
+    int ex_ref_cnt;
+    int ready;          /* Readiness fired in this dispatch */
+    int armed;          /* Events of the poll armed in kernel, zero if none */
+    int dirty;          /* On the dirty list, to be checked by this dispatch */
+    int ios;            /* The native operations in flight, which refer to the file */
+    unsigned int gen;   /* Generation of the armed poll, to drop stale completions */
+    _st_pollfd_link_t *waiters; /* The pollqs waiting on this descriptor, in FIFO order */
+} _uring_fd_data_t;
+
+/* The native operation, which the thread waits for, see _st_uring_netfd_io */
+typedef struct _uring_op {
+    _st_thread_t *thread;
+    int done;
+    int res;
+} _uring_op_t;
+
+static __thread struct _st_uringdata {
+    _uring_fd_data_t *fd_data;
+    int fd_data_size;
+    /* The descriptors fired in this dispatch */
+    int *dirty_fds;
+    int dirty_cnt;
+    int dirty_size;
+    /* Whether to do I/O natively, disabled if the kernel completes it with EAGAIN */
+    int native;
+    int ring_fd;
+    /* The submission queue ring */
+    void *sq_ring;
+    size_t sq_ring_size;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned sq_entries;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    /* The completion queue ring, maybe shares the mapping with submission queue */
+    void *cq_ring;
+    size_t cq_ring_size;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+} *_st_uring_data;
+
+#ifndef ST_URING_ENTRIES
+    /* The size of submission queue, the completion queue is twice */
+    #define ST_URING_ENTRIES 1024
+#endif
+
+/* The user data for completions we don't care, for example, poll remove */
+#define _ST_URING_UDATA_IGNORE   ((__u64)-1)
+/* The user data of poll is the descriptor and generation, while the native operation is tagged by the top bit */
+#define _ST_URING_UDATA(fd)      (((__u64)(_ST_URING_GEN(fd) & 0x7fffffff) << 32) | (__u32)(fd))
+#define _ST_URING_UDATA_OP(op)   ((__u64)(unsigned long)(op) | ((__u64)1 << 63))
+
+#define _ST_URING_READ_CNT(fd)   (_st_uring_data->fd_data[fd].rd_ref_cnt)
+#define _ST_URING_WRITE_CNT(fd)  (_st_uring_data->fd_data[fd].wr_ref_cnt)
+#define _ST_URING_EXCEP_CNT(fd)  (_st_uring_data->fd_data[fd].ex_ref_cnt)
+#define _ST_URING_READY(fd)      (_st_uring_data->fd_data[fd].ready)
+#define _ST_URING_ARMED(fd)      (_st_uring_data->fd_data[fd].armed)
+#define _ST_URING_DIRTY(fd)      (_st_uring_data->fd_data[fd].dirty)
+#define _ST_URING_IOS(fd)        (_st_uring_data->fd_data[fd].ios)
+#define _ST_URING_GEN(fd)        (_st_uring_data->fd_data[fd].gen)
+#define _ST_URING_WAITERS(fd)    (_st_uring_data->fd_data[fd].waiters)
+
+#define _ST_URING_READ_BIT(fd)   (_ST_URING_READ_CNT(fd) ? POLLIN : 0)
+#define _ST_URING_WRITE_BIT(fd)  (_ST_URING_WRITE_CNT(fd) ? POLLOUT : 0)
+#define _ST_URING_EXCEP_BIT(fd)  (_ST_URING_EXCEP_CNT(fd) ? POLLPRI : 0)
+#define _ST_URING_EVENTS(fd) \
+    (_ST_URING_READ_BIT(fd)|_ST_URING_WRITE_BIT(fd)|_ST_URING_EXCEP_BIT(fd))
+
+#endif  /* MD_HAVE_IOURING */
+
 __thread _st_eventsys_t *_st_eventsys = NULL;
 
 
+#if defined(MD_HAVE_EPOLL) || defined(MD_HAVE_IOURING)
+/*
+ * The waiters of a descriptor is a circular list of links, the fd data only
+ * keeps the pointer to the first link, so it's safe to realloc the fd data.
+ */
+static void _st_fd_waiter_add(_st_pollfd_link_t **waiters, _st_pollfd_link_t *link)
+{
+    _st_pollfd_link_t *head = *waiters;
+
+    if (!head) {
+        link->next = link->prev = link;
+        *waiters = link;
+    } else {
+        link->next = head;
+        link->prev = head->prev;
+        head->prev->next = link;
+        head->prev = link;
+    }
+}
+
+static void _st_fd_waiter_del(_st_pollfd_link_t **waiters, _st_pollfd_link_t *link)
+{
+    if (link->next == link) {
+        *waiters = NULL;
+    } else {
+        link->prev->next = link->next;
+        link->next->prev = link->prev;
+        if (*waiters == link)
+            *waiters = link->next;
+    }
+    link->next = link->prev = NULL;
+}
+#endif
+
+
 #ifdef MD_HAVE_SELECT
 /*****************************************
  * select event system
@@ -167,10 +294,11 @@ ST_HIDDEN int _st_select_init(void)
     return 0;
 }
 
-ST_HIDDEN int _st_select_pollset_add(struct pollfd *pds, int npds)
+ST_HIDDEN int _st_select_pollset_add(_st_pollq_t *pq)
 {
     struct pollfd *pd;
-    struct pollfd *epd = pds + npds;
+    struct pollfd *pds = pq->pds;
+    struct pollfd *epd = pds + pq->npds;
 
     /* Do checks up front */
     for (pd = pds; pd < epd; pd++) {
@@ -201,10 +329,11 @@ ST_HIDDEN int _st_select_pollset_add(struct pollfd *pds, int npds)
     return 0;
 }
 
-ST_HIDDEN void _st_select_pollset_del(struct pollfd *pds, int npds)
+ST_HIDDEN void _st_select_pollset_del(_st_pollq_t *pq)
 {
     struct pollfd *pd;
-    struct pollfd *epd = pds + npds;
+    struct pollfd *pds = pq->pds;
+    struct pollfd *epd = pds + pq->npds;
 
     for (pd = pds; pd < epd; pd++) {
         if (pd->events & POLLIN) {
@@ -315,11 +444,9 @@ ST_HIDDEN void _st_select_dispatch(void)
     wp = &w;
     ep = &e;
 
-    if (_ST_SLEEPQ == NULL) {
+    if ((min_timeout = _st_vp_min_timeout()) == ST_UTIME_NO_TIMEOUT) {
         tvp = NULL;
     } else {
-        min_timeout = (_ST_SLEEPQ->due <= _ST_LAST_CLOCK) ? 0 :
-                      (_ST_SLEEPQ->due - _ST_LAST_CLOCK);
         timeout.tv_sec  = (int) (min_timeout / 1000000);
         timeout.tv_usec = (int) (min_timeout % 1000000);
         tvp = &timeout;
@@ -327,6 +454,7 @@ ST_HIDDEN void _st_select_dispatch(void)
 
     /* Check for I/O operations */
     nfd = select(_ST_SELECT_MAX_OSFD + 1, rp, wp, ep, tvp);
+    _st_this_vp.nn_events = (nfd > 0) ? nfd : 0;
 
     /* Notify threads that are associated with the selected descriptors */
     if (nfd > 0) {
@@ -432,7 +560,8 @@ ST_HIDDEN int _st_select_fd_getlimit(void)
 
 ST_HIDDEN void _st_select_destroy(void)
 {
-    /* TODO: FIXME: Implements it */
+    free(_st_select_data);
+    _st_select_data = NULL;
 }
 
 static _st_eventsys_t _st_select_eventsys = {
@@ -590,11 +719,13 @@ ST_HIDDEN void _st_kq_dellist_add(const struct kevent *kev)
     _st_kq_data->dellist_cnt++;
 }
 
-ST_HIDDEN int _st_kq_pollset_add(struct pollfd *pds, int npds)
+ST_HIDDEN int _st_kq_pollset_add(_st_pollq_t *pq)
 {
     struct kevent kev;
     struct pollfd *pd;
-    struct pollfd *epd = pds + npds;
+    struct pollfd *pds = pq->pds;
+    struct pollfd *epd = pds + pq->npds;
+    int npds = pq->npds;
 
     /*
      * Pollset adding is "atomic". That is, either it succeeded for
@@ -645,11 +776,12 @@ ST_HIDDEN int _st_kq_pollset_add(struct pollfd *pds, int npds)
     return 0;
 }
 
-ST_HIDDEN void _st_kq_pollset_del(struct pollfd *pds, int npds)
+ST_HIDDEN void _st_kq_pollset_del(_st_pollq_t *pq)
 {
     struct kevent kev;
     struct pollfd *pd;
-    struct pollfd *epd = pds + npds;
+    struct pollfd *pds = pq->pds;
+    struct pollfd *epd = pds + pq->npds;
 
     /*
      * It's OK if deleting fails because a descriptor will either be
@@ -697,10 +829,9 @@ ST_HIDDEN void _st_kq_dispatch(void)
     int nfd, i, osfd, notify, filter;
     short events, revents;
 
-    if (_ST_SLEEPQ == NULL) {
+    if ((min_timeout = _st_vp_min_timeout()) == ST_UTIME_NO_TIMEOUT) {
         tsp = NULL;
     } else {
-        min_timeout = (_ST_SLEEPQ->due <= _ST_LAST_CLOCK) ? 0 : (_ST_SLEEPQ->due - _ST_LAST_CLOCK);
         timeout.tv_sec  = (time_t) (min_timeout / 1000000);
         timeout.tv_nsec = (long) ((min_timeout % 1000000) * 1000);
         tsp = &timeout;
@@ -713,6 +844,7 @@ ST_HIDDEN void _st_kq_dispatch(void)
                  _st_kq_data->evtlist, _st_kq_data->evtlist_size, tsp);
 
     _st_kq_data->addlist_cnt = 0;
+    _st_this_vp.nn_events = (nfd > 0) ? nfd : 0;
 
     if (nfd > 0) {
         for (i = 0; i < nfd; i++) {
@@ -813,7 +945,7 @@ ST_HIDDEN void _st_kq_dispatch(void)
             memset(_st_kq_data->fd_data, 0, _st_kq_data->fd_data_size * sizeof(_kq_fd_data_t));
             for (q = _ST_IOQ.next; q != &_ST_IOQ; q = q->next) {
                 pq = _ST_POLLQUEUE_PTR(q);
-                _st_kq_pollset_add(pq->pds, pq->npds);
+                _st_kq_pollset_add(pq);
             }
             goto retry_kevent;
         }
@@ -954,11 +1086,18 @@ ST_HIDDEN void _st_epoll_evtlist_expand(void)
     }
 }
 
-ST_HIDDEN void _st_epoll_pollset_del(struct pollfd *pds, int npds)
+/* Change the interest of descriptor, counted for the stat of event loop. */
+static int _st_epoll_ctl(int op, int fd, struct epoll_event *ev)
+{
+    _st_this_vp.nn_ctls++;
+    return epoll_ctl(_st_epoll_data->epfd, op, fd, ev);
+}
+
+static void _st_epoll_pollfds_del(_st_pollq_t *pq, int npds)
 {
     struct epoll_event ev;
     struct pollfd *pd;
-    struct pollfd *epd = pds + npds;
+    struct pollfd *epd = pq->pds + npds;
     int old_events, events, op;
 
     /*
@@ -966,7 +1105,7 @@ ST_HIDDEN void _st_epoll_pollset_del(struct pollfd *pds, int npds)
      * will either be closed or deleted in dispatch function after
      * it fires.
      */
-    for (pd = pds; pd < epd; pd++) {
+    for (pd = pq->pds; pd < epd; pd++) {
         old_events = _ST_EPOLL_EVENTS(pd->fd);
 
         if (pd->events & POLLIN)
@@ -975,6 +1114,7 @@ ST_HIDDEN void _st_epoll_pollset_del(struct pollfd *pds, int npds)
             _ST_EPOLL_WRITE_CNT(pd->fd)--;
         if (pd->events & POLLPRI)
             _ST_EPOLL_EXCEP_CNT(pd->fd)--;
+        _st_fd_waiter_del(&_ST_EPOLL_WAITERS(pd->fd), &pq->fdlinks[pd - pq->pds]);
 
         events = _ST_EPOLL_EVENTS(pd->fd);
         /*
@@ -982,20 +1122,27 @@ ST_HIDDEN void _st_epoll_pollset_del(struct pollfd *pds, int npds)
          * this function inside dispatch(). Outside of dispatch()
          * _ST_EPOLL_REVENTS is always zero for all descriptors.
          */
-        if (events != old_events && _ST_EPOLL_REVENTS(pd->fd) == 0) {
+        if (events != old_events && _ST_EPOLL_REVENTS(pd->fd) == 0 && !_ST_EPOLL_NETFD(pd->fd)) {
             op = events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
             ev.events = events;
             ev.data.fd = pd->fd;
-            if (epoll_ctl(_st_epoll_data->epfd, op, pd->fd, &ev) == 0 && op == EPOLL_CTL_DEL) {
+            if (_st_epoll_ctl(op, pd->fd, &ev) == 0 && op == EPOLL_CTL_DEL) {
                 _st_epoll_data->evtlist_cnt--;
             }
         }
     }
 }
 
-ST_HIDDEN int _st_epoll_pollset_add(struct pollfd *pds, int npds)
+ST_HIDDEN void _st_epoll_pollset_del(_st_pollq_t *pq)
+{
+    _st_epoll_pollfds_del(pq, pq->npds);
+}
+
+ST_HIDDEN int _st_epoll_pollset_add(_st_pollq_t *pq)
 {
     struct epoll_event ev;
+    struct pollfd *pds = pq->pds;
+    int npds = pq->npds;
     int i, fd;
     int old_events, events, op;
 
@@ -1021,13 +1168,16 @@ ST_HIDDEN int _st_epoll_pollset_add(struct pollfd *pds, int npds)
             _ST_EPOLL_WRITE_CNT(fd)++;
         if (pds[i].events & POLLPRI)
             _ST_EPOLL_EXCEP_CNT(fd)++;
+        pq->fdlinks[i].pq = pq;
+        _st_fd_waiter_add(&_ST_EPOLL_WAITERS(fd), &pq->fdlinks[i]);
 
+        /* The persistent descriptor is always registered for all events */
         events = _ST_EPOLL_EVENTS(fd);
-        if (events != old_events) {
+        if (events != old_events && !_ST_EPOLL_NETFD(fd)) {
             op = old_events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
             ev.events = events;
             ev.data.fd = fd;
-            if (epoll_ctl(_st_epoll_data->epfd, op, fd, &ev) < 0 && (op != EPOLL_CTL_ADD || errno != EEXIST))
+            if (_st_epoll_ctl(op, fd, &ev) < 0 && (op != EPOLL_CTL_ADD || errno != EEXIST))
                 break;
             if (op == EPOLL_CTL_ADD) {
                 _st_epoll_data->evtlist_cnt++;
@@ -1041,7 +1191,7 @@ ST_HIDDEN int _st_epoll_pollset_add(struct pollfd *pds, int npds)
         /* Error */
         int err = errno;
         /* Unroll the state */
-        _st_epoll_pollset_del(pds, i + 1);
+        _st_epoll_pollfds_del(pq, i + 1);
         errno = err;
         return -1;
     }
@@ -1049,25 +1199,74 @@ ST_HIDDEN int _st_epoll_pollset_add(struct pollfd *pds, int npds)
     return 0;
 }
 
+static void _st_epoll_netfd_revents(_st_netfd_t *fd, int events)
+{
+    if (events & EPOLLIN)
+        fd->revents |= POLLIN;
+    if (events & EPOLLOUT)
+        fd->revents |= POLLOUT;
+    if (events & EPOLLPRI)
+        fd->revents |= POLLPRI;
+    if (events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP))
+        fd->revents |= POLLIN | POLLOUT | POLLPRI;
+}
+
+/*
+ * Set the revents of all descriptors of pq, return whether any descriptor is
+ * ready, so we should notify the thread.
+ */
+static int _st_epoll_pollq_revents(_st_pollq_t *pq)
+{
+    struct pollfd *pds, *epds;
+    int osfd, events, notify = 0;
+    short revents;
+
+    epds = pq->pds + pq->npds;
+    for (pds = pq->pds; pds < epds; pds++) {
+        if (_ST_EPOLL_REVENTS(pds->fd) == 0) {
+            pds->revents = 0;
+            continue;
+        }
+        osfd = pds->fd;
+        events = pds->events;
+        revents = 0;
+        if ((events & POLLIN) && (_ST_EPOLL_REVENTS(osfd) & EPOLLIN))
+            revents |= POLLIN;
+        if ((events & POLLOUT) && (_ST_EPOLL_REVENTS(osfd) & EPOLLOUT))
+            revents |= POLLOUT;
+        if ((events & POLLPRI) && (_ST_EPOLL_REVENTS(osfd) & EPOLLPRI))
+            revents |= POLLPRI;
+        if (_ST_EPOLL_REVENTS(osfd) & EPOLLERR)
+            revents |= POLLERR;
+        if (_ST_EPOLL_REVENTS(osfd) & EPOLLHUP)
+            revents |= POLLHUP;
+
+        pds->revents = revents;
+        if (revents) {
+            notify = 1;
+        }
+    }
+
+    return notify;
+}
+
 ST_HIDDEN void _st_epoll_dispatch(void)
 {
     st_utime_t min_timeout;
-    _st_clist_t *q;
+    _st_clist_t ready;
+    _st_pollfd_link_t *link;
     _st_pollq_t *pq;
-    struct pollfd *pds, *epds;
     struct epoll_event ev;
-    int timeout, nfd, i, osfd, notify;
+    int timeout, nfd, i, osfd;
     int events, op;
-    short revents;
 
     #if defined(DEBUG) && defined(DEBUG_STATS)
     ++_st_stat_epoll;
     #endif
 
-    if (_ST_SLEEPQ == NULL) {
+    if ((min_timeout = _st_vp_min_timeout()) == ST_UTIME_NO_TIMEOUT) {
         timeout = -1;
     } else {
-        min_timeout = (_ST_SLEEPQ->due <= _ST_LAST_CLOCK) ? 0 : (_ST_SLEEPQ->due - _ST_LAST_CLOCK);
         timeout = (int) (min_timeout / 1000);
 
         // At least wait 1ms when <1ms, to avoid epoll_wait spin loop.
@@ -1088,6 +1287,7 @@ ST_HIDDEN void _st_epoll_dispatch(void)
 
     /* Check for I/O operations */
     nfd = epoll_wait(_st_epoll_data->epfd, _st_epoll_data->evtlist, _st_epoll_data->evtlist_size, timeout);
+    _st_this_vp.nn_events = (nfd > 0) ? nfd : 0;
 
     #if defined(DEBUG) && defined(DEBUG_STATS)
     if (nfd <= 0) {
@@ -1103,62 +1303,62 @@ ST_HIDDEN void _st_epoll_dispatch(void)
                 /* Also set I/O bits on error */
                 _ST_EPOLL_REVENTS(osfd) |= _ST_EPOLL_EVENTS(osfd);
             }
+            if (_ST_EPOLL_NETFD(osfd)) {
+                /* Record the readiness, because the edge never fires again */
+                _st_epoll_netfd_revents(_ST_EPOLL_NETFD(osfd), _st_epoll_data->evtlist[i].events);
+            }
         }
 
-        for (q = _ST_IOQ.next; q != &_ST_IOQ; q = q->next) {
-            pq = _ST_POLLQUEUE_PTR(q);
-            notify = 0;
-            epds = pq->pds + pq->npds;
+        /*
+         * Only visit the pollqs waiting on the fired descriptors, rather than
+         * the whole ioq, so the cost is O(ready) not O(waiters). The ready
+         * pollqs are moved to a temporary list, because we can't delete them
+         * from the waiters while walking it.
+         */
+        ST_INIT_CLIST(&ready);
+        for (i = 0; i < nfd; i++) {
+            osfd = _st_epoll_data->evtlist[i].data.fd;
+            if ((link = _ST_EPOLL_WAITERS(osfd)) == NULL)
+                continue;
 
-            for (pds = pq->pds; pds < epds; pds++) {
-                if (_ST_EPOLL_REVENTS(pds->fd) == 0) {
-                    pds->revents = 0;
-                    continue;
+            do {
+                pq = link->pq;
+                /* Ignore the pollq which is already notified by another descriptor */
+                if (pq->on_ioq && _st_epoll_pollq_revents(pq)) {
+                    ST_REMOVE_LINK(&pq->links);
+                    pq->on_ioq = 0;
+                    ST_APPEND_LINK(&pq->links, &ready);
                 }
-                osfd = pds->fd;
-                events = pds->events;
-                revents = 0;
-                if ((events & POLLIN) && (_ST_EPOLL_REVENTS(osfd) & EPOLLIN))
-                    revents |= POLLIN;
-                if ((events & POLLOUT) && (_ST_EPOLL_REVENTS(osfd) & EPOLLOUT))
-                    revents |= POLLOUT;
-                if ((events & POLLPRI) && (_ST_EPOLL_REVENTS(osfd) & EPOLLPRI))
-                    revents |= POLLPRI;
-                if (_ST_EPOLL_REVENTS(osfd) & EPOLLERR)
-                    revents |= POLLERR;
-                if (_ST_EPOLL_REVENTS(osfd) & EPOLLHUP)
-                    revents |= POLLHUP;
+                link = link->next;
+            } while (link != _ST_EPOLL_WAITERS(osfd));
+        }
 
-                pds->revents = revents;
-                if (revents) {
-                    notify = 1;
-                }
-            }
-            if (notify) {
-                ST_REMOVE_LINK(&pq->links);
-                pq->on_ioq = 0;
-                /*
-                 * Here we will only delete/modify descriptors that
-                 * didn't fire (see comments in _st_epoll_pollset_del()).
-                 */
-                _st_epoll_pollset_del(pq->pds, pq->npds);
+        while (ready.next != &ready) {
+            pq = _ST_POLLQUEUE_PTR(ready.next);
+            ST_REMOVE_LINK(&pq->links);
+            /*
+             * Here we will only delete/modify descriptors that
+             * didn't fire (see comments in _st_epoll_pollfds_del()).
+             */
+            _st_epoll_pollset_del(pq);
 
-                if (pq->thread->flags & _ST_FL_ON_SLEEPQ)
-                    _ST_DEL_SLEEPQ(pq->thread);
-                pq->thread->state = _ST_ST_RUNNABLE;
-                _ST_ADD_RUNQ(pq->thread);
-            }
+            if (pq->thread->flags & _ST_FL_ON_SLEEPQ)
+                _ST_DEL_SLEEPQ(pq->thread);
+            pq->thread->state = _ST_ST_RUNNABLE;
+            _ST_ADD_RUNQ(pq->thread);
         }
 
         for (i = 0; i < nfd; i++) {
-            /* Delete/modify descriptors that fired */
+            /* Delete/modify descriptors that fired, except the persistent ones */
             osfd = _st_epoll_data->evtlist[i].data.fd;
             _ST_EPOLL_REVENTS(osfd) = 0;
+            if (_ST_EPOLL_NETFD(osfd))
+                continue;
             events = _ST_EPOLL_EVENTS(osfd);
             op = events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
             ev.events = events;
             ev.data.fd = osfd;
-            if (epoll_ctl(_st_epoll_data->epfd, op, osfd, &ev) == 0 && op == EPOLL_CTL_DEL) {
+            if (_st_epoll_ctl(op, osfd, &ev) == 0 && op == EPOLL_CTL_DEL) {
                 _st_epoll_data->evtlist_cnt--;
             }
         }
@@ -1183,6 +1383,58 @@ ST_HIDDEN int _st_epoll_fd_close(int osfd)
     return 0;
 }
 
+/*
+ * Register the netfd for all events with EPOLLET, so it's never modified or
+ * deleted until closed, and there is no epoll_ctl for each I/O.
+ */
+ST_HIDDEN int _st_epoll_netfd_add(_st_netfd_t *fd)
+{
+    struct epoll_event ev;
+    int osfd = fd->osfd;
+
+    if (osfd >= _st_epoll_data->fd_data_size && _st_epoll_fd_data_expand(osfd) < 0)
+        return -1;
+
+    /* Somebody is polling the descriptor, it's already registered level-triggered */
+    if (_ST_EPOLL_EVENTS(osfd) || _ST_EPOLL_NETFD(osfd)) {
+        errno = EBUSY;
+        return -1;
+    }
+
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLPRI | EPOLLRDHUP | EPOLLET;
+    ev.data.fd = osfd;
+    if (_st_epoll_ctl(EPOLL_CTL_ADD, osfd, &ev) < 0)
+        return -1;
+
+    _ST_EPOLL_NETFD(osfd) = fd;
+    _st_epoll_data->evtlist_cnt++;
+    if (_st_epoll_data->evtlist_cnt > _st_epoll_data->evtlist_size)
+        _st_epoll_evtlist_expand();
+
+    return 0;
+}
+
+ST_HIDDEN void _st_epoll_netfd_del(_st_netfd_t *fd)
+{
+    struct epoll_event ev;
+    int osfd = fd->osfd;
+
+    if (_ST_EPOLL_NETFD(osfd) != fd)
+        return;
+
+    _ST_EPOLL_NETFD(osfd) = NULL;
+    if (_st_epoll_ctl(EPOLL_CTL_DEL, osfd, &ev) == 0)
+        _st_epoll_data->evtlist_cnt--;
+
+    /* The waiters, if any, need the descriptor registered level-triggered */
+    if (_ST_EPOLL_EVENTS(osfd)) {
+        ev.events = _ST_EPOLL_EVENTS(osfd);
+        ev.data.fd = osfd;
+        if (_st_epoll_ctl(EPOLL_CTL_ADD, osfd, &ev) == 0)
+            _st_epoll_data->evtlist_cnt++;
+    }
+}
+
 ST_HIDDEN int _st_epoll_fd_getlimit(void)
 {
     /* zero means no specific limit */
@@ -1225,11 +1477,660 @@ static _st_eventsys_t _st_epoll_eventsys = {
     _st_epoll_fd_new,
     _st_epoll_fd_close,
     _st_epoll_fd_getlimit,
-    _st_epoll_destroy
+    _st_epoll_destroy,
+    _st_epoll_netfd_add,
+    _st_epoll_netfd_del
 };
 #endif  /* MD_HAVE_EPOLL */
 
 
+#ifdef MD_HAVE_IOURING
+/*****************************************
+ * io_uring event system
+ *
+ * The sockets are read and written by the native operations, like the
+ * IORING_OP_RECV, after the non-blocking syscall fails with EAGAIN, so the
+ * kernel completes the operation when data arrives, and the thread is woken
+ * up with the result, without waiting for the readiness and doing the syscall
+ * again, see _st_uring_netfd_io.
+ *
+ * Other waiters, like st_poll or st_connect, use a one-shot IORING_OP_POLL_ADD
+ * for each descriptor, which reports the current readiness when armed, so it's
+ * level-triggered like epoll and select. The poll stays armed while the
+ * descriptor has waiters, and is canceled when the last one leaves.
+ *
+ * The requests are queued in the submission ring without any syscall, then
+ * submitted together with waiting for completions by one io_uring_enter() in
+ * dispatch, while epoll needs one epoll_ctl() for each change besides the
+ * epoll_wait().
+ *
+ * Like epoll, each descriptor keeps its waiters, so dispatch only visits the
+ * waiters of the fired descriptors, that is O(ready) not O(waiters).
+ */
+static int _st_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int _st_uring_enter(unsigned to_submit, unsigned min_complete, unsigned flags, void *arg, size_t argsz)
+{
+    return (int)syscall(__NR_io_uring_enter, _st_uring_data->ring_fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+/* Submit all queued SQEs to kernel, without waiting for completions. */
+static int _st_uring_submit(void)
+{
+    unsigned to_submit = *_st_uring_data->sq_tail - __atomic_load_n(_st_uring_data->sq_head, __ATOMIC_ACQUIRE);
+
+    if (to_submit == 0)
+        return 0;
+
+    return _st_uring_enter(to_submit, 0, 0, NULL, 0);
+}
+
+static struct io_uring_sqe *_st_uring_get_sqe(void)
+{
+    struct io_uring_sqe *sqe;
+    unsigned tail = *_st_uring_data->sq_tail;
+    unsigned index;
+
+    /* The submission ring is full, flush it to kernel */
+    if (tail - __atomic_load_n(_st_uring_data->sq_head, __ATOMIC_ACQUIRE) >= _st_uring_data->sq_entries) {
+        if (_st_uring_submit() < 0)
+            return NULL;
+    }
+
+    index = tail & *_st_uring_data->sq_mask;
+    sqe = &_st_uring_data->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    _st_uring_data->sq_array[index] = index;
+    __atomic_store_n(_st_uring_data->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    return sqe;
+}
+
+/* Arm a poll for the events of fd, cancel the previous one if any. */
+static int _st_uring_poll_arm(int fd, int events)
+{
+    struct io_uring_sqe *sqe;
+
+    if (_ST_URING_ARMED(fd)) {
+        if ((sqe = _st_uring_get_sqe()) == NULL)
+            return -1;
+        sqe->opcode = IORING_OP_POLL_REMOVE;
+        sqe->fd = -1;
+        sqe->addr = _ST_URING_UDATA(fd);
+        sqe->user_data = _ST_URING_UDATA_IGNORE;
+        _ST_URING_ARMED(fd) = 0;
+        _st_this_vp.nn_ctls++;
+    }
+
+    if (!events)
+        return 0;
+
+    if ((sqe = _st_uring_get_sqe()) == NULL)
+        return -1;
+    _ST_URING_GEN(fd)++;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;
+    sqe->user_data = _ST_URING_UDATA(fd);
+    _ST_URING_ARMED(fd) = events;
+    _st_this_vp.nn_ctls++;
+
+    return 0;
+}
+
+/* Check the fired descriptor in this dispatch. */
+static int _st_uring_dirty(int fd)
+{
+    int *ptr;
+    int n = _st_uring_data->dirty_size;
+
+    if (_ST_URING_DIRTY(fd))
+        return 0;
+
+    if (_st_uring_data->dirty_cnt >= n) {
+        n = n ? n << 1 : ST_URING_ENTRIES;
+        if ((ptr = (int *)realloc(_st_uring_data->dirty_fds, n * sizeof(int))) == NULL)
+            return -1;
+        _st_uring_data->dirty_fds = ptr;
+        _st_uring_data->dirty_size = n;
+    }
+
+    _st_uring_data->dirty_fds[_st_uring_data->dirty_cnt++] = fd;
+    _ST_URING_DIRTY(fd) = 1;
+
+    return 0;
+}
+
+ST_HIDDEN int _st_uring_init(void)
+{
+    struct io_uring_params p;
+    struct _st_uringdata *d;
+    int err = 0;
+    int rv = 0;
+    int fdlim;
+
+    _st_uring_data = d = (struct _st_uringdata *) calloc(1, sizeof(*_st_uring_data));
+    if (!_st_uring_data)
+        return -1;
+
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = ST_URING_ENTRIES * 2;
+    if ((d->ring_fd = _st_uring_setup(ST_URING_ENTRIES, &p)) < 0) {
+        err = errno;
+        rv = -1;
+        goto cleanup_uring;
+    }
+    fcntl(d->ring_fd, F_SETFD, FD_CLOEXEC);
+
+    /* Map the rings, the completion ring shares the mapping if IORING_FEAT_SINGLE_MMAP */
+    d->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    d->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (d->cq_ring_size > d->sq_ring_size)
+            d->sq_ring_size = d->cq_ring_size;
+        d->cq_ring_size = 0;
+    }
+
+    d->sq_ring = mmap(NULL, d->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, d->ring_fd, IORING_OFF_SQ_RING);
+    if (d->sq_ring == MAP_FAILED) {
+        d->sq_ring = NULL;
+        err = errno;
+        rv = -1;
+        goto cleanup_uring;
+    }
+
+    d->cq_ring = d->sq_ring;
+    if (d->cq_ring_size) {
+        d->cq_ring = mmap(NULL, d->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, d->ring_fd, IORING_OFF_CQ_RING);
+        if (d->cq_ring == MAP_FAILED) {
+            d->cq_ring = NULL;
+            err = errno;
+            rv = -1;
+            goto cleanup_uring;
+        }
+    }
+
+    d->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    d->sqes = (struct io_uring_sqe *)mmap(NULL, d->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, d->ring_fd, IORING_OFF_SQES);
+    if (d->sqes == MAP_FAILED) {
+        d->sqes = NULL;
+        err = errno;
+        rv = -1;
+        goto cleanup_uring;
+    }
+
+    d->sq_head = (unsigned *)((char *)d->sq_ring + p.sq_off.head);
+    d->sq_tail = (unsigned *)((char *)d->sq_ring + p.sq_off.tail);
+    d->sq_mask = (unsigned *)((char *)d->sq_ring + p.sq_off.ring_mask);
+    d->sq_array = (unsigned *)((char *)d->sq_ring + p.sq_off.array);
+    d->sq_entries = p.sq_entries;
+    d->cq_head = (unsigned *)((char *)d->cq_ring + p.cq_off.head);
+    d->cq_tail = (unsigned *)((char *)d->cq_ring + p.cq_off.tail);
+    d->cq_mask = (unsigned *)((char *)d->cq_ring + p.cq_off.ring_mask);
+    d->cqes = (struct io_uring_cqe *)((char *)d->cq_ring + p.cq_off.cqes);
+
+    /* Allocate file descriptor data array */
+    fdlim = st_getfdlimit();
+    d->fd_data_size = (fdlim > 0 && fdlim < ST_URING_ENTRIES) ? fdlim : ST_URING_ENTRIES;
+    d->fd_data = (_uring_fd_data_t *)calloc(d->fd_data_size, sizeof(_uring_fd_data_t));
+    if (!d->fd_data) {
+        err = errno;
+        rv = -1;
+    }
+
+    /* Fallback to wait for readiness if the kernel doesn't wait for I/O, see _st_uring_netfd_io */
+    d->native = 1;
+
+ cleanup_uring:
+    if (rv < 0) {
+        if (d->sqes)
+            munmap(d->sqes, d->sqes_size);
+        if (d->cq_ring && d->cq_ring_size)
+            munmap(d->cq_ring, d->cq_ring_size);
+        if (d->sq_ring)
+            munmap(d->sq_ring, d->sq_ring_size);
+        if (d->ring_fd >= 0)
+            close(d->ring_fd);
+        free(d->fd_data);
+        free(d);
+        _st_uring_data = NULL;
+        errno = err;
+    }
+
+    return rv;
+}
+
+ST_HIDDEN int _st_uring_fd_data_expand(int maxfd)
+{
+    _uring_fd_data_t *ptr;
+    int n = _st_uring_data->fd_data_size;
+
+    while (maxfd >= n)
+        n <<= 1;
+
+    ptr = (_uring_fd_data_t *)realloc(_st_uring_data->fd_data, n * sizeof(_uring_fd_data_t));
+    if (!ptr)
+        return -1;
+
+    memset(ptr + _st_uring_data->fd_data_size, 0, (n - _st_uring_data->fd_data_size) * sizeof(_uring_fd_data_t));
+
+    _st_uring_data->fd_data = ptr;
+    _st_uring_data->fd_data_size = n;
+
+    return 0;
+}
+
+static void _st_uring_pollfds_del(_st_pollq_t *pq, int npds)
+{
+    struct pollfd *pd;
+    struct pollfd *epd = pq->pds + npds;
+
+    for (pd = pq->pds; pd < epd; pd++) {
+        if (pd->events & POLLIN)
+            _ST_URING_READ_CNT(pd->fd)--;
+        if (pd->events & POLLOUT)
+            _ST_URING_WRITE_CNT(pd->fd)--;
+        if (pd->events & POLLPRI)
+            _ST_URING_EXCEP_CNT(pd->fd)--;
+        _st_fd_waiter_del(&_ST_URING_WAITERS(pd->fd), &pq->fdlinks[pd - pq->pds]);
+
+        /*
+         * Cancel the poll when the last waiter leaves, because the descriptor
+         * might be closed and reused, while the poll refers to the old file. A
+         * poll with more events than required is harmless, so never narrow it.
+         */
+        if (!_ST_URING_EVENTS(pd->fd) && _ST_URING_ARMED(pd->fd))
+            _st_uring_poll_arm(pd->fd, 0);
+    }
+}
+
+ST_HIDDEN void _st_uring_pollset_del(_st_pollq_t *pq)
+{
+    _st_uring_pollfds_del(pq, pq->npds);
+}
+
+ST_HIDDEN int _st_uring_pollset_add(_st_pollq_t *pq)
+{
+    struct pollfd *pds = pq->pds;
+    int npds = pq->npds;
+    int i, fd, events;
+
+    /* Do as many checks as possible up front */
+    for (i = 0; i < npds; i++) {
+        fd = pds[i].fd;
+        if (fd < 0 || !pds[i].events ||
+            (pds[i].events & ~(POLLIN | POLLOUT | POLLPRI))) {
+            errno = EINVAL;
+            return -1;
+        }
+        if (fd >= _st_uring_data->fd_data_size && _st_uring_fd_data_expand(fd) < 0)
+            return -1;
+    }
+
+    for (i = 0; i < npds; i++) {
+        fd = pds[i].fd;
+
+        if (pds[i].events & POLLIN)
+            _ST_URING_READ_CNT(fd)++;
+        if (pds[i].events & POLLOUT)
+            _ST_URING_WRITE_CNT(fd)++;
+        if (pds[i].events & POLLPRI)
+            _ST_URING_EXCEP_CNT(fd)++;
+        pq->fdlinks[i].pq = pq;
+        _st_fd_waiter_add(&_ST_URING_WAITERS(fd), &pq->fdlinks[i]);
+
+        /* Rearm only when the armed poll doesn't cover the events */
+        events = _ST_URING_EVENTS(fd);
+        if ((events & ~_ST_URING_ARMED(fd)) && _st_uring_poll_arm(fd, events) < 0)
+            break;
+    }
+
+    if (i < npds) {
+        /* Error */
+        int err = errno;
+        /* Unroll the state */
+        _st_uring_pollfds_del(pq, i + 1);
+        errno = err;
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Set the revents of all descriptors of pq by the readiness, return whether
+ * any descriptor is ready, so we should notify the thread.
+ */
+static int _st_uring_pollq_revents(_st_pollq_t *pq)
+{
+    struct pollfd *pds, *epds;
+    int notify = 0;
+
+    epds = pq->pds + pq->npds;
+    for (pds = pq->pds; pds < epds; pds++) {
+        pds->revents = (pds->events | POLLERR | POLLHUP | POLLNVAL) & _ST_URING_READY(pds->fd);
+        if (pds->revents) {
+            notify = 1;
+        }
+    }
+
+    return notify;
+}
+
+ST_HIDDEN void _st_uring_dispatch(void)
+{
+    st_utime_t min_timeout;
+    _st_clist_t ready;
+    _st_pollfd_link_t *link;
+    _st_pollq_t *pq;
+    _uring_op_t *op;
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    struct io_uring_cqe *cqe;
+    unsigned head, tail, to_submit;
+    st_utime_t start = 0, elapsed;
+    int timeout, osfd, i, nn_submit, nn_notified;
+
+ again:
+    if ((min_timeout = _st_vp_min_timeout()) == ST_UTIME_NO_TIMEOUT) {
+        timeout = -1;
+    } else {
+        /* Wait for the rest of timeout, see the end of dispatch */
+        if (start) {
+            if ((elapsed = st_utime() - start) >= min_timeout)
+                return;
+            /* Round up, or we wakeup a little early and loop again */
+            min_timeout += 999 - elapsed;
+        } else {
+            start = st_utime();
+        }
+
+        timeout = (int) (min_timeout / 1000);
+
+        // At least wait 1ms when <1ms, to avoid spin loop, see _st_epoll_dispatch.
+        if (timeout == 0 && min_timeout > 0) {
+            timeout = 1;
+        }
+    }
+
+    /* Submit the queued requests and wait for I/O operations, by one syscall */
+    memset(&arg, 0, sizeof(arg));
+    if (timeout >= 0) {
+        ts.tv_sec = timeout / 1000;
+        ts.tv_nsec = (timeout % 1000) * 1000000LL;
+        arg.ts = (__u64)(unsigned long)&ts;
+    }
+    to_submit = *_st_uring_data->sq_tail - __atomic_load_n(_st_uring_data->sq_head, __ATOMIC_ACQUIRE);
+    nn_submit = _st_uring_enter(to_submit, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+
+    nn_notified = 0;
+    head = *_st_uring_data->cq_head;
+    tail = __atomic_load_n(_st_uring_data->cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+        cqe = &_st_uring_data->cqes[head & *_st_uring_data->cq_mask];
+        if (cqe->user_data == _ST_URING_UDATA_IGNORE)
+            continue;
+
+        /* Wakeup the thread of native operation, unless it's runnable by timeout or interrupt */
+        if (cqe->user_data & _ST_URING_UDATA_OP(0)) {
+            op = (_uring_op_t *)(unsigned long)(cqe->user_data & ~_ST_URING_UDATA_OP(0));
+            op->res = cqe->res;
+            op->done = 1;
+            _st_this_vp.nn_events++;
+            if (op->thread->state == _ST_ST_IO_WAIT) {
+                if (op->thread->flags & _ST_FL_ON_SLEEPQ)
+                    _ST_DEL_SLEEPQ(op->thread);
+                op->thread->state = _ST_ST_RUNNABLE;
+                _ST_ADD_RUNQ(op->thread);
+                nn_notified++;
+            }
+            continue;
+        }
+
+        /* Drop the completion of canceled or stale polls */
+        osfd = (int)(cqe->user_data & 0xffffffff);
+        if (osfd >= _st_uring_data->fd_data_size || !_ST_URING_ARMED(osfd) || cqe->user_data != _ST_URING_UDATA(osfd))
+            continue;
+
+        /* The one-shot poll is done */
+        _st_this_vp.nn_events++;
+        _ST_URING_ARMED(osfd) = 0;
+        _ST_URING_READY(osfd) |= (cqe->res < 0) ? POLLERR : cqe->res;
+        if (_ST_URING_READY(osfd) & (POLLERR | POLLHUP)) {
+            /* Also set I/O bits on error */
+            _ST_URING_READY(osfd) |= POLLIN | POLLOUT | POLLPRI;
+        }
+        _st_uring_dirty(osfd);
+    }
+    __atomic_store_n(_st_uring_data->cq_head, tail, __ATOMIC_RELEASE);
+
+    /*
+     * Only visit the pollqs waiting on the fired descriptors, rather than the
+     * whole ioq, see _st_epoll_dispatch.
+     */
+    ST_INIT_CLIST(&ready);
+    for (i = 0; i < _st_uring_data->dirty_cnt; i++) {
+        osfd = _st_uring_data->dirty_fds[i];
+        if ((link = _ST_URING_WAITERS(osfd)) == NULL)
+            continue;
+
+        do {
+            pq = link->pq;
+            /* Ignore the pollq which is already notified by another descriptor */
+            if (pq->on_ioq && _st_uring_pollq_revents(pq)) {
+                ST_REMOVE_LINK(&pq->links);
+                pq->on_ioq = 0;
+                ST_APPEND_LINK(&pq->links, &ready);
+            }
+            link = link->next;
+        } while (link != _ST_URING_WAITERS(osfd));
+    }
+
+    /* The polls of other descriptors are canceled, if the notified pollq is the last waiter */
+    while (ready.next != &ready) {
+        pq = _ST_POLLQUEUE_PTR(ready.next);
+        ST_REMOVE_LINK(&pq->links);
+        _st_uring_pollset_del(pq);
+
+        if (pq->thread->flags & _ST_FL_ON_SLEEPQ)
+            _ST_DEL_SLEEPQ(pq->thread);
+        pq->thread->state = _ST_ST_RUNNABLE;
+        _ST_ADD_RUNQ(pq->thread);
+        nn_notified++;
+    }
+
+    /* The one-shot poll is done, so rearm it for the rest waiters */
+    for (i = 0; i < _st_uring_data->dirty_cnt; i++) {
+        osfd = _st_uring_data->dirty_fds[i];
+        _ST_URING_DIRTY(osfd) = 0;
+        _ST_URING_READY(osfd) = 0;
+        if (_ST_URING_EVENTS(osfd) & ~_ST_URING_ARMED(osfd))
+            _st_uring_poll_arm(osfd, _ST_URING_EVENTS(osfd));
+    }
+    _st_uring_data->dirty_cnt = 0;
+
+    /*
+     * We are also woken up by the completions of canceled polls, so wait again
+     * for the rest of timeout if no thread is notified, or the sleeping threads
+     * see an early iteration.
+     */
+    if (!nn_notified && nn_submit >= 0 && timeout != 0)
+        goto again;
+}
+
+ST_HIDDEN int _st_uring_fd_new(int osfd)
+{
+    if (osfd >= _st_uring_data->fd_data_size && _st_uring_fd_data_expand(osfd) < 0)
+        return -1;
+
+    return 0;
+}
+
+ST_HIDDEN int _st_uring_fd_close(int osfd)
+{
+    if (_ST_URING_READ_CNT(osfd) || _ST_URING_WRITE_CNT(osfd) || _ST_URING_EXCEP_CNT(osfd) || _ST_URING_IOS(osfd)) {
+        errno = EBUSY;
+        return -1;
+    }
+
+    /* The canceled poll holds a reference of the file until submitted, so submit it before close */
+    _st_uring_submit();
+
+    return 0;
+}
+
+/*
+ * Do the I/O natively after the non-blocking syscall fails with EAGAIN, and
+ * wait for the result, like st_netfd_poll then the syscall again, but by the
+ * kernel. Fails with EAGAIN if the caller should wait for readiness instead.
+ */
+ST_HIDDEN ssize_t _st_uring_netfd_io(_st_netfd_t *fd, int op, void *buf, size_t len, void *arg, st_utime_t timeout)
+{
+    _st_thread_t *me = _ST_CURRENT_THREAD();
+    struct io_uring_sqe *sqe;
+    _uring_op_t uop;
+    int osfd = fd->osfd;
+
+    /*
+     * In copy-stack mode, the buffer might be on the stack, which is overwritten
+     * by other threads while we are waiting, see st_poll.
+     */
+    if (!_st_uring_data->native || (me->stack && me->stack->shared)) {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    if (me->flags & _ST_FL_INTERRUPT) {
+        me->flags &= ~_ST_FL_INTERRUPT;
+        errno = EINTR;
+        return -1;
+    }
+
+    if ((sqe = _st_uring_get_sqe()) == NULL)
+        return -1;
+    sqe->fd = osfd;
+    sqe->addr = (__u64)(unsigned long)buf;
+    if (op == _ST_IO_RECV || op == _ST_IO_SEND) {
+        sqe->opcode = (op == _ST_IO_RECV) ? IORING_OP_RECV : IORING_OP_SEND;
+        sqe->len = (len > 0x7fffffff) ? 0x7fffffff : (__u32)len;
+    } else if (op == _ST_IO_ACCEPT) {
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->addr2 = (__u64)(unsigned long)arg;
+    } else {
+        sqe->opcode = (op == _ST_IO_RECVMSG) ? IORING_OP_RECVMSG : IORING_OP_SENDMSG;
+        sqe->len = 1;
+        sqe->msg_flags = (__u32)len;
+    }
+    uop.thread = me;
+    uop.done = 0;
+    uop.res = 0;
+    sqe->user_data = _ST_URING_UDATA_OP(&uop);
+    _ST_URING_IOS(osfd)++;
+    _st_this_vp.nn_ios++;
+
+    if (timeout != ST_UTIME_NO_TIMEOUT)
+        _ST_ADD_SLEEPQ(me, timeout);
+    me->state = _ST_ST_IO_WAIT;
+    _ST_SWITCH_CONTEXT(me);
+
+    /* Timeout or interrupted, cancel it, and wait for it because the kernel still refers to the buffer */
+    if (!uop.done) {
+        if ((sqe = _st_uring_get_sqe()) != NULL) {
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = -1;
+            sqe->addr = _ST_URING_UDATA_OP(&uop);
+            sqe->user_data = _ST_URING_UDATA_IGNORE;
+        }
+        while (!uop.done) {
+            me->state = _ST_ST_IO_WAIT;
+            _ST_SWITCH_CONTEXT(me);
+        }
+    }
+    _ST_URING_IOS(osfd)--;
+
+    /* The I/O is done before canceled, so keep the interrupt for the next blocking call */
+    if (uop.res >= 0)
+        return uop.res;
+
+    /* The kernel doesn't wait for the non-blocking socket, so wait for readiness from now on */
+    if (uop.res == -EAGAIN) {
+        _st_uring_data->native = 0;
+        errno = EAGAIN;
+        return -1;
+    }
+
+    if (uop.res == -ECANCELED || uop.res == -EINTR) {
+        if (me->flags & _ST_FL_INTERRUPT) {
+            me->flags &= ~_ST_FL_INTERRUPT;
+            errno = EINTR;
+        } else {
+            errno = ETIME;
+        }
+        return -1;
+    }
+
+    errno = -uop.res;
+    return -1;
+}
+
+ST_HIDDEN int _st_uring_fd_getlimit(void)
+{
+    /* zero means no specific limit */
+    return 0;
+}
+
+/*
+ * Check whether the kernel supports io_uring, and the features we required,
+ * for example, waiting with timeout by IORING_ENTER_EXT_ARG since linux 5.11.
+ */
+ST_HIDDEN int _st_uring_is_supported(void)
+{
+    struct io_uring_params p;
+    int fd;
+
+    memset(&p, 0, sizeof(p));
+    if ((fd = _st_uring_setup(1, &p)) < 0)
+        return 0;
+    close(fd);
+
+    return (p.features & IORING_FEAT_EXT_ARG) != 0;
+}
+
+ST_HIDDEN void _st_uring_destroy(void)
+{
+    munmap(_st_uring_data->sqes, _st_uring_data->sqes_size);
+    if (_st_uring_data->cq_ring_size)
+        munmap(_st_uring_data->cq_ring, _st_uring_data->cq_ring_size);
+    munmap(_st_uring_data->sq_ring, _st_uring_data->sq_ring_size);
+    close(_st_uring_data->ring_fd);
+    free(_st_uring_data->fd_data);
+    free(_st_uring_data->dirty_fds);
+    free(_st_uring_data);
+    _st_uring_data = NULL;
+}
+
+static _st_eventsys_t _st_uring_eventsys = {
+    "io_uring",
+    ST_EVENTSYS_IOURING,
+    _st_uring_init,
+    _st_uring_dispatch,
+    _st_uring_pollset_add,
+    _st_uring_pollset_del,
+    _st_uring_fd_new,
+    _st_uring_fd_close,
+    _st_uring_fd_getlimit,
+    _st_uring_destroy,
+    NULL,
+    NULL,
+    _st_uring_netfd_io
+};
+#endif  /* MD_HAVE_IOURING */
+
+
 /*****************************************
  * Public functions
  */
@@ -1260,6 +2161,15 @@ int st_set_eventsys(int eventsys)
 #endif
     }
 
+    if (eventsys == ST_EVENTSYS_IOURING) {
+#if defined (MD_HAVE_IOURING)
+        if (_st_uring_is_supported()) {
+            _st_eventsys = &_st_uring_eventsys;
+            return 0;
+        }
+#endif
+    }
+
     errno = EINVAL;
     return -1;
 }
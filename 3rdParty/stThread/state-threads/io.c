@@ -52,6 +52,7 @@
 #include <fcntl.h>
 #include <signal.h>
 #include <errno.h>
+#include <string.h>
 #include "common.h"
 
 // Global stat.
@@ -82,6 +83,8 @@ __thread unsigned long long _st_stat_sendmsg_eagain = 0;
 
 /* File descriptor object free list */
 static __thread _st_netfd_t *_st_netfd_freelist = NULL;
+/* Whether register new sockets persistently to event system */
+static __thread int _st_netfd_persistent = 0;
 /* Maximum number of file descriptors that the process can open */
 static int _st_osfd_limit = -1;
 
@@ -140,6 +143,10 @@ void st_netfd_free(_st_netfd_t *fd)
         return;
 
     fd->inuse = 0;
+    if (fd->persistent) {
+        (*_st_eventsys->netfd_del)(fd);
+        fd->persistent = 0;
+    }
     if (fd->aux_data)
         _st_netfd_free_aux_data(fd);
     if (fd->private_data && fd->destructor)
@@ -170,24 +177,46 @@ static _st_netfd_t *_st_netfd_new(int osfd, int nonblock, int is_socket)
 
     fd->osfd = osfd;
     fd->inuse = 1;
+    fd->persistent = 0;
+    fd->revents = 0;
     fd->next = NULL;
     
     if (nonblock) {
         /* Use just one system call */
-        if (is_socket && ioctl(osfd, FIONBIO, &flags) != -1)
-            return fd;
-        /* Do it the Posix way */
-        if ((flags = fcntl(osfd, F_GETFL, 0)) < 0 ||
-            fcntl(osfd, F_SETFL, flags | O_NONBLOCK) < 0) {
-            st_netfd_free(fd);
-            return NULL;
+        if (!is_socket || ioctl(osfd, FIONBIO, &flags) == -1) {
+            /* Do it the Posix way */
+            if ((flags = fcntl(osfd, F_GETFL, 0)) < 0 ||
+                fcntl(osfd, F_SETFL, flags | O_NONBLOCK) < 0) {
+                st_netfd_free(fd);
+                return NULL;
+            }
         }
     }
 
+    /*
+     * Register the socket once for its lifetime, if the event system supports.
+     * It's OK to fail, the socket is registered for each poll as usual.
+     */
+    if (is_socket && _st_netfd_persistent && _st_eventsys->netfd_add) {
+        if ((*_st_eventsys->netfd_add)(fd) == 0)
+            fd->persistent = 1;
+    }
+
+    /* The persistent socket is edge-triggered by event system, so never do the I/O natively */
+    fd->native = is_socket && !fd->persistent && _st_eventsys->netfd_io;
+
     return fd;
 }
 
 
+int st_netfd_persistent_set(int on)
+{
+    int wason = _st_netfd_persistent;
+    _st_netfd_persistent = on;
+    return wason;
+}
+
+
 _st_netfd_t *st_netfd_open(int osfd)
 {
     return _st_netfd_new(osfd, 1, 0);
@@ -242,6 +271,15 @@ int st_netfd_poll(_st_netfd_t *fd, int how, st_utime_t timeout)
     struct pollfd pd;
     int n;
     
+    /*
+     * The persistent descriptor is edge-triggered, so we must use the readiness
+     * recorded by event system, because there might be no more event for it.
+     */
+    if (fd->persistent && (fd->revents & how)) {
+        fd->revents &= ~how;
+        return 0;
+    }
+    
     pd.fd = fd->osfd;
     pd.events = (short) how;
     pd.revents = 0;
@@ -257,11 +295,77 @@ int st_netfd_poll(_st_netfd_t *fd, int how, st_utime_t timeout)
         errno = EBADF;
         return -1;
     }
+    if (fd->persistent)
+        fd->revents &= ~how;
     
     return 0;
 }
 
 
+/*
+ * Wait for I/O after the operation failed with EAGAIN, for persistent
+ * descriptor, the readiness recorded by event system is stale now.
+ */
+static int _st_netfd_wait(_st_netfd_t *fd, int how, st_utime_t timeout)
+{
+    fd->revents &= ~how;
+    return st_netfd_poll(fd, how, timeout);
+}
+
+
+/*
+ * Do the I/O natively by event system after the operation failed with EAGAIN,
+ * which waits for the result by itself. Fails with EAGAIN if not supported,
+ * then the caller should wait for I/O by _st_netfd_wait as usual.
+ */
+static ssize_t _st_netfd_io(_st_netfd_t *fd, int op, void *buf, size_t len, void *arg, st_utime_t timeout)
+{
+    if (!fd->native) {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    return (*_st_eventsys->netfd_io)(fd, op, buf, len, arg, timeout);
+}
+
+
+/* Do the vectored I/O natively, the op is _ST_IO_RECV or _ST_IO_SEND. */
+static ssize_t _st_netfd_iov_io(_st_netfd_t *fd, int op, const struct iovec *iov, int iov_size, st_utime_t timeout)
+{
+    struct msghdr msg;
+
+    if (iov_size == 1)
+        return _st_netfd_io(fd, op, iov->iov_base, iov->iov_len, NULL, timeout);
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = (struct iovec *) iov;
+    msg.msg_iovlen = iov_size;
+    return _st_netfd_io(fd, (op == _ST_IO_RECV) ? _ST_IO_RECVMSG : _ST_IO_SENDMSG, &msg, 0, NULL, timeout);
+}
+
+
+/* Do the recvfrom or sendto natively, the op is _ST_IO_RECVMSG or _ST_IO_SENDMSG. */
+static int _st_netfd_msg_io(_st_netfd_t *fd, int op, void *buf, int len, void *addr, int *addrlen, st_utime_t timeout)
+{
+    struct msghdr msg;
+    struct iovec iov;
+    int n;
+
+    iov.iov_base = buf;
+    iov.iov_len = len;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = addr;
+    msg.msg_namelen = (addr && addrlen) ? *addrlen : 0;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    if ((n = (int) _st_netfd_io(fd, op, &msg, 0, NULL, timeout)) >= 0 && op == _ST_IO_RECVMSG && addr && addrlen)
+        *addrlen = msg.msg_namelen;
+
+    return n;
+}
+
+
 /* No-op */
 int st_netfd_serialize_accept(_st_netfd_t *fd)
 {
@@ -285,8 +389,10 @@ _st_netfd_t *st_accept(_st_netfd_t *fd, struct sockaddr *addr, int *addrlen, st_
             continue;
         if (!_IO_NOT_READY_ERROR)
             return NULL;
-        /* Wait until the socket becomes readable */
-        if (st_netfd_poll(fd, POLLIN, timeout) < 0)
+        /* Accept it natively, or wait until the socket becomes readable */
+        if ((osfd = (int) _st_netfd_io(fd, _ST_IO_ACCEPT, addr, 0, addrlen, timeout)) >= 0)
+            break;
+        if (errno != EAGAIN || _st_netfd_wait(fd, POLLIN, timeout) < 0)
             return NULL;
     }
     
@@ -327,7 +433,7 @@ int st_connect(_st_netfd_t *fd, const struct sockaddr *addr, int addrlen, st_uti
             if (errno != EINPROGRESS && (errno != EADDRINUSE || err == 0))
                 return -1;
             /* Wait until the socket becomes writable */
-            if (st_netfd_poll(fd, POLLOUT, timeout) < 0)
+            if (_st_netfd_wait(fd, POLLOUT, timeout) < 0)
                 return -1;
             /* Try to find out whether the connection setup succeeded or failed */
             n = sizeof(int);
@@ -364,8 +470,10 @@ ssize_t st_read(_st_netfd_t *fd, void *buf, size_t nbyte, st_utime_t timeout)
         ++_st_stat_read_eagain;
         #endif
 
-        /* Wait until the socket becomes readable */
-        if (st_netfd_poll(fd, POLLIN, timeout) < 0)
+        /* Read it natively, or wait until the socket becomes readable */
+        if ((n = _st_netfd_io(fd, _ST_IO_RECV, buf, nbyte, NULL, timeout)) >= 0 || errno != EAGAIN)
+            return n;
+        if (_st_netfd_wait(fd, POLLIN, timeout) < 0)
             return -1;
     }
     
@@ -406,8 +514,10 @@ ssize_t st_readv(_st_netfd_t *fd, const struct iovec *iov, int iov_size, st_utim
         ++_st_stat_readv_eagain;
         #endif
 
-        /* Wait until the socket becomes readable */
-        if (st_netfd_poll(fd, POLLIN, timeout) < 0)
+        /* Read it natively, or wait until the socket becomes readable */
+        if ((n = _st_netfd_iov_io(fd, _ST_IO_RECV, iov, iov_size, timeout)) >= 0 || errno != EAGAIN)
+            return n;
+        if (_st_netfd_wait(fd, POLLIN, timeout) < 0)
             return -1;
     }
     
@@ -428,9 +538,13 @@ int st_readv_resid(_st_netfd_t *fd, struct iovec **iov, int *iov_size, st_utime_
                 continue;
             if (!_IO_NOT_READY_ERROR)
                 return -1;
-        } else if (n == 0)
+            /* Read it natively, which waits by itself */
+            if ((n = _st_netfd_iov_io(fd, _ST_IO_RECV, *iov, *iov_size, timeout)) < 0 && errno != EAGAIN)
+                return -1;
+        }
+        if (n == 0)
             break;
-        else {
+        if (n > 0) {
             while ((size_t) n >= (*iov)->iov_len) {
                 n -= (*iov)->iov_len;
                 (*iov)->iov_base = (char *) (*iov)->iov_base + (*iov)->iov_len;
@@ -444,9 +558,12 @@ int st_readv_resid(_st_netfd_t *fd, struct iovec **iov, int *iov_size, st_utime_
                 break;
             (*iov)->iov_base = (char *) (*iov)->iov_base + n;
             (*iov)->iov_len -= n;
+            /* Read again at once, the native read waits by itself */
+            if (fd->native)
+                continue;
         }
         /* Wait until the socket becomes readable */
-        if (st_netfd_poll(fd, POLLIN, timeout) < 0)
+        if (_st_netfd_wait(fd, POLLIN, timeout) < 0)
             return -1;
     }
     
@@ -520,7 +637,13 @@ ssize_t st_writev(_st_netfd_t *fd, const struct iovec *iov, int iov_size, st_uti
                 rv = -1;
                 break;
             }
-        } else {
+            /* Write it natively, which waits by itself */
+            if ((n = _st_netfd_iov_io(fd, _ST_IO_SEND, tmp_iov, iov_cnt, timeout)) < 0 && errno != EAGAIN) {
+                rv = -1;
+                break;
+            }
+        }
+        if (n >= 0) {
             if ((size_t) n == nleft)
                 break;
             nleft -= n;
@@ -549,6 +672,9 @@ ssize_t st_writev(_st_netfd_t *fd, const struct iovec *iov, int iov_size, st_uti
                 tmp_iov[iov_cnt].iov_base = iov[index].iov_base;
                 tmp_iov[iov_cnt].iov_len = iov[index].iov_len;
             }
+            /* Write again at once, the native write waits by itself */
+            if (fd->native)
+                continue;
         }
 
         #if defined(DEBUG) && defined(DEBUG_STATS)
@@ -556,7 +682,7 @@ ssize_t st_writev(_st_netfd_t *fd, const struct iovec *iov, int iov_size, st_uti
         #endif
 
         /* Wait until the socket becomes writable */
-        if (st_netfd_poll(fd, POLLOUT, timeout) < 0) {
+        if (_st_netfd_wait(fd, POLLOUT, timeout) < 0) {
             rv = -1;
             break;
         }
@@ -587,7 +713,11 @@ int st_writev_resid(_st_netfd_t *fd, struct iovec **iov, int *iov_size, st_utime
                 continue;
             if (!_IO_NOT_READY_ERROR)
                 return -1;
-        } else {
+            /* Write it natively, which waits by itself */
+            if ((n = _st_netfd_iov_io(fd, _ST_IO_SEND, *iov, *iov_size, timeout)) < 0 && errno != EAGAIN)
+                return -1;
+        }
+        if (n >= 0) {
             while ((size_t) n >= (*iov)->iov_len) {
                 n -= (*iov)->iov_len;
                 (*iov)->iov_base = (char *) (*iov)->iov_base + (*iov)->iov_len;
@@ -601,6 +731,9 @@ int st_writev_resid(_st_netfd_t *fd, struct iovec **iov, int *iov_size, st_utime
                 break;
             (*iov)->iov_base = (char *) (*iov)->iov_base + n;
             (*iov)->iov_len -= n;
+            /* Write again at once, the native write waits by itself */
+            if (fd->native)
+                continue;
         }
 
         #if defined(DEBUG) && defined(DEBUG_STATS)
@@ -608,7 +741,7 @@ int st_writev_resid(_st_netfd_t *fd, struct iovec **iov, int *iov_size, st_utime
         #endif
 
         /* Wait until the socket becomes writable */
-        if (st_netfd_poll(fd, POLLOUT, timeout) < 0)
+        if (_st_netfd_wait(fd, POLLOUT, timeout) < 0)
             return -1;
     }
     
@@ -637,8 +770,10 @@ int st_recvfrom(_st_netfd_t *fd, void *buf, int len, struct sockaddr *from, int
         ++_st_stat_recvfrom_eagain;
         #endif
 
-        /* Wait until the socket becomes readable */
-        if (st_netfd_poll(fd, POLLIN, timeout) < 0)
+        /* Receive it natively, or wait until the socket becomes readable */
+        if ((n = _st_netfd_msg_io(fd, _ST_IO_RECVMSG, buf, len, from, fromlen, timeout)) >= 0 || errno != EAGAIN)
+            return n;
+        if (_st_netfd_wait(fd, POLLIN, timeout) < 0)
             return -1;
     }
     
@@ -664,8 +799,10 @@ int st_sendto(_st_netfd_t *fd, const void *msg, int len, const struct sockaddr *
         ++_st_stat_sendto_eagain;
         #endif
 
-        /* Wait until the socket becomes writable */
-        if (st_netfd_poll(fd, POLLOUT, timeout) < 0)
+        /* Send it natively, or wait until the socket becomes writable */
+        if ((n = _st_netfd_msg_io(fd, _ST_IO_SENDMSG, (void *) msg, len, (void *) to, &tolen, timeout)) >= 0 || errno != EAGAIN)
+            return n;
+        if (_st_netfd_wait(fd, POLLOUT, timeout) < 0)
             return -1;
     }
     
@@ -691,8 +828,10 @@ int st_recvmsg(_st_netfd_t *fd, struct msghdr *msg, int flags, st_utime_t timeou
         ++_st_stat_recvmsg_eagain;
         #endif
 
-        /* Wait until the socket becomes readable */
-        if (st_netfd_poll(fd, POLLIN, timeout) < 0)
+        /* Receive it natively, or wait until the socket becomes readable */
+        if ((n = (int) _st_netfd_io(fd, _ST_IO_RECVMSG, msg, flags, NULL, timeout)) >= 0 || errno != EAGAIN)
+            return n;
+        if (_st_netfd_wait(fd, POLLIN, timeout) < 0)
             return -1;
     }
     
@@ -718,8 +857,10 @@ int st_sendmsg(_st_netfd_t *fd, const struct msghdr *msg, int flags, st_utime_t
         ++_st_stat_sendmsg_eagain;
         #endif
 
-        /* Wait until the socket becomes writable */
-        if (st_netfd_poll(fd, POLLOUT, timeout) < 0)
+        /* Send it natively, or wait until the socket becomes writable */
+        if ((n = (int) _st_netfd_io(fd, _ST_IO_SENDMSG, (void *) msg, flags, NULL, timeout)) >= 0 || errno != EAGAIN)
+            return n;
+        if (_st_netfd_wait(fd, POLLOUT, timeout) < 0)
             return -1;
     }
     
@@ -58,12 +58,18 @@ static int key_max = 0;
  */
 int st_key_create(int *keyp, _st_destructor_t destructor)
 {
-    if (key_max >= ST_KEYS_MAX) {
-        errno = EAGAIN;
-        return -1;
-    }
-    
-    *keyp = key_max++;
+    int key;
+
+    /* Keys are shared by all VPs, which might create keys concurrently. */
+    do {
+        key = key_max;
+        if (key >= ST_KEYS_MAX) {
+            errno = EAGAIN;
+            return -1;
+        }
+    } while (!__sync_bool_compare_and_swap(&key_max, key, key + 1));
+
+    *keyp = key;
     _st_destructors[*keyp] = destructor;
     
     return 0;
@@ -77,6 +77,41 @@ typedef struct _st_jmp_buf {
 extern int _st_md_cxt_save(_st_jmp_buf_t env);
 extern void _st_md_cxt_restore(_st_jmp_buf_t env, int val);
 
+/*
+ * Save the context to from and restore the context of to by one call, which is
+ * compatible with the context of setjmp/longjmp. Only for x86_64 of linux, and
+ * it's disabled by default, define MD_HAVE_SWITCH to enable it, otherwise we use
+ * setjmp/longjmp.
+ */
+#if defined(MD_HAVE_SWITCH) && !(defined(LINUX) && (defined(__amd64__) || defined(__x86_64__)))
+    #undef MD_HAVE_SWITCH
+#endif
+#if defined(MD_HAVE_SWITCH)
+    extern void _st_md_cxt_switch(_st_jmp_buf_t from, _st_jmp_buf_t to);
+    #define MD_SWITCH(from, to) _st_md_cxt_switch(from, to)
+#endif
+
+/*
+ * The cheap cycle counter to account the time of threads, the TSC of x86 or the
+ * virtual counter of aarch64, or the monotonic clock in nanoseconds for others.
+ */
+static inline unsigned long long _st_md_cycles(void)
+{
+#if defined(__amd64__) || defined(__x86_64__) || defined(__i386__)
+    unsigned int lo, hi;
+    __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((unsigned long long) hi << 32) | lo;
+#elif defined(__aarch64__)
+    unsigned long long v;
+    __asm__ __volatile__ ("mrs %0, cntvct_el0" : "=r" (v));
+    return v;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#endif
+}
+
 /* Always use builtin setjmp/longjmp, use asm code. */
 #define MD_USE_BUILTIN_SETJMP
 #define MD_SETJMP(env) _st_md_cxt_save(env)
@@ -69,6 +69,7 @@
 #define ST_EVENTSYS_DEFAULT 0
 #define ST_EVENTSYS_SELECT  1
 #define ST_EVENTSYS_ALT     3
+#define ST_EVENTSYS_IOURING 4
 
 #ifdef __cplusplus
 extern "C" {
@@ -78,6 +79,8 @@ typedef unsigned long long  st_utime_t;
 typedef struct _st_thread * st_thread_t;
 typedef struct _st_cond *   st_cond_t;
 typedef struct _st_mutex *  st_mutex_t;
+typedef struct _st_rwlock * st_rwlock_t;
+typedef struct _st_sema *   st_sema_t;
 typedef struct _st_netfd *  st_netfd_t;
 #ifdef ST_SWITCH_CB
 typedef void (*st_switch_cb_t)(void);
@@ -101,8 +104,97 @@ extern int st_thread_join(st_thread_t thread, void **retvalp);
 extern void st_thread_interrupt(st_thread_t thread);
 extern void st_thread_yield();
 extern st_thread_t st_thread_create(void *(*start)(void *arg), void *arg, int joinable, int stack_size);
+/*
+ * Priority class of thread, the runnable threads of a higher class always run before the
+ * lower ones, and FIFO in a class. The new threads are normal. The low threads only run when
+ * no higher one is runnable, so use it for bulk work, and the high for timers and control.
+ * Returns the previous one, or -1 with EINVAL.
+ */
+#define ST_PRIO_HIGH   0
+#define ST_PRIO_NORMAL 1
+#define ST_PRIO_LOW    2
+#define ST_PRIO_LEVELS 3
+extern int st_thread_set_prio(st_thread_t thread, int prio);
+extern int st_thread_get_prio(st_thread_t thread);
 extern int st_randomize_stacks(int on);
+/*
+ * Limit the free stacks cached for each size class to max, and release the memory
+ * of free stacks beyond watermark by madvise. Use -1 for unlimited, the default.
+ */
+extern int st_set_stack_cache(int max, int watermark);
+/*
+ * Carve the stacks from arenas of nn stacks, instead of one mmap for each stack, and
+ * preallocate nn stacks of stack_size after st_init, so threads are created without mmap.
+ */
+#define ST_STACK_HUGEPAGE 0x01  /* madvise(MADV_HUGEPAGE) for the arena */
+#define ST_STACK_HUGETLB  0x02  /* mmap(MAP_HUGETLB) for the arena, without guard pages */
+extern int st_set_stack_arena(int nn, int flags);
+extern int st_prealloc_stacks(int nn, int stack_size);
+/* Protect the redzones of stacks, and find the thread which overflows */
+extern int st_set_stack_guard(int on);
+extern st_thread_t st_stack_guard_fault(void *addr);
+/* Paint stacks by canary, to get the deepest usage of stack, for diagnosis only */
+extern int st_paint_stacks(int on);
+extern int st_thread_stack_usage(st_thread_t thread, int *size);
+/*
+ * Run the new threads on nn shared stacks of stack_size, and save the used part of stack
+ * to heap when switched out. Use 0 to disable it. The address of variables on the stack
+ * must not be used by other threads, which is invalid while the owner is switched out.
+ */
+extern int st_set_copy_stack(int nn, int stack_size);
 extern int st_set_utime_function(st_utime_t (*func)(void));
+/*
+ * Use a hierarchical timing wheel of tick for sleeping threads of this VP, instead
+ * of the timeout heap, must be called before st_init. Timeouts are rounded up to tick.
+ */
+extern int st_set_timer_wheel(st_utime_t tick);
+/*
+ * Timer slack, the sleeping threads wakeup in [due, due+slack], so the timers in
+ * a window are batched into one wakeup. The slack of thread overwrites the default
+ * one, or use ST_UTIME_NO_TIMEOUT to reset it.
+ */
+extern st_utime_t st_set_timer_slack(st_utime_t slack);
+extern st_utime_t st_thread_set_slack(st_thread_t thread, st_utime_t slack);
+extern void st_timer_stats(unsigned long long *expired, unsigned long long *coalesced);
+/*
+ * Account the time on CPU, the switches and the delay from runnable to running of the
+ * threads of this VP by the cycle counter, after st_init. The idle thread is on CPU
+ * when the VP waits for events. The times of stat are in microseconds.
+ */
+typedef struct st_thread_stats {
+    st_utime_t cpu;
+    st_utime_t delay;
+    st_utime_t max_delay;
+    unsigned long long nn_switches;
+} st_thread_stats_t;
+extern int st_set_thread_stats(int on);
+extern int st_thread_stats(st_thread_t thread, st_thread_stats_t *stats);
+/*
+ * The stat of event loop of this VP, always on. The loop is the time to run threads from
+ * wakeup to idle, and wait is the time blocked in event system, in microseconds. For the
+ * histogram, the bucket i counts the values in [2^(i-1), 2^i), the last one for larger.
+ * Set the storage of stat after st_init for other pthreads to read it, NULL for default,
+ * then any pthread can read the snapshot by st_vp_stats without lock, NULL for this VP.
+ */
+#define ST_VP_HIST_BUCKETS 24
+typedef struct st_vp_stats {
+    unsigned long long seq;         /* Odd while the VP updates it */
+    unsigned long long nn_loops;
+    unsigned long long nn_events;
+    unsigned long long nn_ctls;     /* The requests to change interests, like epoll_ctl or io_uring poll */
+    unsigned long long nn_ios;      /* The native I/O operations, like io_uring recv */
+    unsigned long long idle;        /* Whether blocked in event system */
+    st_utime_t wakeup_at;           /* The st_utime of last wakeup, to find the stuck VP if not idle */
+    st_utime_t loop_total;
+    st_utime_t loop_max;
+    st_utime_t wait_total;
+    unsigned long long loop[ST_VP_HIST_BUCKETS];
+    unsigned long long wait[ST_VP_HIST_BUCKETS];
+    unsigned long long events[ST_VP_HIST_BUCKETS];
+    unsigned long long runq[ST_VP_HIST_BUCKETS];
+} st_vp_stats_t;
+extern st_vp_stats_t *st_set_vp_stats(st_vp_stats_t *stats);
+extern void st_vp_stats(const st_vp_stats_t *stats, st_vp_stats_t *snapshot);
 
 extern st_utime_t st_utime(void);
 extern st_utime_t st_utime_last_clock(void);
@@ -121,6 +213,23 @@ extern int st_mutex_destroy(st_mutex_t lock);
 extern int st_mutex_lock(st_mutex_t lock);
 extern int st_mutex_unlock(st_mutex_t lock);
 extern int st_mutex_trylock(st_mutex_t lock);
+/*
+ * The reader-writer lock, writers are preferred over the new readers, and the waiting
+ * readers are woken together when a writer unlocks.
+ */
+extern st_rwlock_t st_rwlock_new(void);
+extern int st_rwlock_destroy(st_rwlock_t lock);
+extern int st_rwlock_rdlock(st_rwlock_t lock);
+extern int st_rwlock_wrlock(st_rwlock_t lock);
+extern int st_rwlock_tryrdlock(st_rwlock_t lock);
+extern int st_rwlock_trywrlock(st_rwlock_t lock);
+extern int st_rwlock_unlock(st_rwlock_t lock);
+/* The counting semaphore, the permits are handed to waiters in FIFO order */
+extern st_sema_t st_sema_new(int value);
+extern int st_sema_destroy(st_sema_t sema);
+extern int st_sema_acquire(st_sema_t sema, st_utime_t timeout);
+extern int st_sema_tryacquire(st_sema_t sema);
+extern int st_sema_release(st_sema_t sema);
 
 extern int st_key_create(int *keyp, void (*destructor)(void *));
 extern int st_key_getlimit(void);
@@ -136,6 +245,11 @@ extern void st_netfd_setspecific(st_netfd_t fd, void *value, void (*destructor)(
 extern void *st_netfd_getspecific(st_netfd_t fd);
 extern int st_netfd_serialize_accept(st_netfd_t fd);
 extern int st_netfd_poll(st_netfd_t fd, int how, st_utime_t timeout);
+/*
+ * Register the sockets opened later to event system once(edge-triggered) until
+ * closed, only for epoll. Wait the persistent netfd by st_netfd_poll, not st_poll.
+ */
+extern int st_netfd_persistent_set(int on);
 
 extern int st_poll(struct pollfd *pds, int npds, st_utime_t timeout);
 extern st_netfd_t st_accept(st_netfd_t fd, struct sockaddr *addr, int *addrlen, st_utime_t timeout);
@@ -81,14 +81,35 @@ __thread int _st_active_count = 0;       /* Active thread count */
 __thread time_t _st_curr_time = 0;       /* Current time as returned by time(2) */
 __thread st_utime_t _st_last_tset;       /* Last time it was fetched */
 
-// We should initialize the thread-local variable in st_init().
-extern __thread _st_clist_t _st_free_stacks;
+/* The tick of timing wheel, or 0 to use the timeout heap */
+static __thread st_utime_t _st_wheel_tick = 0;
+
+/* The default timer slack of threads, and the stat of expired timers */
+static __thread st_utime_t _st_timer_slack = 0;
+static __thread unsigned long long _st_timer_expired = 0;
+static __thread unsigned long long _st_timer_coalesced = 0;
+
+/* The stat of event loop, published to the storage of user if set */
+static __thread st_vp_stats_t _st_vp_stats_default;
+
+
+static unsigned long long _st_monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+
+/* Most of polls are for one descriptor, for example st_netfd_poll */
+#define _LOCAL_MAXFDLINKS  4
 
 int st_poll(struct pollfd *pds, int npds, st_utime_t timeout)
 {
     struct pollfd *pd;
-    struct pollfd *epd = pds + npds;
-    _st_pollq_t pq;
+    struct pollfd *epd;
+    _st_pollq_t local_pq, *pq = &local_pq;
+    _st_pollfd_link_t local_fdlinks[_LOCAL_MAXFDLINKS];
     _st_thread_t *me = _ST_CURRENT_THREAD();
     int n;
     
@@ -98,14 +119,36 @@ int st_poll(struct pollfd *pds, int npds, st_utime_t timeout)
         return -1;
     }
     
-    if ((*_st_eventsys->pollset_add)(pds, npds) < 0)
-        return -1;
+    if (me->stack && me->stack->shared) {
+        /*
+         * In copy-stack mode, the stack is overwritten by other threads while
+         * we are waiting, so the pollq and descriptors must live on heap.
+         */
+        pq = (_st_pollq_t *) malloc(sizeof(_st_pollq_t) + npds * (sizeof(_st_pollfd_link_t) + sizeof(struct pollfd)));
+        if (!pq)
+            return -1;
+        pq->fdlinks = (_st_pollfd_link_t *) (pq + 1);
+        pq->pds = (struct pollfd *) (pq->fdlinks + npds);
+        memcpy(pq->pds, pds, npds * sizeof(struct pollfd));
+    } else {
+        pq->pds = pds;
+        pq->fdlinks = local_fdlinks;
+        if (npds > _LOCAL_MAXFDLINKS) {
+            pq->fdlinks = (_st_pollfd_link_t *) malloc(npds * sizeof(_st_pollfd_link_t));
+            if (!pq->fdlinks)
+                return -1;
+        }
+    }
+    pq->npds = npds;
+    pq->thread = me;
     
-    pq.pds = pds;
-    pq.npds = npds;
-    pq.thread = me;
-    pq.on_ioq = 1;
-    _ST_ADD_IOQ(pq);
+    if ((*_st_eventsys->pollset_add)(pq) < 0) {
+        n = -1;
+        goto done;
+    }
+    
+    pq->on_ioq = 1;
+    _ST_ADD_IOQ(*pq);
     if (timeout != ST_UTIME_NO_TIMEOUT)
         _ST_ADD_SLEEPQ(me, timeout);
     me->state = _ST_ST_IO_WAIT;
@@ -113,18 +156,29 @@ int st_poll(struct pollfd *pds, int npds, st_utime_t timeout)
     _ST_SWITCH_CONTEXT(me);
     
     n = 0;
-    if (pq.on_ioq) {
+    if (pq->on_ioq) {
         /* If we timed out, the pollq might still be on the ioq. Remove it */
-        _ST_DEL_IOQ(pq);
-        (*_st_eventsys->pollset_del)(pds, npds);
+        _ST_DEL_IOQ(*pq);
+        (*_st_eventsys->pollset_del)(pq);
     } else {
         /* Count the number of ready descriptors */
-        for (pd = pds; pd < epd; pd++) {
+        for (pd = pq->pds, epd = pd + npds; pd < epd; pd++) {
             if (pd->revents)
                 n++;
         }
     }
     
+done:
+    if (pq != &local_pq) {
+        memcpy(pds, pq->pds, npds * sizeof(struct pollfd));
+        free(pq);
+    } else if (pq->fdlinks != local_fdlinks) {
+        free(pq->fdlinks);
+    }
+    
+    if (n < 0)
+        return -1;
+    
     if (me->flags & _ST_FL_INTERRUPT) {
         me->flags &= ~_ST_FL_INTERRUPT;
         errno = EINTR;
@@ -135,17 +189,56 @@ int st_poll(struct pollfd *pds, int npds, st_utime_t timeout)
 }
 
 
-void _st_vp_schedule(void)
+/*
+ * Account the time on CPU of the thread switched out, and the delay of the thread
+ * switched in. The stamps before stats enabled are stale, so they are ignored.
+ */
+static void _st_thread_stats_switch(_st_thread_t *me, _st_thread_t *thread)
+{
+    unsigned long long now = _st_md_cycles();
+    unsigned long long since = _st_this_vp.stats_since;
+    
+    if (me->run_at >= since)
+        me->cpu += now - me->run_at;
+    
+    if (thread->ready_at >= since && thread != _st_this_vp.idle_thread) {
+        unsigned long long delay = now - thread->ready_at;
+        thread->delay += delay;
+        if (thread->max_delay < delay)
+            thread->max_delay = delay;
+    }
+    thread->ready_at = 0;
+    thread->run_at = now;
+    thread->nn_switches++;
+}
+
+
+/* The highest class of runnable threads, above the prio, or -1 if none */
+static inline int _st_runq_first(int prio)
+{
+    int i;
+    
+    for (i = 0; i < prio; i++) {
+        if (_ST_RUNQ(i).next != &_ST_RUNQ(i))
+            return i;
+    }
+    return -1;
+}
+
+
+/* Pull the next thread to run, or the idle thread if none */
+static inline _st_thread_t *_st_vp_next(void)
 {
     _st_thread_t *thread;
+    int prio = _st_runq_first(ST_PRIO_LEVELS);
     
-    if (_ST_RUNQ.next != &_ST_RUNQ) {
+    if (prio >= 0) {
         #if defined(DEBUG) && defined(DEBUG_STATS)
         ++_st_stat_thread_run;
         #endif
 
-        /* Pull thread off of the run queue */
-        thread = _ST_THREAD_PTR(_ST_RUNQ.next);
+        /* Pull thread off of the run queue of the highest class */
+        thread = _ST_THREAD_PTR(_ST_RUNQ(prio).next);
         _ST_DEL_RUNQ(thread);
     } else {
         #if defined(DEBUG) && defined(DEBUG_STATS)
@@ -157,18 +250,61 @@ void _st_vp_schedule(void)
     }
     ST_ASSERT(thread->state == _ST_ST_RUNNABLE);
     
-    /* Resume the thread */
     thread->state = _ST_ST_RUNNING;
+    
+    if (_st_this_vp.stats)
+        _st_thread_stats_switch(_ST_CURRENT_THREAD(), thread);
+    return thread;
+}
+
+
+void _st_vp_schedule(void)
+{
+    _st_thread_t *thread = _st_vp_next();
+    
+    /* Resume the thread */
+    if (thread->stack && thread->stack->shared)
+        _st_stack_switch_in(thread);
     _ST_RESTORE_CONTEXT(thread);
 }
 
 
+#ifdef MD_HAVE_SWITCH
+/*
+ * Switch from me to the next thread directly, which saves the context of me
+ * and restores the next one by one call, and never switches if it's me.
+ */
+void _st_vp_switch(_st_thread_t *me)
+{
+    _st_thread_t *thread = _st_vp_next();
+    
+    if (thread == me) {
+        _ST_SET_CURRENT_THREAD(me);
+        return;
+    }
+    
+    /* In copy-stack mode, the frames of owner, might be me, are saved from the context */
+    if (thread->stack && thread->stack->shared) {
+        if (!MD_SETJMP(me->context)) {
+            _st_stack_switch_in(thread);
+            _ST_RESTORE_CONTEXT(thread);
+        }
+        return;
+    }
+    
+    _ST_SET_CURRENT_THREAD(thread);
+    MD_SWITCH(me->context, thread->context);
+}
+#endif
+
+
 /*
  * Initialize this Virtual Processor
  */
 int st_init(void)
 {
     _st_thread_t *thread;
+    int i;
 
     if (_st_active_count) {
         /* Already initialized */
@@ -182,12 +318,15 @@ int st_init(void)
         return -1;
 
     // Initialize the thread-local variables.
-    ST_INIT_CLIST(&_st_free_stacks);
+    _st_stack_init();
 
     // Initialize ST.
     memset(&_st_this_vp, 0, sizeof(_st_vp_t));
+    memset(&_st_vp_stats_default, 0, sizeof(st_vp_stats_t));
+    _st_this_vp.vstats = &_st_vp_stats_default;
     
-    ST_INIT_CLIST(&_ST_RUNQ);
+    for (i = 0; i < ST_PRIO_LEVELS; i++)
+        ST_INIT_CLIST(&_ST_RUNQ(i));
     ST_INIT_CLIST(&_ST_IOQ);
     ST_INIT_CLIST(&_ST_ZOMBIEQ);
 #ifdef DEBUG
@@ -199,6 +338,16 @@ int st_init(void)
     
     _st_this_vp.pagesize = getpagesize();
     _st_this_vp.last_clock = st_utime();
+
+    if (_st_wheel_tick > 0) {
+        if ((_ST_WHEEL = (_st_wheel_t *) malloc(sizeof(_st_wheel_t))) == NULL)
+            return -1;
+        memset(_ST_WHEEL->bitmap, 0, sizeof(_ST_WHEEL->bitmap));
+        for (i = 0; i < _ST_WHEEL_SLOTS; i++)
+            ST_INIT_CLIST(&_ST_WHEEL->slots[i]);
+        _ST_WHEEL->tick = _st_wheel_tick;
+        _ST_WHEEL->base = _ST_LAST_CLOCK / _st_wheel_tick;
+    }
     
     /*
      * Create idle thread
@@ -219,6 +368,7 @@ int st_init(void)
     thread->private_data = (void **) (thread + 1);
     thread->state = _ST_ST_RUNNING;
     thread->flags = _ST_FL_PRIMORDIAL;
+    thread->prio = ST_PRIO_NORMAL;
     _ST_SET_CURRENT_THREAD(thread);
     _st_active_count++;
 #ifdef DEBUG
@@ -235,6 +385,178 @@ int st_init(void)
 void st_destroy(void)
 {
     (*_st_eventsys->destroy)();
+
+    free(_ST_WHEEL);
+    _ST_WHEEL = NULL;
+}
+
+
+/*
+ * Use the timing wheel instead of the timeout heap for this VP, which costs
+ * O(1) to add or delete a sleeping thread, while timeouts are rounded up to
+ * the tick. Set tick to 0 to use the heap, which is the default.
+ */
+int st_set_timer_wheel(st_utime_t tick)
+{
+    if (_st_active_count) {
+        errno = EBUSY;
+        return -1;
+    }
+
+    _st_wheel_tick = tick;
+    return 0;
+}
+
+
+/*
+ * Allow the sleeping threads to wakeup at most slack later than due, so the
+ * timers due in a window are expired by one wakeup. Returns the previous one.
+ */
+st_utime_t st_set_timer_slack(st_utime_t slack)
+{
+    st_utime_t prev = _st_timer_slack;
+
+    _st_timer_slack = slack;
+    return prev;
+}
+
+
+/*
+ * Set the timer slack of thread, which overwrites the default one, or use the
+ * default if slack is ST_UTIME_NO_TIMEOUT. Returns the previous one.
+ */
+st_utime_t st_thread_set_slack(_st_thread_t *thread, st_utime_t slack)
+{
+    st_utime_t prev = (thread->flags & _ST_FL_SLACK) ? thread->slack : ST_UTIME_NO_TIMEOUT;
+
+    if (slack == ST_UTIME_NO_TIMEOUT) {
+        thread->flags &= ~_ST_FL_SLACK;
+    } else {
+        thread->flags |= _ST_FL_SLACK;
+        thread->slack = slack;
+    }
+    return prev;
+}
+
+
+/*
+ * Set the priority class of thread, and move it to the run queue of the class if
+ * it's runnable, at the tail as it's made runnable now. Returns the previous one.
+ */
+int st_thread_set_prio(_st_thread_t *thread, int prio)
+{
+    int prev = thread->prio;
+    
+    if (prio < 0 || prio >= ST_PRIO_LEVELS || (thread->flags & _ST_FL_IDLE_THREAD)) {
+        errno = EINVAL;
+        return -1;
+    }
+    
+    thread->prio = prio;
+    if (thread->state == _ST_ST_RUNNABLE && prev != prio) {
+        /* Move to the tail of new class, the size of run queues is not changed */
+        ST_REMOVE_LINK(&thread->links);
+        ST_APPEND_LINK(&thread->links, &_ST_RUNQ(prio));
+    }
+    return prev;
+}
+
+
+int st_thread_get_prio(_st_thread_t *thread)
+{
+    return thread->prio;
+}
+
+
+/*
+ * Get the number of timers expired, and the ones expired before due, which
+ * are coalesced to a wakeup for other timers, that is the wakeups saved.
+ */
+void st_timer_stats(unsigned long long *expired, unsigned long long *coalesced)
+{
+    if (expired)
+        *expired = _st_timer_expired;
+    if (coalesced)
+        *coalesced = _st_timer_coalesced;
+}
+
+
+int st_set_thread_stats(int on)
+{
+    int ostats = _st_this_vp.stats;
+    
+    if (on && !ostats) {
+        /* Record the cycles and clock, to calibrate the cycles by each query, see st_thread_stats */
+        _st_this_vp.stats_since = _st_md_cycles();
+        _st_this_vp.stats_ns = _st_monotonic_ns();
+        _ST_CURRENT_THREAD()->run_at = _st_this_vp.stats_since;
+    }
+    _st_this_vp.stats = on;
+    
+    return ostats;
+}
+
+
+int st_thread_stats(st_thread_t thread, st_thread_stats_t *stats)
+{
+    unsigned long long now, cpu, ns;
+    double per_us;
+    
+    if (!_st_this_vp.stats) {
+        errno = EINVAL;
+        return -1;
+    }
+    
+    now = _st_md_cycles();
+    ns = _st_monotonic_ns() - _st_this_vp.stats_ns;
+    per_us = (double) (now - _st_this_vp.stats_since) * 1000 / (ns ? ns : 1);
+    if (per_us <= 0)
+        per_us = 1;
+    
+    /* The current thread is still on CPU */
+    cpu = thread->cpu;
+    if (thread == _ST_CURRENT_THREAD() && thread->run_at >= _st_this_vp.stats_since)
+        cpu += now - thread->run_at;
+    
+    stats->cpu = (st_utime_t) (cpu / per_us);
+    stats->delay = (st_utime_t) (thread->delay / per_us);
+    stats->max_delay = (st_utime_t) (thread->max_delay / per_us);
+    stats->nn_switches = thread->nn_switches;
+    
+    return 0;
+}
+
+
+st_vp_stats_t *st_set_vp_stats(st_vp_stats_t *stats)
+{
+    st_vp_stats_t *ostats = _st_this_vp.vstats;
+    
+    if (!stats)
+        stats = &_st_vp_stats_default;
+    
+    /* The stat goes on, the readers of old storage get the stale stat */
+    if (stats != ostats)
+        memcpy(stats, ostats, sizeof(st_vp_stats_t));
+    _st_this_vp.vstats = stats;
+    
+    return (ostats == &_st_vp_stats_default) ? NULL : ostats;
+}
+
+
+void st_vp_stats(const st_vp_stats_t *stats, st_vp_stats_t *snapshot)
+{
+    unsigned long long seq;
+    
+    if (!stats)
+        stats = _st_this_vp.vstats;
+    
+    /* Retry if the VP updates it while copying */
+    do {
+        while ((seq = __atomic_load_n(&stats->seq, __ATOMIC_ACQUIRE)) & 1) {
+        }
+        memcpy(snapshot, stats, sizeof(st_vp_stats_t));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (seq != __atomic_load_n(&stats->seq, __ATOMIC_RELAXED));
 }
 
 
@@ -255,6 +577,48 @@ st_switch_cb_t st_set_switch_out_cb(st_switch_cb_t cb)
 #endif
 
 
+/* Add the value to the log2 histogram, the bucket i counts values in [2^(i-1), 2^i) */
+static inline void _st_vp_hist_add(unsigned long long *hist, unsigned long long v)
+{
+    int i = v ? 64 - __builtin_clzll(v) : 0;
+    hist[i < ST_VP_HIST_BUCKETS ? i : ST_VP_HIST_BUCKETS - 1]++;
+}
+
+
+/*
+ * Update the stat of an iteration of event loop, the busy and wait are in nanoseconds.
+ * It's guarded by the sequence, so the readers of other pthreads never see a partial
+ * update, without any lock.
+ */
+static void _st_vp_stats_update(unsigned long long busy, unsigned long long wait)
+{
+    st_vp_stats_t *s = _st_this_vp.vstats;
+    
+    busy /= 1000;
+    wait /= 1000;
+    
+    __atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    
+    s->idle = 0;
+    s->nn_loops++;
+    s->nn_events += _st_this_vp.nn_events;
+    s->nn_ctls = _st_this_vp.nn_ctls;
+    s->nn_ios = _st_this_vp.nn_ios;
+    s->wakeup_at = _ST_LAST_CLOCK;
+    s->loop_total += busy;
+    s->wait_total += wait;
+    if (s->loop_max < busy)
+        s->loop_max = busy;
+    _st_vp_hist_add(s->loop, busy);
+    _st_vp_hist_add(s->wait, wait);
+    _st_vp_hist_add(s->events, _st_this_vp.nn_events);
+    _st_vp_hist_add(s->runq, _ST_RUNQ_SIZE);
+    
+    __atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELEASE);
+}
+
+
 /*
  * Start function for the idle thread
  */
@@ -262,14 +626,24 @@ st_switch_cb_t st_set_switch_out_cb(st_switch_cb_t cb)
 void *_st_idle_thread_start(void *arg)
 {
     _st_thread_t *me = _ST_CURRENT_THREAD();
+    unsigned long long idle_at, now, wakeup_at = 0;
     
     while (_st_active_count > 0) {
+        idle_at = _st_monotonic_ns();
+        _st_this_vp.nn_events = 0;
+        __atomic_store_n(&_st_this_vp.vstats->idle, 1, __ATOMIC_RELAXED);
+        
         /* Idle vp till I/O is ready or the smallest timeout expired */
         _ST_VP_IDLE();
         
         /* Check sleep queue for expired threads */
         _st_vp_check_clock();
         
+        /* The threads run from last wakeup to idle, which is the lag of event loop */
+        now = _st_monotonic_ns();
+        _st_vp_stats_update(wakeup_at ? idle_at - wakeup_at : 0, now - idle_at);
+        wakeup_at = now;
+        
         me->state = _ST_ST_RUNNABLE;
         _ST_SWITCH_CONTEXT(me);
     }
@@ -501,10 +875,177 @@ static void heap_delete(_st_thread_t *thread) {
 }
 
 
+/* The slot index of level, and the bits of tick shifted for the level */
+#define _ST_WHEEL_SLOT(_level, _i)  ((_level) == 0 ? (_i) : \
+    _ST_WHEEL_L0_SIZE + ((_level) - 1) * _ST_WHEEL_LN_SIZE + (_i))
+#define _ST_WHEEL_SHIFT(_level)     ((_level) == 0 ? 0 : \
+    _ST_WHEEL_L0_BITS + ((_level) - 1) * _ST_WHEEL_LN_BITS)
+#define _ST_WHEEL_MAX_TICKS         0xffffffffULL
+
+static void _st_wheel_add(_st_wheel_t *w, _st_thread_t *thread)
+{
+    unsigned long long expires, latest, mask, idx;
+    int level, slot;
+
+    /* Round up, never wakeup before the earliest due */
+    expires = (thread->due_early + w->tick - 1) / w->tick;
+    latest = thread->due / w->tick;
+
+    /*
+     * Align to the tick with most trailing zeros in slack, so the timers of
+     * different due are likely to be in the same slot.
+     */
+    if (latest > expires) {
+        mask = (1ULL << (63 - __builtin_clzll(expires ^ latest))) - 1;
+        expires = latest & ~mask;
+    }
+    if (expires < w->base)
+        expires = w->base;
+
+    idx = expires - w->base;
+    if (idx > _ST_WHEEL_MAX_TICKS) {
+        /* Cascade again when the slot expires */
+        expires = w->base + _ST_WHEEL_MAX_TICKS;
+        idx = _ST_WHEEL_MAX_TICKS;
+    }
+
+    for (level = 0; level < _ST_WHEEL_LEVELS - 1; level++) {
+        if (idx < (1ULL << _ST_WHEEL_SHIFT(level + 1)))
+            break;
+    }
+    if (level == 0) {
+        slot = (int) (expires & (_ST_WHEEL_L0_SIZE - 1));
+    } else {
+        slot = _ST_WHEEL_SLOT(level, (int) ((expires >> _ST_WHEEL_SHIFT(level)) & (_ST_WHEEL_LN_SIZE - 1)));
+    }
+
+    ST_APPEND_LINK(&thread->links, &w->slots[slot]);
+    w->bitmap[slot >> 6] |= 1ULL << (slot & 63);
+    thread->heap_index = slot;
+}
+
+static void _st_wheel_del(_st_wheel_t *w, _st_thread_t *thread)
+{
+    int slot = thread->heap_index;
+
+    ST_REMOVE_LINK(&thread->links);
+    if (ST_CLIST_IS_EMPTY(&w->slots[slot]))
+        w->bitmap[slot >> 6] &= ~(1ULL << (slot & 63));
+}
+
+/* Move threads of the slot at upper level to lower levels */
+static void _st_wheel_cascade(_st_wheel_t *w, int level, int i)
+{
+    _st_thread_t *thread;
+    int slot = _ST_WHEEL_SLOT(level, i);
+
+    while (!ST_CLIST_IS_EMPTY(&w->slots[slot])) {
+        thread = _ST_THREAD_PTR(w->slots[slot].next);
+        _st_wheel_del(w, thread);
+        _st_wheel_add(w, thread);
+    }
+}
+
+/* The distance from level 0 slot i to the first non-empty slot, or -1 if empty */
+static int _st_wheel_l0_next(_st_wheel_t *w, int i)
+{
+    unsigned long long bits;
+    int n, word;
+
+    for (n = 0; n <= _ST_WHEEL_L0_SIZE / 64; n++) {
+        word = ((i >> 6) + n) % (_ST_WHEEL_L0_SIZE / 64);
+        bits = w->bitmap[word];
+        if (n == 0)
+            bits &= ~0ULL << (i & 63);
+        else if (n == _ST_WHEEL_L0_SIZE / 64)
+            bits &= (1ULL << (i & 63)) - 1;
+        if (bits)
+            return (word * 64 + __builtin_ctzll(bits) - i) & (_ST_WHEEL_L0_SIZE - 1);
+    }
+
+    return -1;
+}
+
+/*
+ * Advance the wheel to the first thread expires before now, skip the empty
+ * slots by bitmap, and cascade when level 0 starts a new round.
+ */
+static _st_thread_t *_st_wheel_expired(_st_wheel_t *w, st_utime_t now)
+{
+    unsigned long long target = now / w->tick, next;
+    int i, level, d;
+
+    while (w->base <= target) {
+        i = (int) (w->base & (_ST_WHEEL_L0_SIZE - 1));
+        if (!ST_CLIST_IS_EMPTY(&w->slots[i]))
+            return _ST_THREAD_PTR(w->slots[i].next);
+
+        /* The next non-empty slot in this round, or the next round */
+        d = _st_wheel_l0_next(w, i);
+        if (d > 0 && i + d < _ST_WHEEL_L0_SIZE)
+            next = w->base + d;
+        else
+            next = (w->base | (_ST_WHEEL_L0_SIZE - 1)) + 1;
+        w->base = (next < target + 1) ? next : target + 1;
+
+        if ((w->base & (_ST_WHEEL_L0_SIZE - 1)) != 0)
+            continue;
+        for (level = 1; level < _ST_WHEEL_LEVELS; level++) {
+            i = (int) ((w->base >> _ST_WHEEL_SHIFT(level)) & (_ST_WHEEL_LN_SIZE - 1));
+            _st_wheel_cascade(w, level, i);
+            if (i != 0)
+                break;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * The earliest tick to expire or cascade, the upper levels are checked at
+ * the tick to cascade, which is not later than the threads in the slot.
+ */
+static unsigned long long _st_wheel_next(_st_wheel_t *w)
+{
+    unsigned long long t, next = ~0ULL, bits;
+    int level, i, d;
+
+    if ((d = _st_wheel_l0_next(w, (int) (w->base & (_ST_WHEEL_L0_SIZE - 1)))) >= 0)
+        next = w->base + d;
+
+    for (level = 1; level < _ST_WHEEL_LEVELS; level++) {
+        bits = w->bitmap[_ST_WHEEL_SLOT(level, 0) >> 6];
+        if (!bits)
+            continue;
+        /* The current slot of level cascades after a full round */
+        i = (int) (((w->base >> _ST_WHEEL_SHIFT(level)) + 1) & (_ST_WHEEL_LN_SIZE - 1));
+        if (i)
+            bits = (bits >> i) | (bits << (64 - i));
+        d = __builtin_ctzll(bits) + 1;
+        t = ((w->base >> _ST_WHEEL_SHIFT(level)) + d) << _ST_WHEEL_SHIFT(level);
+        if (t < next)
+            next = t;
+    }
+
+    return next;
+}
+
+
 void _st_add_sleep_q(_st_thread_t *thread, st_utime_t timeout)
 {
-    thread->due = _ST_LAST_CLOCK + timeout;
+    st_utime_t slack = (thread->flags & _ST_FL_SLACK) ? thread->slack : _st_timer_slack;
+
+    /* The heap is ordered by the latest due, and expires from the earliest due */
+    thread->due_early = _ST_LAST_CLOCK + timeout;
+    thread->due = thread->due_early + slack;
+    if (thread->due < thread->due_early)
+        thread->due = ST_UTIME_NO_TIMEOUT;
     thread->flags |= _ST_FL_ON_SLEEPQ;
+    if (_ST_WHEEL) {
+        ++_ST_SLEEPQ_SIZE;
+        _st_wheel_add(_ST_WHEEL, thread);
+        return;
+    }
     thread->heap_index = ++_ST_SLEEPQ_SIZE;
     heap_insert(thread);
 }
@@ -512,11 +1053,38 @@ void _st_add_sleep_q(_st_thread_t *thread, st_utime_t timeout)
 
 void _st_del_sleep_q(_st_thread_t *thread)
 {
-    heap_delete(thread);
+    if (_ST_WHEEL) {
+        _st_wheel_del(_ST_WHEEL, thread);
+        --_ST_SLEEPQ_SIZE;
+    } else {
+        heap_delete(thread);
+    }
     thread->flags &= ~_ST_FL_ON_SLEEPQ;
 }
 
 
+/*
+ * The time to wait for the earliest sleeping thread, or ST_UTIME_NO_TIMEOUT
+ * if no thread is sleeping.
+ */
+st_utime_t _st_vp_min_timeout(void)
+{
+    st_utime_t due;
+
+    if (_ST_WHEEL) {
+        if (!_ST_SLEEPQ_SIZE)
+            return ST_UTIME_NO_TIMEOUT;
+        due = (st_utime_t) (_st_wheel_next(_ST_WHEEL) * _ST_WHEEL->tick);
+    } else {
+        if (_ST_SLEEPQ == NULL)
+            return ST_UTIME_NO_TIMEOUT;
+        due = _ST_SLEEPQ->due;
+    }
+
+    return (due <= _ST_LAST_CLOCK) ? 0 : (due - _ST_LAST_CLOCK);
+}
+
+
 void _st_vp_check_clock(void)
 {
     _st_thread_t *thread;
@@ -558,12 +1126,21 @@ void _st_vp_check_clock(void)
         _st_last_tset = now;
     }
     
-    while (_ST_SLEEPQ != NULL) {
-        thread = _ST_SLEEPQ;
+    while (1) {
+        if (_ST_WHEEL) {
+            if ((thread = _st_wheel_expired(_ST_WHEEL, now)) == NULL)
+                break;
+        } else {
+            if ((thread = _ST_SLEEPQ) == NULL || thread->due_early > now)
+                break;
+        }
         ST_ASSERT(thread->flags & _ST_FL_ON_SLEEPQ);
-        if (thread->due > now)
-            break;
         _ST_DEL_SLEEPQ(thread);
+
+        /* Expired before due, by the wakeup for other timers */
+        ++_st_timer_expired;
+        if (thread->due > now)
+            ++_st_timer_coalesced;
         
         /* If thread is waiting on condition variable, set the time out flag */
         if (thread->state == _ST_ST_COND_WAIT)
@@ -572,7 +1149,7 @@ void _st_vp_check_clock(void)
         /* Make thread runnable */
         ST_ASSERT(!(thread->flags & _ST_FL_IDLE_THREAD));
         thread->state = _ST_ST_RUNNABLE;
-        // Insert at the head of RunQ, to execute timer first.
+        // Insert at the head of RunQ of its class, to execute timer first.
         _ST_INSERT_RUNQ(thread);
     }
 }
@@ -589,8 +1166,8 @@ void st_thread_yield()
     /* Check sleep queue for expired threads */
     _st_vp_check_clock();
 
-    // If not thread in RunQ to yield to, ignore and continue to run.
-    if (_ST_RUNQ.next == &_ST_RUNQ) {
+    // If not thread of the same or higher class in RunQ to yield to, ignore and continue to run.
+    if (_st_runq_first(me->prio + 1) < 0) {
         return;
     }
 
@@ -642,12 +1219,14 @@ _st_thread_t *st_thread_create(void *(*start)(void *arg), void *arg, int joinabl
     if (!stack)
         return NULL;
     
-    /* Allocate thread object and per-thread data off the stack */
-    sp = stack->stk_top;
+    /* Allocate thread object and per-thread data off the stack, or the private memory for shared stack */
+    sp = stack->shared ? stack->vaddr + stack->vaddr_size : stack->stk_top;
     sp = sp - (ST_KEYS_MAX * sizeof(void *));
     ptds = (void **) sp;
     sp = sp - sizeof(_st_thread_t);
     thread = (_st_thread_t *) sp;
+    if (stack->shared)
+        sp = stack->stk_top;
     
     /* Make stack 64-byte aligned */
     if ((unsigned long)sp & 0x3f)
@@ -662,6 +1241,7 @@ _st_thread_t *st_thread_create(void *(*start)(void *arg), void *arg, int joinabl
     thread->stack = stack;
     thread->start = start;
     thread->arg = arg;
+    thread->prio = ST_PRIO_NORMAL;
 
     _ST_INIT_CONTEXT(thread, stack->sp, _st_thread_main);
 
@@ -42,6 +42,8 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -52,57 +54,365 @@
 /* How much space to leave between the stacks, at each end */
 #define REDZONE	_ST_PAGE_SIZE
 
-__thread _st_clist_t _st_free_stacks;
+/*
+ * The free stacks are cached by size classes of power of two, from the page
+ * size to 1GB, so a stack is found in O(1) and never serves a much smaller
+ * request. For each class, the hot stacks are reused first, while the cold
+ * ones beyond the watermark have their memory released by madvise. The slab
+ * stacks are carved from an arena but never used, or returned to the arena
+ * instead of unmapped.
+ */
+#define _ST_STACK_MIN_SHIFT 12
+#define _ST_STACK_MAX_SHIFT 30
+#define _ST_STACK_CLASSES   (_ST_STACK_MAX_SHIFT - _ST_STACK_MIN_SHIFT + 1)
+
+typedef struct _st_stack_class {
+    _st_clist_t hot;            /* Free stacks with memory, most recently used first */
+    _st_clist_t cold;           /* Free stacks with memory released */
+    _st_clist_t slab;           /* Free stacks in arenas, without memory */
+    int nn_hot;
+    int nn_cold;
+    int nn_slab;
+} _st_stack_class_t;
+
+static __thread _st_stack_class_t _st_stack_classes[_ST_STACK_CLASSES];
 __thread int _st_num_free_stacks = 0;
 __thread int _st_randomize_stacks = 0;
 
-static char *_st_new_stk_segment(int size);
+/* Protect the redzones of stacks to catch the overflow, always on for DEBUG */
+#ifdef DEBUG
+static __thread int _st_stack_guard = 1;
+#else
+static __thread int _st_stack_guard = 0;
+#endif
 
-_st_stack_t *_st_stack_new(int stack_size)
+/* Paint the stacks by canary, to find the deepest usage of stack */
+#define _ST_STACK_CANARY ((unsigned long) 0xa5a5a5a5a5a5a5a5ULL)
+static __thread int _st_paint_stacks = 0;
+
+/*
+ * Carve the stacks from arenas of nn stacks, to save the mmaps and VMAs, and
+ * use huge pages by flags. The guard pages are inside the arena, except for
+ * MAP_HUGETLB which can't protect a normal page.
+ */
+#define _ST_SLAB_PAGE    1
+#define _ST_SLAB_HUGETLB 2
+#define _ST_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+static __thread int _st_stack_arena_nn = 0;
+static __thread int _st_stack_arena_flags = 0;
+
+/* The max number of free stacks and hot stacks of each class, -1 is unlimited */
+static __thread int _st_stack_cache_max = -1;
+static __thread int _st_stack_cache_watermark = -1;
+
+/*
+ * The stack freed by the exiting thread, which is still running on it, so we
+ * cache it when the next stack is allocated or freed.
+ */
+static __thread _st_stack_t *_st_stack_pending = NULL;
+
+/*
+ * In copy-stack mode, the threads run on a few shared stacks. When another
+ * thread runs on the stack, the frames of owner are saved to heap, and copied
+ * back by the copier when the owner runs again. The copier runs on its own
+ * stack, because the frames are restored over the stack we might be on.
+ */
+typedef struct _st_shared_stack {
+    _st_stack_t *stack;         /* The stack which threads run on */
+    _st_thread_t *owner;        /* The thread whose frames are on the stack */
+} _st_shared_stack_t;
+
+#define _ST_COPIER_STACK_SIZE (4 * _ST_PAGE_SIZE)
+
+static __thread _st_shared_stack_t *_st_shared_stacks = NULL;
+static __thread int _st_nn_shared_stacks = 0;
+static __thread int _st_shared_stack_next = 0;
+static __thread int _st_nn_copy_threads = 0;
+static __thread _st_stack_t *_st_copier_stack = NULL;
+static __thread _st_thread_t _st_copier;
+static __thread _st_thread_t *_st_copier_next = NULL;
+
+static char *_st_new_stk_segment(size_t size);
+static void _st_delete_stk_segment(char *vaddr, int size);
+
+void _st_stack_init(void)
 {
-    _st_clist_t *qp;
-    _st_stack_t *ts;
-    int extra;
-    
-    for (qp = _st_free_stacks.next; qp != &_st_free_stacks; qp = qp->next) {
-        ts = _ST_THREAD_STACK_PTR(qp);
-        if (ts->stk_size >= stack_size) {
-            /* Found a stack that is big enough */
-            ST_REMOVE_LINK(&ts->links);
-            _st_num_free_stacks--;
-            ts->links.next = NULL;
-            ts->links.prev = NULL;
-            return ts;
-        }
+    int i;
+
+    for (i = 0; i < _ST_STACK_CLASSES; i++) {
+        ST_INIT_CLIST(&_st_stack_classes[i].hot);
+        ST_INIT_CLIST(&_st_stack_classes[i].cold);
+        ST_INIT_CLIST(&_st_stack_classes[i].slab);
+        _st_stack_classes[i].nn_hot = 0;
+        _st_stack_classes[i].nn_cold = 0;
+        _st_stack_classes[i].nn_slab = 0;
     }
-    
-    /* Make a new thread stack object. */
-    if ((ts = (_st_stack_t *)calloc(1, sizeof(_st_stack_t))) == NULL)
-        return NULL;
-    extra = _st_randomize_stacks ? _ST_PAGE_SIZE : 0;
-    ts->vaddr_size = stack_size + 2*REDZONE + extra;
-    ts->vaddr = _st_new_stk_segment(ts->vaddr_size);
-    if (!ts->vaddr) {
-        free(ts);
-        return NULL;
+    _st_num_free_stacks = 0;
+    _st_stack_pending = NULL;
+}
+
+/* The class of stack size, or -1 if too large */
+static int _st_stack_class(int stack_size)
+{
+    int shift = (stack_size <= (1 << _ST_STACK_MIN_SHIFT)) ? _ST_STACK_MIN_SHIFT :
+        32 - __builtin_clz((unsigned int) (stack_size - 1));
+
+    return (shift > _ST_STACK_MAX_SHIFT) ? -1 : shift - _ST_STACK_MIN_SHIFT;
+}
+
+static void _st_stack_dontneed(_st_stack_t *ts)
+{
+#if !defined(MALLOC_STACK) && defined(MADV_DONTNEED)
+    (void) madvise(ts->vaddr + REDZONE, ts->vaddr_size - 2*REDZONE, MADV_DONTNEED);
+#endif
+}
+
+static void _st_stack_destroy(_st_stack_t *ts)
+{
+    _st_stack_class_t *sc;
+
+    /* The stack in arena is never unmapped, but returned to arena without memory */
+    if (ts->slab) {
+        sc = &_st_stack_classes[_st_stack_class(ts->stk_size)];
+        _st_stack_dontneed(ts);
+        ST_INSERT_LINK(&ts->links, &sc->slab);
+        sc->nn_slab++;
+        return;
+    }
+
+    _st_delete_stk_segment(ts->vaddr, ts->vaddr_size);
+    free(ts);
+}
+
+/* Release the memory of the coldest hot stack of class */
+static void _st_stack_release(_st_stack_class_t *sc)
+{
+    _st_stack_t *ts = _ST_THREAD_STACK_PTR(sc->hot.prev);
+
+    ST_REMOVE_LINK(&ts->links);
+    sc->nn_hot--;
+
+    _st_stack_dontneed(ts);
+
+    ST_INSERT_LINK(&ts->links, &sc->cold);
+    sc->nn_cold++;
+}
+
+/* Cache the stack which is not used by any thread */
+static void _st_stack_cache(_st_stack_t *ts)
+{
+    _st_stack_class_t *sc = &_st_stack_classes[_st_stack_class(ts->stk_size)];
+
+    if (_st_stack_cache_max >= 0 && sc->nn_hot + sc->nn_cold >= _st_stack_cache_max) {
+        _st_stack_destroy(ts);
+        return;
     }
-    ts->stk_size = stack_size;
-    ts->stk_bottom = ts->vaddr + REDZONE;
-    ts->stk_top = ts->stk_bottom + stack_size;
 
+    ST_INSERT_LINK(&ts->links, &sc->hot);
+    sc->nn_hot++;
+    _st_num_free_stacks++;
+
+    while (_st_stack_cache_watermark >= 0 && sc->nn_hot > _st_stack_cache_watermark)
+        _st_stack_release(sc);
+}
+
+static void _st_stack_protect(_st_stack_t *ts)
+{
     /* For example, in OpenWRT, the memory at the begin minus 16B by mprotect is read-only. */
-#if defined(DEBUG) && !defined(MD_NO_PROTECT)
+#if !defined(MD_NO_PROTECT)
+    if (ts->guarded || !_st_stack_guard || ts->slab == _ST_SLAB_HUGETLB)
+        return;
+
     mprotect(ts->vaddr, REDZONE, PROT_NONE);
-    mprotect(ts->stk_top + extra, REDZONE, PROT_NONE);
+    mprotect(ts->vaddr + ts->vaddr_size - REDZONE, REDZONE, PROT_NONE);
+    ts->guarded = 1;
 #endif
-    
+}
+
+static void _st_stack_paint(_st_stack_t *ts)
+{
+    unsigned long *p;
+
+    ts->painted = _st_paint_stacks;
+    if (!_st_paint_stacks)
+        return;
+
+    for (p = (unsigned long *) ts->stk_bottom; p < (unsigned long *) ts->stk_top; p++)
+        *p = _ST_STACK_CANARY;
+}
+
+/* Setup the stack on the memory at vaddr, with a random offset if extra */
+static void _st_stack_setup(_st_stack_t *ts, char *vaddr, int stack_size, int extra)
+{
+    ts->vaddr_size = stack_size + 2*REDZONE + extra;
+    ts->vaddr = vaddr;
+    ts->stk_size = stack_size;
+    ts->stk_bottom = ts->vaddr + REDZONE;
+    ts->stk_top = ts->stk_bottom + stack_size;
+
+    _st_stack_protect(ts);
+
     if (extra) {
         long offset = (random() % extra) & ~0xf;
         
         ts->stk_bottom += offset;
         ts->stk_top += offset;
     }
+}
+
+/*
+ * Map an arena of nn stacks of class, by one mmap, and carve the stacks to the
+ * slab list of class. The stack objects are allocated together, and never freed.
+ */
+static int _st_stack_arena_new(int cls, int nn)
+{
+    _st_stack_class_t *sc = &_st_stack_classes[cls];
+    int stack_size = 1 << (cls + _ST_STACK_MIN_SHIFT);
+    int extra = _st_randomize_stacks ? _ST_PAGE_SIZE : 0;
+    size_t slot = stack_size + 2*REDZONE + extra;
+    size_t size = slot * nn;
+    int slab = _ST_SLAB_PAGE;
+    _st_stack_t *stacks;
+    char *vaddr = NULL;
+    int i;
+
+    if ((stacks = (_st_stack_t *)calloc(nn, sizeof(_st_stack_t))) == NULL)
+        return -1;
+
+#if !defined(MALLOC_STACK) && defined(MD_USE_BSD_ANON_MMAP) && defined(MAP_HUGETLB)
+    /* Fallback to normal pages if no huge pages reserved */
+    if (_st_stack_arena_flags & ST_STACK_HUGETLB) {
+        size_t hsize = (size + _ST_HUGE_PAGE_SIZE - 1) & ~((size_t)_ST_HUGE_PAGE_SIZE - 1);
+        vaddr = mmap(NULL, hsize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON | MAP_HUGETLB, -1, 0);
+        if (vaddr == (void *)MAP_FAILED)
+            vaddr = NULL;
+        else
+            slab = _ST_SLAB_HUGETLB;
+    }
+#endif
+
+    if (!vaddr && (vaddr = _st_new_stk_segment(size)) == NULL) {
+        free(stacks);
+        return -1;
+    }
+
+#if !defined(MALLOC_STACK) && defined(MADV_HUGEPAGE)
+    if (slab == _ST_SLAB_PAGE && (_st_stack_arena_flags & ST_STACK_HUGEPAGE))
+        (void) madvise(vaddr, size, MADV_HUGEPAGE);
+#endif
+
+    for (i = 0; i < nn; i++) {
+        _st_stack_t *ts = &stacks[i];
+        ts->slab = slab;
+        _st_stack_setup(ts, vaddr + slot * i, stack_size, extra);
+        ST_APPEND_LINK(&ts->links, &sc->slab);
+        sc->nn_slab++;
+    }
+
+    return 0;
+}
+
+/* Allocate the private memory of thread to run on the shared stack */
+static _st_stack_t *_st_stack_new_shared(void)
+{
+    _st_shared_stack_t *ss = &_st_shared_stacks[_st_shared_stack_next];
+    int size = sizeof(_st_thread_t) + ST_KEYS_MAX * sizeof(void *);
+    _st_stack_t *ts;
+
+    /* The thread object and per-thread data are allocated off the private memory */
+    if ((ts = (_st_stack_t *)calloc(1, sizeof(_st_stack_t) + size)) == NULL)
+        return NULL;
+    ts->vaddr = (char *) (ts + 1);
+    ts->vaddr_size = size;
+    ts->stk_size = ss->stack->stk_size;
+    ts->stk_bottom = ss->stack->stk_bottom;
+    ts->stk_top = ss->stack->stk_top;
+    ts->shared = ss;
+
+    _st_shared_stack_next = (_st_shared_stack_next + 1) % _st_nn_shared_stacks;
+    _st_nn_copy_threads++;
+    return ts;
+}
+
+static void _st_stack_destroy_shared(_st_stack_t *ts)
+{
+    free(ts->save_buf);
+    free(ts);
+    _st_nn_copy_threads--;
+}
+
+static void _st_stack_flush_pending(void)
+{
+    if (_st_stack_pending) {
+        if (_st_stack_pending->shared)
+            _st_stack_destroy_shared(_st_stack_pending);
+        else
+            _st_stack_cache(_st_stack_pending);
+        _st_stack_pending = NULL;
+    }
+}
+
+_st_stack_t *_st_stack_new(int stack_size)
+{
+    _st_stack_class_t *sc;
+    _st_stack_t *ts;
+    char *vaddr;
+    int extra, cls;
+
+    if ((cls = _st_stack_class(stack_size)) < 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    stack_size = 1 << (cls + _ST_STACK_MIN_SHIFT);
+
+    _st_stack_flush_pending();
+
+    /* Run on the shared stack, except the idle thread which switches to others */
+    if (_st_nn_shared_stacks && _st_this_vp.idle_thread && stack_size <= _st_shared_stacks[0].stack->stk_size)
+        return _st_stack_new_shared();
+
+    /* Reuse the hot stack first, then the cold one */
+    sc = &_st_stack_classes[cls];
+    if (sc->nn_hot || sc->nn_cold) {
+        if (sc->nn_hot) {
+            ts = _ST_THREAD_STACK_PTR(sc->hot.next);
+            sc->nn_hot--;
+        } else {
+            ts = _ST_THREAD_STACK_PTR(sc->cold.next);
+            sc->nn_cold--;
+        }
+        ST_REMOVE_LINK(&ts->links);
+        _st_num_free_stacks--;
+        ts->links.next = NULL;
+        ts->links.prev = NULL;
+        _st_stack_protect(ts);
+        _st_stack_paint(ts);
+        return ts;
+    }
+
+    /* Carve from the arena, map a new one if empty */
+    if (sc->nn_slab || (_st_stack_arena_nn > 0 && _st_stack_arena_new(cls, _st_stack_arena_nn) == 0)) {
+        ts = _ST_THREAD_STACK_PTR(sc->slab.next);
+        ST_REMOVE_LINK(&ts->links);
+        sc->nn_slab--;
+        ts->links.next = NULL;
+        ts->links.prev = NULL;
+        _st_stack_protect(ts);
+        _st_stack_paint(ts);
+        return ts;
+    }
     
+    /* Make a new thread stack object. */
+    if ((ts = (_st_stack_t *)calloc(1, sizeof(_st_stack_t))) == NULL)
+        return NULL;
+    extra = _st_randomize_stacks ? _ST_PAGE_SIZE : 0;
+    if ((vaddr = _st_new_stk_segment(stack_size + 2*REDZONE + extra)) == NULL) {
+        free(ts);
+        return NULL;
+    }
+    _st_stack_setup(ts, vaddr, stack_size, extra);
+
+    _st_stack_paint(ts);
     return ts;
 }
 
@@ -114,14 +424,208 @@ void _st_stack_free(_st_stack_t *ts)
 {
     if (!ts)
         return;
+
+    /* The frames of exited thread on the shared stack are never restored */
+    if (ts->shared && ts->shared->owner && ts->shared->owner->stack == ts)
+        ts->shared->owner = NULL;
     
-    /* Put the stack on the free list */
-    ST_APPEND_LINK(&ts->links, _st_free_stacks.prev);
-    _st_num_free_stacks++;
+    /* The stack of previous exited thread is not used now */
+    _st_stack_flush_pending();
+    _st_stack_pending = ts;
+}
+
+
+/* Save the frames of thread, from its sp to the top of shared stack */
+static void _st_stack_save(_st_thread_t *thread)
+{
+    _st_stack_t *ts = thread->stack;
+    char *sp = (char *) MD_GET_SP(thread);
+    int size = (int) (ts->stk_top - sp);
+    int cap = (size | 0xff) + 1;
+    char *buf;
+
+    /* Fit the buffer to the frames, grow it or shrink it if mostly unused */
+    if (cap > ts->save_cap || cap * 4 <= ts->save_cap) {
+        /* The thread is lost without its frames, and we can't fail the switch */
+        if ((buf = (char *) realloc(ts->save_buf, cap)) == NULL)
+            abort();
+        ts->save_buf = buf;
+        ts->save_cap = cap;
+    }
+
+    memcpy(ts->save_buf, sp, size);
+    ts->save_size = size;
+}
+
+
+/* Copy back the frames of thread on the stack of copier, then resume it */
+static void _st_stack_copier_main(void)
+{
+    _st_thread_t *thread = _st_copier_next;
+    _st_stack_t *ts = thread->stack;
+
+    memcpy(ts->stk_top - ts->save_size, ts->save_buf, ts->save_size);
+    _ST_RESTORE_CONTEXT(thread);
+}
+
+
+/*
+ * Give the shared stack to thread before restoring its context, the frames of
+ * current owner are saved, which is safe even we are running on its frames.
+ */
+void _st_stack_switch_in(_st_thread_t *thread)
+{
+    _st_shared_stack_t *ss = thread->stack->shared;
+
+    if (ss->owner == thread)
+        return;
+
+    if (ss->owner)
+        _st_stack_save(ss->owner);
+    ss->owner = thread;
+
+    /* Not going to return if the frames are copied back */
+    if (thread->stack->save_size) {
+        _st_copier_next = thread;
+        MD_LONGJMP(_st_copier.context, 1);
+    }
+}
+
+
+static int _st_stack_copier_init(void)
+{
+    char *sp;
+
+    if (_st_copier_stack)
+        return 0;
+    if ((_st_copier_stack = _st_stack_new(_ST_COPIER_STACK_SIZE)) == NULL)
+        return -1;
+
+    sp = _st_copier_stack->stk_top;
+    sp = sp - ((unsigned long)sp & 0x3f) - _ST_STACK_PAD_SIZE;
+    _ST_INIT_CONTEXT(&_st_copier, sp, _st_stack_copier_main);
+    return 0;
+}
+
+
+/*
+ * Run the threads created later on nn shared stacks of stack_size, assigned by
+ * round robin, and the stack is copied to heap when switched out, so an idle
+ * thread costs the used part of stack only. The threads which need a larger
+ * stack still run on their own stacks. Use 0 to disable it. It fails with
+ * EBUSY if any thread is still running on the shared stacks.
+ */
+int st_set_copy_stack(int nn, int stack_size)
+{
+    _st_shared_stack_t *stacks;
+    int i;
+
+    _st_stack_flush_pending();
+    if (_st_nn_copy_threads) {
+        errno = EBUSY;
+        return -1;
+    }
+
+    for (i = 0; i < _st_nn_shared_stacks; i++)
+        _st_stack_destroy(_st_shared_stacks[i].stack);
+    free(_st_shared_stacks);
+    _st_shared_stacks = NULL;
+    _st_nn_shared_stacks = 0;
+    _st_shared_stack_next = 0;
+
+    if (nn <= 0)
+        return 0;
+
+    if (stack_size <= 0)
+        stack_size = ST_DEFAULT_STACK_SIZE;
+    if ((stacks = (_st_shared_stack_t *)calloc(nn, sizeof(_st_shared_stack_t))) == NULL)
+        return -1;
+    for (i = 0; i < nn; i++) {
+        if ((stacks[i].stack = _st_stack_new(stack_size)) == NULL)
+            break;
+    }
+
+    if (i < nn || _st_stack_copier_init() < 0) {
+        while (--i >= 0)
+            _st_stack_destroy(stacks[i].stack);
+        free(stacks);
+        return -1;
+    }
+
+    _st_shared_stacks = stacks;
+    _st_nn_shared_stacks = nn;
+    return 0;
+}
+
+
+/*
+ * Carve the stacks from arenas of nn stacks, each arena is mapped by one mmap
+ * when the free stacks of a size class run out, with the huge pages by flags.
+ * Use 0 to mmap each stack, which is the default.
+ */
+int st_set_stack_arena(int nn, int flags)
+{
+    _st_stack_arena_nn = nn;
+    _st_stack_arena_flags = flags;
+    return 0;
+}
+
+
+/*
+ * Map an arena of nn stacks of stack_size now, so the threads created later
+ * never call mmap, even when the arena is disabled. It must be after st_init.
+ */
+int st_prealloc_stacks(int nn, int stack_size)
+{
+    int cls;
+
+    if (stack_size == 0)
+        stack_size = ST_DEFAULT_STACK_SIZE;
+    stack_size = ((stack_size + _ST_PAGE_SIZE - 1) / _ST_PAGE_SIZE) * _ST_PAGE_SIZE;
+
+    if (nn <= 0 || (cls = _st_stack_class(stack_size)) < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return _st_stack_arena_new(cls, nn);
+}
+
+
+/*
+ * Set the max number of free stacks cached for each size class, the stacks
+ * beyond it are unmapped, and the watermark of free stacks which keep their
+ * memory, the memory of others is released to OS. Use -1 for unlimited.
+ */
+int st_set_stack_cache(int max, int watermark)
+{
+    int i;
+
+    _st_stack_cache_max = max;
+    _st_stack_cache_watermark = watermark;
+
+    /* Apply to the cached stacks */
+    for (i = 0; i < _ST_STACK_CLASSES; i++) {
+        _st_stack_class_t *sc = &_st_stack_classes[i];
+        while (max >= 0 && sc->nn_hot + sc->nn_cold > max) {
+            _st_clist_t *qp = sc->nn_cold ? sc->cold.prev : sc->hot.prev;
+            if (sc->nn_cold)
+                sc->nn_cold--;
+            else
+                sc->nn_hot--;
+            ST_REMOVE_LINK(qp);
+            _st_num_free_stacks--;
+            _st_stack_destroy(_ST_THREAD_STACK_PTR(qp));
+        }
+        while (watermark >= 0 && sc->nn_hot > watermark)
+            _st_stack_release(sc);
+    }
+
+    return 0;
 }
 
 
-static char *_st_new_stk_segment(int size)
+static char *_st_new_stk_segment(size_t size)
 {
 #ifdef MALLOC_STACK
     void *vaddr = malloc(size);
@@ -152,9 +656,7 @@ static char *_st_new_stk_segment(int size)
 }
 
 
-/* Not used */
-#if 0
-void _st_delete_stk_segment(char *vaddr, int size)
+static void _st_delete_stk_segment(char *vaddr, int size)
 {
 #ifdef MALLOC_STACK
     free(vaddr);
@@ -162,7 +664,81 @@ void _st_delete_stk_segment(char *vaddr, int size)
     (void) munmap(vaddr, size);
 #endif
 }
-#endif
+
+/*
+ * Protect the redzones of new stacks by PROT_NONE, so the overflow of stack
+ * faults at once instead of corrupting the memory of others. It's always on
+ * for DEBUG. See st_stack_guard_fault to find the thread which overflows.
+ */
+int st_set_stack_guard(int on)
+{
+    int wason = _st_stack_guard;
+
+    _st_stack_guard = on;
+    return wason;
+}
+
+
+/*
+ * Get the current thread if addr is in the redzones of its stack, for the
+ * signal handler of SIGSEGV to identify the overflow, or NULL if not.
+ */
+_st_thread_t *st_stack_guard_fault(void *addr)
+{
+    _st_thread_t *thread = _ST_CURRENT_THREAD();
+    _st_stack_t *ts = thread ? thread->stack : NULL;
+    char *p = (char *) addr;
+
+    /* The thread in copy-stack mode overflows the shared stack */
+    if (ts && ts->shared)
+        ts = ts->shared->stack;
+
+    if (!ts || !ts->guarded || p < ts->vaddr || p >= ts->vaddr + ts->vaddr_size)
+        return NULL;
+
+    if (p < ts->vaddr + REDZONE || p >= ts->vaddr + ts->vaddr_size - REDZONE)
+        return thread;
+    return NULL;
+}
+
+
+/*
+ * Paint the new stacks by canary, which touches all pages of stack, so only
+ * for diagnosis, to find the deepest usage of stack by st_thread_stack_usage.
+ */
+int st_paint_stacks(int on)
+{
+    int wason = _st_paint_stacks;
+
+    _st_paint_stacks = on;
+    return wason;
+}
+
+
+/*
+ * Get the deepest usage of stack in bytes, and the size of stack if not NULL,
+ * the stack must be painted, or return -1.
+ */
+int st_thread_stack_usage(_st_thread_t *thread, int *size)
+{
+    _st_stack_t *ts = thread->stack;
+    unsigned long *p;
+
+    if (!ts || !ts->painted) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (p = (unsigned long *) ts->stk_bottom; p < (unsigned long *) ts->stk_top; p++) {
+        if (*p != _ST_STACK_CANARY)
+            break;
+    }
+
+    if (size)
+        *size = ts->stk_size;
+    return (int) (ts->stk_top - (char *) p);
+}
+
 
 int st_randomize_stacks(int on)
 {
@@ -368,3 +368,318 @@ int st_mutex_trylock(_st_mutex_t *lock)
     return 0;
 }
 
+
+
+/*****************************************
+ * Functions of locks which hand over to waiters
+ */
+
+/* Wait on the queue until granted, or timeout or interrupted */
+static int _st_sync_wait(_st_clist_t *wait_q, st_utime_t timeout)
+{
+    _st_thread_t *me = _ST_CURRENT_THREAD();
+    
+    me->state = _ST_ST_LOCK_WAIT;
+    ST_APPEND_LINK(&me->wait_links, wait_q);
+    
+    if (timeout != ST_UTIME_NO_TIMEOUT)
+        _ST_ADD_SLEEPQ(me, timeout);
+    
+    _ST_SWITCH_CONTEXT(me);
+    
+    ST_REMOVE_LINK(&me->wait_links);
+    
+    /* Got it even interrupted, the interrupt is left for next blocking call */
+    if (me->flags & _ST_FL_GRANTED) {
+        me->flags &= ~_ST_FL_GRANTED;
+        return 0;
+    }
+    
+    if (me->flags & _ST_FL_INTERRUPT) {
+        me->flags &= ~_ST_FL_INTERRUPT;
+        errno = EINTR;
+    } else {
+        errno = ETIME;
+    }
+    
+    return -1;
+}
+
+
+/* Get the first thread which is still waiting on the queue */
+static _st_thread_t *_st_sync_waiter(_st_clist_t *wait_q)
+{
+    _st_thread_t *thread;
+    _st_clist_t *q;
+    
+    for (q = wait_q->next; q != wait_q; q = q->next) {
+        thread = _ST_THREAD_WAITQ_PTR(q);
+        if (thread->state == _ST_ST_LOCK_WAIT)
+            return thread;
+    }
+    
+    return NULL;
+}
+
+
+/* Hand over the lock to the waiting thread, and make it runnable */
+static void _st_sync_grant(_st_thread_t *thread)
+{
+    if (thread->flags & _ST_FL_ON_SLEEPQ)
+        _ST_DEL_SLEEPQ(thread);
+    
+    thread->flags |= _ST_FL_GRANTED;
+    thread->state = _ST_ST_RUNNABLE;
+    _ST_ADD_RUNQ(thread);
+}
+
+
+/*****************************************
+ * Reader-writer lock functions
+ */
+
+_st_rwlock_t *st_rwlock_new(void)
+{
+    _st_rwlock_t *lock;
+    
+    lock = (_st_rwlock_t *) calloc(1, sizeof(_st_rwlock_t));
+    if (lock) {
+        ST_INIT_CLIST(&lock->rwait_q);
+        ST_INIT_CLIST(&lock->wwait_q);
+    }
+    
+    return lock;
+}
+
+
+int st_rwlock_destroy(_st_rwlock_t *lock)
+{
+    if (lock->readers || lock->writer || lock->rwait_q.next != &lock->rwait_q || lock->wwait_q.next != &lock->wwait_q) {
+        errno = EBUSY;
+        return -1;
+    }
+    
+    free(lock);
+    
+    return 0;
+}
+
+
+/*
+ * Grant the lock to waiters if it's free. The waiting readers are woken together if
+ * readers_first or no writer is waiting, otherwise the first writer gets the lock.
+ */
+static void _st_rwlock_wakeup(_st_rwlock_t *lock, int readers_first)
+{
+    _st_thread_t *thread;
+    
+    if (lock->writer)
+        return;
+    
+    if (readers_first || !_st_sync_waiter(&lock->wwait_q)) {
+        while ((thread = _st_sync_waiter(&lock->rwait_q)) != NULL) {
+            lock->readers++;
+            _st_sync_grant(thread);
+        }
+    }
+    
+    if (!lock->readers && (thread = _st_sync_waiter(&lock->wwait_q)) != NULL) {
+        lock->writer = thread;
+        _st_sync_grant(thread);
+    }
+}
+
+
+int st_rwlock_rdlock(_st_rwlock_t *lock)
+{
+    _st_thread_t *me = _ST_CURRENT_THREAD();
+    
+    if (me->flags & _ST_FL_INTERRUPT) {
+        me->flags &= ~_ST_FL_INTERRUPT;
+        errno = EINTR;
+        return -1;
+    }
+    
+    if (st_rwlock_tryrdlock(lock) == 0)
+        return 0;
+    
+    if (lock->writer == me) {
+        errno = EDEADLK;
+        return -1;
+    }
+    
+    if (_st_sync_wait(&lock->rwait_q, ST_UTIME_NO_TIMEOUT) < 0) {
+        /* We might be the writer which blocks the readers */
+        _st_rwlock_wakeup(lock, 0);
+        return -1;
+    }
+    
+    return 0;
+}
+
+
+int st_rwlock_wrlock(_st_rwlock_t *lock)
+{
+    _st_thread_t *me = _ST_CURRENT_THREAD();
+    
+    if (me->flags & _ST_FL_INTERRUPT) {
+        me->flags &= ~_ST_FL_INTERRUPT;
+        errno = EINTR;
+        return -1;
+    }
+    
+    if (st_rwlock_trywrlock(lock) == 0)
+        return 0;
+    
+    if (lock->writer == me) {
+        errno = EDEADLK;
+        return -1;
+    }
+    
+    if (_st_sync_wait(&lock->wwait_q, ST_UTIME_NO_TIMEOUT) < 0) {
+        _st_rwlock_wakeup(lock, 0);
+        return -1;
+    }
+    
+    return 0;
+}
+
+
+int st_rwlock_tryrdlock(_st_rwlock_t *lock)
+{
+    /* Never starve the waiting writers */
+    if (lock->writer || _st_sync_waiter(&lock->wwait_q)) {
+        errno = EBUSY;
+        return -1;
+    }
+    
+    lock->readers++;
+    
+    return 0;
+}
+
+
+int st_rwlock_trywrlock(_st_rwlock_t *lock)
+{
+    if (lock->writer || lock->readers) {
+        errno = EBUSY;
+        return -1;
+    }
+    
+    lock->writer = _ST_CURRENT_THREAD();
+    
+    return 0;
+}
+
+
+int st_rwlock_unlock(_st_rwlock_t *lock)
+{
+    if (lock->writer) {
+        if (lock->writer != _ST_CURRENT_THREAD()) {
+            errno = EPERM;
+            return -1;
+        }
+        
+        lock->writer = NULL;
+        _st_rwlock_wakeup(lock, 1);
+        return 0;
+    }
+    
+    if (!lock->readers) {
+        errno = EPERM;
+        return -1;
+    }
+    
+    if (--lock->readers == 0)
+        _st_rwlock_wakeup(lock, 0);
+    
+    return 0;
+}
+
+
+/*****************************************
+ * Semaphore functions
+ */
+
+_st_sema_t *st_sema_new(int value)
+{
+    _st_sema_t *sema;
+    
+    if (value < 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    
+    sema = (_st_sema_t *) calloc(1, sizeof(_st_sema_t));
+    if (sema) {
+        ST_INIT_CLIST(&sema->wait_q);
+        sema->value = value;
+    }
+    
+    return sema;
+}
+
+
+int st_sema_destroy(_st_sema_t *sema)
+{
+    if (sema->wait_q.next != &sema->wait_q) {
+        errno = EBUSY;
+        return -1;
+    }
+    
+    free(sema);
+    
+    return 0;
+}
+
+
+int st_sema_acquire(_st_sema_t *sema, st_utime_t timeout)
+{
+    _st_thread_t *me = _ST_CURRENT_THREAD();
+    
+    if (me->flags & _ST_FL_INTERRUPT) {
+        me->flags &= ~_ST_FL_INTERRUPT;
+        errno = EINTR;
+        return -1;
+    }
+    
+    if (st_sema_tryacquire(sema) == 0)
+        return 0;
+    
+    if (timeout == ST_UTIME_NO_WAIT) {
+        errno = ETIME;
+        return -1;
+    }
+    
+    return _st_sync_wait(&sema->wait_q, timeout);
+}
+
+
+int st_sema_tryacquire(_st_sema_t *sema)
+{
+    /* Never overtake the waiters */
+    if (sema->value <= 0 || _st_sync_waiter(&sema->wait_q)) {
+        errno = EBUSY;
+        return -1;
+    }
+    
+    sema->value--;
+    
+    return 0;
+}
+
+
+int st_sema_release(_st_sema_t *sema)
+{
+    _st_thread_t *thread;
+    
+    /* Hand over the permit to the first waiter */
+    if ((thread = _st_sync_waiter(&sema->wait_q)) != NULL) {
+        _st_sync_grant(thread);
+        return 0;
+    }
+    
+    sema->value++;
+    
+    return 0;
+}
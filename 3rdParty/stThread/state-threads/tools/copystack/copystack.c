@@ -0,0 +1,160 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2013-2022 Winlin */
+
+/*
+ * Benchmark the private stacks and the copy-stack mode of ST, to show the memory
+ * of each idle coroutine, and the cost of each switch:
+ *      ./copystack             # Run both private and copy, for 10k, 100k and 1M coroutines.
+ *      ./copystack copy 1000000  # Run copy-stack only, for 1M coroutines.
+ *      ./copystack private 10000 4096  # Run private stacks only, each uses 4KB stack.
+ * The coroutines of private stacks might fail to be created for the limit of mmap,
+ * see /proc/sys/vm/max_map_count.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <alloca.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <st.h>
+
+#define NN_SHARED_STACKS 4
+#define NN_SWITCHERS 64
+#define NN_SWITCHES 100000
+
+static int depth = 1024;
+static st_cond_t quit;
+
+static st_utime_t real_utime(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (st_utime_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Get the virtual memory and resident memory in pages */
+static void statm_pages(long *size, long *rss)
+{
+    FILE *f = fopen("/proc/self/statm", "r");
+    *size = *rss = 0;
+    if (f) {
+        if (fscanf(f, "%ld %ld", size, rss) != 2)
+            *size = *rss = 0;
+        fclose(f);
+    }
+}
+
+/* The idle coroutine, like a session which keeps some state on its stack */
+static void *idle_start(void *arg)
+{
+    char *state = (char *)alloca(depth);
+    memset(state, 0, depth);
+
+    st_cond_wait(quit);
+    return (void *)(long)state[0];
+}
+
+static void *switch_start(void *arg)
+{
+    char *state = (char *)alloca(depth);
+    int i;
+
+    memset(state, 0, depth);
+    for (i = 0; i < NN_SWITCHES / NN_SWITCHERS; i++) {
+        st_thread_yield();
+    }
+    return (void *)(long)state[0];
+}
+
+static int bench(int copy, int nn)
+{
+    st_thread_t *trds, switchers[NN_SWITCHERS];
+    st_utime_t starttime, cost;
+    long vsz0, vsz1, rss0, rss1;
+    int i;
+
+    if (st_init() < 0) {
+        return -1;
+    }
+
+    /* Measure the memory used by stack only, the redzones split the mappings */
+    st_set_stack_guard(0);
+    if (copy && st_set_copy_stack(NN_SHARED_STACKS, 0) < 0) {
+        return -1;
+    }
+
+    if ((trds = (st_thread_t *)calloc(nn, sizeof(st_thread_t))) == NULL) {
+        return -1;
+    }
+    quit = st_cond_new();
+
+    /* The memory of idle coroutines, after they all run and wait */
+    statm_pages(&vsz0, &rss0);
+    for (i = 0; i < nn; i++) {
+        if ((trds[i] = st_thread_create(idle_start, NULL, 1, 0)) == NULL) {
+            printf("%-7s nn=%d, create coroutine #%d failed\n", copy? "copy" : "private", nn, i);
+            nn = i;
+            break;
+        }
+    }
+    st_usleep(0);
+    statm_pages(&vsz1, &rss1);
+
+    /* The cost of switches, when the idle coroutines are still alive */
+    starttime = real_utime();
+    for (i = 0; i < NN_SWITCHERS; i++) {
+        switchers[i] = st_thread_create(switch_start, NULL, 1, 0);
+    }
+    for (i = 0; i < NN_SWITCHERS; i++) {
+        st_thread_join(switchers[i], NULL);
+    }
+    cost = real_utime() - starttime;
+
+    printf("%-7s nn=%d, depth=%d, memory=%ldB/coroutine, virtual=%ldB/coroutine, switch=%dns\n",
+        copy? "copy" : "private", nn, depth, nn? (rss1 - rss0) * getpagesize() / nn : 0,
+        nn? (vsz1 - vsz0) * getpagesize() / nn : 0, (int)(cost * 1000 / NN_SWITCHES));
+
+    st_cond_broadcast(quit);
+    for (i = 0; i < nn; i++) {
+        st_thread_join(trds[i], NULL);
+    }
+    free(trds);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    int i, j, r0 = 0, wstatus;
+    int copies[] = {0, 1};
+    int nns[] = {10000, 100000, 1000000};
+    int nn = argc > 2? atoi(argv[2]) : 0;
+
+    depth = argc > 3? atoi(argv[3]) : depth;
+
+    for (i = 0; i < (int)(sizeof(copies) / sizeof(copies[0])); i++) {
+        if (argc > 1 && strcmp(argv[1], copies[i]? "copy" : "private")) {
+            continue;
+        }
+
+        for (j = 0; j < (int)(sizeof(nns) / sizeof(nns[0])); j++) {
+            if (nn && nns[j] != nn) {
+                continue;
+            }
+
+            /* Each benchmark in a child process, to measure the memory from the same start */
+            pid_t pid = fork();
+            if (pid == 0) {
+                exit(bench(copies[i], nns[j]) == 0? 0 : 1);
+            }
+            if (pid == -1 || waitpid(pid, &wstatus, 0) == -1 || !WIFEXITED(wstatus) || WEXITSTATUS(wstatus)) {
+                r0 = -1;
+            }
+        }
+    }
+
+    return r0;
+}
@@ -0,0 +1,222 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2013-2022 Winlin */
+
+/*
+ * Benchmark the event system(select, epoll or io_uring), to show the cost of dispatch
+ * when there are lots of idle descriptors and some active ones, for example:
+ *      ./eventsys              # Run all event systems, each in a child process.
+ *      ./eventsys epoll 10000  # Run epoll only, for 10000 rounds.
+ *      ./eventsys epoll 10000 1  # Only one active socket, the cost of a single wakeup.
+ * Each round sends one UDP packet to each active socket, then waits for all
+ * the active coroutines to receive it, while the idle coroutines are blocked
+ * on sockets which never receive anything.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <st.h>
+
+#define STACK_SIZE (64 * 1024)
+
+static int nn_active = 100;
+static int nn_received = 0;
+static st_cond_t received;
+
+static int udp_socket(struct sockaddr_in *addr)
+{
+    int fd;
+    socklen_t len = sizeof(*addr);
+
+    if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) == -1) {
+        return -1;
+    }
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = inet_addr("127.0.0.1");
+    if (bind(fd, (struct sockaddr *)addr, sizeof(*addr)) == -1 || getsockname(fd, (struct sockaddr *)addr, &len) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static void *idle_reader(void *arg)
+{
+    char buf[16];
+    st_netfd_t stfd = (st_netfd_t)arg;
+    st_recvfrom(stfd, buf, sizeof(buf), NULL, NULL, ST_UTIME_NO_TIMEOUT);
+    return NULL;
+}
+
+static void *active_reader(void *arg)
+{
+    char buf[16];
+    st_netfd_t stfd = (st_netfd_t)arg;
+
+    while (st_recvfrom(stfd, buf, sizeof(buf), NULL, NULL, ST_UTIME_NO_TIMEOUT) > 0) {
+        if (++nn_received == nn_active) {
+            st_cond_signal(received);
+        }
+    }
+    return NULL;
+}
+
+static st_netfd_t open_reader(struct sockaddr_in *addr, void *(*reader)(void *), st_thread_t *trd)
+{
+    int fd;
+    st_netfd_t stfd;
+
+    if ((fd = udp_socket(addr)) == -1) {
+        return NULL;
+    }
+    if ((stfd = st_netfd_open_socket(fd)) == NULL) {
+        close(fd);
+        return NULL;
+    }
+    if ((*trd = st_thread_create(reader, stfd, 1, STACK_SIZE)) == NULL) {
+        st_netfd_close(stfd);
+        return NULL;
+    }
+
+    return stfd;
+}
+
+static void close_reader(st_netfd_t stfd, st_thread_t trd)
+{
+    st_thread_interrupt(trd);
+    st_thread_join(trd, NULL);
+    st_netfd_close(stfd);
+}
+
+static int run(int nn_idle, int rounds, int sender, struct sockaddr_in *active_addrs)
+{
+    int i, r, nn = 0;
+    st_utime_t starttime, elapsed;
+    struct sockaddr_in addr;
+    st_netfd_t *idle_fds = (st_netfd_t *)calloc(nn_idle, sizeof(st_netfd_t));
+    st_thread_t *idle_trds = (st_thread_t *)calloc(nn_idle, sizeof(st_thread_t));
+
+    for (nn = 0; nn < nn_idle; nn++) {
+        if ((idle_fds[nn] = open_reader(&addr, idle_reader, &idle_trds[nn])) == NULL) {
+            break;
+        }
+    }
+
+    /* Let all idle coroutines block in the event system. */
+    st_usleep(0);
+
+    if (nn < nn_idle) {
+        printf("%-8s idle=%-6d skipped, open #%d failed, errno=%d(%s), fdlimit=%d\n",
+            st_get_eventsys_name(), nn_idle, nn, errno, strerror(errno), st_getfdlimit());
+    } else {
+        starttime = st_utime();
+        for (r = 0; r < rounds; r++) {
+            nn_received = 0;
+            for (i = 0; i < nn_active; i++) {
+                sendto(sender, "x", 1, 0, (struct sockaddr *)&active_addrs[i], sizeof(active_addrs[i]));
+            }
+            while (nn_received < nn_active) {
+                st_cond_wait(received);
+            }
+        }
+        elapsed = st_utime() - starttime;
+
+        printf("%-8s idle=%-6d active=%d rounds=%d, %.2fus/round, %.0fns/wakeup\n",
+            st_get_eventsys_name(), nn_idle, nn_active, rounds,
+            (double)elapsed / rounds, (double)elapsed * 1000 / rounds / nn_active);
+    }
+
+    for (i = 0; i < nn; i++) {
+        close_reader(idle_fds[i], idle_trds[i]);
+    }
+    free(idle_fds);
+    free(idle_trds);
+
+    return 0;
+}
+
+static int bench(int eventsys, int rounds)
+{
+    int i, sender;
+    struct sockaddr_in addr;
+    struct sockaddr_in *active_addrs = (struct sockaddr_in *)calloc(nn_active, sizeof(struct sockaddr_in));
+    st_netfd_t *active_fds = (st_netfd_t *)calloc(nn_active, sizeof(st_netfd_t));
+    st_thread_t *active_trds = (st_thread_t *)calloc(nn_active, sizeof(st_thread_t));
+
+    if (st_set_eventsys(eventsys) == -1) {
+        printf("set eventsys %d failed, errno=%d(%s)\n", eventsys, errno, strerror(errno));
+        return -1;
+    }
+    if (st_init() == -1) {
+        printf("st_init failed, errno=%d(%s)\n", errno, strerror(errno));
+        return -1;
+    }
+
+    received = st_cond_new();
+    if ((sender = udp_socket(&addr)) == -1) {
+        printf("create sender failed, errno=%d(%s)\n", errno, strerror(errno));
+        return -1;
+    }
+    for (i = 0; i < nn_active; i++) {
+        if ((active_fds[i] = open_reader(&active_addrs[i], active_reader, &active_trds[i])) == NULL) {
+            printf("create active #%d failed, errno=%d(%s)\n", i, errno, strerror(errno));
+            return -1;
+        }
+    }
+
+    run(100, rounds, sender, active_addrs);
+    run(1000, rounds, sender, active_addrs);
+    run(10000, rounds, sender, active_addrs);
+
+    for (i = 0; i < nn_active; i++) {
+        close_reader(active_fds[i], active_trds[i]);
+    }
+    close(sender);
+    st_cond_destroy(received);
+    free(active_addrs);
+    free(active_fds);
+    free(active_trds);
+
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    int i, status;
+    int rounds = (argc > 2) ? atoi(argv[2]) : 1000;
+    int eventsyses[] = {ST_EVENTSYS_SELECT, ST_EVENTSYS_ALT, ST_EVENTSYS_IOURING};
+    const char *names[] = {"select", "epoll", "io_uring"};
+
+    if (argc > 3) {
+        nn_active = atoi(argv[3]);
+    }
+
+    for (i = 0; i < (int)(sizeof(eventsyses) / sizeof(eventsyses[0])); i++) {
+        if (argc > 1 && strcmp(argv[1], names[i]) != 0) {
+            continue;
+        }
+
+        /* The event system can only be set once, so run each one in a child process. */
+        pid_t pid = fork();
+        if (pid == 0) {
+            exit(bench(eventsyses[i], rounds) == 0 ? 0 : 1);
+        }
+        if (pid == -1 || waitpid(pid, &status, 0) == -1) {
+            printf("run %s failed, errno=%d(%s)\n", names[i], errno, strerror(errno));
+            return -1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,97 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2013-2022 Winlin */
+
+/*
+ * Benchmark the context switch of ST, by two coroutines which ping-pong each other,
+ * and report the cost of each switch:
+ *      ./switch                # Run both yield and cond, for 10M switches.
+ *      ./switch yield 1000000  # Ping-pong by st_thread_yield only, for 1M switches.
+ *      ./switch cond           # Ping-pong by st_cond_signal and st_cond_wait only.
+ * The setjmp/longjmp switch is used by default, to compare with the one call switch, build libst.a by:
+ *      make linux-optimized EXTRA_CFLAGS=-DMD_HAVE_SWITCH
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <st.h>
+
+static int nn_switches = 10000000;
+
+static st_cond_t conds[2];
+
+static st_utime_t real_utime(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (st_utime_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Each yield switches to the other coroutine */
+static void *yield_start(void *arg)
+{
+    int i;
+
+    for (i = 0; i < nn_switches / 2; i++) {
+        st_thread_yield();
+    }
+    return NULL;
+}
+
+/* Signal the other coroutine then wait for it, each wait switches to the other */
+static void *cond_start(void *arg)
+{
+    int id = (int)(long)arg;
+    int i;
+
+    for (i = 0; i < nn_switches / 2; i++) {
+        st_cond_signal(conds[1 - id]);
+        st_cond_wait(conds[id]);
+    }
+    st_cond_signal(conds[1 - id]);
+    return NULL;
+}
+
+static void bench(const char *name, void *(*start)(void *arg))
+{
+    st_thread_t trds[2];
+    st_utime_t starttime, cost;
+    int i;
+
+    starttime = real_utime();
+    for (i = 0; i < 2; i++) {
+        trds[i] = st_thread_create(start, (void *)(long)i, 1, 0);
+    }
+    for (i = 0; i < 2; i++) {
+        st_thread_join(trds[i], NULL);
+    }
+    cost = real_utime() - starttime;
+
+    printf("%-5s switches=%d, cost=%dms, switch=%.1fns\n", name, nn_switches, (int)(cost / 1000),
+        (double)cost * 1000 / nn_switches);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 2) {
+        nn_switches = atoi(argv[2]);
+    }
+
+    if (st_init() < 0) {
+        return -1;
+    }
+
+    conds[0] = st_cond_new();
+    conds[1] = st_cond_new();
+
+    if (argc <= 1 || !strcmp(argv[1], "yield")) {
+        bench("yield", yield_start);
+    }
+    if (argc <= 1 || !strcmp(argv[1], "cond")) {
+        bench("cond", cond_start);
+    }
+
+    return 0;
+}
@@ -0,0 +1,163 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2013-2022 Winlin */
+
+/*
+ * Benchmark the sleep queue of ST, the timeout heap and the timing wheel, to show
+ * the cost of adding, renewing, deleting and expiring the sleeping threads, which
+ * is what a server with lots of connections does for each read or write timeout:
+ *      ./timer             # Run both heap and wheel, for 10k, 100k and 1M threads.
+ *      ./timer wheel 1000000  # Run wheel only, for 1M threads.
+ *      ./timer heap 100000 10000  # Run heap only, with 10ms timer slack.
+ * The threads are not real coroutines, only the sleep queue is exercised by a fake
+ * clock, so it requires the internal headers and the same defines as libst.a.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "../../common.h"
+
+#define WHEEL_TICK 1000
+#define MAX_TIMEOUT (30 * 1000 * 1000)
+
+static st_utime_t fake_clock = 0;
+static st_utime_t slack = 0;
+
+static st_utime_t fake_utime(void)
+{
+    return fake_clock;
+}
+
+static st_utime_t real_utime(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (st_utime_t)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static st_utime_t random_timeout(void)
+{
+    return 1000 * 1000 + (st_utime_t)(random() % (MAX_TIMEOUT - 1000 * 1000));
+}
+
+static int bench(int wheel, int nn)
+{
+    int i, j, expired = 0, late = 0, wakeups = 0;
+    unsigned long long coalesced = 0;
+    st_utime_t starttime, elapsed, timeout, max_late = 0;
+    _st_thread_t *thread, *threads;
+
+    st_set_utime_function(fake_utime);
+    if (wheel && st_set_timer_wheel(WHEEL_TICK) == -1) {
+        printf("set timer wheel failed, errno=%d(%s)\n", errno, strerror(errno));
+        return -1;
+    }
+    if (st_init() == -1) {
+        printf("st_init failed, errno=%d(%s)\n", errno, strerror(errno));
+        return -1;
+    }
+    st_set_timer_slack(slack);
+
+    if ((threads = (_st_thread_t *)calloc(nn, sizeof(_st_thread_t))) == NULL) {
+        printf("alloc %d threads failed\n", nn);
+        return -1;
+    }
+
+    /* Add all threads to sleep queue */
+    srandom(0);
+    starttime = real_utime();
+    for (i = 0; i < nn; i++) {
+        _ST_ADD_SLEEPQ(&threads[i], random_timeout());
+    }
+    elapsed = real_utime() - starttime;
+    printf("%-5s threads=%-7d add    %.0fns/op\n", wheel? "wheel" : "heap", nn, (double)elapsed * 1000 / nn);
+
+    /* Renew the timeout of random threads, like a connection reads some data */
+    starttime = real_utime();
+    for (i = 0; i < nn; i++) {
+        thread = &threads[random() % nn];
+        _ST_DEL_SLEEPQ(thread);
+        _ST_ADD_SLEEPQ(thread, random_timeout());
+    }
+    elapsed = real_utime() - starttime;
+    printf("%-5s threads=%-7d renew  %.0fns/op\n", wheel? "wheel" : "heap", nn, (double)elapsed * 1000 / nn);
+
+    /* Expire all threads, advance the clock to the next timeout like the event system */
+    starttime = real_utime();
+    while (expired < nn) {
+        timeout = _st_vp_min_timeout();
+        fake_clock += timeout > 1000 ? timeout : 1000;
+        _st_vp_check_clock();
+        wakeups++;
+
+        while (_ST_RUNQ.next != &_ST_RUNQ) {
+            thread = _ST_THREAD_PTR(_ST_RUNQ.next);
+            _ST_DEL_RUNQ(thread);
+            if (thread->due_early > fake_clock)
+                late = -1;
+            if (late >= 0 && fake_clock - thread->due_early > max_late)
+                max_late = fake_clock - thread->due_early;
+            expired++;
+        }
+    }
+    elapsed = real_utime() - starttime;
+    st_timer_stats(NULL, &coalesced);
+    printf("%-5s threads=%-7d expire %.0fns/op, wakeups %d, coalesced %llu, max late %dus%s\n", wheel? "wheel" : "heap",
+        nn, (double)elapsed * 1000 / nn, wakeups, coalesced, (int)max_late, late < 0? ", EARLY WAKEUP" : "");
+
+    /* Add and delete all threads, like the IO is done before timeout */
+    for (j = 0; j < 2; j++) {
+        starttime = real_utime();
+        for (i = 0; i < nn; i++) {
+            _ST_ADD_SLEEPQ(&threads[i], random_timeout());
+        }
+        for (i = 0; i < nn; i++) {
+            _ST_DEL_SLEEPQ(&threads[j? nn - 1 - i : i]);
+        }
+        elapsed = real_utime() - starttime;
+        printf("%-5s threads=%-7d add+del(%s) %.0fns/op\n", wheel? "wheel" : "heap", nn,
+            j? "lifo" : "fifo", (double)elapsed * 1000 / nn);
+    }
+
+    free(threads);
+    return late;
+}
+
+int main(int argc, char** argv)
+{
+    int i, j, r0 = 0, wstatus;
+    int wheels[] = {0, 1};
+    int nns[] = {10000, 100000, 1000000};
+    int nn = argc > 2? atoi(argv[2]) : 0;
+
+    slack = argc > 3? atoi(argv[3]) : 0;
+
+    for (i = 0; i < (int)(sizeof(wheels) / sizeof(wheels[0])); i++) {
+        if (argc > 1 && strcmp(argv[1], wheels[i]? "wheel" : "heap")) {
+            continue;
+        }
+
+        for (j = 0; j < (int)(sizeof(nns) / sizeof(nns[0])); j++) {
+            if (nn && nns[j] != nn) {
+                continue;
+            }
+
+            /* Each benchmark in a child process, the sleep queue must be set before st_init */
+            pid_t pid = fork();
+            if (pid == 0) {
+                exit(bench(wheels[i], nns[j]) == 0? 0 : 1);
+            }
+            if (pid == -1 || waitpid(pid, &wstatus, 0) == -1 || !WIFEXITED(wstatus) || WEXITSTATUS(wstatus)) {
+                r0 = -1;
+            }
+        }
+    }
+
+    return r0;
+}
@@ -118,3 +118,170 @@ VOID TEST(CoroutineTest, StartCoroutineParams)
     EXPECT_EQ(110, r0);
 }
 
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// The utest for stat of coroutine, to find the coroutine which starves others.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#define ST_UTEST_HOG_US 20000
+
+struct CoroutineStat
+{
+    int nn_loops;
+    st_thread_stats_t stats;
+};
+
+void* coroutine_hog(void* arg)
+{
+    CoroutineStat* s = (CoroutineStat*)arg;
+
+    // Eat the CPU without switching, which delays the victim.
+    for (int i = 0; i < s->nn_loops; i++) {
+        st_utime_t starttime = st_utime();
+        while (st_utime() - starttime < ST_UTEST_HOG_US) {
+        }
+        st_thread_yield();
+    }
+
+    st_thread_stats(st_thread_self(), &s->stats);
+    return NULL;
+}
+
+void* coroutine_victim(void* arg)
+{
+    CoroutineStat* s = (CoroutineStat*)arg;
+
+    for (int i = 0; i < s->nn_loops; i++) {
+        st_thread_yield();
+    }
+
+    st_thread_stats(st_thread_self(), &s->stats);
+    return NULL;
+}
+
+VOID TEST(CoroutineTest, ThreadStats)
+{
+    st_thread_stats_t stats;
+    EXPECT_EQ(-1, st_thread_stats(st_thread_self(), &stats));
+    EXPECT_EQ(0, st_set_thread_stats(1));
+
+    CoroutineStat hog, victim;
+    memset(&hog, 0, sizeof(hog));
+    memset(&victim, 0, sizeof(victim));
+    hog.nn_loops = victim.nn_loops = 3;
+
+    st_thread_t trd0 = st_thread_create(coroutine_hog, &hog, 1, 0);
+    st_thread_t trd1 = st_thread_create(coroutine_victim, &victim, 1, 0);
+    st_thread_join(trd0, NULL);
+    st_thread_join(trd1, NULL);
+
+    // The current thread is on CPU while query it.
+    EXPECT_EQ(0, st_thread_stats(st_thread_self(), &stats));
+    EXPECT_GT(stats.nn_switches, 0ULL);
+
+    EXPECT_EQ(1, st_set_thread_stats(0));
+
+    // The hog is on CPU for all loops, while the victim waits for the hog.
+    EXPECT_GE(hog.stats.cpu, (st_utime_t)(hog.nn_loops * ST_UTEST_HOG_US * 9 / 10));
+    EXPECT_GE(hog.stats.nn_switches, (unsigned long long)hog.nn_loops);
+    EXPECT_LT(victim.stats.cpu, (st_utime_t)ST_UTEST_HOG_US);
+    EXPECT_GE(victim.stats.max_delay, (st_utime_t)(ST_UTEST_HOG_US * 9 / 10));
+    EXPECT_GE(victim.stats.delay, victim.stats.max_delay);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// The utest for priority classes of run queue.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+struct CoroutinePrio
+{
+    std::string* order;
+    char name;
+    int nn_loops;
+    // Signal the cond at the first loop if not NULL.
+    st_cond_t cond;
+};
+
+void* coroutine_prio(void* arg)
+{
+    CoroutinePrio* p = (CoroutinePrio*)arg;
+
+    for (int i = 0; i < p->nn_loops; i++) {
+        p->order->push_back(p->name);
+        if (p->cond && i == 0) {
+            st_cond_signal(p->cond);
+        }
+        st_thread_yield();
+    }
+
+    return NULL;
+}
+
+void* coroutine_prio_waiter(void* arg)
+{
+    CoroutinePrio* p = (CoroutinePrio*)arg;
+
+    st_cond_wait(p->cond);
+    p->order->push_back(p->name);
+
+    return NULL;
+}
+
+VOID TEST(CoroutineTest, PriorityOrder)
+{
+    std::string order;
+    CoroutinePrio low = {&order, 'l', 2, NULL};
+    CoroutinePrio normal = {&order, 'n', 2, NULL};
+    CoroutinePrio high = {&order, 'h', 2, NULL};
+
+    st_thread_t trd0 = st_thread_create(coroutine_prio, &low, 1, 0);
+    st_thread_t trd1 = st_thread_create(coroutine_prio, &normal, 1, 0);
+    st_thread_t trd2 = st_thread_create(coroutine_prio, &high, 1, 0);
+    EXPECT_EQ(ST_PRIO_NORMAL, st_thread_set_prio(trd0, ST_PRIO_LOW));
+    EXPECT_EQ(ST_PRIO_NORMAL, st_thread_set_prio(trd2, ST_PRIO_HIGH));
+
+    st_thread_join(trd0, NULL);
+    st_thread_join(trd1, NULL);
+    st_thread_join(trd2, NULL);
+
+    // The yield never switches to a lower class, so each thread runs to end.
+    EXPECT_STREQ("hhnnll", order.c_str());
+}
+
+VOID TEST(CoroutineTest, PriorityInvalid)
+{
+    EXPECT_EQ(ST_PRIO_NORMAL, st_thread_get_prio(st_thread_self()));
+    EXPECT_EQ(-1, st_thread_set_prio(st_thread_self(), ST_PRIO_LEVELS));
+    EXPECT_EQ(-1, st_thread_set_prio(st_thread_self(), -1));
+
+    EXPECT_EQ(ST_PRIO_NORMAL, st_thread_set_prio(st_thread_self(), ST_PRIO_HIGH));
+    EXPECT_EQ(ST_PRIO_HIGH, st_thread_set_prio(st_thread_self(), ST_PRIO_NORMAL));
+}
+
+VOID TEST(CoroutineTest, PriorityWakeup)
+{
+    std::string order;
+    st_cond_t cond = st_cond_new();
+    CoroutinePrio waiter = {&order, 'h', 1, cond};
+    CoroutinePrio a = {&order, 'a', 3, cond};
+    CoroutinePrio b = {&order, 'b', 3, NULL};
+    CoroutinePrio c = {&order, 'c', 3, NULL};
+
+    st_thread_t trd0 = st_thread_create(coroutine_prio_waiter, &waiter, 1, 0);
+    st_thread_set_prio(trd0, ST_PRIO_HIGH);
+
+    // The bulk threads saturate the loop by yield.
+    st_thread_t trd1 = st_thread_create(coroutine_prio, &a, 1, 0);
+    st_thread_t trd2 = st_thread_create(coroutine_prio, &b, 1, 0);
+    st_thread_t trd3 = st_thread_create(coroutine_prio, &c, 1, 0);
+    st_thread_set_prio(trd1, ST_PRIO_LOW);
+    st_thread_set_prio(trd2, ST_PRIO_LOW);
+    st_thread_set_prio(trd3, ST_PRIO_LOW);
+
+    st_thread_join(trd0, NULL);
+    st_thread_join(trd1, NULL);
+    st_thread_join(trd2, NULL);
+    st_thread_join(trd3, NULL);
+    st_cond_destroy(cond);
+
+    // The high thread runs right after signaled, before the bulk threads in the queue.
+    EXPECT_STREQ("ahbcabcabc", order.c_str());
+}
@@ -0,0 +1,491 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2013-2022 Winlin */
+
+#include <st_utest.hpp>
+
+#include <st.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define ST_UTEST_TIMEOUT (100 * SRS_UTIME_MILLISECONDS)
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// The utest for st_poll, many coroutines wait on the same or different descriptors.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+struct PollArgs {
+    struct pollfd pds[2];
+    int npds;
+    st_utime_t timeout;
+    int nn_ready;
+};
+
+void* poll_waiter(void* arg)
+{
+    PollArgs* args = (PollArgs*)arg;
+    args->nn_ready = st_poll(args->pds, args->npds, args->timeout);
+    return NULL;
+}
+
+static void poll_args(PollArgs* args, int fd0, int fd1, st_utime_t timeout)
+{
+    args->pds[0].fd = fd0;
+    args->pds[0].events = POLLIN;
+    args->pds[0].revents = 0;
+    args->pds[1].fd = fd1;
+    args->pds[1].events = POLLIN;
+    args->pds[1].revents = 0;
+    args->npds = (fd1 >= 0) ? 2 : 1;
+    args->timeout = timeout;
+    args->nn_ready = -1;
+}
+
+// The cases of st_poll, which also run in the pthread with io_uring, see PollTest.IoUring.
+static void poll_waiters_of_same_fd()
+{
+    int a[2], b[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, a));
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, b));
+
+    // Three waiters on a[0], one of them also waits on b[0], and one waiter times out.
+    PollArgs args[4];
+    poll_args(&args[0], a[0], -1, ST_UTIME_NO_TIMEOUT);
+    poll_args(&args[1], b[0], a[0], ST_UTIME_NO_TIMEOUT);
+    poll_args(&args[2], a[0], -1, 1 * SRS_UTIME_MILLISECONDS);
+    poll_args(&args[3], a[0], -1, ST_UTIME_NO_TIMEOUT);
+
+    st_thread_t trds[4];
+    for (int i = 0; i < 4; i++) {
+        trds[i] = st_thread_create(poll_waiter, &args[i], 1, 0);
+        EXPECT_TRUE(trds[i] != NULL);
+    }
+
+    // Let the waiter with timeout quit, it should be removed from the waiters of a[0].
+    st_usleep(10 * SRS_UTIME_MILLISECONDS);
+    EXPECT_EQ(0, args[2].nn_ready);
+    EXPECT_EQ(-1, args[0].nn_ready);
+
+    // Wakeup all the waiters of a[0], by one event.
+    EXPECT_EQ(1, write(a[1], "x", 1));
+    for (int i = 0; i < 4; i++) {
+        st_thread_join(trds[i], NULL);
+    }
+
+    EXPECT_EQ(1, args[0].nn_ready);
+    EXPECT_EQ(POLLIN, args[0].pds[0].revents);
+    EXPECT_EQ(1, args[1].nn_ready);
+    EXPECT_EQ(0, args[1].pds[0].revents);
+    EXPECT_EQ(POLLIN, args[1].pds[1].revents);
+    EXPECT_EQ(1, args[3].nn_ready);
+
+    // All the waiters are done, the descriptors are free to close.
+    ::close(a[0]); ::close(a[1]);
+    ::close(b[0]); ::close(b[1]);
+}
+
+static void poll_waiter_of_multiple_fds()
+{
+    int a[2], b[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, a));
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, b));
+
+    // Both descriptors fire in the same dispatch, the waiter should be notified only once.
+    PollArgs args;
+    poll_args(&args, a[0], b[0], ST_UTEST_TIMEOUT);
+    st_thread_t trd = st_thread_create(poll_waiter, &args, 1, 0);
+    EXPECT_TRUE(trd != NULL);
+    st_usleep(0);
+
+    EXPECT_EQ(1, write(a[1], "x", 1));
+    EXPECT_EQ(1, write(b[1], "x", 1));
+    st_thread_join(trd, NULL);
+
+    EXPECT_EQ(2, args.nn_ready);
+    EXPECT_EQ(POLLIN, args.pds[0].revents);
+    EXPECT_EQ(POLLIN, args.pds[1].revents);
+
+    ::close(a[0]); ::close(a[1]);
+    ::close(b[0]); ::close(b[1]);
+}
+
+static void poll_timeout()
+{
+    int a[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, a));
+
+    // Nothing to read, the poll should timeout, and never wakeup before due.
+    struct pollfd pd;
+    pd.fd = a[0];
+    pd.events = POLLIN;
+    pd.revents = 0;
+    st_utime_t starttime = st_utime();
+    EXPECT_EQ(0, st_poll(&pd, 1, 10 * SRS_UTIME_MILLISECONDS));
+    EXPECT_EQ(0, pd.revents);
+    EXPECT_GE(st_utime() - starttime, (st_utime_t)(10 * SRS_UTIME_MILLISECONDS));
+
+    // Then ready before timeout.
+    EXPECT_EQ(1, write(a[1], "x", 1));
+    EXPECT_EQ(1, st_poll(&pd, 1, ST_UTEST_TIMEOUT));
+    EXPECT_EQ(POLLIN, pd.revents);
+
+    ::close(a[0]); ::close(a[1]);
+}
+
+VOID TEST(PollTest, WaitersOfSameFd)
+{
+    poll_waiters_of_same_fd();
+}
+
+VOID TEST(PollTest, WaiterOfMultipleFds)
+{
+    poll_waiter_of_multiple_fds();
+}
+
+VOID TEST(PollTest, Timeout)
+{
+    poll_timeout();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// The utest for persistent netfd, which is registered edge-triggered until closed.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void* persistent_reader(void* arg)
+{
+    st_netfd_t stfd = (st_netfd_t)arg;
+
+    char buf[16];
+    for (int i = 0; i < 3; i++) {
+        ssize_t nn = st_read(stfd, buf, sizeof(buf), ST_UTEST_TIMEOUT);
+        ST_ASSERT_ERROR(nn != 1, (int)nn, "Read");
+    }
+
+    return NULL;
+}
+
+// The reader waits again after draining the netfd, which should not change the interests of event system.
+#define ST_UTEST_STEADY_NN 10
+
+void* steady_reader(void* arg)
+{
+    st_netfd_t stfd = (st_netfd_t)arg;
+
+    char buf[16];
+    for (int i = 0; i < ST_UTEST_STEADY_NN; i++) {
+        ssize_t nn = st_read(stfd, buf, sizeof(buf), ST_UTEST_TIMEOUT);
+        ST_ASSERT_ERROR(nn != 1, (int)nn, "Read");
+    }
+
+    return NULL;
+}
+
+// Get the requests to change interests, like epoll_ctl, while the reader waits on the netfd again and again.
+static unsigned long long netfd_steady_ctls(st_netfd_t r, st_netfd_t w)
+{
+    st_thread_t trd = st_thread_create(steady_reader, r, 1, 0);
+    EXPECT_TRUE(trd != NULL);
+
+    // The stat is updated by each iteration of event loop, so sleep to get the fresh one. Skip the first and last
+    // read, which register and unregister the netfd.
+    st_vp_stats_t s0, s1;
+    for (int i = 0; i < ST_UTEST_STEADY_NN; i++) {
+        st_usleep(1 * SRS_UTIME_MILLISECONDS);
+        if (i == 1) st_vp_stats(NULL, &s0);
+        if (i == ST_UTEST_STEADY_NN - 1) st_vp_stats(NULL, &s1);
+        EXPECT_EQ(1, st_write(w, "y", 1, ST_UTEST_TIMEOUT));
+    }
+
+    ST_COROUTINE_JOIN(trd, r0);
+    ST_EXPECT_SUCCESS(r0);
+
+    return s1.nn_ctls - s0.nn_ctls;
+}
+
+VOID TEST(PollTest, PersistentNetfd)
+{
+    int wason = st_netfd_persistent_set(1);
+
+    int fds[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    st_netfd_t r = st_netfd_open_socket(fds[0]);
+    st_netfd_t w = st_netfd_open_socket(fds[1]);
+    EXPECT_TRUE(r != NULL && w != NULL);
+
+    // The edge fires when nobody is waiting, it should be recorded.
+    EXPECT_EQ(1, write(fds[1], "x", 1));
+    st_usleep(1 * SRS_UTIME_MILLISECONDS);
+    EXPECT_EQ(0, st_netfd_poll(r, POLLIN, 1 * SRS_UTIME_MILLISECONDS));
+
+    char buf[16];
+    EXPECT_EQ(1, st_read(r, buf, sizeof(buf), ST_UTEST_TIMEOUT));
+
+    // The readiness is consumed, so poll should timeout.
+    EXPECT_EQ(-1, st_netfd_poll(r, POLLIN, 1 * SRS_UTIME_MILLISECONDS));
+    EXPECT_EQ(ETIME, errno);
+
+    // The reader is waked up by each edge.
+    st_thread_t trd = st_thread_create(persistent_reader, r, 1, 0);
+    EXPECT_TRUE(trd != NULL);
+    for (int i = 0; i < 3; i++) {
+        st_usleep(1 * SRS_UTIME_MILLISECONDS);
+        EXPECT_EQ(1, st_write(w, "y", 1, ST_UTEST_TIMEOUT));
+    }
+
+    ST_COROUTINE_JOIN(trd, r0);
+    ST_EXPECT_SUCCESS(r0);
+
+    // The netfd is registered once, so no epoll_ctl when the reader waits again.
+    EXPECT_EQ(0ULL, netfd_steady_ctls(r, w));
+
+    EXPECT_EQ(0, st_netfd_close(r));
+    EXPECT_EQ(0, st_netfd_close(w));
+    st_netfd_persistent_set(wason);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// The utest for stat of event loop, which is read by other pthread without lock.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#define ST_UTEST_LAG_US 20000
+
+static unsigned long long vp_hist_from(const unsigned long long* hist, int from)
+{
+    unsigned long long v = 0;
+    for (int i = from; i < ST_VP_HIST_BUCKETS; i++) {
+        v += hist[i];
+    }
+    return v;
+}
+
+static void* vp_stats_reader(void* arg)
+{
+    st_vp_stats_t* stats = (st_vp_stats_t*)arg;
+    st_vp_stats_t* snapshot = new st_vp_stats_t();
+    st_vp_stats(stats, snapshot);
+    return snapshot;
+}
+
+VOID TEST(PollTest, EventLoopStats)
+{
+    st_vp_stats_t live;
+    EXPECT_TRUE(st_set_vp_stats(&live) == NULL);
+
+    // The first iteration of event loop has no busy time, so wait once if this is the first case to run.
+    st_usleep(1 * SRS_UTIME_MILLISECONDS);
+
+    st_vp_stats_t s0;
+    st_vp_stats(NULL, &s0);
+
+    // Lag the event loop, then wait in event system.
+    for (int i = 0; i < 3; i++) {
+        st_utime_t starttime = st_utime();
+        while (st_utime() - starttime < ST_UTEST_LAG_US) {
+        }
+        st_usleep(ST_UTEST_LAG_US);
+    }
+
+    // Read the stat in other pthread, which is the same as this VP.
+    pthread_t tid;
+    ASSERT_EQ(0, pthread_create(&tid, NULL, vp_stats_reader, &live));
+    void* r0 = NULL;
+    pthread_join(tid, &r0);
+    st_vp_stats_t s1 = *(st_vp_stats_t*)r0;
+    delete (st_vp_stats_t*)r0;
+    EXPECT_EQ(0, (int)(s1.seq & 1));
+    EXPECT_EQ(live.nn_loops, s1.nn_loops);
+
+    EXPECT_TRUE(st_set_vp_stats(NULL) == &live);
+
+    // The lag of 20ms is in bucket 15, which is [16384, 32768).
+    EXPECT_GE(s1.nn_loops - s0.nn_loops, 3ULL);
+    EXPECT_GE(vp_hist_from(s1.loop, 15) - vp_hist_from(s0.loop, 15), 3ULL);
+    EXPECT_GE(vp_hist_from(s1.wait, 14) - vp_hist_from(s0.wait, 14), 3ULL);
+    EXPECT_GE(s1.loop_max, (st_utime_t)ST_UTEST_LAG_US);
+    EXPECT_GE(s1.wait_total - s0.wait_total, (st_utime_t)(3 * ST_UTEST_LAG_US));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// The utest for io_uring, which runs the cases of st_poll in a pthread, because the event system is per pthread.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+struct UringResult
+{
+    int supported;
+    int r0;
+    unsigned long long ctls;
+    unsigned long long ios;
+};
+
+// The native operation of reader, which is interrupted or done.
+struct UringReadArgs
+{
+    st_netfd_t stfd;
+    ssize_t nn;
+    int err;
+};
+
+static void* uring_reader(void* arg)
+{
+    UringReadArgs* args = (UringReadArgs*)arg;
+
+    char buf[16];
+    args->nn = st_read(args->stfd, buf, sizeof(buf), ST_UTIME_NO_TIMEOUT);
+    args->err = errno;
+    return NULL;
+}
+
+static void* uring_acceptor(void* arg)
+{
+    st_netfd_t stfd = (st_netfd_t)arg;
+
+    st_netfd_t client = st_accept(stfd, NULL, NULL, ST_UTEST_TIMEOUT);
+    if (client) st_netfd_close(client);
+    return client;
+}
+
+static void* uring_receiver(void* arg)
+{
+    UringReadArgs* args = (UringReadArgs*)arg;
+
+    char buf[16];
+    sockaddr_in from;
+    int fromlen = sizeof(from);
+    args->nn = st_recvfrom(args->stfd, buf, sizeof(buf), (sockaddr*)&from, &fromlen, ST_UTEST_TIMEOUT);
+    args->err = (fromlen == sizeof(from) && from.sin_family == AF_INET) ? 0 : EINVAL;
+    return NULL;
+}
+
+// Create the listen or UDP socket on a random port of loopback.
+static st_netfd_t uring_socket(int type, sockaddr_in* addr)
+{
+    int fd = socket(AF_INET, type, 0);
+    EXPECT_TRUE(fd >= 0);
+
+    socklen_t addrlen = sizeof(*addr);
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = inet_addr("127.0.0.1");
+    EXPECT_EQ(0, bind(fd, (sockaddr*)addr, addrlen));
+    EXPECT_EQ(0, getsockname(fd, (sockaddr*)addr, &addrlen));
+    if (type == SOCK_STREAM) {
+        EXPECT_EQ(0, listen(fd, 8));
+    }
+
+    return st_netfd_open_socket(fd);
+}
+
+// The native operations of io_uring, which also work like the poll of other event systems.
+static void uring_native_ops(st_netfd_t r, st_netfd_t w)
+{
+    char buf[16];
+
+    // The poll is level-triggered, so it's ready until the data is read.
+    EXPECT_EQ(1, st_write(w, "x", 1, ST_UTEST_TIMEOUT));
+    EXPECT_EQ(0, st_netfd_poll(r, POLLIN, ST_UTEST_TIMEOUT));
+    EXPECT_EQ(0, st_netfd_poll(r, POLLIN, ST_UTEST_TIMEOUT));
+    EXPECT_EQ(1, st_read(r, buf, sizeof(buf), ST_UTEST_TIMEOUT));
+
+    // The native read is canceled by timeout, then read the data arrives later.
+    EXPECT_EQ(-1, st_read(r, buf, sizeof(buf), 1 * SRS_UTIME_MILLISECONDS));
+    EXPECT_EQ(ETIME, errno);
+    EXPECT_EQ(1, st_write(w, "y", 1, ST_UTEST_TIMEOUT));
+    EXPECT_EQ(1, st_read(r, buf, sizeof(buf), ST_UTEST_TIMEOUT));
+
+    // The native read is canceled by interrupt.
+    UringReadArgs args = {r, 0, 0};
+    st_thread_t trd = st_thread_create(uring_reader, &args, 1, 0);
+    EXPECT_TRUE(trd != NULL);
+    st_usleep(1 * SRS_UTIME_MILLISECONDS);
+    st_thread_interrupt(trd);
+    st_thread_join(trd, NULL);
+    EXPECT_EQ(-1, args.nn);
+    EXPECT_EQ(EINTR, args.err);
+
+    // The native accept.
+    sockaddr_in addr;
+    st_netfd_t lfd = uring_socket(SOCK_STREAM, &addr);
+    EXPECT_TRUE(lfd != NULL);
+    trd = st_thread_create(uring_acceptor, lfd, 1, 0);
+    EXPECT_TRUE(trd != NULL);
+    st_usleep(1 * SRS_UTIME_MILLISECONDS);
+
+    st_netfd_t client = st_netfd_open_socket(socket(AF_INET, SOCK_STREAM, 0));
+    EXPECT_TRUE(client != NULL);
+    EXPECT_EQ(0, st_connect(client, (sockaddr*)&addr, sizeof(addr), ST_UTEST_TIMEOUT));
+    void* accepted = NULL;
+    st_thread_join(trd, &accepted);
+    EXPECT_TRUE(accepted != NULL);
+    EXPECT_EQ(0, st_netfd_close(client));
+    EXPECT_EQ(0, st_netfd_close(lfd));
+
+    // The native recvfrom, with the address of peer.
+    st_netfd_t ufd = uring_socket(SOCK_DGRAM, &addr);
+    EXPECT_TRUE(ufd != NULL);
+    args.stfd = ufd;
+    trd = st_thread_create(uring_receiver, &args, 1, 0);
+    EXPECT_TRUE(trd != NULL);
+    st_usleep(1 * SRS_UTIME_MILLISECONDS);
+
+    st_netfd_t sender = st_netfd_open_socket(socket(AF_INET, SOCK_DGRAM, 0));
+    EXPECT_TRUE(sender != NULL);
+    EXPECT_EQ(3, st_sendto(sender, "abc", 3, (sockaddr*)&addr, sizeof(addr), ST_UTEST_TIMEOUT));
+    st_thread_join(trd, NULL);
+    EXPECT_EQ(3, args.nn);
+    EXPECT_EQ(0, args.err);
+    EXPECT_EQ(0, st_netfd_close(sender));
+    EXPECT_EQ(0, st_netfd_close(ufd));
+}
+
+static void* uring_pthread(void* arg)
+{
+    UringResult* res = (UringResult*)arg;
+
+    // Only available when ST is built with MD_HAVE_IOURING, and the kernel supports.
+    if (st_set_eventsys(ST_EVENTSYS_IOURING) != 0) return NULL;
+    res->supported = 1;
+    if ((res->r0 = st_init()) != 0) return NULL;
+
+    poll_waiters_of_same_fd();
+    poll_waiter_of_multiple_fds();
+    poll_timeout();
+
+    int fds[2];
+    if ((res->r0 = socketpair(AF_UNIX, SOCK_STREAM, 0, fds)) != 0) return NULL;
+    st_netfd_t r = st_netfd_open_socket(fds[0]);
+    st_netfd_t w = st_netfd_open_socket(fds[1]);
+    EXPECT_TRUE(r != NULL && w != NULL);
+
+    // The reader waits again by native read, which never touches the poll.
+    st_vp_stats_t s0, s1;
+    st_vp_stats(NULL, &s0);
+    res->ctls = netfd_steady_ctls(r, w);
+    uring_native_ops(r, w);
+    st_vp_stats(NULL, &s1);
+    res->ios = s1.nn_ios - s0.nn_ios;
+
+    EXPECT_EQ(0, st_netfd_close(r));
+    EXPECT_EQ(0, st_netfd_close(w));
+
+    st_destroy();
+    return NULL;
+}
+
+VOID TEST(PollTest, IoUring)
+{
+    UringResult res;
+    memset(&res, 0, sizeof(res));
+
+    pthread_t tid;
+    ASSERT_EQ(0, pthread_create(&tid, NULL, uring_pthread, &res));
+    pthread_join(tid, NULL);
+    if (!res.supported) {
+        GTEST_SKIP() << "io_uring unavailable";
+    }
+
+    EXPECT_EQ(0, res.r0);
+    EXPECT_EQ(0ULL, res.ctls);
+    EXPECT_GE(res.ios, (unsigned long long)ST_UTEST_STEADY_NN);
+}
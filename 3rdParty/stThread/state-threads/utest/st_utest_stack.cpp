@@ -0,0 +1,422 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2013-2022 Winlin */
+
+#include <st_utest.hpp>
+
+#include <st.h>
+#include <string.h>
+#include <unistd.h>
+#include <alloca.h>
+#include <sys/socket.h>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// The utest for stack cache.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#define ST_UTEST_STACK_NN 64
+#define ST_UTEST_STACK_SIZE (256 * 1024)
+
+struct StackToucher
+{
+    int size;
+    st_cond_t quit;
+    int ok;
+};
+
+// Use most of the stack, and verify it after the other coroutines run.
+static void* stack_toucher(void* arg)
+{
+    StackToucher* t = (StackToucher*)arg;
+
+    int size = t->size * 3 / 4;
+    char* buf = (char*)alloca(size);
+    memset(buf, (char)(size & 0xff), size);
+
+    if (t->quit) {
+        st_cond_wait(t->quit);
+    } else {
+        st_usleep(0);
+    }
+
+    t->ok = 1;
+    for (int i = 0; i < size; i++) {
+        if (buf[i] != (char)(size & 0xff)) {
+            t->ok = 0;
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+VOID TEST(StackTest, CacheLimited)
+{
+    // Never cache the stacks, and release all free stacks.
+    EXPECT_EQ(0, st_set_stack_cache(0, 0));
+
+    StackToucher touchers[ST_UTEST_STACK_NN];
+    st_thread_t trds[ST_UTEST_STACK_NN];
+    for (int i = 0; i < ST_UTEST_STACK_NN; i++) {
+        touchers[i].size = (i % 2)? 64 * 1024 : ST_UTEST_STACK_SIZE;
+        touchers[i].quit = NULL;
+        touchers[i].ok = 0;
+        trds[i] = st_thread_create(stack_toucher, &touchers[i], 1, touchers[i].size);
+        ASSERT_TRUE(trds[i] != NULL);
+
+        // Some coroutines exit, while new ones are created.
+        if (i % 3 == 0) {
+            st_thread_join(trds[i], NULL);
+            trds[i] = NULL;
+        }
+    }
+    for (int i = 0; i < ST_UTEST_STACK_NN; i++) {
+        if (trds[i]) {
+            st_thread_join(trds[i], NULL);
+        }
+        EXPECT_EQ(1, touchers[i].ok);
+    }
+
+    // Cache the stacks, and release the memory of cold ones.
+    EXPECT_EQ(0, st_set_stack_cache(4, 1));
+    for (int i = 0; i < ST_UTEST_STACK_NN; i++) {
+        touchers[i].ok = 0;
+        trds[i] = st_thread_create(stack_toucher, &touchers[i], 1, touchers[i].size);
+        ASSERT_TRUE(trds[i] != NULL);
+    }
+    for (int i = 0; i < ST_UTEST_STACK_NN; i++) {
+        st_thread_join(trds[i], NULL);
+        EXPECT_EQ(1, touchers[i].ok);
+    }
+
+    EXPECT_EQ(0, st_set_stack_cache(-1, -1));
+}
+
+VOID TEST(StackTest, ClassTooLarge)
+{
+    // The stack is larger than the max class.
+    st_thread_t trd = st_thread_create(stack_toucher, NULL, 1, 0x7ffff000);
+    EXPECT_TRUE(trd == NULL);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// The utest for stack usage.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+struct StackUsage
+{
+    int depth;
+    int usage;
+    int size;
+};
+
+static void* stack_user(void* arg)
+{
+    StackUsage* u = (StackUsage*)arg;
+
+    char* buf = (char*)alloca(u->depth);
+    memset(buf, 0, u->depth);
+
+    u->usage = st_thread_stack_usage(st_thread_self(), &u->size);
+    return NULL;
+}
+
+VOID TEST(StackTest, PaintUsage)
+{
+    // Not painted by default.
+    StackUsage u0 = {1024, 0, 0};
+    st_thread_t trd = st_thread_create(stack_user, &u0, 1, 0);
+    st_thread_join(trd, NULL);
+    EXPECT_EQ(-1, u0.usage);
+
+    // Painted, even the stack is reused.
+    EXPECT_EQ(0, st_paint_stacks(1));
+    for (int i = 1; i <= 4; i++) {
+        StackUsage u = {i * 16 * 1024, 0, 0};
+        trd = st_thread_create(stack_user, &u, 1, 0);
+        st_thread_join(trd, NULL);
+
+        EXPECT_EQ(128 * 1024, u.size);
+        EXPECT_GE(u.usage, u.depth);
+        EXPECT_LT(u.usage, u.depth + 16 * 1024);
+    }
+    EXPECT_EQ(1, st_paint_stacks(0));
+
+    // The primordial thread has no stack of ST.
+    EXPECT_EQ(-1, st_thread_stack_usage(st_thread_self(), NULL));
+}
+
+#ifdef __linux__
+static long stack_rss_pages()
+{
+    long size = 0, rss = 0;
+    FILE* f = fopen("/proc/self/statm", "r");
+    if (f) {
+        if (fscanf(f, "%ld %ld", &size, &rss) != 2) rss = 0;
+        fclose(f);
+    }
+    return rss;
+}
+
+VOID TEST(StackTest, CacheReleaseMemory)
+{
+    // A spike of coroutines, which use the stacks at the same time.
+    StackToucher touchers[ST_UTEST_STACK_NN];
+    st_thread_t trds[ST_UTEST_STACK_NN];
+    st_cond_t quit = st_cond_new();
+    for (int i = 0; i < ST_UTEST_STACK_NN; i++) {
+        touchers[i].size = ST_UTEST_STACK_SIZE;
+        touchers[i].quit = quit;
+        trds[i] = st_thread_create(stack_toucher, &touchers[i], 1, touchers[i].size);
+        ASSERT_TRUE(trds[i] != NULL);
+    }
+    st_usleep(0);
+    st_cond_broadcast(quit);
+    for (int i = 0; i < ST_UTEST_STACK_NN; i++) {
+        st_thread_join(trds[i], NULL);
+        EXPECT_EQ(1, touchers[i].ok);
+    }
+    st_cond_destroy(quit);
+
+    // The joined coroutines free the stacks when they run again.
+    st_usleep(0);
+
+    // The free stacks beyond watermark release the memory.
+    long before = stack_rss_pages();
+    EXPECT_EQ(0, st_set_stack_cache(-1, 0));
+    long after = stack_rss_pages();
+    EXPECT_GT(before - after, (long)(ST_UTEST_STACK_NN / 2 * ST_UTEST_STACK_SIZE / 2 / getpagesize()));
+
+    EXPECT_EQ(0, st_set_stack_cache(-1, -1));
+}
+#endif
+
+#ifdef __linux__
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// The utest for stack arena.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static int stack_nn_maps()
+{
+    int nn = 0;
+    char line[512];
+    FILE* f = fopen("/proc/self/maps", "r");
+    if (f) {
+        while (fgets(line, sizeof(line), f)) nn++;
+        fclose(f);
+    }
+    return nn;
+}
+
+VOID TEST(StackTest, ArenaPrealloc)
+{
+    // The size class which is not used by other cases.
+    const int size = 16 * 1024;
+    ASSERT_EQ(0, st_prealloc_stacks(ST_UTEST_STACK_NN, size));
+
+    // Never map when creating coroutines.
+    int nn_maps = stack_nn_maps();
+    StackToucher touchers[ST_UTEST_STACK_NN];
+    st_thread_t trds[ST_UTEST_STACK_NN];
+    for (int i = 0; i < ST_UTEST_STACK_NN; i++) {
+        touchers[i].size = size;
+        touchers[i].quit = NULL;
+        touchers[i].ok = 0;
+        trds[i] = st_thread_create(stack_toucher, &touchers[i], 1, size);
+        ASSERT_TRUE(trds[i] != NULL);
+    }
+    EXPECT_EQ(nn_maps, stack_nn_maps());
+
+    for (int i = 0; i < ST_UTEST_STACK_NN; i++) {
+        st_thread_join(trds[i], NULL);
+        EXPECT_EQ(1, touchers[i].ok);
+    }
+
+    EXPECT_EQ(-1, st_prealloc_stacks(0, size));
+    EXPECT_EQ(EINVAL, errno);
+}
+
+VOID TEST(StackTest, ArenaHugePage)
+{
+    // The huge pages might not be reserved, which fallback to normal pages.
+    int flags[] = {ST_STACK_HUGEPAGE, ST_STACK_HUGETLB};
+    for (int j = 0; j < 2; j++) {
+        EXPECT_EQ(0, st_set_stack_arena(16, flags[j]));
+
+        // Never cache the stacks, which are returned to arena.
+        EXPECT_EQ(0, st_set_stack_cache(0, 0));
+
+        StackToucher touchers[ST_UTEST_STACK_NN];
+        st_thread_t trds[ST_UTEST_STACK_NN];
+        for (int i = 0; i < ST_UTEST_STACK_NN; i++) {
+            touchers[i].size = 32 * 1024;
+            touchers[i].quit = NULL;
+            touchers[i].ok = 0;
+            trds[i] = st_thread_create(stack_toucher, &touchers[i], 1, touchers[i].size);
+            ASSERT_TRUE(trds[i] != NULL);
+        }
+        for (int i = 0; i < ST_UTEST_STACK_NN; i++) {
+            st_thread_join(trds[i], NULL);
+            EXPECT_EQ(1, touchers[i].ok);
+        }
+        st_usleep(0);
+
+        EXPECT_EQ(0, st_set_stack_cache(-1, -1));
+        EXPECT_EQ(0, st_set_stack_arena(0, 0));
+    }
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// The utest for stack guard.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#include <signal.h>
+#include <sys/wait.h>
+
+static void stack_guard_handler(int /*signo*/, siginfo_t* info, void* /*context*/)
+{
+    // Exit with 42 if the overflow is identified.
+    _exit(st_stack_guard_fault(info->si_addr) == st_thread_self()? 42 : 1);
+}
+
+static int stack_overflow(int n)
+{
+    volatile char buf[1024];
+    buf[0] = (char)n;
+    return n > 0? stack_overflow(n - 1) + buf[0] : 0;
+}
+
+static void* stack_overflow_start(void* arg)
+{
+    *(int*)arg = stack_overflow(1024 * 1024);
+    return NULL;
+}
+
+VOID TEST(StackTest, GuardOverflow)
+{
+    // It's always on for DEBUG.
+    int wason = st_set_stack_guard(1);
+
+    // Not in the redzones.
+    int v = 0;
+    EXPECT_TRUE(st_stack_guard_fault(&v) == NULL);
+
+    // Overflow the stack in child process, which faults at the redzone.
+    pid_t pid = fork();
+    if (pid == 0) {
+        static char altstack[64 * 1024];
+        stack_t ss;
+        ss.ss_sp = altstack;
+        ss.ss_size = sizeof(altstack);
+        ss.ss_flags = 0;
+        sigaltstack(&ss, NULL);
+
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_sigaction = stack_guard_handler;
+        sa.sa_flags = SA_SIGINFO | SA_ONSTACK;
+        sigaction(SIGSEGV, &sa, NULL);
+        sigaction(SIGBUS, &sa, NULL);
+
+        st_thread_t trd = st_thread_create(stack_overflow_start, &v, 1, 64 * 1024);
+        st_thread_join(trd, NULL);
+        _exit(0);
+    }
+
+    int status = 0;
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    EXPECT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(42, WEXITSTATUS(status));
+
+    st_set_stack_guard(wason);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// The utest for copy-stack mode.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+VOID TEST(StackTest, CopyStackIntact)
+{
+    EXPECT_EQ(0, st_set_copy_stack(2, ST_UTEST_STACK_SIZE));
+
+    // The coroutines share two stacks, while some larger ones run on their own stacks.
+    StackToucher touchers[ST_UTEST_STACK_NN];
+    st_thread_t trds[ST_UTEST_STACK_NN];
+    st_cond_t quit = st_cond_new();
+    for (int i = 0; i < ST_UTEST_STACK_NN; i++) {
+        touchers[i].size = (i % 4 == 3)? 2 * ST_UTEST_STACK_SIZE : (i + 1) * 1024;
+        touchers[i].quit = (i % 2)? quit : NULL;
+        touchers[i].ok = 0;
+        trds[i] = st_thread_create(stack_toucher, &touchers[i], 1, touchers[i].size);
+        ASSERT_TRUE(trds[i] != NULL);
+    }
+    st_usleep(0);
+
+    // Never change it when coroutines are on the shared stacks.
+    EXPECT_EQ(-1, st_set_copy_stack(0, 0));
+    EXPECT_EQ(EBUSY, errno);
+
+    st_cond_broadcast(quit);
+    for (int i = 0; i < ST_UTEST_STACK_NN; i++) {
+        st_thread_join(trds[i], NULL);
+        EXPECT_EQ(1, touchers[i].ok);
+    }
+    st_cond_destroy(quit);
+
+    // The joined coroutines free the stacks when they run again.
+    st_usleep(0);
+    EXPECT_EQ(0, st_set_copy_stack(0, 0));
+}
+
+struct StackReader
+{
+    int id;
+    st_netfd_t stfd;
+    int ok;
+};
+
+// Read by st_read, which polls the fd while the stack is overwritten by others.
+static void* stack_reader(void* arg)
+{
+    StackReader* r = (StackReader*)arg;
+
+    char stack_data[4096];
+    memset(stack_data, (char)r->id, sizeof(stack_data));
+
+    char buf[16];
+    ssize_t nn = st_read(r->stfd, buf, sizeof(buf), ST_UTIME_NO_TIMEOUT);
+
+    r->ok = (nn == 4 && memcmp(buf, "ping", 4) == 0);
+    for (int i = 0; r->ok && i < (int)sizeof(stack_data); i++) {
+        r->ok = (stack_data[i] == (char)r->id);
+    }
+
+    return NULL;
+}
+
+VOID TEST(StackTest, CopyStackPoll)
+{
+    EXPECT_EQ(0, st_set_copy_stack(1, 0));
+
+    int fds[ST_UTEST_STACK_NN][2];
+    StackReader readers[ST_UTEST_STACK_NN];
+    st_thread_t trds[ST_UTEST_STACK_NN];
+    for (int i = 0; i < ST_UTEST_STACK_NN; i++) {
+        ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds[i]));
+        readers[i].id = i;
+        readers[i].stfd = st_netfd_open_socket(fds[i][0]);
+        readers[i].ok = 0;
+        trds[i] = st_thread_create(stack_reader, &readers[i], 1, 0);
+        ASSERT_TRUE(trds[i] != NULL);
+    }
+    st_usleep(0);
+
+    // Wakeup the readers in reverse order.
+    for (int i = ST_UTEST_STACK_NN - 1; i >= 0; i--) {
+        ASSERT_EQ(4, write(fds[i][1], "ping", 4));
+    }
+    for (int i = 0; i < ST_UTEST_STACK_NN; i++) {
+        st_thread_join(trds[i], NULL);
+        EXPECT_EQ(1, readers[i].ok);
+        st_netfd_close(readers[i].stfd);
+        close(fds[i][1]);
+    }
+
+    st_usleep(0);
+    EXPECT_EQ(0, st_set_copy_stack(0, 0));
+}
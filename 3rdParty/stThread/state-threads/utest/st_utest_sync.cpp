@@ -0,0 +1,247 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2013-2022 Winlin */
+
+#include <st_utest.hpp>
+
+#include <st.h>
+
+#include <algorithm>
+#include <string>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// The utest for reader-writer lock.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+struct RwlockArgs
+{
+    st_rwlock_t lock;
+    // The number of readers hold the lock, and the max of it.
+    int readers;
+    int max_readers;
+    // The order of threads which get the lock.
+    std::string order;
+};
+
+struct RwlockThread
+{
+    RwlockArgs* args;
+    char name;
+    bool writer;
+    int r0;
+};
+
+static void* rwlock_thread(void* arg)
+{
+    RwlockThread* t = (RwlockThread*)arg;
+    RwlockArgs* args = t->args;
+
+    if ((t->r0 = t->writer? st_rwlock_wrlock(args->lock) : st_rwlock_rdlock(args->lock)) != 0) {
+        return NULL;
+    }
+    args->order += t->name;
+
+    if (!t->writer) {
+        args->readers++;
+        args->max_readers = std::max(args->max_readers, args->readers);
+    }
+    st_usleep(10 * 1000);
+    if (!t->writer) {
+        args->readers--;
+    }
+
+    st_rwlock_unlock(args->lock);
+    return NULL;
+}
+
+VOID TEST(SyncTest, RwlockReaders)
+{
+    RwlockArgs args;
+    args.lock = st_rwlock_new();
+    args.readers = args.max_readers = 0;
+
+    RwlockThread ts[3] = {{&args, 'a', false, -1}, {&args, 'b', false, -1}, {&args, 'c', false, -1}};
+    st_thread_t trds[3];
+    for (int i = 0; i < 3; i++) {
+        trds[i] = st_thread_create(rwlock_thread, &ts[i], 1, 0);
+    }
+    for (int i = 0; i < 3; i++) {
+        st_thread_join(trds[i], NULL);
+        EXPECT_EQ(0, ts[i].r0);
+    }
+
+    // All readers hold the lock together.
+    EXPECT_EQ(3, args.max_readers);
+    EXPECT_EQ(0, st_rwlock_destroy(args.lock));
+}
+
+VOID TEST(SyncTest, RwlockWriterPreference)
+{
+    RwlockArgs args;
+    args.lock = st_rwlock_new();
+    args.readers = args.max_readers = 0;
+
+    // The reader a holds the lock, then writer W waits, so the new reader b waits for W.
+    RwlockThread ts[3] = {{&args, 'a', false, -1}, {&args, 'W', true, -1}, {&args, 'b', false, -1}};
+    st_thread_t trds[3];
+    for (int i = 0; i < 3; i++) {
+        trds[i] = st_thread_create(rwlock_thread, &ts[i], 1, 0);
+        st_usleep(1000);
+    }
+
+    EXPECT_EQ(-1, st_rwlock_tryrdlock(args.lock));
+    EXPECT_EQ(EBUSY, errno);
+
+    for (int i = 0; i < 3; i++) {
+        st_thread_join(trds[i], NULL);
+        EXPECT_EQ(0, ts[i].r0);
+    }
+    EXPECT_STREQ("aWb", args.order.c_str());
+    EXPECT_EQ(1, args.max_readers);
+    EXPECT_EQ(0, st_rwlock_destroy(args.lock));
+}
+
+VOID TEST(SyncTest, RwlockBatchReaders)
+{
+    RwlockArgs args;
+    args.lock = st_rwlock_new();
+    args.readers = args.max_readers = 0;
+
+    // The readers wait for the writer, and are woken together before the writer X.
+    EXPECT_EQ(0, st_rwlock_wrlock(args.lock));
+    RwlockThread ts[4] = {{&args, 'a', false, -1}, {&args, 'b', false, -1}, {&args, 'X', true, -1}, {&args, 'c', false, -1}};
+    st_thread_t trds[4];
+    for (int i = 0; i < 4; i++) {
+        trds[i] = st_thread_create(rwlock_thread, &ts[i], 1, 0);
+    }
+    st_usleep(1000);
+
+    // The reader c also waits for the writer, so it's woken with a and b, before X.
+    EXPECT_EQ(-1, st_rwlock_wrlock(args.lock));
+    EXPECT_EQ(EDEADLK, errno);
+    EXPECT_EQ(0, st_rwlock_unlock(args.lock));
+
+    for (int i = 0; i < 4; i++) {
+        st_thread_join(trds[i], NULL);
+        EXPECT_EQ(0, ts[i].r0);
+    }
+    EXPECT_STREQ("abcX", args.order.c_str());
+    EXPECT_EQ(3, args.max_readers);
+
+    EXPECT_EQ(-1, st_rwlock_unlock(args.lock));
+    EXPECT_EQ(EPERM, errno);
+    EXPECT_EQ(0, st_rwlock_destroy(args.lock));
+}
+
+VOID TEST(SyncTest, RwlockInterrupted)
+{
+    RwlockArgs args;
+    args.lock = st_rwlock_new();
+    args.readers = args.max_readers = 0;
+
+    // The writer W is interrupted, then the reader a which waits for W should get the lock.
+    EXPECT_EQ(0, st_rwlock_rdlock(args.lock));
+    RwlockThread ts[2] = {{&args, 'W', true, -1}, {&args, 'a', false, -1}};
+    st_thread_t trds[2];
+    for (int i = 0; i < 2; i++) {
+        trds[i] = st_thread_create(rwlock_thread, &ts[i], 1, 0);
+    }
+    st_usleep(1000);
+
+    st_thread_interrupt(trds[0]);
+    st_thread_join(trds[0], NULL);
+    EXPECT_EQ(-1, ts[0].r0);
+
+    st_thread_join(trds[1], NULL);
+    EXPECT_EQ(0, ts[1].r0);
+    EXPECT_EQ(1, args.max_readers);
+
+    EXPECT_EQ(0, st_rwlock_unlock(args.lock));
+    EXPECT_EQ(0, st_rwlock_destroy(args.lock));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// The utest for semaphore.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+struct SemaArgs
+{
+    st_sema_t sema;
+    int running;
+    int max_running;
+    int nn_done;
+};
+
+static void* sema_thread(void* arg)
+{
+    SemaArgs* args = (SemaArgs*)arg;
+
+    if (st_sema_acquire(args->sema, ST_UTIME_NO_TIMEOUT) != 0) {
+        return NULL;
+    }
+
+    args->running++;
+    args->max_running = std::max(args->max_running, args->running);
+    st_usleep(5 * 1000);
+    args->running--;
+    args->nn_done++;
+
+    st_sema_release(args->sema);
+    return NULL;
+}
+
+VOID TEST(SyncTest, SemaBounded)
+{
+    SemaArgs args;
+    args.sema = st_sema_new(2);
+    args.running = args.max_running = args.nn_done = 0;
+
+    st_thread_t trds[5];
+    for (int i = 0; i < 5; i++) {
+        trds[i] = st_thread_create(sema_thread, &args, 1, 0);
+    }
+    for (int i = 0; i < 5; i++) {
+        st_thread_join(trds[i], NULL);
+    }
+
+    EXPECT_EQ(5, args.nn_done);
+    EXPECT_EQ(2, args.max_running);
+    EXPECT_EQ(0, st_sema_destroy(args.sema));
+}
+
+static void* sema_waiter(void* arg)
+{
+    st_sema_t sema = (st_sema_t)arg;
+    int r0 = st_sema_acquire(sema, ST_UTIME_NO_TIMEOUT);
+    return (void*)(long)(r0? errno : 0);
+}
+
+VOID TEST(SyncTest, SemaTimeout)
+{
+    st_sema_t sema = st_sema_new(1);
+    EXPECT_EQ(0, st_sema_tryacquire(sema));
+    EXPECT_EQ(-1, st_sema_tryacquire(sema));
+    EXPECT_EQ(EBUSY, errno);
+
+    st_utime_t starttime = st_utime();
+    EXPECT_EQ(-1, st_sema_acquire(sema, 10 * 1000));
+    EXPECT_EQ(ETIME, errno);
+    EXPECT_GE(st_utime() - starttime, 10 * 1000ULL);
+
+    // The interrupted waiter never takes the permit.
+    void* r0 = NULL;
+    st_thread_t trd = st_thread_create(sema_waiter, sema, 1, 0);
+    st_usleep(1000);
+    st_thread_interrupt(trd);
+    st_thread_join(trd, &r0);
+    EXPECT_EQ(EINTR, (int)(long)r0);
+
+    // The permit is handed to the waiter, and never overtaken by tryacquire.
+    trd = st_thread_create(sema_waiter, sema, 1, 0);
+    st_usleep(1000);
+    EXPECT_EQ(0, st_sema_release(sema));
+    EXPECT_EQ(-1, st_sema_tryacquire(sema));
+    st_thread_join(trd, &r0);
+    EXPECT_EQ(0, (int)(long)r0);
+
+    EXPECT_EQ(0, st_sema_release(sema));
+    EXPECT_EQ(0, st_sema_destroy(sema));
+}
+
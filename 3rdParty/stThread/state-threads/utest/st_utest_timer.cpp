@@ -0,0 +1,172 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2013-2022 Winlin */
+
+#include <st_utest.hpp>
+
+#include <st.h>
+#include <pthread.h>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// The utest for timing wheel, which runs in a new pthread because it must be set before st_init.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#define ST_UTEST_WHEEL_TICK 1000
+#define ST_UTEST_WHEEL_NN 64
+
+struct WheelSleeper
+{
+    st_utime_t timeout;
+    st_utime_t elapsed;
+};
+
+static void* wheel_sleeper(void* arg)
+{
+    WheelSleeper* s = (WheelSleeper*)arg;
+
+    // The due is based on the last clock of VP.
+    st_utime_t starttime = st_utime_last_clock();
+    st_usleep(s->timeout);
+    s->elapsed = st_utime() - starttime;
+
+    return NULL;
+}
+
+static void* wheel_canceled(void* arg)
+{
+    int* r0 = (int*)arg;
+    *r0 = st_usleep(3600 * 1000 * 1000LL);
+    return NULL;
+}
+
+struct WheelResult
+{
+    int r0;
+    WheelSleeper sleepers[ST_UTEST_WHEEL_NN];
+    int interrupted;
+    int cond_r0;
+    int cond_errno;
+};
+
+static void* wheel_pthread(void* arg)
+{
+    WheelResult* res = (WheelResult*)arg;
+
+    if ((res->r0 = st_set_eventsys(ST_EVENTSYS_ALT)) != 0) return NULL;
+    if ((res->r0 = st_set_timer_wheel(ST_UTEST_WHEEL_TICK)) != 0) return NULL;
+    if ((res->r0 = st_init()) != 0) return NULL;
+
+    // Spread the timeouts over level 0 and level 1 of wheel.
+    st_thread_t trds[ST_UTEST_WHEEL_NN];
+    for (int i = 0; i < ST_UTEST_WHEEL_NN; i++) {
+        res->sleepers[i].timeout = (i % 2)? i * 5 * 1000 : (ST_UTEST_WHEEL_NN - i) * 7 * 1000;
+        trds[i] = st_thread_create(wheel_sleeper, &res->sleepers[i], 1, 0);
+    }
+
+    // The canceled thread should be removed from wheel.
+    st_thread_t trd = st_thread_create(wheel_canceled, &res->interrupted, 1, 0);
+    st_usleep(10 * 1000);
+    st_thread_interrupt(trd);
+    st_thread_join(trd, NULL);
+
+    // The timeout of condition is also driven by wheel.
+    st_cond_t cond = st_cond_new();
+    res->cond_r0 = st_cond_timedwait(cond, 20 * 1000);
+    res->cond_errno = errno;
+    st_cond_destroy(cond);
+
+    for (int i = 0; i < ST_UTEST_WHEEL_NN; i++) {
+        st_thread_join(trds[i], NULL);
+    }
+
+    st_destroy();
+    return NULL;
+}
+
+VOID TEST(TimerTest, WheelTimeout)
+{
+    WheelResult res;
+    memset(&res, 0, sizeof(res));
+
+    pthread_t tid;
+    ASSERT_EQ(0, pthread_create(&tid, NULL, wheel_pthread, &res));
+    pthread_join(tid, NULL);
+    ASSERT_EQ(0, res.r0);
+
+    // Never wakeup before due, and wakeup in a few ticks after due.
+    for (int i = 0; i < ST_UTEST_WHEEL_NN; i++) {
+        WheelSleeper* s = &res.sleepers[i];
+        EXPECT_GE(s->elapsed, s->timeout);
+        EXPECT_LT(s->elapsed, s->timeout + 50 * ST_UTEST_WHEEL_TICK);
+    }
+
+    EXPECT_EQ(-1, res.interrupted);
+    EXPECT_EQ(-1, res.cond_r0);
+    EXPECT_EQ(ETIME, res.cond_errno);
+}
+
+VOID TEST(TimerTest, WheelSetAfterInit)
+{
+    // The st_init is done by main of utest.
+    EXPECT_EQ(-1, st_set_timer_wheel(ST_UTEST_WHEEL_TICK));
+    EXPECT_EQ(EBUSY, errno);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// The utest for timer slack.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#define ST_UTEST_SLACK ((st_utime_t)10000)
+
+VOID TEST(TimerTest, SlackCoalesce)
+{
+    unsigned long long expired0, coalesced0, expired1, coalesced1;
+    st_timer_stats(&expired0, &coalesced0);
+
+    // Update the last clock of VP, which might be stale after the previous cases.
+    st_thread_yield();
+
+    // The timeouts are in a window of slack, so they should be expired by a few wakeups.
+    WheelSleeper sleepers[ST_UTEST_WHEEL_NN];
+    st_thread_t trds[ST_UTEST_WHEEL_NN];
+    st_utime_t prev = st_set_timer_slack(ST_UTEST_SLACK);
+    for (int i = 0; i < ST_UTEST_WHEEL_NN; i++) {
+        sleepers[i].timeout = 10 * 1000 + i * 100;
+        trds[i] = st_thread_create(wheel_sleeper, &sleepers[i], 1, 0);
+    }
+    for (int i = 0; i < ST_UTEST_WHEEL_NN; i++) {
+        st_thread_join(trds[i], NULL);
+    }
+    EXPECT_EQ(ST_UTEST_SLACK, st_set_timer_slack(prev));
+
+    st_timer_stats(&expired1, &coalesced1);
+    EXPECT_EQ(ST_UTEST_WHEEL_NN, (int)(expired1 - expired0));
+    EXPECT_GT(coalesced1 - coalesced0, (unsigned long long)ST_UTEST_WHEEL_NN / 2);
+
+    // Never wakeup before due, and not too later than due with slack.
+    for (int i = 0; i < ST_UTEST_WHEEL_NN; i++) {
+        WheelSleeper* s = &sleepers[i];
+        EXPECT_GE(s->elapsed, s->timeout);
+        EXPECT_LT(s->elapsed, s->timeout + ST_UTEST_SLACK + 50 * 1000);
+    }
+}
+
+VOID TEST(TimerTest, SlackOfThread)
+{
+    st_thread_t self = st_thread_self();
+
+    // Use the default slack, which is not set for thread.
+    EXPECT_EQ(ST_UTIME_NO_TIMEOUT, st_thread_set_slack(self, 0));
+    EXPECT_EQ(0, (int)st_thread_set_slack(self, ST_UTEST_SLACK));
+    EXPECT_EQ(ST_UTEST_SLACK, st_thread_set_slack(self, ST_UTIME_NO_TIMEOUT));
+    EXPECT_EQ(ST_UTIME_NO_TIMEOUT, st_thread_set_slack(self, ST_UTIME_NO_TIMEOUT));
+
+    // The slack of thread overwrites the default one, so it never coalesces.
+    unsigned long long coalesced0, coalesced1;
+    st_timer_stats(NULL, &coalesced0);
+    st_utime_t prev = st_set_timer_slack(ST_UTEST_SLACK);
+    st_thread_set_slack(self, 0);
+    st_usleep(1000);
+    st_thread_set_slack(self, ST_UTIME_NO_TIMEOUT);
+    st_set_timer_slack(prev);
+    st_timer_stats(NULL, &coalesced1);
+    EXPECT_EQ(coalesced0, coalesced1);
+}
+
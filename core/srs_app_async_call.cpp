@@ -0,0 +1,240 @@
+//
+// Copyright (c) 2013-2021 The SRS Authors
+//
+// SPDX-License-Identifier: MIT
+//
+
+#include <srs_app_async_call.hpp>
+
+#include <time.h>
+
+using namespace std;
+
+#include <srs_kernel_error.hpp>
+#include <srs_kernel_log.hpp>
+#include <srs_kernel_utility.hpp>
+#include <srs_core_autofree.hpp>
+#include <srs_app_mailbox.hpp>
+
+// The interval to check whether the completion is lost, see SrsAsyncCallEntry.
+#define SRS_ASYNC_CALL_LOST_CHECK (100 * SRS_UTIME_MILLISECONDS)
+
+// The monotonic time for workers, never use the time cache of ST thread.
+static srs_utime_t srs_async_call_now()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (srs_utime_t)ts.tv_sec * SRS_UTIME_SECONDS + ts.tv_nsec / 1000;
+}
+
+ISrsAsyncCallTask::ISrsAsyncCallTask()
+{
+}
+
+ISrsAsyncCallTask::~ISrsAsyncCallTask()
+{
+}
+
+SrsAsyncCallWorker::SrsAsyncCallWorker(string label, int nn_workers)
+{
+    label_ = label;
+    nn_workers_ = srs_max(1, nn_workers);
+    stopping_ = false;
+
+    pthread_mutex_init(&lock_, NULL);
+    pthread_cond_init(&cond_, NULL);
+
+    memset(&stat_, 0, sizeof(stat_));
+}
+
+SrsAsyncCallWorker::~SrsAsyncCallWorker()
+{
+    stop();
+
+    pthread_cond_destroy(&cond_);
+    pthread_mutex_destroy(&lock_);
+}
+
+srs_error_t SrsAsyncCallWorker::start()
+{
+    if (!workers_.empty()) {
+        return srs_error_new(ERROR_THREAD_STARTED, "async %s started", label_.c_str());
+    }
+
+    stopping_ = false;
+    for (int i = 0; i < nn_workers_; i++) {
+        pthread_t tid;
+        int r0 = pthread_create(&tid, NULL, worker_pthread, this);
+        if (r0 != 0) {
+            stop();
+            return srs_error_new(ERROR_THREAD_CREATE, "async %s create worker=%d, r0=%d", label_.c_str(), i, r0);
+        }
+        workers_.push_back(tid);
+    }
+
+    srs_trace("async %s started, workers=%d", label_.c_str(), nn_workers_);
+    return srs_success;
+}
+
+void SrsAsyncCallWorker::stop()
+{
+    pthread_mutex_lock(&lock_);
+    stopping_ = true;
+    pthread_cond_broadcast(&cond_);
+    pthread_mutex_unlock(&lock_);
+
+    for (int i = 0; i < (int)workers_.size(); i++) {
+        pthread_join(workers_.at(i), NULL);
+    }
+    workers_.clear();
+}
+
+srs_error_t SrsAsyncCallWorker::execute(ISrsAsyncCallTask* task)
+{
+    srs_error_t err = srs_success;
+
+    // The worker delivers the completion to the mailbox of current ST thread.
+    SrsMailbox* mailbox = srs_mailbox_self();
+    if (!mailbox) {
+        return srs_error_new(ERROR_SYSTEM_CREATE_PIPE, "async %s no mailbox, see srs_mailbox_set_self", label_.c_str());
+    }
+
+    SrsAsyncCallEntry* entry = new SrsAsyncCallEntry();
+    SrsAutoFree(SrsAsyncCallEntry, entry);
+    entry->task = task;
+    entry->mailbox = mailbox;
+    entry->cond = srs_cond_new();
+    entry->done = false;
+    entry->lost.store(false);
+    entry->err = srs_success;
+    entry->submit_at = srs_async_call_now();
+
+    pthread_mutex_lock(&lock_);
+    if (stopping_ || workers_.empty()) {
+        pthread_mutex_unlock(&lock_);
+        srs_cond_destroy(entry->cond);
+        return srs_error_new(ERROR_THREAD_DISPOSED, "async %s not running", label_.c_str());
+    }
+    tasks_.push_back(entry);
+    stat_.nn_submitted++;
+    stat_.depth = (int)tasks_.size();
+    stat_.max_depth = srs_max(stat_.max_depth, stat_.depth);
+    pthread_cond_signal(&cond_);
+    pthread_mutex_unlock(&lock_);
+
+    // Never quit when interrupted, the worker still references the entry. The completion is
+    // lost if the mailbox is stopped, and the worker never touches the entry after marking it.
+    while (!entry->done && !entry->lost.load()) {
+        srs_cond_timedwait(entry->cond, SRS_ASYNC_CALL_LOST_CHECK);
+    }
+    srs_cond_destroy(entry->cond);
+
+    if ((err = entry->err) != srs_success) {
+        return srs_error_wrap(err, "async %s task %s", label_.c_str(), task->to_string().c_str());
+    }
+
+    return err;
+}
+
+void SrsAsyncCallWorker::stat(SrsAsyncCallStat* v)
+{
+    pthread_mutex_lock(&lock_);
+    *v = stat_;
+    pthread_mutex_unlock(&lock_);
+}
+
+void* SrsAsyncCallWorker::worker_pthread(void* arg)
+{
+    SrsAsyncCallWorker* worker = (SrsAsyncCallWorker*)arg;
+    worker->do_work();
+    return NULL;
+}
+
+void SrsAsyncCallWorker::do_work()
+{
+    while (true) {
+        pthread_mutex_lock(&lock_);
+        while (tasks_.empty() && !stopping_) {
+            pthread_cond_wait(&cond_, &lock_);
+        }
+        // Drain the queued tasks before quit, or the coroutines park forever.
+        if (tasks_.empty()) {
+            pthread_mutex_unlock(&lock_);
+            break;
+        }
+        SrsAsyncCallEntry* entry = tasks_.front();
+        tasks_.pop_front();
+        stat_.depth = (int)tasks_.size();
+        pthread_mutex_unlock(&lock_);
+
+        srs_utime_t starttime = srs_async_call_now();
+        srs_error_t err = entry->task->call();
+        srs_utime_t endtime = srs_async_call_now();
+
+        pthread_mutex_lock(&lock_);
+        stat_.nn_done++;
+        stat_.wait_total += starttime - entry->submit_at;
+        stat_.wait_max = srs_max(stat_.wait_max, starttime - entry->submit_at);
+        stat_.run_total += endtime - starttime;
+        pthread_mutex_unlock(&lock_);
+
+        // Resume the coroutine in its ST thread.
+        srs_error_t r0 = entry->mailbox->post([entry, err]() {
+            entry->err = err;
+            entry->done = true;
+            srs_cond_signal(entry->cond);
+        });
+        if (r0 != srs_success) {
+            srs_warn("async %s notify task %s, err %s", label_.c_str(), entry->task->to_string().c_str(), srs_error_desc(r0).c_str());
+
+            // The closure is rejected, so complete the entry here, or the coroutine parks forever.
+            if (srs_error_code(r0) == ERROR_THREAD_DISPOSED) {
+                entry->err = err;
+                entry->lost.store(true);
+            }
+            srs_freep(r0);
+        }
+    }
+}
+
+SrsDnsResolveTask::SrsDnsResolveTask(string h, int f)
+{
+    host = h;
+    family = f;
+}
+
+SrsDnsResolveTask::~SrsDnsResolveTask()
+{
+}
+
+srs_error_t SrsDnsResolveTask::call()
+{
+    if ((ip = srs_dns_resolve(host, family)).empty()) {
+        return srs_error_new(ERROR_SYSTEM_DNS_RESOLVE, "dns resolve %s", host.c_str());
+    }
+
+    return srs_success;
+}
+
+string SrsDnsResolveTask::to_string()
+{
+    return "dns-resolve-" + host;
+}
+
+srs_error_t srs_dns_resolve_async(SrsAsyncCallWorker* worker, string host, int& family, string& ip)
+{
+    srs_error_t err = srs_success;
+
+    // The worker writes the result to task, so it must be on heap, see ISrsAsyncCallTask.
+    SrsDnsResolveTask* task = new SrsDnsResolveTask(host, family);
+    SrsAutoFree(SrsDnsResolveTask, task);
+    if ((err = worker->execute(task)) != srs_success) {
+        return srs_error_wrap(err, "resolve %s", host.c_str());
+    }
+
+    family = task->family;
+    ip = task->ip;
+
+    return err;
+}
+
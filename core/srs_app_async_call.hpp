@@ -0,0 +1,136 @@
+//
+// Copyright (c) 2013-2021 The SRS Authors
+//
+// SPDX-License-Identifier: MIT
+//
+
+#ifndef SRS_APP_ASYNC_CALL_HPP
+#define SRS_APP_ASYNC_CALL_HPP
+
+#include <srs_core.hpp>
+
+#include <pthread.h>
+
+#include <atomic>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <srs_service_st.hpp>
+
+class SrsMailbox;
+
+// The task to run in the worker pthread, for the blocking calls which freeze all coroutines
+// if called in ST thread, for example, getaddrinfo, fsync or a blocking library.
+// @remark The call() runs in a worker pthread, so never use the ST or coroutine APIs in it.
+// @remark The task must be allocated on heap, never on the stack of coroutine, which is saved
+//      elsewhere when the coroutine is switched out in copy-stack mode, see st_set_copy_stack.
+class ISrsAsyncCallTask
+{
+public:
+    ISrsAsyncCallTask();
+    virtual ~ISrsAsyncCallTask();
+public:
+    // Execute the task in worker, and return the error to the coroutine which executes it.
+    virtual srs_error_t call() = 0;
+    // Convert the task to string to describe it.
+    virtual std::string to_string() = 0;
+};
+
+// The stat of async call worker.
+struct SrsAsyncCallStat
+{
+    // The tasks in queue, not picked by workers.
+    int depth;
+    int max_depth;
+    // The number of tasks submitted and done.
+    uint64_t nn_submitted;
+    uint64_t nn_done;
+    // The time tasks wait in queue, and run in workers.
+    srs_utime_t wait_total;
+    srs_utime_t wait_max;
+    srs_utime_t run_total;
+};
+
+// The fixed pthread pool to offload the blocking calls. The coroutine submits the task and
+// parks on an ST condition, the worker runs the task and delivers the completion back to the
+// ST thread by its mailbox(eventfd), then the coroutine resumes.
+// Usage:
+//      SrsAsyncCallWorker* worker = new SrsAsyncCallWorker("dns", 2);
+//      if ((err = worker->start()) != srs_success) {
+//          return err;
+//      }
+//      // In coroutine, park until the task is done.
+//      MyTask* task = new MyTask();
+//      SrsAutoFree(MyTask, task);
+//      if ((err = worker->execute(task)) != srs_success) {
+//          return err;
+//      }
+// @remark The worker is shared by all VPs.
+class SrsAsyncCallWorker
+{
+private:
+    // The task submitted by coroutine, which is on heap, so the worker never touches the stack
+    // of coroutine.
+    struct SrsAsyncCallEntry {
+        ISrsAsyncCallTask* task;
+        SrsMailbox* mailbox;
+        srs_cond_t cond;
+        bool done;
+        // Set by worker if the mailbox rejects the completion, the coroutine checks it periodically.
+        std::atomic<bool> lost;
+        srs_error_t err;
+        srs_utime_t submit_at;
+    };
+private:
+    std::string label_;
+    int nn_workers_;
+    std::vector<pthread_t> workers_;
+    bool stopping_;
+    pthread_mutex_t lock_;
+    pthread_cond_t cond_;
+    std::deque<SrsAsyncCallEntry*> tasks_;
+    SrsAsyncCallStat stat_;
+public:
+    SrsAsyncCallWorker(std::string label, int nn_workers);
+    virtual ~SrsAsyncCallWorker();
+public:
+    // Start the worker pthreads.
+    virtual srs_error_t start();
+    // Stop the workers after the queued tasks are done, and join them.
+    // @remark Never call it in ST thread which waits for the tasks.
+    virtual void stop();
+    // Submit the task and park current coroutine until the task is done.
+    // @param task The task on heap, which is still owned by the caller.
+    // @return The error of task->call().
+    // @remark It's not interruptible, because the worker holds the entry and task.
+    virtual srs_error_t execute(ISrsAsyncCallTask* task);
+    // Get the stat of worker.
+    virtual void stat(SrsAsyncCallStat* v);
+private:
+    static void* worker_pthread(void* arg);
+    void do_work();
+};
+
+// The task to resolve the host by getaddrinfo.
+class SrsDnsResolveTask : public ISrsAsyncCallTask
+{
+public:
+    std::string host;
+    // The input and output family, for example, AF_UNSPEC to resolve any.
+    int family;
+    // The resolved ip.
+    std::string ip;
+public:
+    SrsDnsResolveTask(std::string h, int f);
+    virtual ~SrsDnsResolveTask();
+public:
+    virtual srs_error_t call();
+    virtual std::string to_string();
+};
+
+// Resolve the host by worker, like srs_dns_resolve, but never block the ST thread.
+extern srs_error_t srs_dns_resolve_async(SrsAsyncCallWorker* worker, std::string host, int& family, std::string& ip);
+
+#endif
+
@@ -0,0 +1,133 @@
+//
+// Copyright (c) 2013-2021 The SRS Authors
+//
+// SPDX-License-Identifier: MIT
+//
+
+#include <srs_app_channel.hpp>
+
+#include <algorithm>
+using namespace std;
+
+SrsChannelBase::SrsChannelBase()
+{
+    closed_ = false;
+    rcond_ = srs_cond_new();
+    wcond_ = srs_cond_new();
+}
+
+SrsChannelBase::~SrsChannelBase()
+{
+    srs_cond_destroy(rcond_);
+    srs_cond_destroy(wcond_);
+}
+
+void SrsChannelBase::close()
+{
+    if (closed_) {
+        return;
+    }
+    closed_ = true;
+
+    srs_cond_broadcast(rcond_);
+    srs_cond_broadcast(wcond_);
+    for (int i = 0; i < (int)selects_.size(); i++) {
+        srs_cond_signal(selects_.at(i));
+    }
+}
+
+bool SrsChannelBase::closed()
+{
+    return closed_;
+}
+
+void SrsChannelBase::notify_readable()
+{
+    srs_cond_signal(rcond_);
+    for (int i = 0; i < (int)selects_.size(); i++) {
+        srs_cond_signal(selects_.at(i));
+    }
+}
+
+srs_error_t SrsChannelBase::wait(srs_cond_t cond, srs_utime_t deadline)
+{
+    if (srs_cond_wait_until(cond, deadline) == 0) {
+        return srs_success;
+    }
+    if (errno == ETIME) {
+        return srs_error_new(ERROR_CHANNEL_TIMEOUT, "channel timeout");
+    }
+    return srs_error_new(ERROR_THREAD_INTERRUPED, "channel interrupted");
+}
+
+void SrsChannelBase::add_select(srs_cond_t cond)
+{
+    selects_.push_back(cond);
+}
+
+void SrsChannelBase::remove_select(srs_cond_t cond)
+{
+    vector<srs_cond_t>::iterator it = std::find(selects_.begin(), selects_.end(), cond);
+    if (it != selects_.end()) {
+        selects_.erase(it);
+    }
+}
+
+SrsChannelSelect::SrsChannelSelect()
+{
+    cond_ = srs_cond_new();
+}
+
+SrsChannelSelect::~SrsChannelSelect()
+{
+    srs_cond_destroy(cond_);
+}
+
+void SrsChannelSelect::add(SrsChannelBase* ch)
+{
+    channels_.push_back(ch);
+}
+
+srs_error_t SrsChannelSelect::wait(SrsChannelBase** pch, srs_utime_t timeout)
+{
+    srs_error_t err = srs_success;
+
+    if (channels_.empty()) {
+        return srs_error_new(ERROR_SYSTEM_IO_INVALID, "select no channel");
+    }
+
+    if ((*pch = pick()) != NULL) {
+        return err;
+    }
+
+    // Watch the channels only when block, so the ready path is cheap.
+    for (int i = 0; i < (int)channels_.size(); i++) {
+        channels_.at(i)->add_select(cond_);
+    }
+
+    srs_utime_t deadline = srs_is_never_timeout(timeout)? 0 : srs_update_system_time() + timeout;
+    while ((*pch = pick()) == NULL) {
+        if ((err = SrsChannelBase::wait(cond_, deadline)) != srs_success) {
+            err = srs_error_wrap(err, "select");
+            break;
+        }
+    }
+
+    for (int i = 0; i < (int)channels_.size(); i++) {
+        channels_.at(i)->remove_select(cond_);
+    }
+
+    return err;
+}
+
+SrsChannelBase* SrsChannelSelect::pick()
+{
+    for (int i = 0; i < (int)channels_.size(); i++) {
+        SrsChannelBase* ch = channels_.at(i);
+        if (ch->readable()) {
+            return ch;
+        }
+    }
+    return NULL;
+}
+
@@ -0,0 +1,262 @@
+//
+// Copyright (c) 2013-2021 The SRS Authors
+//
+// SPDX-License-Identifier: MIT
+//
+
+#ifndef SRS_APP_CHANNEL_HPP
+#define SRS_APP_CHANNEL_HPP
+
+#include <srs_core.hpp>
+
+#include <errno.h>
+
+#include <deque>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <srs_kernel_error.hpp>
+#include <srs_kernel_utility.hpp>
+#include <srs_service_st.hpp>
+
+// The base of channels, for SrsChannelSelect to wait on channels of different types.
+// @remark All coroutines of the channel must be in the same VP, use SrsMailbox for others.
+class SrsChannelBase
+{
+private:
+    // The conditions of SrsChannelSelect which wait on this channel.
+    std::vector<srs_cond_t> selects_;
+protected:
+    bool closed_;
+    // The coroutines wait to recv or send.
+    srs_cond_t rcond_;
+    srs_cond_t wcond_;
+public:
+    SrsChannelBase();
+    virtual ~SrsChannelBase();
+public:
+    // Close the channel, and wakeup all waiters. The values in channel could still be received,
+    // then recv fails with ERROR_CHANNEL_CLOSED, while send fails immediately.
+    void close();
+    bool closed();
+    // Whether recv never blocks, the channel has value or is closed.
+    virtual bool readable() = 0;
+protected:
+    // Notify a receiver and the selects, when a value is sent or closed.
+    void notify_readable();
+    // Wait on the condition until timeout, the deadline is 0 for no timeout.
+    static srs_error_t wait(srs_cond_t cond, srs_utime_t deadline);
+private:
+    friend class SrsChannelSelect;
+    void add_select(srs_cond_t cond);
+    void remove_select(srs_cond_t cond);
+};
+
+// The storage of bounded channel, the values are stored inline without allocation.
+template<typename T, int Cap>
+class SrsChannelStorage
+{
+private:
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type items_[Cap];
+    int head_;
+    int size_;
+public:
+    SrsChannelStorage() {
+        head_ = size_ = 0;
+    }
+    ~SrsChannelStorage() {
+        while (size_ > 0) {
+            pop();
+        }
+    }
+public:
+    bool empty() {
+        return size_ == 0;
+    }
+    bool full() {
+        return size_ == Cap;
+    }
+    int size() {
+        return size_;
+    }
+    void push(T&& v) {
+        new (&items_[(head_ + size_) % Cap]) T(std::move(v));
+        size_++;
+    }
+    T& front() {
+        return *reinterpret_cast<T*>(&items_[head_]);
+    }
+    void pop() {
+        front().~T();
+        head_ = (head_ + 1) % Cap;
+        size_--;
+    }
+};
+
+// The storage of unbounded channel.
+template<typename T>
+class SrsChannelStorage<T, 0>
+{
+private:
+    std::deque<T> items_;
+public:
+    bool empty() {
+        return items_.empty();
+    }
+    bool full() {
+        return false;
+    }
+    int size() {
+        return (int)items_.size();
+    }
+    void push(T&& v) {
+        items_.push_back(std::move(v));
+    }
+    T& front() {
+        return items_.front();
+    }
+    void pop() {
+        items_.pop_front();
+    }
+};
+
+// The channel to pass values between coroutines of a VP, like the chan of Go. The sender blocks
+// when a bounded channel is full, and the receiver blocks when it's empty, both on ST conditions
+// so they wakeup as soon as the channel is ready, without polling.
+// @param Cap The capacity of bounded channel, the values are stored inline. Use 0 for unbounded
+//      channel, which never blocks the sender.
+// Usage:
+//      SrsChannel<std::unique_ptr<SrsPacket>, 64> ch;
+//      // In producer coroutine.
+//      if ((err = ch.send(std::move(pkt))) != srs_success) {
+//          return err;
+//      }
+//      // In consumer coroutine, until channel is closed.
+//      std::unique_ptr<SrsPacket> pkt;
+//      while ((err = ch.recv(&pkt)) == srs_success) {
+//      }
+template<typename T, int Cap = 0>
+class SrsChannel : public SrsChannelBase
+{
+private:
+    SrsChannelStorage<T, Cap> items_;
+public:
+    SrsChannel() {
+    }
+    virtual ~SrsChannel() {
+    }
+public:
+    // Send the value, block if channel is full.
+    // @param timeout The timeout to wait, or SRS_UTIME_NO_TIMEOUT to wait for ever.
+    // @return ERROR_CHANNEL_CLOSED if closed, ERROR_CHANNEL_TIMEOUT if timeout, or
+    //      ERROR_THREAD_INTERRUPED if interrupted, and the value is not sent.
+    srs_error_t send(T v, srs_utime_t timeout = SRS_UTIME_NO_TIMEOUT) {
+        srs_error_t err = srs_success;
+
+        srs_utime_t deadline = srs_is_never_timeout(timeout)? 0 : srs_update_system_time() + timeout;
+        while (!closed_ && items_.full()) {
+            if ((err = wait(wcond_, deadline)) != srs_success) {
+                return srs_error_wrap(err, "send");
+            }
+        }
+
+        if (closed_) {
+            return srs_error_new(ERROR_CHANNEL_CLOSED, "send");
+        }
+
+        items_.push(std::move(v));
+        notify_readable();
+
+        return err;
+    }
+    // Receive a value, block if channel is empty.
+    // @param pv Output the value, which is moved out from channel.
+    // @return ERROR_CHANNEL_CLOSED if closed and empty, ERROR_CHANNEL_TIMEOUT if timeout, or
+    //      ERROR_THREAD_INTERRUPED if interrupted.
+    srs_error_t recv(T* pv, srs_utime_t timeout = SRS_UTIME_NO_TIMEOUT) {
+        srs_error_t err = srs_success;
+
+        srs_utime_t deadline = srs_is_never_timeout(timeout)? 0 : srs_update_system_time() + timeout;
+        while (!closed_ && items_.empty()) {
+            if ((err = wait(rcond_, deadline)) != srs_success) {
+                return srs_error_wrap(err, "recv");
+            }
+        }
+
+        if (!try_recv(pv)) {
+            return srs_error_new(ERROR_CHANNEL_CLOSED, "recv");
+        }
+
+        return err;
+    }
+    // Send the value if not full and not closed, never block.
+    bool try_send(T&& v) {
+        if (closed_ || items_.full()) {
+            return false;
+        }
+
+        items_.push(std::move(v));
+        notify_readable();
+        return true;
+    }
+    // Receive a value if not empty, never block.
+    bool try_recv(T* pv) {
+        if (items_.empty()) {
+            return false;
+        }
+
+        *pv = std::move(items_.front());
+        items_.pop();
+
+        // Wakeup a sender which waits for room.
+        if (Cap > 0) {
+            srs_cond_signal(wcond_);
+        }
+        return true;
+    }
+    // The number of values in channel.
+    int size() {
+        return items_.size();
+    }
+// Interface SrsChannelBase
+public:
+    virtual bool readable() {
+        return closed_ || !items_.empty();
+    }
+};
+
+// Wait for any of channels to be readable, like the select of Go.
+// Usage:
+//      SrsChannelSelect select;
+//      select.add(&ch0);
+//      select.add(&ch1);
+//      SrsChannelBase* ch = NULL;
+//      if ((err = select.wait(&ch)) != srs_success) {
+//          return err;
+//      }
+//      if (ch == &ch0 && ch0.try_recv(&v0)) {
+//      }
+// @remark The readable channel might be drained by other receivers, so use try_recv after select.
+class SrsChannelSelect
+{
+private:
+    std::vector<SrsChannelBase*> channels_;
+    srs_cond_t cond_;
+public:
+    SrsChannelSelect();
+    virtual ~SrsChannelSelect();
+public:
+    // Add the channel to select, which must outlive the select.
+    void add(SrsChannelBase* ch);
+    // Wait for a channel to be readable, in the order of add if more than one.
+    // @param pch Output the readable channel.
+    // @return ERROR_CHANNEL_TIMEOUT if timeout, or ERROR_THREAD_INTERRUPED if interrupted.
+    srs_error_t wait(SrsChannelBase** pch, srs_utime_t timeout = SRS_UTIME_NO_TIMEOUT);
+private:
+    SrsChannelBase* pick();
+};
+
+#endif
+
@@ -0,0 +1,795 @@
+//
+// Copyright (c) 2013-2021 The SRS Authors
+//
+// SPDX-License-Identifier: MIT
+//
+
+#include <srs_app_cotask.hpp>
+
+#ifdef SRS_CXX20_COROUTINE
+
+#include <st.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <algorithm>
+using namespace std;
+
+#include <srs_kernel_log.hpp>
+#include <srs_kernel_utility.hpp>
+
+// The scheduler of current ST thread.
+static thread_local SrsCoScheduler* _srs_co_scheduler = NULL;
+
+// The max events of epoll for each poll, the left ones are got in next poll.
+#define SRS_CO_POLL_EVENTS 256
+
+coroutine_handle<> SrsCoTask::SrsFinalAwaiter::await_suspend(handle_type h) noexcept
+{
+    promise_type& promise = h.promise();
+    if (promise.parent_) {
+        return promise.parent_;
+    }
+
+    // The root task is freed by scheduler, after it's resumed.
+    if (promise.scheduler_) {
+        promise.scheduler_->on_task_done(h);
+    }
+    return noop_coroutine();
+}
+
+SrsCoTask::SrsCoTask(handle_type h)
+{
+    handle_ = h;
+}
+
+SrsCoTask::SrsCoTask(SrsCoTask&& o)
+{
+    handle_ = o.handle_;
+    o.handle_ = handle_type();
+}
+
+SrsCoTask& SrsCoTask::operator=(SrsCoTask&& o)
+{
+    if (this != &o) {
+        if (handle_) {
+            handle_.destroy();
+        }
+        handle_ = o.handle_;
+        o.handle_ = handle_type();
+    }
+    return *this;
+}
+
+SrsCoTask::~SrsCoTask()
+{
+    if (handle_) {
+        srs_error_t err = handle_.promise().err_;
+        srs_freep(err);
+        handle_.destroy();
+    }
+}
+
+SrsCoTask::handle_type SrsCoTask::release()
+{
+    handle_type h = handle_;
+    handle_ = handle_type();
+    return h;
+}
+
+srs_error_t SrsCoTask::await_resume()
+{
+    if (!handle_) {
+        return srs_error_new(ERROR_THREAD_DUMMY, "no task");
+    }
+
+    srs_error_t err = handle_.promise().err_;
+    handle_.promise().err_ = srs_success;
+    return err;
+}
+
+SrsCoWaiter::SrsCoWaiter()
+{
+    scheduler_ = NULL;
+    fd_ = -1;
+    events_ = 0;
+    deadline_ = 0;
+    timeout_ = woken_ = false;
+    index_ = -1;
+}
+
+SrsCoWaiter::~SrsCoWaiter()
+{
+}
+
+void SrsCoWaiter::park(coroutine_handle<> h, srs_utime_t timeout)
+{
+    scheduler_ = SrsCoScheduler::current();
+    srs_assert(scheduler_);
+
+    handle_ = h;
+    deadline_ = srs_is_never_timeout(timeout)? 0 : srs_update_system_time() + timeout;
+    scheduler_->park(this);
+}
+
+bool SrsCoWaiter::on_ready()
+{
+    return true;
+}
+
+void SrsCoWaiter::on_timeout()
+{
+}
+
+SrsCoPollFd::SrsCoPollFd(int fd)
+{
+    fd_ = fd;
+    events_ = 0;
+}
+
+SrsCoPollFd::~SrsCoPollFd()
+{
+}
+
+SrsCoScheduler::SrsCoScheduler(string name)
+{
+    name_ = name;
+    trd_ = new SrsDummyCoroutine();
+    thread_ = NULL;
+    polling_ = started_ = disposed_ = false;
+    err_ = srs_success;
+#if defined(__linux__)
+    epfd_ = -1;
+    events_.resize(SRS_CO_POLL_EVENTS);
+#endif
+}
+
+SrsCoScheduler::~SrsCoScheduler()
+{
+    stop();
+    srs_freep(trd_);
+    srs_freep(err_);
+}
+
+srs_error_t SrsCoScheduler::start()
+{
+    srs_error_t err = srs_success;
+
+    if (disposed_ || started_) {
+        return srs_error_new(disposed_? ERROR_THREAD_DISPOSED : ERROR_THREAD_STARTED, "scheduler %s", name_.c_str());
+    }
+
+    if (_srs_co_scheduler) {
+        return srs_error_new(ERROR_THREAD_STARTED, "scheduler %s, VP has %s", name_.c_str(), _srs_co_scheduler->name_.c_str());
+    }
+
+#if defined(__linux__)
+    if ((epfd_ = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        return srs_error_new(ERROR_ST_SET_EPOLL, "scheduler %s epoll", name_.c_str());
+    }
+#endif
+
+    srs_freep(trd_);
+    trd_ = new SrsSTCoroutine("co-" + name_, this, _srs_context->get_id());
+    if ((err = trd_->start()) != srs_success) {
+        return srs_error_wrap(err, "start scheduler %s", name_.c_str());
+    }
+
+    started_ = true;
+    _srs_co_scheduler = this;
+
+    return err;
+}
+
+void SrsCoScheduler::stop()
+{
+    if (disposed_) {
+        return;
+    }
+    disposed_ = true;
+
+    trd_->stop();
+
+    if (_srs_co_scheduler == this) {
+        _srs_co_scheduler = NULL;
+    }
+
+    // The waiters are freed with the frames of tasks.
+    for (map<int, SrsCoPollFd*>::iterator it = fds_.begin(); it != fds_.end(); ++it) {
+        SrsCoPollFd* pfd = it->second;
+        srs_freep(pfd);
+    }
+    fds_.clear();
+    timers_.clear();
+    ready_.clear();
+
+#if defined(__linux__)
+    if (epfd_ >= 0) {
+        ::close(epfd_);
+        epfd_ = -1;
+    }
+#endif
+
+    vector<SrsCoTask::handle_type> roots;
+    roots.swap(roots_);
+    for (int i = 0; i < (int)roots.size(); i++) {
+        roots.at(i).destroy();
+    }
+
+    reap();
+}
+
+srs_error_t SrsCoScheduler::spawn(SrsCoTask task)
+{
+    srs_error_t err = srs_success;
+
+    if (disposed_ || !started_) {
+        return srs_error_new(ERROR_THREAD_DISPOSED, "scheduler %s not running", name_.c_str());
+    }
+
+    SrsCoTask::handle_type h = task.release();
+    if (!h) {
+        return srs_error_new(ERROR_THREAD_DUMMY, "scheduler %s no task", name_.c_str());
+    }
+
+    h.promise().scheduler_ = this;
+    h.promise().index_ = (int)roots_.size();
+    roots_.push_back(h);
+
+    ready_.push_back(h);
+    if (polling_) {
+        polling_ = false;
+        srs_thread_interrupt(thread_);
+    }
+
+    return err;
+}
+
+int SrsCoScheduler::size()
+{
+    return (int)roots_.size();
+}
+
+SrsCoScheduler* SrsCoScheduler::current()
+{
+    return _srs_co_scheduler;
+}
+
+void SrsCoScheduler::wakeup(SrsCoWaiter* waiter)
+{
+    if (waiter->woken_) {
+        return;
+    }
+    waiter->woken_ = true;
+
+    unpark(waiter);
+    ready_.push_back(waiter->handle_);
+
+    // Wakeup the scheduler from st_poll, when notified by stackful coroutines.
+    if (polling_) {
+        polling_ = false;
+        srs_thread_interrupt(thread_);
+    }
+}
+
+srs_error_t SrsCoScheduler::cycle()
+{
+    srs_error_t err = srs_success;
+
+    // The tasks spawned before cycle are ready, and the polling is after.
+    thread_ = srs_thread_self();
+
+    while (true) {
+        if ((err = trd_->pull()) != srs_success) {
+            return srs_error_wrap(err, "scheduler %s", name_.c_str());
+        }
+
+        run();
+        reap();
+
+        if ((err = poll()) != srs_success) {
+            return srs_error_wrap(err, "scheduler %s", name_.c_str());
+        }
+    }
+
+    return err;
+}
+
+void SrsCoScheduler::park(SrsCoWaiter* waiter)
+{
+    waiter->woken_ = waiter->timeout_ = false;
+
+    if (waiter->fd_ >= 0) {
+        SrsCoPollFd*& pfd = fds_[waiter->fd_];
+        if (!pfd) {
+            pfd = new SrsCoPollFd(waiter->fd_);
+        }
+
+        waiter->index_ = (int)pfd->waiters_.size();
+        pfd->waiters_.push_back(waiter);
+
+        srs_error_t err = update(pfd);
+        if (err != srs_success && err_ == srs_success) {
+            err_ = err;
+        } else {
+            srs_freep(err);
+        }
+    }
+
+    if (waiter->deadline_) {
+        waiter->timer_ = timers_.insert(make_pair(waiter->deadline_, waiter));
+    }
+}
+
+void SrsCoScheduler::unpark(SrsCoWaiter* waiter)
+{
+    // Remove the waiter of fd by swapping with the last one.
+    if (waiter->index_ >= 0) {
+        map<int, SrsCoPollFd*>::iterator it = fds_.find(waiter->fd_);
+        srs_assert(it != fds_.end());
+        SrsCoPollFd* pfd = it->second;
+
+        SrsCoWaiter* last = pfd->waiters_.back();
+        pfd->waiters_[waiter->index_] = last;
+        last->index_ = waiter->index_;
+        pfd->waiters_.pop_back();
+        waiter->index_ = -1;
+
+        // Never fail for removing fd, which might be closed by user.
+        srs_error_t err = update(pfd);
+        srs_freep(err);
+
+        if (pfd->waiters_.empty()) {
+            fds_.erase(it);
+            srs_freep(pfd);
+        }
+    }
+
+    if (waiter->deadline_) {
+        timers_.erase(waiter->timer_);
+        waiter->deadline_ = 0;
+    }
+}
+
+srs_error_t SrsCoScheduler::update(SrsCoPollFd* pfd)
+{
+    short events = 0;
+    for (int i = 0; i < (int)pfd->waiters_.size(); i++) {
+        events |= pfd->waiters_.at(i)->events_;
+    }
+
+    if (events == pfd->events_) {
+        return srs_success;
+    }
+
+#if defined(__linux__)
+    struct epoll_event ev;
+    ev.events = 0;
+    ev.data.fd = pfd->fd_;
+    if (events & POLLIN) {
+        ev.events |= EPOLLIN;
+    }
+    if (events & POLLOUT) {
+        ev.events |= EPOLLOUT;
+    }
+    if (events & POLLPRI) {
+        ev.events |= EPOLLPRI;
+    }
+
+    int op = !pfd->events_? EPOLL_CTL_ADD : (events? EPOLL_CTL_MOD : EPOLL_CTL_DEL);
+    if (epoll_ctl(epfd_, op, pfd->fd_, &ev) < 0) {
+        return srs_error_new(ERROR_SOCKET_WAIT, "epoll op=%d fd=%d", op, pfd->fd_);
+    }
+#endif
+
+    pfd->events_ = events;
+    return srs_success;
+}
+
+void SrsCoScheduler::run()
+{
+    // Never run the tasks ready during this round, or the stackful coroutines might starve.
+    int nn = (int)ready_.size();
+    for (int i = 0; i < nn && !ready_.empty(); i++) {
+        coroutine_handle<> h = ready_.front();
+        ready_.pop_front();
+        h.resume();
+    }
+}
+
+srs_error_t SrsCoScheduler::poll()
+{
+    srs_utime_t now = srs_update_system_time();
+
+    // Only yield to the stackful coroutines, if there are ready tasks.
+    srs_utime_t timeout = SRS_UTIME_NO_TIMEOUT;
+    if (!ready_.empty()) {
+        timeout = 0;
+    } else if (!timers_.empty()) {
+        timeout = srs_max(0, timers_.begin()->first - now);
+    }
+
+    if (err_ != srs_success) {
+        srs_error_t err = err_;
+        err_ = srs_success;
+        return srs_error_wrap(err, "register fds=%d", (int)fds_.size());
+    }
+
+    // The waiters might be reordered by wakeup, so collect the ready ones first.
+    vector<SrsCoWaiter*> readies;
+
+#if defined(__linux__)
+    // The fds are registered to epoll when parked, so we only wait for the epoll fd.
+    struct pollfd pd;
+    pd.fd = epfd_;
+    pd.events = POLLIN;
+    pd.revents = 0;
+
+    // The stackful coroutines wakeup us by interrupt, when they spawn or notify tasks.
+    polling_ = ready_.empty();
+    int r0 = st_poll(fds_.empty()? NULL : &pd, fds_.empty()? 0 : 1, srs_is_never_timeout(timeout)? ST_UTIME_NO_TIMEOUT : (st_utime_t)timeout);
+    polling_ = false;
+
+    if (r0 < 0 && errno != EINTR) {
+        return srs_error_new(ERROR_SOCKET_WAIT, "poll fds=%d", (int)fds_.size());
+    }
+
+    int nn = (r0 > 0)? epoll_wait(epfd_, &events_[0], (int)events_.size(), 0) : 0;
+    for (int i = 0; i < nn; i++) {
+        struct epoll_event& ev = events_.at(i);
+        map<int, SrsCoPollFd*>::iterator it = fds_.find(ev.data.fd);
+        if (it == fds_.end()) {
+            continue;
+        }
+
+        // The error or hangup is ready for all events, like poll.
+        short revents = 0;
+        if (ev.events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+            revents |= POLLIN;
+        }
+        if (ev.events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) {
+            revents |= POLLOUT;
+        }
+        if (ev.events & (EPOLLPRI | EPOLLERR | EPOLLHUP)) {
+            revents |= POLLPRI;
+        }
+
+        SrsCoPollFd* pfd = it->second;
+        for (int j = 0; j < (int)pfd->waiters_.size(); j++) {
+            SrsCoWaiter* waiter = pfd->waiters_.at(j);
+            if (waiter->events_ & revents) {
+                readies.push_back(waiter);
+            }
+        }
+    }
+#else
+    pds_.resize(fds_.size());
+    map<int, SrsCoPollFd*>::iterator it = fds_.begin();
+    for (int i = 0; it != fds_.end(); ++it, i++) {
+        struct pollfd& pd = pds_.at(i);
+        pd.fd = it->first;
+        pd.events = it->second->events_;
+        pd.revents = 0;
+    }
+
+    // The stackful coroutines wakeup us by interrupt, when they spawn or notify tasks.
+    polling_ = ready_.empty();
+    int r0 = st_poll(pds_.empty()? NULL : &pds_[0], (int)pds_.size(), srs_is_never_timeout(timeout)? ST_UTIME_NO_TIMEOUT : (st_utime_t)timeout);
+    polling_ = false;
+
+    if (r0 < 0 && errno != EINTR) {
+        return srs_error_new(ERROR_SOCKET_WAIT, "poll fds=%d", (int)pds_.size());
+    }
+
+    it = fds_.begin();
+    for (int i = 0; it != fds_.end(); ++it, i++) {
+        short revents = pds_.at(i).revents;
+        if (!revents) {
+            continue;
+        }
+
+        SrsCoPollFd* pfd = it->second;
+        for (int j = 0; j < (int)pfd->waiters_.size(); j++) {
+            SrsCoWaiter* waiter = pfd->waiters_.at(j);
+            if ((waiter->events_ & revents) || (revents & (POLLERR | POLLHUP | POLLNVAL))) {
+                readies.push_back(waiter);
+            }
+        }
+    }
+#endif
+
+    for (int i = 0; i < (int)readies.size(); i++) {
+        SrsCoWaiter* waiter = readies.at(i);
+        if (!waiter->woken_ && waiter->on_ready()) {
+            wakeup(waiter);
+        }
+    }
+
+    // Expire the timers, which are removed by wakeup.
+    now = srs_update_system_time();
+    while (!timers_.empty() && timers_.begin()->first <= now) {
+        SrsCoWaiter* waiter = timers_.begin()->second;
+        waiter->timeout_ = true;
+        waiter->on_timeout();
+        wakeup(waiter);
+    }
+
+    return srs_success;
+}
+
+void SrsCoScheduler::on_task_done(SrsCoTask::handle_type h)
+{
+    SrsCoTask::promise_type& promise = h.promise();
+
+    // Remove the root by swapping with the last one.
+    if (promise.index_ >= 0) {
+        SrsCoTask::handle_type last = roots_.back();
+        roots_[promise.index_] = last;
+        last.promise().index_ = promise.index_;
+        roots_.pop_back();
+        promise.index_ = -1;
+    }
+
+    zombies_.push_back(h);
+}
+
+void SrsCoScheduler::reap()
+{
+    for (int i = 0; i < (int)zombies_.size(); i++) {
+        SrsCoTask::handle_type h = zombies_.at(i);
+
+        srs_error_t err = h.promise().err_;
+        if (err != srs_success) {
+            srs_warn("scheduler %s task err %s", name_.c_str(), srs_error_desc(err).c_str());
+            srs_freep(err);
+        }
+
+        h.destroy();
+    }
+    zombies_.clear();
+}
+
+SrsCoSleep::SrsCoSleep(srs_utime_t timeout)
+{
+    timeout_us_ = timeout;
+}
+
+SrsCoSleep::~SrsCoSleep()
+{
+}
+
+bool SrsCoSleep::await_ready()
+{
+    return timeout_us_ <= 0;
+}
+
+void SrsCoSleep::await_suspend(coroutine_handle<> h)
+{
+    park(h, timeout_us_);
+}
+
+void SrsCoSleep::await_resume()
+{
+}
+
+SrsCoRead::SrsCoRead(srs_netfd_t stfd, void* buf, size_t size, srs_utime_t timeout)
+{
+    fd_read_ = srs_netfd_fileno(stfd);
+    buf_ = buf;
+    size_ = size;
+    timeout_us_ = timeout;
+    nread_ = -1;
+    errno_ = 0;
+}
+
+SrsCoRead::~SrsCoRead()
+{
+}
+
+bool SrsCoRead::await_ready()
+{
+    return on_ready();
+}
+
+void SrsCoRead::await_suspend(coroutine_handle<> h)
+{
+    fd_ = fd_read_;
+    events_ = POLLIN;
+    park(h, timeout_us_);
+}
+
+ssize_t SrsCoRead::await_resume()
+{
+    if (timeout_) {
+        errno = ETIME;
+        return -1;
+    }
+
+    errno = errno_;
+    return nread_;
+}
+
+bool SrsCoRead::on_ready()
+{
+    // The fd of ST is non-blocking.
+    if ((nread_ = ::read(fd_read_, buf_, size_)) < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return false;
+    }
+
+    errno_ = errno;
+    return true;
+}
+
+SrsCoRecvfrom::SrsCoRecvfrom(srs_netfd_t stfd, void* buf, int size, struct sockaddr* from, int* fromlen, srs_utime_t timeout)
+{
+    fd_read_ = srs_netfd_fileno(stfd);
+    buf_ = buf;
+    size_ = size;
+    from_ = from;
+    fromlen_ = fromlen;
+    timeout_us_ = timeout;
+    nread_ = -1;
+    errno_ = 0;
+}
+
+SrsCoRecvfrom::~SrsCoRecvfrom()
+{
+}
+
+bool SrsCoRecvfrom::await_ready()
+{
+    return on_ready();
+}
+
+void SrsCoRecvfrom::await_suspend(coroutine_handle<> h)
+{
+    fd_ = fd_read_;
+    events_ = POLLIN;
+    park(h, timeout_us_);
+}
+
+int SrsCoRecvfrom::await_resume()
+{
+    if (timeout_) {
+        errno = ETIME;
+        return -1;
+    }
+
+    errno = errno_;
+    return nread_;
+}
+
+bool SrsCoRecvfrom::on_ready()
+{
+    socklen_t addrlen = fromlen_? (socklen_t)*fromlen_ : 0;
+    if ((nread_ = (int)::recvfrom(fd_read_, buf_, size_, 0, from_, fromlen_? &addrlen : NULL)) < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return false;
+        }
+    } else if (fromlen_) {
+        *fromlen_ = (int)addrlen;
+    }
+
+    errno_ = errno;
+    return true;
+}
+
+SrsCoConditionWaiter::SrsCoConditionWaiter(SrsCoCondition* cond, srs_utime_t timeout)
+{
+    cond_ = cond;
+    timeout_us_ = timeout;
+    linked_ = false;
+}
+
+SrsCoConditionWaiter::~SrsCoConditionWaiter()
+{
+    unlink();
+}
+
+bool SrsCoConditionWaiter::await_ready()
+{
+    return false;
+}
+
+void SrsCoConditionWaiter::await_suspend(coroutine_handle<> h)
+{
+    cond_->waiters_.push_back(this);
+    linked_ = true;
+    park(h, timeout_us_);
+}
+
+int SrsCoConditionWaiter::await_resume()
+{
+    if (timeout_) {
+        errno = ETIME;
+        return -1;
+    }
+    return 0;
+}
+
+void SrsCoConditionWaiter::on_timeout()
+{
+    unlink();
+}
+
+void SrsCoConditionWaiter::unlink()
+{
+    if (!linked_) {
+        return;
+    }
+    linked_ = false;
+
+    deque<SrsCoConditionWaiter*>::iterator it = std::find(cond_->waiters_.begin(), cond_->waiters_.end(), this);
+    if (it != cond_->waiters_.end()) {
+        cond_->waiters_.erase(it);
+    }
+}
+
+SrsCoCondition::SrsCoCondition()
+{
+    cond_ = srs_cond_new();
+}
+
+SrsCoCondition::~SrsCoCondition()
+{
+    // The tasks never wakeup, which should be freed by scheduler.
+    for (int i = 0; i < (int)waiters_.size(); i++) {
+        waiters_.at(i)->linked_ = false;
+    }
+    srs_cond_destroy(cond_);
+}
+
+int SrsCoCondition::wait(srs_utime_t timeout)
+{
+    if (srs_is_never_timeout(timeout)) {
+        return srs_cond_wait(cond_);
+    }
+    return srs_cond_timedwait(cond_, timeout);
+}
+
+SrsCoConditionWaiter SrsCoCondition::co_wait(srs_utime_t timeout)
+{
+    return SrsCoConditionWaiter(this, timeout);
+}
+
+void SrsCoCondition::signal()
+{
+    if (waiters_.empty()) {
+        srs_cond_signal(cond_);
+        return;
+    }
+
+    SrsCoConditionWaiter* waiter = waiters_.front();
+    waiters_.pop_front();
+    waiter->linked_ = false;
+    waiter->scheduler_->wakeup(waiter);
+}
+
+void SrsCoCondition::broadcast()
+{
+    while (!waiters_.empty()) {
+        SrsCoConditionWaiter* waiter = waiters_.front();
+        waiters_.pop_front();
+        waiter->linked_ = false;
+        waiter->scheduler_->wakeup(waiter);
+    }
+    srs_cond_broadcast(cond_);
+}
+
+SrsCoSleep srs_co_usleep(srs_utime_t usecs)
+{
+    return SrsCoSleep(usecs);
+}
+
+SrsCoRead srs_co_read(srs_netfd_t stfd, void* buf, size_t nbyte, srs_utime_t timeout)
+{
+    return SrsCoRead(stfd, buf, nbyte, timeout);
+}
+
+SrsCoRecvfrom srs_co_recvfrom(srs_netfd_t stfd, void* buf, int len, struct sockaddr* from, int* fromlen, srs_utime_t timeout)
+{
+    return SrsCoRecvfrom(stfd, buf, len, from, fromlen, timeout);
+}
+
+#endif
+
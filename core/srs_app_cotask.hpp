@@ -0,0 +1,345 @@
+//
+// Copyright (c) 2013-2021 The SRS Authors
+//
+// SPDX-License-Identifier: MIT
+//
+
+#ifndef SRS_APP_COTASK_HPP
+#define SRS_APP_COTASK_HPP
+
+#include <srs_core.hpp>
+
+// The stackless tasks of C++20 coroutines, enabled by cmake -DSRS_CXX20_COROUTINE=ON.
+#ifdef SRS_CXX20_COROUTINE
+
+#include <poll.h>
+#include <sys/socket.h>
+#if defined(__linux__)
+#include <sys/epoll.h>
+#endif
+
+#include <coroutine>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <srs_kernel_error.hpp>
+#include <srs_service_st.hpp>
+#include <srs_app_st.hpp>
+
+class SrsCoScheduler;
+class SrsCoCondition;
+
+// The stackless task, which returns the error by co_return, like ISrsCoroutineHandler::cycle.
+// A task is able to co_await other tasks, and the root task is run by SrsCoScheduler::spawn.
+// The frame of task is allocated on heap, which is much smaller than the stack of ST coroutine.
+// Usage:
+//      SrsCoTask on_packet(srs_netfd_t stfd) {
+//          char buf[1500];
+//          ssize_t nn = co_await srs_co_read(stfd, buf, sizeof(buf), 3 * SRS_UTIME_SECONDS);
+//          if (nn <= 0) {
+//              co_return srs_error_new(ERROR_SOCKET_READ, "read nn=%d", (int)nn);
+//          }
+//          co_return srs_success;
+//      }
+//      scheduler->spawn(on_packet(stfd));
+class SrsCoTask
+{
+public:
+    struct promise_type;
+    typedef std::coroutine_handle<promise_type> handle_type;
+    // Resume the parent task when done, or notify the scheduler for root task.
+    struct SrsFinalAwaiter {
+        bool await_ready() noexcept {
+            return false;
+        }
+        std::coroutine_handle<> await_suspend(handle_type h) noexcept;
+        void await_resume() noexcept {
+        }
+    };
+    struct promise_type {
+        srs_error_t err_;
+        // The parent task which awaits this one.
+        std::coroutine_handle<> parent_;
+        // The scheduler of root task, and the index in roots of scheduler.
+        SrsCoScheduler* scheduler_;
+        int index_;
+        promise_type() {
+            err_ = srs_success;
+            scheduler_ = NULL;
+            index_ = -1;
+        }
+        SrsCoTask get_return_object() {
+            return SrsCoTask(handle_type::from_promise(*this));
+        }
+        // The task runs when spawned or awaited.
+        std::suspend_always initial_suspend() noexcept {
+            return std::suspend_always();
+        }
+        SrsFinalAwaiter final_suspend() noexcept {
+            return SrsFinalAwaiter();
+        }
+        void return_value(srs_error_t err) {
+            err_ = err;
+        }
+        // We never use exceptions.
+        void unhandled_exception() {
+            srs_assert(false);
+        }
+    };
+private:
+    handle_type handle_;
+public:
+    SrsCoTask(handle_type h = handle_type());
+    SrsCoTask(SrsCoTask&& o);
+    SrsCoTask& operator=(SrsCoTask&& o);
+    virtual ~SrsCoTask();
+private:
+    SrsCoTask(const SrsCoTask&);
+    SrsCoTask& operator=(const SrsCoTask&);
+public:
+    // Detach the frame from task, which is owned by user.
+    handle_type release();
+// The awaiter to run the task as child of current task.
+public:
+    bool await_ready() {
+        return !handle_ || handle_.done();
+    }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> parent) {
+        handle_.promise().parent_ = parent;
+        return handle_;
+    }
+    // @return The error of child, which should be freed by user.
+    srs_error_t await_resume();
+};
+
+// The pending operation of task, which waits for the fd, the timeout or the notify.
+class SrsCoWaiter
+{
+public:
+    SrsCoScheduler* scheduler_;
+    std::coroutine_handle<> handle_;
+    // The fd and events to poll, or -1 to wait for notify.
+    int fd_;
+    short events_;
+    // The deadline of timer, 0 for no timeout.
+    srs_utime_t deadline_;
+    bool timeout_;
+    // Whether woken up and the task is scheduled to resume.
+    bool woken_;
+    // The position in the waiters of fd, for removing it.
+    int index_;
+    std::multimap<srs_utime_t, SrsCoWaiter*>::iterator timer_;
+public:
+    SrsCoWaiter();
+    virtual ~SrsCoWaiter();
+public:
+    // Park the task on the scheduler of current VP.
+    void park(std::coroutine_handle<> h, srs_utime_t timeout);
+    // Try the operation when fd is ready.
+    // @return Whether the operation is done, or false to wait again, for example, EAGAIN.
+    virtual bool on_ready();
+    // When the timer expires, before the task is resumed.
+    virtual void on_timeout();
+};
+
+// The fd of parked waiters, which is registered to the poller of scheduler once when the first
+// waiter parks, and removed when the last one is woken up.
+class SrsCoPollFd
+{
+public:
+    int fd_;
+    // The registered events, which is the union of events of waiters.
+    short events_;
+    std::vector<SrsCoWaiter*> waiters_;
+public:
+    SrsCoPollFd(int fd);
+    virtual ~SrsCoPollFd();
+};
+
+// The scheduler of stackless tasks in a VP, which is a ST coroutine to resume the ready tasks,
+// then waits for the fds and timers of all parked tasks by st_poll of ST event system. The fds
+// are registered to an epoll of scheduler when parked, so st_poll only waits for the epoll fd,
+// whatever the number of parked tasks. So the
+// stackful coroutines and stackless tasks interoperate on the same VP, and the stackful
+// coroutines are able to spawn tasks, or notify tasks by SrsCoCondition.
+// @remark There is only one scheduler for each VP, which must be started in the VP.
+class SrsCoScheduler : public ISrsCoroutineHandler
+{
+    friend class SrsCoWaiter;
+    friend struct SrsCoTask::SrsFinalAwaiter;
+private:
+    std::string name_;
+    SrsCoroutine* trd_;
+    // The ST thread of scheduler, to wakeup it when it's polling.
+    srs_thread_t thread_;
+    bool polling_;
+    bool started_;
+    bool disposed_;
+private:
+    // The root tasks, and the done ones to free.
+    std::vector<SrsCoTask::handle_type> roots_;
+    std::vector<SrsCoTask::handle_type> zombies_;
+    // The tasks to resume, in FIFO order.
+    std::deque<std::coroutine_handle<> > ready_;
+    // The fds of parked waiters, and the timers.
+    std::map<int, SrsCoPollFd*> fds_;
+    std::multimap<srs_utime_t, SrsCoWaiter*> timers_;
+    // The error to register fd, which fails the scheduler in next poll.
+    srs_error_t err_;
+#if defined(__linux__)
+    // The epoll of fds, which is waited by st_poll as a fd.
+    int epfd_;
+    std::vector<struct epoll_event> events_;
+#else
+    // The fds to poll, in the order of fds_.
+    std::vector<struct pollfd> pds_;
+#endif
+public:
+    SrsCoScheduler(std::string name);
+    virtual ~SrsCoScheduler();
+public:
+    // Start the coroutine of scheduler in current VP.
+    virtual srs_error_t start();
+    // Stop the coroutine of scheduler, and free all tasks.
+    virtual void stop();
+    // Run the root task, which is owned by scheduler. It's ok to spawn in stackful coroutines or
+    // in tasks of the VP. The error of task is logged.
+    virtual srs_error_t spawn(SrsCoTask task);
+    // The number of root tasks running.
+    virtual int size();
+    // Get the scheduler of current VP, NULL if not started.
+    static SrsCoScheduler* current();
+public:
+    // Wakeup the parked task, which is resumed in next round.
+    void wakeup(SrsCoWaiter* waiter);
+// Interface ISrsCoroutineHandler
+public:
+    virtual srs_error_t cycle();
+private:
+    void park(SrsCoWaiter* waiter);
+    void unpark(SrsCoWaiter* waiter);
+    // Update the registered events of fd, only when changed.
+    srs_error_t update(SrsCoPollFd* pfd);
+    // Resume the ready tasks, and the tasks ready by them run in next round.
+    void run();
+    // Poll the fds and timers, or only yield if there are ready tasks.
+    srs_error_t poll();
+    void on_task_done(SrsCoTask::handle_type h);
+    void reap();
+};
+
+// The awaiter to sleep the task.
+class SrsCoSleep : public SrsCoWaiter
+{
+private:
+    srs_utime_t timeout_us_;
+public:
+    SrsCoSleep(srs_utime_t timeout);
+    virtual ~SrsCoSleep();
+public:
+    bool await_ready();
+    void await_suspend(std::coroutine_handle<> h);
+    void await_resume();
+};
+
+// The awaiter to read the fd, like srs_read.
+class SrsCoRead : public SrsCoWaiter
+{
+private:
+    int fd_read_;
+    void* buf_;
+    size_t size_;
+    srs_utime_t timeout_us_;
+    ssize_t nread_;
+    int errno_;
+public:
+    SrsCoRead(srs_netfd_t stfd, void* buf, size_t size, srs_utime_t timeout);
+    virtual ~SrsCoRead();
+public:
+    // Read directly if data is ready, without suspend.
+    bool await_ready();
+    void await_suspend(std::coroutine_handle<> h);
+    // @return The bytes read, or -1 with errno ETIME if timeout.
+    ssize_t await_resume();
+    virtual bool on_ready();
+};
+
+// The awaiter to recvfrom the fd, like srs_recvfrom.
+class SrsCoRecvfrom : public SrsCoWaiter
+{
+private:
+    int fd_read_;
+    void* buf_;
+    int size_;
+    struct sockaddr* from_;
+    int* fromlen_;
+    srs_utime_t timeout_us_;
+    int nread_;
+    int errno_;
+public:
+    SrsCoRecvfrom(srs_netfd_t stfd, void* buf, int size, struct sockaddr* from, int* fromlen, srs_utime_t timeout);
+    virtual ~SrsCoRecvfrom();
+public:
+    bool await_ready();
+    void await_suspend(std::coroutine_handle<> h);
+    // @return The bytes received, or -1 with errno ETIME if timeout.
+    int await_resume();
+    virtual bool on_ready();
+};
+
+// The awaiter of task to wait for SrsCoCondition.
+class SrsCoConditionWaiter : public SrsCoWaiter
+{
+    friend class SrsCoCondition;
+private:
+    SrsCoCondition* cond_;
+    srs_utime_t timeout_us_;
+    bool linked_;
+public:
+    SrsCoConditionWaiter(SrsCoCondition* cond, srs_utime_t timeout);
+    virtual ~SrsCoConditionWaiter();
+public:
+    bool await_ready();
+    void await_suspend(std::coroutine_handle<> h);
+    // @return 0 if notified, or -1 with errno ETIME if timeout.
+    int await_resume();
+    virtual void on_timeout();
+private:
+    void unlink();
+};
+
+// The condition for both the stackful coroutines and the stackless tasks of a VP, because the
+// waiters of ST condition must be ST threads. The tasks are notified before the coroutines.
+class SrsCoCondition
+{
+    friend class SrsCoConditionWaiter;
+private:
+    srs_cond_t cond_;
+    std::deque<SrsCoConditionWaiter*> waiters_;
+public:
+    SrsCoCondition();
+    virtual ~SrsCoCondition();
+public:
+    // Wait in stackful coroutine, like srs_cond_timedwait.
+    int wait(srs_utime_t timeout = SRS_UTIME_NO_TIMEOUT);
+    // Wait in stackless task, by co_await cond.co_wait().
+    SrsCoConditionWaiter co_wait(srs_utime_t timeout = SRS_UTIME_NO_TIMEOUT);
+    void signal();
+    void broadcast();
+};
+
+// Sleep the task, by co_await srs_co_usleep(v).
+extern SrsCoSleep srs_co_usleep(srs_utime_t usecs);
+
+// Read the fd in task, by co_await srs_co_read(stfd, buf, size, timeout).
+extern SrsCoRead srs_co_read(srs_netfd_t stfd, void* buf, size_t nbyte, srs_utime_t timeout);
+
+// Receive from the fd in task, by co_await srs_co_recvfrom(stfd, buf, size, from, fromlen, timeout).
+extern SrsCoRecvfrom srs_co_recvfrom(srs_netfd_t stfd, void* buf, int len, struct sockaddr* from, int* fromlen, srs_utime_t timeout);
+
+#endif
+
+#endif
+
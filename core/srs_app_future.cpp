@@ -0,0 +1,327 @@
+//
+// Copyright (c) 2013-2021 The SRS Authors
+//
+// SPDX-License-Identifier: MIT
+//
+
+#include <srs_app_future.hpp>
+
+#include <errno.h>
+
+#include <algorithm>
+using namespace std;
+
+#include <srs_kernel_utility.hpp>
+#include <srs_core_autofree.hpp>
+
+// Wait on the condition until timeout, the deadline is 0 for no timeout.
+static srs_error_t srs_future_wait(srs_cond_t cond, srs_utime_t deadline)
+{
+    if (srs_cond_wait_until(cond, deadline) == 0) {
+        return srs_success;
+    }
+    if (errno == ETIME) {
+        return srs_error_new(ERROR_FUTURE_TIMEOUT, "future timeout");
+    }
+    return srs_error_new(ERROR_THREAD_INTERRUPED, "future interrupted");
+}
+
+static srs_utime_t srs_future_deadline(srs_utime_t timeout)
+{
+    return srs_is_never_timeout(timeout)? 0 : srs_update_system_time() + timeout;
+}
+
+SrsFutureStateBase::SrsFutureStateBase()
+{
+    refs_ = 1;
+    producer_ = NULL;
+    ready_ = false;
+    err_ = srs_success;
+    cond_ = NULL;
+}
+
+SrsFutureStateBase::~SrsFutureStateBase()
+{
+    srs_freep(err_);
+    if (cond_) {
+        srs_cond_destroy(cond_);
+    }
+}
+
+void SrsFutureStateBase::ref()
+{
+    refs_++;
+}
+
+void SrsFutureStateBase::unref()
+{
+    if (--refs_ == 0) {
+        delete this;
+    }
+}
+
+bool SrsFutureStateBase::ready()
+{
+    return ready_;
+}
+
+srs_error_t SrsFutureStateBase::wait(srs_utime_t deadline)
+{
+    srs_error_t err = srs_success;
+
+    if (!ready_ && !cond_) {
+        cond_ = srs_cond_new();
+    }
+
+    // Hold the state, which might be freed by others when we wait.
+    ref();
+    while (!ready_) {
+        if ((err = srs_future_wait(cond_, deadline)) != srs_success) {
+            break;
+        }
+    }
+    unref();
+
+    return err;
+}
+
+bool SrsFutureStateBase::fail(srs_error_t err)
+{
+    if (ready_) {
+        srs_freep(err);
+        return false;
+    }
+
+    err_ = err;
+    complete();
+    return true;
+}
+
+void SrsFutureStateBase::cancel()
+{
+    if (ready_) {
+        return;
+    }
+
+    // The producer is unbound by complete, so interrupt it before.
+    if (producer_) {
+        srs_thread_interrupt(producer_);
+    }
+    fail(srs_error_new(ERROR_FUTURE_CANCELED, "canceled"));
+}
+
+void SrsFutureStateBase::bind(srs_thread_t producer)
+{
+    if (!ready_) {
+        producer_ = producer;
+    }
+}
+
+void SrsFutureStateBase::complete()
+{
+    ready_ = true;
+    producer_ = NULL;
+
+    if (cond_) {
+        srs_cond_broadcast(cond_);
+    }
+
+    for (int i = 0; i < (int)waiters_.size(); i++) {
+        SrsFutureWaiter* waiter = waiters_.at(i);
+        if (waiter->pending > 0 && --waiter->pending == 0) {
+            srs_cond_signal(waiter->cond);
+        }
+    }
+}
+
+void SrsFutureStateBase::add_waiter(SrsFutureWaiter* waiter)
+{
+    waiters_.push_back(waiter);
+}
+
+void SrsFutureStateBase::remove_waiter(SrsFutureWaiter* waiter)
+{
+    vector<SrsFutureWaiter*>::iterator it = std::find(waiters_.begin(), waiters_.end(), waiter);
+    if (it != waiters_.end()) {
+        waiters_.erase(it);
+    }
+}
+
+SrsFutureBase::SrsFutureBase(SrsFutureStateBase* state)
+{
+    state_ = state;
+    if (state_) {
+        state_->ref();
+    }
+}
+
+SrsFutureBase::SrsFutureBase(const SrsFutureBase& o)
+{
+    state_ = o.state_;
+    if (state_) {
+        state_->ref();
+    }
+}
+
+SrsFutureBase& SrsFutureBase::operator=(const SrsFutureBase& o)
+{
+    if (o.state_) {
+        o.state_->ref();
+    }
+    if (state_) {
+        state_->unref();
+    }
+    state_ = o.state_;
+    return *this;
+}
+
+SrsFutureBase::~SrsFutureBase()
+{
+    if (state_) {
+        state_->unref();
+    }
+}
+
+bool SrsFutureBase::valid()
+{
+    return state_ != NULL;
+}
+
+bool SrsFutureBase::ready()
+{
+    return state_ && state_->ready();
+}
+
+void SrsFutureBase::cancel()
+{
+    if (state_) {
+        state_->cancel();
+    }
+}
+
+srs_error_t SrsFutureBase::wait(srs_utime_t timeout)
+{
+    if (!state_) {
+        return srs_error_new(ERROR_FUTURE_BROKEN, "no state");
+    }
+    return state_->wait(srs_future_deadline(timeout));
+}
+
+// Wait for the pending futures, the waiter is signaled when pending is 0.
+static srs_error_t srs_future_wait_pending(SrsFutureWaiter* waiter, srs_utime_t timeout)
+{
+    srs_error_t err = srs_success;
+
+    srs_utime_t deadline = srs_future_deadline(timeout);
+    waiter->cond = srs_cond_new();
+
+    while (waiter->pending > 0) {
+        if ((err = srs_future_wait(waiter->cond, deadline)) != srs_success) {
+            break;
+        }
+    }
+
+    srs_cond_destroy(waiter->cond);
+
+    return err;
+}
+
+srs_error_t srs_when_all(const vector<SrsFutureBase*>& futures, srs_utime_t timeout)
+{
+    srs_error_t err = srs_success;
+
+    vector<SrsFutureStateBase*> states;
+    for (int i = 0; i < (int)futures.size(); i++) {
+        SrsFutureStateBase* state = futures.at(i)->state_;
+        if (!state) {
+            return srs_error_new(ERROR_FUTURE_BROKEN, "future #%d no state", i);
+        }
+        if (!state->ready()) {
+            states.push_back(state);
+        }
+    }
+
+    // Never block if all are ready.
+    if (states.empty()) {
+        return err;
+    }
+
+    // The waiter is updated by producers when we wait, so never put it on stack, which is
+    // swapped out in copy-stack mode.
+    SrsFutureWaiter* waiter = new SrsFutureWaiter();
+    SrsAutoFree(SrsFutureWaiter, waiter);
+    waiter->pending = (int)states.size();
+
+    // Hold the states, which might be freed by others when we wait.
+    for (int i = 0; i < (int)states.size(); i++) {
+        states.at(i)->ref();
+        states.at(i)->add_waiter(waiter);
+    }
+
+    err = srs_future_wait_pending(waiter, timeout);
+
+    for (int i = 0; i < (int)states.size(); i++) {
+        SrsFutureStateBase* state = states.at(i);
+        state->remove_waiter(waiter);
+        state->unref();
+    }
+
+    if (err != srs_success) {
+        return srs_error_wrap(err, "when all, pending=%d", waiter->pending);
+    }
+
+    return err;
+}
+
+srs_error_t srs_when_any(const vector<SrsFutureBase*>& futures, int* pindex, srs_utime_t timeout)
+{
+    srs_error_t err = srs_success;
+
+    if (futures.empty()) {
+        return srs_error_new(ERROR_FUTURE_BROKEN, "when any no future");
+    }
+
+    for (int i = 0; i < (int)futures.size(); i++) {
+        SrsFutureStateBase* state = futures.at(i)->state_;
+        if (!state) {
+            return srs_error_new(ERROR_FUTURE_BROKEN, "future #%d no state", i);
+        }
+        if (state->ready()) {
+            *pindex = i;
+            return err;
+        }
+    }
+
+    // Any of the states wakes up the waiter, and hold the states when we wait. The waiter is on
+    // heap, see srs_when_all.
+    SrsFutureWaiter* waiter = new SrsFutureWaiter();
+    SrsAutoFree(SrsFutureWaiter, waiter);
+    waiter->pending = 1;
+
+    vector<SrsFutureStateBase*> states;
+    for (int i = 0; i < (int)futures.size(); i++) {
+        SrsFutureStateBase* state = futures.at(i)->state_;
+        state->ref();
+        state->add_waiter(waiter);
+        states.push_back(state);
+    }
+
+    err = srs_future_wait_pending(waiter, timeout);
+
+    *pindex = -1;
+    for (int i = 0; i < (int)states.size(); i++) {
+        SrsFutureStateBase* state = states.at(i);
+        if (*pindex < 0 && state->ready()) {
+            *pindex = i;
+        }
+        state->remove_waiter(waiter);
+        state->unref();
+    }
+
+    if (err != srs_success) {
+        return srs_error_wrap(err, "when any");
+    }
+
+    return err;
+}
+
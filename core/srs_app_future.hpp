@@ -0,0 +1,247 @@
+//
+// Copyright (c) 2013-2021 The SRS Authors
+//
+// SPDX-License-Identifier: MIT
+//
+
+#ifndef SRS_APP_FUTURE_HPP
+#define SRS_APP_FUTURE_HPP
+
+#include <srs_core.hpp>
+
+#include <utility>
+#include <vector>
+
+#include <srs_kernel_error.hpp>
+#include <srs_service_st.hpp>
+
+class SrsFutureBase;
+
+// The waiter of combinators, which is signaled when the pending futures are all ready.
+struct SrsFutureWaiter
+{
+    srs_cond_t cond;
+    int pending;
+};
+
+// The shared state of future and promise, which is freed by the last reference.
+// @remark The future and promise must be used in the same VP, the reference is not atomic.
+class SrsFutureStateBase
+{
+private:
+    int refs_;
+    // The coroutine which fulfills the promise, interrupted when canceled.
+    srs_thread_t producer_;
+    // The combinators which wait for this state.
+    std::vector<SrsFutureWaiter*> waiters_;
+protected:
+    bool ready_;
+    // The error of failed or canceled state.
+    srs_error_t err_;
+    // The coroutines which wait in get, created when the first one waits.
+    srs_cond_t cond_;
+public:
+    SrsFutureStateBase();
+    virtual ~SrsFutureStateBase();
+public:
+    void ref();
+    // Free the state when it's the last reference.
+    void unref();
+    bool ready();
+    // Wait for the state to be ready, the deadline is 0 for no timeout.
+    srs_error_t wait(srs_utime_t deadline);
+    // Fail the state, the err is freed if already ready.
+    // @return Whether the state is failed by this err.
+    bool fail(srs_error_t err);
+    // Fail the state with ERROR_FUTURE_CANCELED, and interrupt the producer.
+    void cancel();
+    void bind(srs_thread_t producer);
+protected:
+    // Mark the state ready, and wakeup all waiters.
+    void complete();
+private:
+    friend srs_error_t srs_when_all(const std::vector<SrsFutureBase*>& futures, srs_utime_t timeout);
+    friend srs_error_t srs_when_any(const std::vector<SrsFutureBase*>& futures, int* pindex, srs_utime_t timeout);
+    void add_waiter(SrsFutureWaiter* waiter);
+    void remove_waiter(SrsFutureWaiter* waiter);
+};
+
+template<typename T>
+class SrsFutureState : public SrsFutureStateBase
+{
+public:
+    T value_;
+public:
+    SrsFutureState() {
+    }
+    virtual ~SrsFutureState() {
+    }
+public:
+    // @return Whether the state is fulfilled by this value.
+    bool set(T&& v) {
+        if (ready_) {
+            return false;
+        }
+
+        value_ = std::move(v);
+        complete();
+        return true;
+    }
+    // Get the value or the error of ready state.
+    srs_error_t get(T* pv) {
+        if (err_ != srs_success) {
+            return srs_error_copy(err_);
+        }
+
+        *pv = value_;
+        return srs_success;
+    }
+};
+
+// The base of futures, for the combinators to wait on futures of different types.
+class SrsFutureBase
+{
+protected:
+    SrsFutureStateBase* state_;
+public:
+    SrsFutureBase(SrsFutureStateBase* state = NULL);
+    SrsFutureBase(const SrsFutureBase& o);
+    SrsFutureBase& operator=(const SrsFutureBase& o);
+    virtual ~SrsFutureBase();
+public:
+    // Whether the future is got from a promise.
+    bool valid();
+    // Whether the value or error is set, so get never blocks.
+    bool ready();
+    // Cancel the future, which fails with ERROR_FUTURE_CANCELED, and the coroutine bound to the
+    // promise is interrupted, so it quits from the blocking calls. Ignored if already ready.
+    void cancel();
+protected:
+    // Wait for the future to be ready.
+    // @return ERROR_FUTURE_TIMEOUT if timeout, or ERROR_THREAD_INTERRUPED if interrupted.
+    srs_error_t wait(srs_utime_t timeout);
+private:
+    friend srs_error_t srs_when_all(const std::vector<SrsFutureBase*>& futures, srs_utime_t timeout);
+    friend srs_error_t srs_when_any(const std::vector<SrsFutureBase*>& futures, int* pindex, srs_utime_t timeout);
+};
+
+// The future to get the result of an async operation, which is set by the promise in another
+// coroutine. The future is copyable, and all copies share the same result.
+template<typename T>
+class SrsFuture : public SrsFutureBase
+{
+public:
+    SrsFuture() {
+    }
+    SrsFuture(SrsFutureState<T>* state) : SrsFutureBase(state) {
+    }
+    virtual ~SrsFuture() {
+    }
+public:
+    // Wait for the result, which could be got more than once.
+    // @param pv Output a copy of the value.
+    // @param timeout The timeout to wait, or SRS_UTIME_NO_TIMEOUT to wait for ever.
+    // @return The error set by promise, ERROR_FUTURE_CANCELED if canceled, ERROR_FUTURE_BROKEN
+    //      if promise is freed without result, ERROR_FUTURE_TIMEOUT if timeout, or
+    //      ERROR_THREAD_INTERRUPED if interrupted.
+    srs_error_t get(T* pv, srs_utime_t timeout = SRS_UTIME_NO_TIMEOUT) {
+        srs_error_t err = srs_success;
+
+        if ((err = wait(timeout)) != srs_success) {
+            return srs_error_wrap(err, "future get");
+        }
+
+        if ((err = static_cast<SrsFutureState<T>*>(state_)->get(pv)) != srs_success) {
+            return srs_error_wrap(err, "future get");
+        }
+
+        return err;
+    }
+};
+
+// The promise to set the result of an async operation, which is moved to the coroutine which
+// runs the operation. The future fails with ERROR_FUTURE_BROKEN if the promise is freed without
+// result. The result is set once, and the later ones are ignored.
+// Usage:
+//      SrsPromise<std::string> promise;
+//      SrsFuture<std::string> future = promise.get_future();
+//      pool->spawn([promise = std::move(promise)]() mutable {
+//          promise.bind();
+//          promise.set_value(fetch_backend());
+//      });
+//      std::string v;
+//      if ((err = future.get(&v, 3 * SRS_UTIME_SECONDS)) != srs_success) {
+//          future.cancel();
+//          return err;
+//      }
+template<typename T>
+class SrsPromise
+{
+private:
+    SrsFutureState<T>* state_;
+public:
+    SrsPromise() {
+        state_ = new SrsFutureState<T>();
+    }
+    SrsPromise(SrsPromise&& o) {
+        state_ = o.state_;
+        o.state_ = NULL;
+    }
+    SrsPromise& operator=(SrsPromise&& o) {
+        if (this != &o) {
+            reset();
+            state_ = o.state_;
+            o.state_ = NULL;
+        }
+        return *this;
+    }
+    virtual ~SrsPromise() {
+        reset();
+    }
+private:
+    SrsPromise(const SrsPromise&);
+    SrsPromise& operator=(const SrsPromise&);
+public:
+    SrsFuture<T> get_future() {
+        return SrsFuture<T>(state_);
+    }
+    // Bind the current coroutine, which is interrupted when the future is canceled, until the
+    // result is set or the promise is freed.
+    void bind() {
+        state_->bind(srs_thread_self());
+    }
+    // @return Whether the value is set, false if already set or canceled.
+    bool set_value(T v) {
+        return state_->set(std::move(v));
+    }
+    // Fail the future, the err is owned by promise.
+    // @return Whether the error is set, false if already set or canceled.
+    bool set_error(srs_error_t err) {
+        return state_->fail(err);
+    }
+private:
+    void reset() {
+        if (!state_) {
+            return;
+        }
+
+        if (!state_->ready()) {
+            state_->fail(srs_error_new(ERROR_FUTURE_BROKEN, "broken promise"));
+        }
+        state_->unref();
+        state_ = NULL;
+    }
+};
+
+// Wait for all futures to be ready, the waiter is woken up only once when the last one is ready.
+// @remark Get the results from futures, which never block.
+// @return ERROR_FUTURE_TIMEOUT if timeout, or ERROR_THREAD_INTERRUPED if interrupted.
+extern srs_error_t srs_when_all(const std::vector<SrsFutureBase*>& futures, srs_utime_t timeout = SRS_UTIME_NO_TIMEOUT);
+
+// Wait for any of futures to be ready.
+// @param pindex Output the index of the first ready future, in the order of futures.
+// @return ERROR_FUTURE_TIMEOUT if timeout, or ERROR_THREAD_INTERRUPED if interrupted.
+extern srs_error_t srs_when_any(const std::vector<SrsFutureBase*>& futures, int* pindex, srs_utime_t timeout = SRS_UTIME_NO_TIMEOUT);
+
+#endif
+
@@ -201,6 +201,7 @@ ISrsFastTimer::~ISrsFastTimer()
 SrsFastTimer::SrsFastTimer(std::string label, srs_utime_t interval)
 {
     interval_ = interval;
+    slack_ = SRS_UTIME_NO_TIMEOUT;
     trd_ = new SrsSTCoroutine(label, this, _srs_context->get_id());
 }
 
@@ -239,6 +240,10 @@ srs_error_t SrsFastTimer::cycle()
 {
     srs_error_t err = srs_success;
 
+    if (slack_ != SRS_UTIME_NO_TIMEOUT) {
+        srs_thread_set_slack(srs_thread_self(), slack_);
+    }
+
     while (true) {
         if ((err = trd_->pull()) != srs_success) {
             return srs_error_wrap(err, "quit");
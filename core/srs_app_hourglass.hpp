@@ -144,6 +144,8 @@ class SrsFastTimer : public ISrsCoroutineHandler
 private:
     SrsCoroutine* trd_;
     srs_utime_t interval_;
+    // The timer slack of coroutine, or SRS_UTIME_NO_TIMEOUT to use the default one.
+    srs_utime_t slack_;
     std::vector<ISrsFastTimer*> handlers_;
 public:
     SrsFastTimer(std::string label, srs_utime_t interval);
@@ -151,6 +153,9 @@ public:
 public:
     srs_error_t start();
     void set_stack_size(int size){ ((SrsSTCoroutine*)trd_)->set_stack_size(size); }
+    // Allow the timer to tick at most slack later, to be batched with other timers, for
+    // example, the heartbeats which are not sensitive to delay. Set it before start.
+    void set_slack(srs_utime_t slack) { slack_ = slack; }
 public:
     void subscribe(ISrsFastTimer* timer);
     void unsubscribe(ISrsFastTimer* timer);
@@ -441,7 +441,7 @@ std::string SrsUdpMuxSocket::peer_id()
         }
 
         // Build the peer id.
-        static char id_buf[128];
+        static thread_local char id_buf[128];
         int len = snprintf(id_buf, sizeof(id_buf), "%s:%d", peer_ip.c_str(), peer_port);
         peer_id_ = string(id_buf, len);
 
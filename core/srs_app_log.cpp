@@ -13,6 +13,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <pthread.h>
 
 // #include <srs_app_config.hpp>
 #include <srs_kernel_error.hpp>
@@ -27,10 +28,14 @@
 // reserved for the end of log data, it must be strlen(LOG_TAIL)
 #define LOG_TAIL_SIZE 1
 
+// The log buffer of each VP(pthread), coroutines in the same VP never yield while logging.
+static thread_local char log_data[LOG_MAX_SIZE];
+// Protect the log file, which is opened by the first VP writing log.
+static pthread_mutex_t log_file_lock = PTHREAD_MUTEX_INITIALIZER;
+
 SrsFileLog::SrsFileLog()
 {
     level = SrsLogLevelTrace;
-    log_data = new char[LOG_MAX_SIZE];
     
     fd = -1;
     log_to_file_tank = true;
@@ -39,8 +44,6 @@ SrsFileLog::SrsFileLog()
 
 SrsFileLog::~SrsFileLog()
 {
-    srs_freepa(log_data);
-    
     if (fd > 0) {
         ::close(fd);
         fd = -1;
@@ -207,7 +210,11 @@ void SrsFileLog::write_log(int& fd, char *str_log, int size, int level)
     
     // open log file. if specified
     if (fd < 0) {
-        open_log_file();
+        pthread_mutex_lock(&log_file_lock);
+        if (fd < 0) {
+            open_log_file();
+        }
+        pthread_mutex_unlock(&log_file_lock);
     }
     
     // write log to file.
@@ -27,13 +27,13 @@
 // Use memory/disk cache and donot flush when write log.
 // it's ok to use it without config, which will log to console, and default trace level.
 // when you want to use different level, override this classs, set the protected _level.
+// @remark The log buffer is per thread, so it's safe to share the log between VPs.
 class SrsFileLog : public ISrsLog
 {
 private:
     // Defined in SrsLogLevel.
     SrsLogLevel level;
 private:
-    char* log_data;
     // Log to file if specified srs_log_file
     int fd;
     // Whether log to file tank
@@ -0,0 +1,243 @@
+//
+// Copyright (c) 2013-2021 The SRS Authors
+//
+// SPDX-License-Identifier: MIT
+//
+
+#include <srs_app_mailbox.hpp>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
+
+using namespace std;
+
+#include <srs_kernel_error.hpp>
+#include <srs_kernel_log.hpp>
+
+// The mailbox of current ST thread.
+static thread_local SrsMailbox* _srs_mailbox_self = NULL;
+
+SrsMailbox* srs_mailbox_self()
+{
+    return _srs_mailbox_self;
+}
+
+void srs_mailbox_set_self(SrsMailbox* mailbox)
+{
+    _srs_mailbox_self = mailbox;
+}
+
+SrsMailbox::SrsMailbox(string label)
+{
+    label_ = label;
+    trd_ = new SrsDummyCoroutine();
+    stfd_ = NULL;
+    rfd_ = wfd_ = -1;
+
+    // The VP reads the rfd_ by ST, which is closed when VP stops, while foreign threads
+    // might still post to the wfd_, so we use a dup of eventfd for writing.
+#if defined(__linux__)
+    if ((rfd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) >= 0) {
+        wfd_ = dup(rfd_);
+    }
+#else
+    int fds[2];
+    if (pipe(fds) == 0) {
+        rfd_ = fds[0];
+        wfd_ = fds[1];
+        fcntl(wfd_, F_SETFL, fcntl(wfd_, F_GETFL) | O_NONBLOCK);
+        fcntl(rfd_, F_SETFD, FD_CLOEXEC);
+        fcntl(wfd_, F_SETFD, FD_CLOEXEC);
+    }
+#endif
+
+    SrsMailboxNode* stub = new SrsMailboxNode();
+    stub->next.store(NULL, std::memory_order_relaxed);
+    head_.store(stub, std::memory_order_relaxed);
+    tail_ = stub;
+    notified_.store(false, std::memory_order_relaxed);
+    stopped_.store(false, std::memory_order_relaxed);
+    posting_.store(0, std::memory_order_relaxed);
+
+    nn_wakeups_ = 0;
+    nn_msgs_ = 0;
+}
+
+SrsMailbox::~SrsMailbox()
+{
+    stop();
+
+    if (rfd_ >= 0) {
+        ::close(rfd_);
+    }
+    if (wfd_ >= 0) {
+        ::close(wfd_);
+    }
+
+    // Discard the closures not drained.
+    while (tail_) {
+        SrsMailboxNode* next = tail_->next.load(std::memory_order_acquire);
+        srs_freep(tail_);
+        tail_ = next;
+    }
+}
+
+srs_error_t SrsMailbox::start()
+{
+    srs_error_t err = srs_success;
+
+    if (rfd_ < 0 || wfd_ < 0) {
+        return srs_error_new(ERROR_SYSTEM_CREATE_PIPE, "mailbox %s create fd", label_.c_str());
+    }
+
+    if (stfd_) {
+        return srs_error_new(ERROR_THREAD_STARTED, "mailbox %s started", label_.c_str());
+    }
+
+    if ((stfd_ = srs_netfd_open(rfd_)) == NULL) {
+        return srs_error_new(ERROR_ST_OPEN_SOCKET, "mailbox %s open fd=%d", label_.c_str(), rfd_);
+    }
+    stopped_.store(false);
+
+    srs_freep(trd_);
+    trd_ = new SrsSTCoroutine("mailbox-" + label_, this, _srs_context->get_id());
+    if ((err = trd_->start()) != srs_success) {
+        return srs_error_wrap(err, "start mailbox %s", label_.c_str());
+    }
+
+    return err;
+}
+
+void SrsMailbox::stop()
+{
+    trd_->stop();
+
+    // Reject the new posts, and wait for the producers which already passed the check, then
+    // drain the closures posted before stop, or the producers wait for them forever.
+    stopped_.store(true);
+    while (posting_.load() > 0) {
+        sched_yield();
+    }
+
+    // The rfd_ is closed with stfd_, never close it again.
+    if (stfd_) {
+        nn_msgs_ += drain();
+        srs_close_stfd(stfd_);
+        rfd_ = -1;
+    }
+}
+
+srs_error_t SrsMailbox::post(SrsMailboxFunc func)
+{
+    if (wfd_ < 0) {
+        return srs_error_new(ERROR_SYSTEM_CREATE_PIPE, "mailbox %s create fd", label_.c_str());
+    }
+
+    // Check the stopped after posting is set, so the stop either rejects us, or waits for us.
+    posting_.fetch_add(1);
+    if (stopped_.load()) {
+        posting_.fetch_sub(1);
+        return srs_error_new(ERROR_THREAD_DISPOSED, "mailbox %s stopped", label_.c_str());
+    }
+
+    SrsMailboxNode* node = new SrsMailboxNode();
+    node->next.store(NULL, std::memory_order_relaxed);
+    node->func = func;
+
+    SrsMailboxNode* prev = head_.exchange(node, std::memory_order_acq_rel);
+    prev->next.store(node, std::memory_order_release);
+    posting_.fetch_sub(1);
+
+    // Only the first post after the VP is woken up writes the fd, the rest of batch is
+    // drained on the same wakeup.
+    if (notified_.exchange(true, std::memory_order_acq_rel)) {
+        return srs_success;
+    }
+
+    // For pipe, if full, there is already data to wakeup the VP, so ignore EAGAIN.
+    uint64_t v = 1;
+#if defined(__linux__)
+    ssize_t nn = ::write(wfd_, &v, sizeof(v));
+#else
+    ssize_t nn = ::write(wfd_, &v, 1);
+#endif
+    if (nn <= 0 && errno != EAGAIN) {
+        // The VP is not notified, so the next post should try again.
+        notified_.store(false);
+        return srs_error_new(ERROR_SYSTEM_FILE_WRITE, "mailbox %s notify fd=%d", label_.c_str(), wfd_);
+    }
+
+    return srs_success;
+}
+
+uint64_t SrsMailbox::nn_wakeups()
+{
+    return nn_wakeups_;
+}
+
+uint64_t SrsMailbox::nn_msgs()
+{
+    return nn_msgs_;
+}
+
+srs_error_t SrsMailbox::cycle()
+{
+    srs_error_t err = srs_success;
+
+    // For eventfd, it requires at least 8 bytes.
+    char buf[64];
+
+    while (true) {
+        if ((err = trd_->pull()) != srs_success) {
+            return srs_error_wrap(err, "mailbox %s", label_.c_str());
+        }
+
+        ssize_t nn = srs_read(stfd_, buf, sizeof(buf), SRS_UTIME_NO_TIMEOUT);
+        if (nn <= 0) {
+            // Interrupted by stop, or the fd is closed.
+            if (errno == EINTR) {
+                continue;
+            }
+            return srs_error_new(ERROR_SYSTEM_FILE_READ, "mailbox %s read, nn=%d", label_.c_str(), (int)nn);
+        }
+        nn_wakeups_++;
+
+        // Reset the notified before drain, so the producers which post after it will
+        // wakeup us again, and the closures linked before it are visible to drain.
+        notified_.exchange(false, std::memory_order_acq_rel);
+        nn_msgs_ += drain();
+    }
+
+    return err;
+}
+
+int SrsMailbox::drain()
+{
+    int nn = 0;
+
+    while (true) {
+        SrsMailboxNode* tail = tail_;
+        SrsMailboxNode* next = tail->next.load(std::memory_order_acquire);
+
+        // Empty, or a producer is linking the node, which will notify us again.
+        if (!next) {
+            break;
+        }
+
+        // The next becomes the stub, take its closure.
+        tail_ = next;
+        SrsMailboxFunc func;
+        func.swap(next->func);
+        srs_freep(tail);
+
+        func();
+        nn++;
+    }
+
+    return nn;
+}
+
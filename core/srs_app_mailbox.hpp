@@ -0,0 +1,102 @@
+//
+// Copyright (c) 2013-2021 The SRS Authors
+//
+// SPDX-License-Identifier: MIT
+//
+
+#ifndef SRS_APP_MAILBOX_HPP
+#define SRS_APP_MAILBOX_HPP
+
+#include <srs_core.hpp>
+
+#include <atomic>
+#include <functional>
+
+#include <srs_app_st.hpp>
+
+// The mailbox to post work from foreign threads into an ST event loop(VP), for example,
+// the plain std::thread or pthread which is not a VP, or the other VPs.
+//
+// The foreign threads push the closures to a lock-free MPSC queue, and wakeup the VP by
+// an eventfd(or pipe if eventfd is not available), which is registered to ST event system.
+// A coroutine of VP drains the whole batch of closures on one wakeup, so there is no polling,
+// and only the first post of a batch writes the eventfd.
+//
+// Usage:
+//      // In VP, start the coroutine to drain the mailbox.
+//      SrsMailbox* mailbox = new SrsMailbox("vp0");
+//      if ((err = mailbox->start()) != srs_success) {
+//          return err;
+//      }
+//      // In any thread, run the closure in the coroutine of VP.
+//      mailbox->post([=]() { ... });
+class SrsMailbox : public ISrsCoroutineHandler
+{
+public:
+    typedef std::function<void()> SrsMailboxFunc;
+private:
+    // The node of MPSC queue, see http://www.1024cores.net/home/lock-free-algorithms/queues/intrusive-mpsc-node-based-queue
+    struct SrsMailboxNode {
+        std::atomic<SrsMailboxNode*> next;
+        SrsMailboxFunc func;
+    };
+private:
+    std::string label_;
+    SrsCoroutine* trd_;
+    // The eventfd to wakeup VP, or the read end of pipe.
+    int rfd_;
+    // The write end of pipe, same to rfd_ for eventfd.
+    int wfd_;
+    srs_netfd_t stfd_;
+private:
+    // The producers push to head, the consumer pops from tail, which is a stub node.
+    std::atomic<SrsMailboxNode*> head_;
+    SrsMailboxNode* tail_;
+    // Whether the VP is already notified, to merge the wakeups of a batch.
+    std::atomic<bool> notified_;
+    // Whether stopped, then the posts are rejected, because nobody drains them.
+    std::atomic<bool> stopped_;
+    // The producers which are posting, the stop waits for them before the last drain.
+    std::atomic<int> posting_;
+private:
+    // The stat of mailbox, updated by consumer.
+    uint64_t nn_wakeups_;
+    uint64_t nn_msgs_;
+public:
+    // @remark The mailbox could be created in any thread, but start in the VP to drain it.
+    SrsMailbox(std::string label);
+    virtual ~SrsMailbox();
+public:
+    // Start the coroutine in current VP to drain the mailbox.
+    virtual srs_error_t start();
+    // Stop the coroutine, and run the closures posted before stop.
+    // @remark It must be called in the VP, like start.
+    virtual void stop();
+    // Post the closure to run in the VP, it's thread-safe and lock-free.
+    // @return ERROR_THREAD_DISPOSED if stopped, then the closure is never run. For other
+    //      errors, the closure is queued and run by next wakeup or stop.
+    // @remark The closures are run in order of post for each producer.
+    virtual srs_error_t post(SrsMailboxFunc func);
+    // The number of wakeups and closures drained, for stat.
+    virtual uint64_t nn_wakeups();
+    virtual uint64_t nn_msgs();
+// Interface ISrsCoroutineHandler
+public:
+    virtual srs_error_t cycle();
+private:
+    // Pop all closures and run them, return the number of closures.
+    int drain();
+};
+
+// Get the mailbox of current ST thread, for example, the worker threads deliver the result
+// back to the coroutine by it.
+// @return NULL if no mailbox is set by srs_mailbox_set_self.
+// @remark It must be called in the coroutine of ST thread.
+extern SrsMailbox* srs_mailbox_self();
+
+// Set the mailbox of current ST thread, for example, the VP uses its own mailbox. The owner
+// starts and frees the mailbox, and should set it to NULL before free.
+extern void srs_mailbox_set_self(SrsMailbox* mailbox);
+
+#endif
+
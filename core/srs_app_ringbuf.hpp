@@ -1,215 +1,322 @@
-#pragma once
+//
+// Copyright (c) 2013-2021 The SRS Authors
+//
+// SPDX-License-Identifier: MIT
+//
 
-#define MAX_RINGBUFFER_SIZE   1000
-#define MAX_BUFFER_NAME_SIZE  80
+#ifndef SRS_APP_RINGBUF_HPP
+#define SRS_APP_RINGBUF_HPP
 
-#define FALSE                   0
-#define TRUE                    1
-#define INVALID_VALUE           0xffff
-#ifndef NULL
-    #define NULL                    0
-#endif
+#include <srs_core.hpp>
 
-typedef enum
-{
-    E_RET_BUF_NULL = 0,
-    E_RET_BUF_FULL,
-    E_RET_BUF_EMPTY,
-    E_RET_BUF_NOT_INIT,
-    E_RET_BUF_OK
-}E_OPER_BUFFER_RET;
-
-template <class T>
-class T_PacketRing_Buffer
-{
-public:
-    T* ptArrayBuffer[MAX_RINGBUFFER_SIZE];
-    unsigned int          write;
-    unsigned int          read;
-    unsigned int          bufferSize;//缓存数组的个数
-    unsigned int          curCount;
-    unsigned int          writeCount;
-    unsigned int          readCount;
-    //char            pRingbufName[MAX_BUFFER_NAME_SIZE];
-    bool            bIsInit;
-    bool            bIsWrited;
-    unsigned int          overwriteCnt;
-};
+#include <stdint.h>
 
-#define RING_BUFFER_CUR_READ_POS(ring_buffer) ring_buffer->read
-#define RING_BUFFER_CUR_WRITE_POS(ring_buffer) ring_buffer->write
-#define RING_BUFFER_ADD_READ_POS(ring_buffer) {ring_buffer->read = (ring_buffer->read + 1)%(ring_buffer->bufferSize);}
-#define RING_BUFFER_TO_WRITE_POS(ring_buffer) (ring_buffer->write + 1)%(ring_buffer->bufferSize)
-#define RING_BUFFER_ADD_WRITE_POS(ring_buffer) {ring_buffer->write = (ring_buffer->write + 1)%(ring_buffer->bufferSize);}
+#include <atomic>
+#include <new>
+#include <type_traits>
+#include <utility>
 
+// The size of cache line, to pad the indexes of producers and consumer to avoid false sharing.
+#define SRS_CACHELINE_SIZE 64
 
+// The max capacity of ring.
+#define SRS_RING_MAX_CAPACITY (1 << 30)
 
-template <class T>
-class SrsRingBuffer
-{
-public:
-    SrsRingBuffer(unsigned int iBufferSize);
-
-    E_OPER_BUFFER_RET Read_Packet_RingBuffer(T** ptOutBuffer);
-    E_OPER_BUFFER_RET Read_Packet_Top_RingBuffer(T** ptOutBuffer);
-    E_OPER_BUFFER_RET Write_Packet_RingBuffer(T* ptInBuffer, unsigned int iReadIdx = 0);
-    void Destroy_Packet_RingBuffer(unsigned int iReadIdx = 0);
-    unsigned int Get_Packet_RingBuffer_Count();
-    
-    virtual ~SrsRingBuffer();
-
-private:
-    T_PacketRing_Buffer<T> mRingBuf;
-};
-
-
-
-
-template <class T>
-SrsRingBuffer<T>::SrsRingBuffer(unsigned int iBufferSize)
-{
-    memset(&mRingBuf, 0, sizeof(T_PacketRing_Buffer<T>));
-    mRingBuf.bufferSize = (iBufferSize <= 0 || iBufferSize >= MAX_RINGBUFFER_SIZE) ? MAX_RINGBUFFER_SIZE : iBufferSize;
-    mRingBuf.bIsInit = TRUE;
-}
-
-template <class T>
-unsigned int SrsRingBuffer<T>::Get_Packet_RingBuffer_Count()
+// Round up the capacity to the power of two, so the index is masked instead of modulo.
+inline uint64_t srs_ring_capacity(uint64_t v)
 {
-    return (mRingBuf.write + mRingBuf.bufferSize - mRingBuf.read) % (mRingBuf.bufferSize);
+    uint64_t capacity = 2;
+    while (capacity < v && capacity < SRS_RING_MAX_CAPACITY) {
+        capacity <<= 1;
+    }
+    return capacity;
 }
 
-
-template <class T>
-E_OPER_BUFFER_RET SrsRingBuffer<T>::Read_Packet_RingBuffer(T** ptOutBuffer)
+// The lock-free ring for a producer thread and a consumer thread, the values are stored in the
+// ring, and moved in and out. The indexes only grow and never wrap, and each side caches the
+// index of the other side, so it only touches the cache line of the other side when the cached
+// one says full or empty.
+// Usage:
+//      SrsSpscRing<SrsPacket*> ring(1024);
+//      // In producer thread.
+//      if (!ring.push(pkt)) {
+//          // Full, drop or retry.
+//      }
+//      // In consumer thread, pop a batch to publish the index once.
+//      SrsPacket* pkts[64];
+//      int nn = ring.pop_batch(pkts, 64);
+template<typename T>
+class SrsSpscRing
 {
-    if (NULL == ptOutBuffer)
-    {
-        return E_RET_BUF_NULL;
+private:
+    typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type SrsRingSlot;
+    SrsRingSlot* slots_;
+    uint64_t capacity_;
+    uint64_t mask_;
+    char pad0_[SRS_CACHELINE_SIZE];
+    // The consumer pops at head, and caches the tail of producer.
+    std::atomic<uint64_t> head_;
+    uint64_t tail_cache_;
+    char pad1_[SRS_CACHELINE_SIZE];
+    // The producer pushes at tail, and caches the head of consumer.
+    std::atomic<uint64_t> tail_;
+    uint64_t head_cache_;
+    char pad2_[SRS_CACHELINE_SIZE];
+public:
+    // @param capacity Round up to the power of two.
+    SrsSpscRing(uint64_t capacity) {
+        capacity_ = srs_ring_capacity(capacity);
+        mask_ = capacity_ - 1;
+        slots_ = new SrsRingSlot[capacity_];
+        head_.store(0, std::memory_order_relaxed);
+        tail_.store(0, std::memory_order_relaxed);
+        tail_cache_ = head_cache_ = 0;
     }
+    virtual ~SrsSpscRing() {
+        T v;
+        while (pop(&v)) {
+        }
+        delete[] slots_;
+    }
+private:
+    SrsSpscRing(const SrsSpscRing&);
+    SrsSpscRing& operator=(const SrsSpscRing&);
+public:
+    // Push the value in producer thread.
+    // @return false if full, and the value is not moved.
+    bool push(T&& v) {
+        uint64_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_cache_ >= capacity_) {
+            head_cache_ = head_.load(std::memory_order_acquire);
+            if (tail - head_cache_ >= capacity_) {
+                return false;
+            }
+        }
 
-    if (FALSE == mRingBuf.bIsInit)
-    {
-        return E_RET_BUF_NOT_INIT;
+        new (&slots_[tail & mask_]) T(std::move(v));
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+    bool push(const T& v) {
+        T copy = v;
+        return push(std::move(copy));
     }
+    // Push the values in producer thread, and publish them once.
+    // @return The number of values moved in, which is less than n if no room.
+    int push_batch(T* vs, int n) {
+        uint64_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_cache_ + n > capacity_) {
+            head_cache_ = head_.load(std::memory_order_acquire);
+        }
+
+        uint64_t room = capacity_ - (tail - head_cache_);
+        int nn = (room < (uint64_t)n)? (int)room : n;
+        for (int i = 0; i < nn; i++) {
+            new (&slots_[(tail + i) & mask_]) T(std::move(vs[i]));
+        }
 
-    if (RING_BUFFER_CUR_READ_POS((&mRingBuf)) == RING_BUFFER_CUR_WRITE_POS((&mRingBuf)))
-    {
-        return E_RET_BUF_EMPTY;
+        if (nn > 0) {
+            tail_.store(tail + nn, std::memory_order_release);
+        }
+        return nn;
     }
-    else
-    {
-        mRingBuf.readCount++;
-        *ptOutBuffer = mRingBuf.ptArrayBuffer[RING_BUFFER_CUR_READ_POS((&mRingBuf))];
-        if (NULL == (*ptOutBuffer))
-        {
-            //ERRORLOG("Read_Packet_RingBuffer, mRingBuf is NULL, buffer name: %s\n", mRingBuf.pRingbufName);
-            return E_RET_BUF_EMPTY;
+    // Pop a value in consumer thread.
+    // @return false if empty.
+    bool pop(T* pv) {
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_cache_) {
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            if (head == tail_cache_) {
+                return false;
+            }
         }
-        mRingBuf.curCount = Get_Packet_RingBuffer_Count();
-        RING_BUFFER_ADD_READ_POS((&mRingBuf));
-        
-        return E_RET_BUF_OK;
+
+        T* p = reinterpret_cast<T*>(&slots_[head & mask_]);
+        *pv = std::move(*p);
+        p->~T();
+        head_.store(head + 1, std::memory_order_release);
+        return true;
     }
-}
+    // Pop the values in consumer thread, and publish the room once.
+    // @return The number of values moved out, 0 if empty.
+    int pop_batch(T* pvs, int n) {
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        if (tail_cache_ - head < (uint64_t)n) {
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+        }
 
+        uint64_t ready = tail_cache_ - head;
+        int nn = (ready < (uint64_t)n)? (int)ready : n;
+        for (int i = 0; i < nn; i++) {
+            T* p = reinterpret_cast<T*>(&slots_[(head + i) & mask_]);
+            pvs[i] = std::move(*p);
+            p->~T();
+        }
 
-template <class T>
-E_OPER_BUFFER_RET SrsRingBuffer<T>::Read_Packet_Top_RingBuffer(T** ptOutBuffer)
-{
-    if (NULL == ptOutBuffer || 0 == mRingBuf.bufferSize)
-    {
-        return E_RET_BUF_NULL;
+        if (nn > 0) {
+            head_.store(head + nn, std::memory_order_release);
+        }
+        return nn;
     }
-
-    if (FALSE == mRingBuf.bIsInit)
-    {
-        return E_RET_BUF_NOT_INIT;
+    // The number of values, which is a snapshot when the other side is running.
+    int size() {
+        uint64_t head = head_.load(std::memory_order_acquire);
+        uint64_t tail = tail_.load(std::memory_order_acquire);
+        return (tail > head)? (int)(tail - head) : 0;
     }
+    int capacity() {
+        return (int)capacity_;
+    }
+};
 
-    if (RING_BUFFER_CUR_READ_POS((&mRingBuf)) == RING_BUFFER_CUR_WRITE_POS((&mRingBuf)))
-    {
-        return E_RET_BUF_EMPTY;
+// The lock-free ring for many producer threads and a consumer thread, see the bounded MPMC queue
+// http://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+// Each slot has a sequence, which is its position when it's free, or the position plus one when
+// the value is published. So a producer reserves the tail by CAS and publishes the slot by its
+// sequence, without reading the head of consumer.
+// @remark The consumer sees the values in order of reservation, so a preempted producer delays
+//      the values after it, but never loses them.
+template<typename T>
+class SrsMpscRing
+{
+private:
+    struct SrsRingSlot {
+        std::atomic<uint64_t> seq;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type value;
+    };
+    SrsRingSlot* slots_;
+    uint64_t capacity_;
+    uint64_t mask_;
+    char pad0_[SRS_CACHELINE_SIZE];
+    // The consumer pops at head.
+    std::atomic<uint64_t> head_;
+    char pad1_[SRS_CACHELINE_SIZE];
+    // The producers reserve at tail.
+    std::atomic<uint64_t> tail_;
+    char pad2_[SRS_CACHELINE_SIZE];
+public:
+    // @param capacity Round up to the power of two.
+    SrsMpscRing(uint64_t capacity) {
+        capacity_ = srs_ring_capacity(capacity);
+        mask_ = capacity_ - 1;
+        slots_ = new SrsRingSlot[capacity_];
+        for (uint64_t i = 0; i < capacity_; i++) {
+            slots_[i].seq.store(i, std::memory_order_relaxed);
+        }
+        head_.store(0, std::memory_order_relaxed);
+        tail_.store(0, std::memory_order_relaxed);
     }
-    else
-    {
-        *ptOutBuffer = mRingBuf.ptArrayBuffer[RING_BUFFER_CUR_READ_POS((&mRingBuf))];
-        if (NULL == (*ptOutBuffer))
-        {
-            //ERRORLOG("Read_Packet_RingBuffer, mRingBuf is NULL, buffer name: %s\n", mRingBuf.pRingbufName);
-            return E_RET_BUF_EMPTY;
+    virtual ~SrsMpscRing() {
+        T v;
+        while (pop(&v)) {
         }
-        
-        return E_RET_BUF_OK;
+        delete[] slots_;
     }
-}
-
+private:
+    SrsMpscRing(const SrsMpscRing&);
+    SrsMpscRing& operator=(const SrsMpscRing&);
+public:
+    // Push the value in any producer thread.
+    // @return false if full, and the value is not moved.
+    bool push(T&& v) {
+        uint64_t tail = tail_.load(std::memory_order_relaxed);
+        while (true) {
+            SrsRingSlot* slot = &slots_[tail & mask_];
+            int64_t dif = (int64_t)(slot->seq.load(std::memory_order_acquire) - tail);
+            if (dif == 0) {
+                if (tail_.compare_exchange_weak(tail, tail + 1, std::memory_order_relaxed)) {
+                    new (&slot->value) T(std::move(v));
+                    slot->seq.store(tail + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (dif < 0) {
+                // The slot is not consumed in the last lap.
+                return false;
+            } else {
+                tail = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+    bool push(const T& v) {
+        T copy = v;
+        return push(std::move(copy));
+    }
+    // Push the values in any producer thread, which reserves the slots by one CAS.
+    // @return The number of values moved in, which is less than n if no room.
+    int push_batch(T* vs, int n) {
+        uint64_t tail = tail_.load(std::memory_order_relaxed);
+        int nn = 0;
+        while (true) {
+            // The slots before head are all consumed, because there is only one consumer.
+            uint64_t head = head_.load(std::memory_order_acquire);
+            uint64_t room = (tail - head < capacity_)? capacity_ - (tail - head) : 0;
+            nn = (room < (uint64_t)n)? (int)room : n;
+            if (nn == 0) {
+                return 0;
+            }
+            if (tail_.compare_exchange_weak(tail, tail + nn, std::memory_order_relaxed)) {
+                break;
+            }
+        }
 
-template <class T>
-E_OPER_BUFFER_RET SrsRingBuffer<T>::Write_Packet_RingBuffer(T* ptInBuffer, unsigned int iReadIdx)
-{
-    if (NULL == ptInBuffer)
-    {
-        return E_RET_BUF_NULL;
-    }
-    if (0 == mRingBuf.bufferSize)
-    {
-       // MemPool::getInstance()->FreePacketBuffer(ptInBuffer, iReadIdx);
-        // fix it
-        return E_RET_BUF_NULL;
-    }
-    if (FALSE == mRingBuf.bIsInit)
-    {
-        //MemPool::getInstance()->FreePacketBuffer(ptInBuffer, iReadIdx);
-         // fix it
-        return E_RET_BUF_NOT_INIT;
-    }
-    mRingBuf.writeCount++;
-    if (RING_BUFFER_TO_WRITE_POS((&mRingBuf)) == RING_BUFFER_CUR_READ_POS((&mRingBuf)))
-    {
-        //MemPool::getInstance()->FreePacketBuffer(ptInBuffer, iReadIdx);
-         // fix it
-        mRingBuf.overwriteCnt++;
-        //ERRORLOG("Write_Packet_RingBuffer, ringbuf name = %s, ringbuf is full, write [%d] read [%d]", mRingBuf.pRingbufName, mRingBuf.writeCount, mRingBuf.readCount);
-        return E_RET_BUF_FULL;
-    }
-
-    mRingBuf.ptArrayBuffer[RING_BUFFER_CUR_WRITE_POS((&mRingBuf))] = ptInBuffer;
-    mRingBuf.curCount = Get_Packet_RingBuffer_Count();
-    RING_BUFFER_ADD_WRITE_POS((&mRingBuf));
-    if (FALSE == mRingBuf.bIsWrited)
-    {
-        mRingBuf.bIsWrited = TRUE;
-    }
-    
-    return E_RET_BUF_OK;
-}
+        for (int i = 0; i < nn; i++) {
+            SrsRingSlot* slot = &slots_[(tail + i) & mask_];
+            new (&slot->value) T(std::move(vs[i]));
+            slot->seq.store(tail + i + 1, std::memory_order_release);
+        }
+        return nn;
+    }
+    // Pop a value in consumer thread.
+    // @return false if empty, or the next value is not published.
+    bool pop(T* pv) {
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        SrsRingSlot* slot = &slots_[head & mask_];
+        if (slot->seq.load(std::memory_order_acquire) != head + 1) {
+            return false;
+        }
 
+        T* p = reinterpret_cast<T*>(&slot->value);
+        *pv = std::move(*p);
+        p->~T();
 
-template <class T>
-void SrsRingBuffer<T>::Destroy_Packet_RingBuffer(unsigned int iReadIdx)
-{
-    T* ptBuffer = NULL;
-    
-    if (FALSE == mRingBuf.bIsInit)
-    {
-        return;
+        // Free the slot for the producer of next lap.
+        slot->seq.store(head + capacity_, std::memory_order_release);
+        head_.store(head + 1, std::memory_order_release);
+        return true;
     }
+    // Pop the published values in consumer thread, and publish the head once.
+    // @return The number of values moved out, 0 if empty.
+    int pop_batch(T* pvs, int n) {
+        uint64_t head = head_.load(std::memory_order_relaxed);
+
+        int nn = 0;
+        for (; nn < n; nn++) {
+            SrsRingSlot* slot = &slots_[(head + nn) & mask_];
+            if (slot->seq.load(std::memory_order_acquire) != head + nn + 1) {
+                break;
+            }
+
+            T* p = reinterpret_cast<T*>(&slot->value);
+            pvs[nn] = std::move(*p);
+            p->~T();
+            slot->seq.store(head + nn + capacity_, std::memory_order_release);
+        }
 
-    while (1)
-    {
-        if (E_RET_BUF_OK != Read_Packet_RingBuffer(&ptBuffer))
-        {
-            break;
+        if (nn > 0) {
+            head_.store(head + nn, std::memory_order_release);
         }
-        //MemPool::getInstance()->FreePacketBuffer(ptBuffer, iReadIdx);
-        //fit it
+        return nn;
     }
-}
-
+    // The number of values, which is a snapshot when the other side is running.
+    int size() {
+        uint64_t head = head_.load(std::memory_order_acquire);
+        uint64_t tail = tail_.load(std::memory_order_acquire);
+        return (tail > head)? (int)(tail - head) : 0;
+    }
+    int capacity() {
+        return (int)capacity_;
+    }
+};
 
-template <class T>
-SrsRingBuffer<T>::~SrsRingBuffer()
-{
-}
+#endif
 
@@ -7,11 +7,17 @@
 #include <srs_app_st.hpp>
 
 #include <st.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <string.h>
+#include <algorithm>
 #include <string>
 using namespace std;
 
 #include <srs_kernel_error.hpp>
 #include <srs_kernel_log.hpp>
+#include <srs_kernel_utility.hpp>
 // #include <srs_app_utility.hpp>
 // #include <srs_app_log.hpp>
 
@@ -70,6 +76,11 @@ const SrsContextId& SrsDummyCoroutine::cid()
     return _srs_context->get_id();
 }
 
+srs_error_t SrsDummyCoroutine::stats(SrsCoroutineCpuStat* /*v*/)
+{
+    return srs_error_new(ERROR_THREAD_DUMMY, "dummy stats");
+}
+
 SrsSTCoroutine::SrsSTCoroutine(string n, ISrsCoroutineHandler* h)
 {
     impl_ = new SrsFastCoroutine(n, h);
@@ -90,6 +101,11 @@ void SrsSTCoroutine::set_stack_size(int v)
     impl_->set_stack_size(v);
 }
 
+void SrsSTCoroutine::set_priority(SrsCoroutinePriority v)
+{
+    impl_->set_priority(v);
+}
+
 srs_error_t SrsSTCoroutine::start()
 {
     return impl_->start();
@@ -115,8 +131,176 @@ const SrsContextId& SrsSTCoroutine::cid()
     return impl_->cid();
 }
 
+srs_error_t SrsSTCoroutine::stats(SrsCoroutineCpuStat* v)
+{
+    return impl_->stats(v);
+}
+
 _ST_THREAD_CREATE_PFN _pfn_st_thread_create = (_ST_THREAD_CREATE_PFN)st_thread_create;
 
+// The stack usage of coroutines of current ST thread.
+static thread_local map<string, SrsCoroutineStackStat>* _srs_coroutine_stacks = NULL;
+
+void srs_coroutine_stack_stat(bool enabled)
+{
+    st_paint_stacks(enabled);
+}
+
+map<string, SrsCoroutineStackStat> srs_coroutine_stack_stats()
+{
+    if (!_srs_coroutine_stacks) {
+        return map<string, SrsCoroutineStackStat>();
+    }
+    return *_srs_coroutine_stacks;
+}
+
+// Sample the stack usage of current coroutine, if its stack is painted.
+static void srs_coroutine_stack_sample(const string& name)
+{
+    int size = 0;
+    int used = st_thread_stack_usage(st_thread_self(), &size);
+    if (used < 0) {
+        return;
+    }
+
+    if (!_srs_coroutine_stacks) {
+        _srs_coroutine_stacks = new map<string, SrsCoroutineStackStat>();
+    }
+
+    map<string, SrsCoroutineStackStat>::iterator it = _srs_coroutine_stacks->find(name);
+    if (it == _srs_coroutine_stacks->end()) {
+        SrsCoroutineStackStat stat = {size, used, 1};
+        _srs_coroutine_stacks->insert(make_pair(name, stat));
+        return;
+    }
+
+    SrsCoroutineStackStat& stat = it->second;
+    stat.stack_size = srs_max(stat.stack_size, size);
+    stat.max_used = srs_max(stat.max_used, used);
+    stat.nn_coroutines++;
+}
+
+// The running coroutines of current ST thread, for the CPU stat.
+static thread_local SrsFastCoroutine* _srs_coroutine_running = NULL;
+
+void srs_coroutine_cpu_stat(bool enabled)
+{
+    st_set_thread_stats(enabled);
+}
+
+static bool srs_coroutine_cpu_greater(const SrsCoroutineCpuStat& a, const SrsCoroutineCpuStat& b)
+{
+    return a.cpu > b.cpu;
+}
+
+vector<SrsCoroutineCpuStat> srs_coroutine_cpu_stats()
+{
+    vector<SrsCoroutineCpuStat> stats;
+
+    for (SrsFastCoroutine* p = _srs_coroutine_running; p; p = p->next_) {
+        SrsCoroutineCpuStat stat;
+        srs_error_t err = p->stats(&stat);
+        if (err != srs_success) {
+            srs_freep(err);
+            continue;
+        }
+        stats.push_back(stat);
+    }
+
+    std::sort(stats.begin(), stats.end(), srs_coroutine_cpu_greater);
+    return stats;
+}
+
+void srs_coroutine_cpu_dump(int n)
+{
+    vector<SrsCoroutineCpuStat> stats = srs_coroutine_cpu_stats();
+    for (int i = 0; i < (int)stats.size() && i < n; i++) {
+        SrsCoroutineCpuStat& stat = stats.at(i);
+        srs_trace("coroutine #%d %s cid=%s, cpu=%dms, switches=%llu, delay=%dms, max_delay=%dms",
+            i, stat.name.c_str(), stat.cid.c_str(), srsu2msi(stat.cpu), (unsigned long long)stat.nn_switches,
+            srsu2msi(stat.delay), srsu2msi(stat.max_delay));
+    }
+}
+
+// The key of ST thread to get its SrsFastCoroutine, for the handler of stack overflow.
+static int _srs_coroutine_key = -1;
+static pthread_once_t _srs_coroutine_guard_once = PTHREAD_ONCE_INIT;
+static int _srs_coroutine_guard_r0 = 0;
+static struct sigaction _srs_sigsegv_prev;
+static struct sigaction _srs_sigbus_prev;
+
+// @remark Only the async-signal-safe calls, except the snprintf for the fault of stack.
+void srs_coroutine_stack_overflow(int signo, siginfo_t* info, void* context)
+{
+    st_thread_t thread = st_stack_guard_fault(info->si_addr);
+    if (thread) {
+        SrsFastCoroutine* p = NULL;
+        if (_srs_coroutine_key >= 0) {
+            p = (SrsFastCoroutine*)st_thread_getspecific(_srs_coroutine_key);
+        }
+
+        char buf[512];
+        int nn = snprintf(buf, sizeof(buf), "stack overflow of coroutine %s, cid=%s, thread=%p, addr=%p, signo=%d\n",
+            p? p->name.c_str() : "unknown", p? p->cid_.c_str() : "", thread, info->si_addr, signo);
+        if (nn > 0 && write(STDERR_FILENO, buf, srs_min(nn, (int)sizeof(buf) - 1)) < 0) {
+            // Ignore any error, we are crashing.
+        }
+    }
+
+    // Restore the previous handler, which handles the fault when the instruction restarts,
+    // for example, crashes and dumps core by default.
+    sigaction(signo, (signo == SIGBUS)? &_srs_sigbus_prev : &_srs_sigsegv_prev, NULL);
+    if (info->si_code <= 0) {
+        raise(signo);
+    }
+}
+
+static void srs_coroutine_guard_init()
+{
+    if (st_key_create(&_srs_coroutine_key, NULL) != 0) {
+        _srs_coroutine_guard_r0 = -1;
+        return;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = srs_coroutine_stack_overflow;
+    sa.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    sigemptyset(&sa.sa_mask);
+
+    if (sigaction(SIGSEGV, &sa, &_srs_sigsegv_prev) != 0 || sigaction(SIGBUS, &sa, &_srs_sigbus_prev) != 0) {
+        _srs_coroutine_guard_r0 = -2;
+    }
+}
+
+srs_error_t srs_coroutine_stack_guard()
+{
+    pthread_once(&_srs_coroutine_guard_once, srs_coroutine_guard_init);
+    if (_srs_coroutine_guard_r0 != 0) {
+        return srs_error_new(ERROR_SYSTEM_SIGNAL, "install handler, r0=%d", _srs_coroutine_guard_r0);
+    }
+
+    // The overflowed stack is unusable, so the handler runs on the alternate stack of pthread.
+    static thread_local char* altstack = NULL;
+    if (!altstack) {
+        int size = srs_max((int)SIGSTKSZ, 64 * 1024);
+        altstack = new char[size];
+
+        stack_t ss;
+        ss.ss_sp = altstack;
+        ss.ss_size = size;
+        ss.ss_flags = 0;
+        if (sigaltstack(&ss, NULL) != 0) {
+            srs_freepa(altstack);
+            return srs_error_new(ERROR_SYSTEM_SIGNAL, "sigaltstack size=%d", size);
+        }
+    }
+
+    st_set_stack_guard(1);
+
+    return srs_success;
+}
+
 SrsFastCoroutine::SrsFastCoroutine(string n, ISrsCoroutineHandler* h)
 {
     // TODO: FIXME: Reduce duplicated code.
@@ -126,9 +310,12 @@ SrsFastCoroutine::SrsFastCoroutine(string n, ISrsCoroutineHandler* h)
     trd_err = srs_success;
     started = interrupted = disposed = cycle_done = false;
     stopping_ = false;
+    prev_ = next_ = NULL;
+    running_ = false;
 
     //  0 use default, default is 64K.
     stack_size = 0;
+    priority_ = SrsCoroutinePriorityNormal;
 }
 
 SrsFastCoroutine::SrsFastCoroutine(string n, ISrsCoroutineHandler* h, SrsContextId cid)
@@ -140,9 +327,12 @@ SrsFastCoroutine::SrsFastCoroutine(string n, ISrsCoroutineHandler* h, SrsContext
     trd_err = srs_success;
     started = interrupted = disposed = cycle_done = false;
     stopping_ = false;
+    prev_ = next_ = NULL;
+    running_ = false;
 
     //  0 use default, default is 64K.
     stack_size = 0;
+    priority_ = SrsCoroutinePriorityNormal;
 }
 
 SrsFastCoroutine::~SrsFastCoroutine()
@@ -159,6 +349,16 @@ void SrsFastCoroutine::set_stack_size(int v)
     stack_size = v;
 }
 
+void SrsFastCoroutine::set_priority(SrsCoroutinePriority v)
+{
+    priority_ = v;
+
+    // Move the thread to the run queue of class, if it's runnable.
+    if (trd && !cycle_done) {
+        srs_thread_set_priority(trd, priority_);
+    }
+}
+
 srs_error_t SrsFastCoroutine::start()
 {
     srs_error_t err = srs_success;
@@ -185,6 +385,10 @@ srs_error_t SrsFastCoroutine::start()
         
         return err;
     }
+
+    if (priority_ != SrsCoroutinePriorityNormal) {
+        srs_thread_set_priority(trd, priority_);
+    }
     
     started = true;
 
@@ -260,6 +464,27 @@ const SrsContextId& SrsFastCoroutine::cid()
     return cid_;
 }
 
+srs_error_t SrsFastCoroutine::stats(SrsCoroutineCpuStat* v)
+{
+    if (!running_) {
+        return srs_error_new(ERROR_THREAD_STATS, "coroutine %s not running", name.c_str());
+    }
+
+    st_thread_stats_t stats;
+    if (st_thread_stats((st_thread_t)trd, &stats) != 0) {
+        return srs_error_new(ERROR_THREAD_STATS, "coroutine %s stats disabled", name.c_str());
+    }
+
+    v->name = name;
+    v->cid = cid_;
+    v->cpu = (srs_utime_t)stats.cpu;
+    v->delay = (srs_utime_t)stats.delay;
+    v->max_delay = (srs_utime_t)stats.max_delay;
+    v->nn_switches = stats.nn_switches;
+
+    return srs_success;
+}
+
 srs_error_t SrsFastCoroutine::cycle()
 {
     if (_srs_context) {
@@ -284,8 +509,35 @@ void* SrsFastCoroutine::pfn(void* arg)
 {
     SrsFastCoroutine* p = (SrsFastCoroutine*)arg;
 
+    // For the handler of stack overflow to find the coroutine.
+    if (_srs_coroutine_key >= 0) {
+        st_thread_setspecific(_srs_coroutine_key, p);
+    }
+
+    // Link to the running coroutines, for the CPU stat.
+    p->running_ = true;
+    p->next_ = _srs_coroutine_running;
+    if (_srs_coroutine_running) {
+        _srs_coroutine_running->prev_ = p;
+    }
+    _srs_coroutine_running = p;
+
     srs_error_t err = p->cycle();
 
+    p->running_ = false;
+    if (p->prev_) {
+        p->prev_->next_ = p->next_;
+    } else {
+        _srs_coroutine_running = p->next_;
+    }
+    if (p->next_) {
+        p->next_->prev_ = p->prev_;
+    }
+    p->prev_ = p->next_ = NULL;
+
+    // The cycle is done, so the deepest usage of stack is known.
+    srs_coroutine_stack_sample(p->name);
+
     // Set the err for function pull to fetch it.
     // @see https://github.com/ossrs/srs/pull/1304#issuecomment-480484151
     if (err != srs_success) {
@@ -297,3 +549,374 @@ void* SrsFastCoroutine::pfn(void* arg)
     return (void*)err;
 }
 
+
+// The worker of pool, which parks on its condition for the task to run.
+class SrsCoroutinePoolWorker : public ISrsCoroutineHandler
+{
+public:
+    SrsCoroutinePool* pool_;
+    SrsFastCoroutine* trd_;
+    srs_cond_t cond_;
+    // The task dispatched to worker, empty if parked.
+    SrsCoroutineTask task_;
+public:
+    SrsCoroutinePoolWorker(SrsCoroutinePool* pool) {
+        pool_ = pool;
+        trd_ = new SrsFastCoroutine(pool->name_, this);
+        trd_->set_stack_size(pool->stack_size_);
+        cond_ = srs_cond_new();
+    }
+    virtual ~SrsCoroutinePoolWorker() {
+        srs_freep(trd_);
+        srs_cond_destroy(cond_);
+    }
+public:
+    virtual srs_error_t cycle() {
+        return pool_->do_cycle(this);
+    }
+};
+
+SrsCoroutinePool::SrsCoroutinePool(string name, int min_workers, int max_workers)
+{
+    name_ = name;
+    min_workers_ = srs_max(0, min_workers);
+    max_workers_ = srs_max(1, srs_max(min_workers_, max_workers));
+    stack_size_ = 0;
+    idle_timeout_ = 30 * SRS_UTIME_SECONDS;
+    started_ = disposed_ = false;
+
+    // Never allocate when workers park or wakeup.
+    workers_.reserve(max_workers_);
+    idle_.reserve(max_workers_);
+
+    memset(&stat_, 0, sizeof(stat_));
+}
+
+SrsCoroutinePool::~SrsCoroutinePool()
+{
+    stop();
+}
+
+void SrsCoroutinePool::set_stack_size(int v)
+{
+    stack_size_ = v;
+}
+
+void SrsCoroutinePool::set_idle_timeout(srs_utime_t v)
+{
+    idle_timeout_ = v;
+}
+
+srs_error_t SrsCoroutinePool::start()
+{
+    srs_error_t err = srs_success;
+
+    if (started_ || disposed_) {
+        return srs_error_new(disposed_? ERROR_THREAD_DISPOSED : ERROR_THREAD_STARTED, "pool %s", name_.c_str());
+    }
+    started_ = true;
+
+    // Never grow the lists when workers park or retire, which is on the hot path.
+    workers_.reserve(max_workers_);
+    idle_.reserve(max_workers_);
+    zombies_.reserve(max_workers_);
+
+    for (int i = 0; i < min_workers_; i++) {
+        if ((err = create_worker()) != srs_success) {
+            return srs_error_wrap(err, "pool %s worker=%d", name_.c_str(), i);
+        }
+    }
+
+    return err;
+}
+
+void SrsCoroutinePool::stop()
+{
+    if (disposed_) {
+        return;
+    }
+    disposed_ = true;
+
+    // Interrupt all workers to quit, then join them.
+    for (int i = 0; i < (int)workers_.size(); i++) {
+        workers_.at(i)->trd_->interrupt();
+    }
+    for (int i = 0; i < (int)workers_.size(); i++) {
+        SrsCoroutinePoolWorker* worker = workers_.at(i);
+        srs_freep(worker);
+    }
+    workers_.clear();
+    idle_.clear();
+    pending_.clear();
+
+    reap();
+}
+
+srs_error_t SrsCoroutinePool::spawn(SrsCoroutineTask task)
+{
+    srs_error_t err = srs_success;
+
+    if (!started_ || disposed_) {
+        return srs_error_new(ERROR_THREAD_DISPOSED, "pool %s not running", name_.c_str());
+    }
+
+    reap();
+    stat_.nn_spawned++;
+
+    // Wakeup the last parked worker, whose stack is hot.
+    if (!idle_.empty()) {
+        SrsCoroutinePoolWorker* worker = idle_.back();
+        idle_.pop_back();
+        worker->task_ = std::move(task);
+        srs_cond_signal(worker->cond_);
+        return err;
+    }
+
+    // Queue the task, which is picked by the new worker, or the busy worker when done.
+    pending_.push_back(std::move(task));
+
+    if ((int)workers_.size() < max_workers_ && (err = create_worker()) != srs_success) {
+        // It's ok if there are workers to run the task.
+        if (!workers_.empty()) {
+            srs_warn("pool %s grow, workers=%d, err %s", name_.c_str(), (int)workers_.size(), srs_error_desc(err).c_str());
+            srs_freep(err);
+            return srs_success;
+        }
+        pending_.pop_back();
+        return srs_error_wrap(err, "pool %s grow", name_.c_str());
+    }
+
+    return err;
+}
+
+void SrsCoroutinePool::stat(SrsCoroutinePoolStat* v)
+{
+    *v = stat_;
+    v->nn_workers = (int)workers_.size();
+    v->nn_idle = (int)idle_.size();
+    v->nn_pending = (int)pending_.size();
+}
+
+srs_error_t SrsCoroutinePool::create_worker()
+{
+    srs_error_t err = srs_success;
+
+    SrsCoroutinePoolWorker* worker = new SrsCoroutinePoolWorker(this);
+    if ((err = worker->trd_->start()) != srs_success) {
+        srs_freep(worker);
+        return srs_error_wrap(err, "start worker");
+    }
+
+    workers_.push_back(worker);
+    stat_.nn_created++;
+
+    return err;
+}
+
+srs_error_t SrsCoroutinePool::do_cycle(SrsCoroutinePoolWorker* worker)
+{
+    srs_error_t err = srs_success;
+
+    while (true) {
+        if ((err = worker->trd_->pull()) != srs_success) {
+            return srs_error_wrap(err, "pool %s worker", name_.c_str());
+        }
+
+        // Run the pending tasks first, then park for the task dispatched by spawn.
+        if (!worker->task_ && !pending_.empty()) {
+            worker->task_ = std::move(pending_.front());
+            pending_.pop_front();
+        }
+
+        if (!worker->task_) {
+            idle_.push_back(worker);
+            int r0 = srs_cond_timedwait(worker->cond_, idle_timeout_);
+
+            // Not dispatched, so we're still parked, timeout or interrupted.
+            if (!worker->task_) {
+                idle_.erase(std::find(idle_.begin(), idle_.end(), worker));
+
+                // Retire the idle worker, which is freed by others because it's running.
+                if (r0 != 0 && errno == ETIME && (int)workers_.size() > min_workers_) {
+                    workers_.erase(std::find(workers_.begin(), workers_.end(), worker));
+                    zombies_.push_back(worker);
+                    stat_.nn_retired++;
+                    return err;
+                }
+                continue;
+            }
+        }
+
+        worker->task_();
+        worker->task_.reset();
+        stat_.nn_done++;
+    }
+
+    return err;
+}
+
+void SrsCoroutinePool::reap()
+{
+    for (int i = 0; i < (int)zombies_.size(); i++) {
+        SrsCoroutinePoolWorker* worker = zombies_.at(i);
+        srs_freep(worker);
+    }
+    zombies_.clear();
+}
+
+// The child of group, which notifies the group when its cycle is done.
+class SrsCoroutineGroupChild : public ISrsCoroutineHandler
+{
+public:
+    SrsCoroutineGroup* group_;
+    ISrsCoroutineHandler* handler_;
+    SrsSTCoroutine* trd_;
+    // The index in children of group, for removing it in O(1).
+    int index_;
+public:
+    SrsCoroutineGroupChild(SrsCoroutineGroup* group, string name, ISrsCoroutineHandler* h) {
+        group_ = group;
+        handler_ = h;
+        trd_ = new SrsSTCoroutine(name, this);
+        trd_->set_stack_size(group->stack_size_);
+        index_ = -1;
+    }
+    virtual ~SrsCoroutineGroupChild() {
+        srs_freep(trd_);
+    }
+public:
+    virtual srs_error_t cycle() {
+        srs_error_t err = handler_->cycle();
+        group_->on_child_done(this, err);
+        return err;
+    }
+};
+
+SrsCoroutineGroup::SrsCoroutineGroup(string name)
+{
+    name_ = name;
+    stack_size_ = 0;
+    canceled_ = disposed_ = false;
+    err_ = srs_success;
+    cond_ = srs_cond_new();
+}
+
+SrsCoroutineGroup::~SrsCoroutineGroup()
+{
+    stop();
+
+    srs_freep(err_);
+    srs_cond_destroy(cond_);
+}
+
+void SrsCoroutineGroup::set_stack_size(int v)
+{
+    stack_size_ = v;
+}
+
+srs_error_t SrsCoroutineGroup::spawn(string name, ISrsCoroutineHandler* h, SrsCoroutine** ptrd)
+{
+    srs_error_t err = srs_success;
+
+    if (disposed_ || canceled_) {
+        return srs_error_new(disposed_? ERROR_THREAD_DISPOSED : ERROR_THREAD_INTERRUPED, "group %s spawn %s",
+            name_.c_str(), name.c_str());
+    }
+
+    reap();
+
+    SrsCoroutineGroupChild* child = new SrsCoroutineGroupChild(this, name, h);
+    if (ptrd) {
+        *ptrd = child->trd_;
+    }
+
+    // The child never runs before start returns, so it's safe to link it after start.
+    if ((err = child->trd_->start()) != srs_success) {
+        if (ptrd) {
+            *ptrd = NULL;
+        }
+        srs_freep(child);
+        return srs_error_wrap(err, "group %s spawn %s", name_.c_str(), name.c_str());
+    }
+
+    child->index_ = (int)children_.size();
+    children_.push_back(child);
+
+    return err;
+}
+
+void SrsCoroutineGroup::interrupt()
+{
+    canceled_ = true;
+
+    for (int i = 0; i < (int)children_.size(); i++) {
+        children_.at(i)->trd_->interrupt();
+    }
+}
+
+srs_error_t SrsCoroutineGroup::wait()
+{
+    while (!children_.empty()) {
+        if (srs_cond_wait(cond_) != 0) {
+            return srs_error_new(ERROR_THREAD_INTERRUPED, "group %s wait", name_.c_str());
+        }
+    }
+
+    reap();
+
+    return err_? srs_error_copy(err_) : srs_success;
+}
+
+void SrsCoroutineGroup::stop()
+{
+    if (disposed_) {
+        return;
+    }
+    disposed_ = true;
+
+    // Interrupt all children in one pass, so they quit together while we join the first one.
+    interrupt();
+
+    // The child is moved to zombies when its cycle is done, which is before joined.
+    while (!children_.empty()) {
+        children_.back()->trd_->stop();
+    }
+
+    reap();
+}
+
+int SrsCoroutineGroup::size()
+{
+    return (int)children_.size();
+}
+
+void SrsCoroutineGroup::on_child_done(SrsCoroutineGroupChild* child, srs_error_t err)
+{
+    // Remove the child by swapping with the last one.
+    SrsCoroutineGroupChild* last = children_.back();
+    children_[child->index_] = last;
+    last->index_ = child->index_;
+    children_.pop_back();
+    child->index_ = -1;
+
+    zombies_.push_back(child);
+
+    // The first error cancels the siblings, while the errors after canceled are caused by it.
+    if (err != srs_success && !canceled_) {
+        err_ = srs_error_copy(err);
+        interrupt();
+    }
+
+    if (children_.empty()) {
+        srs_cond_broadcast(cond_);
+    }
+}
+
+void SrsCoroutineGroup::reap()
+{
+    for (int i = 0; i < (int)zombies_.size(); i++) {
+        SrsCoroutineGroupChild* child = zombies_.at(i);
+        srs_freep(child);
+    }
+    zombies_.clear();
+}
@@ -9,7 +9,16 @@
 
 #include <srs_core.hpp>
 
+#include <signal.h>
+
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <new>
 #include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 #include <srs_kernel_log.hpp>
 #include <srs_kernel_error.hpp>
@@ -17,6 +26,7 @@
 #include <srs_protocol_io.hpp>
 
 class SrsFastCoroutine;
+struct SrsCoroutineCpuStat;
 
 // Each ST-coroutine must implements this interface,
 // to do the cycle job and handle some events.
@@ -77,6 +87,8 @@ public:
     //      NULL if not terminated and user should pull again.
     virtual srs_error_t pull() = 0;
     virtual const SrsContextId& cid() = 0;
+    // Get the CPU stat of coroutine, see srs_coroutine_cpu_stat.
+    virtual srs_error_t stats(SrsCoroutineCpuStat* v) = 0;
 };
 
 // An empty coroutine, user can default to this object before create any real coroutine.
@@ -92,6 +104,7 @@ public:
     virtual void interrupt();
     virtual srs_error_t pull();
     virtual const SrsContextId& cid();
+    virtual srs_error_t stats(SrsCoroutineCpuStat* v);
 };
 
 // A ST-coroutine is a lightweight thread, just like the goroutine.
@@ -119,6 +132,9 @@ public:
 public:
     // Set the stack size of coroutine, default to 0(64KB).
     void set_stack_size(int v);
+    // Set the priority class of coroutine, default to normal. Use low for the bulk coroutines
+    // which yield often, and high for the timers and control, see srs_thread_set_priority.
+    void set_priority(SrsCoroutinePriority v);
 public:
     // Start the thread.
     // @remark Should never start it when stopped or terminated.
@@ -140,8 +156,60 @@ public:
     virtual srs_error_t pull();
     // Get the context id of thread.
     virtual const SrsContextId& cid();
+    // Get the CPU stat of thread, which should be running.
+    virtual srs_error_t stats(SrsCoroutineCpuStat* v);
+};
+
+// The stack usage of coroutines with the same name.
+struct SrsCoroutineStackStat
+{
+    // The max size of stack.
+    int stack_size;
+    // The deepest usage of stack in bytes.
+    int max_used;
+    // The number of coroutines sampled.
+    int64_t nn_coroutines;
+};
+
+// Paint the stacks of coroutines created after it, to sample the deepest usage of stack
+// when coroutine quits, for sizing the stacks. It's for diagnosis only, because it touches
+// the whole stack, see st_paint_stacks.
+extern void srs_coroutine_stack_stat(bool enabled);
+
+// Get the stack usage of coroutines of current ST thread, key is the name of coroutine.
+extern std::map<std::string, SrsCoroutineStackStat> srs_coroutine_stack_stats();
+
+// Protect the redzones of coroutine stacks of current ST thread by PROT_NONE, and handle the
+// SIGSEGV on an alternate signal stack, which prints the name and cid of the coroutine whose
+// stack overflows, then crashes as normal. It should be called in each ST thread, for example,
+// in ISrsVpHandler::on_vp_start, before the coroutines are created.
+extern srs_error_t srs_coroutine_stack_guard();
+
+// The CPU stat of coroutine, the times are accounted by the cycle counter of ST.
+struct SrsCoroutineCpuStat
+{
+    std::string name;
+    SrsContextId cid;
+    // The time on CPU.
+    srs_utime_t cpu;
+    // The total and max delay from runnable to running, which is large if starved by others.
+    srs_utime_t delay;
+    srs_utime_t max_delay;
+    // The number of times switched in.
+    uint64_t nn_switches;
 };
 
+// Account the time on CPU, the switches and the scheduling delay of coroutines of current ST
+// thread, see st_set_thread_stats. It's cheap, but disabled by default.
+extern void srs_coroutine_cpu_stat(bool enabled);
+
+// Get the CPU stat of running coroutines of current ST thread, sorted by the time on CPU, so
+// the coroutine which starves the rest is the first one.
+extern std::vector<SrsCoroutineCpuStat> srs_coroutine_cpu_stats();
+
+// Print the top n coroutines of srs_coroutine_cpu_stats, with name and cid.
+extern void srs_coroutine_cpu_dump(int n);
+
 // For utest to mock the thread create.
 typedef void* (*_ST_THREAD_CREATE_PFN)(void *(*start)(void *arg), void *arg, int joinable, int stack_size);
 extern _ST_THREAD_CREATE_PFN _pfn_st_thread_create;
@@ -152,6 +220,7 @@ class SrsFastCoroutine
 private:
     std::string name;
     int stack_size;
+    SrsCoroutinePriority priority_;
     ISrsCoroutineHandler* handler;
 private:
     srs_thread_t trd;
@@ -167,12 +236,18 @@ private:
     // Sub state in disposed, we need to wait for thread to quit.
     bool stopping_;
     SrsContextId stopping_cid_;
+private:
+    // The list of running coroutines of current ST thread, for the CPU stat.
+    SrsFastCoroutine* prev_;
+    SrsFastCoroutine* next_;
+    bool running_;
 public:
     SrsFastCoroutine(std::string n, ISrsCoroutineHandler* h);
     SrsFastCoroutine(std::string n, ISrsCoroutineHandler* h, SrsContextId cid);
     ~SrsFastCoroutine();
 public:
     void set_stack_size(int v);
+    void set_priority(SrsCoroutinePriority v);
 public:
     srs_error_t start();
     void stop();
@@ -184,10 +259,249 @@ public:
         return srs_error_copy(trd_err);
     }
     const SrsContextId& cid();
+    srs_error_t stats(SrsCoroutineCpuStat* v);
 private:
     srs_error_t cycle();
     static void* pfn(void* arg);
+    friend std::vector<SrsCoroutineCpuStat> srs_coroutine_cpu_stats();
+    friend void srs_coroutine_stack_overflow(int signo, siginfo_t* info, void* context);
 };
 
-#endif
+// The closure no larger than it is stored inline by SrsCoroutineTask, or allocated on heap.
+#define SRS_COROUTINE_TASK_INLINE 64
+
+// The move-only closure to run in coroutine, like std::function<void()>, but never copied so the
+// move-only callables are ok, and the small closure is stored inline without allocation.
+// Usage:
+//      SrsCoroutineTask task([=]() { ... });
+//      task();
+class SrsCoroutineTask
+{
+private:
+    struct SrsTaskOps {
+        void (*invoke)(void* p);
+        // Move construct the closure at dst from src, and destroy the src.
+        void (*move)(void* dst, void* src);
+        void (*destroy)(void* p);
+    };
+    template<typename F>
+    struct SrsInlineOps {
+        static void invoke(void* p) { (*(F*)p)(); }
+        static void move(void* dst, void* src) { new (dst) F(std::move(*(F*)src)); ((F*)src)->~F(); }
+        static void destroy(void* p) { ((F*)p)->~F(); }
+        static const SrsTaskOps ops;
+    };
+    template<typename F>
+    struct SrsHeapOps {
+        static void invoke(void* p) { (**(F**)p)(); }
+        static void move(void* dst, void* src) { *(F**)dst = *(F**)src; }
+        static void destroy(void* p) { delete *(F**)p; }
+        static const SrsTaskOps ops;
+    };
+private:
+    const SrsTaskOps* ops_;
+    alignas(std::max_align_t) char buf_[SRS_COROUTINE_TASK_INLINE];
+public:
+    SrsCoroutineTask() : ops_(NULL) {
+    }
+    template<typename F, typename = typename std::enable_if<
+        !std::is_same<typename std::decay<F>::type, SrsCoroutineTask>::value>::type>
+    SrsCoroutineTask(F&& f) {
+        typedef typename std::decay<F>::type T;
+        init<T>(std::forward<F>(f), std::integral_constant<bool, sizeof(T) <= SRS_COROUTINE_TASK_INLINE
+            && alignof(T) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible<T>::value>());
+    }
+    SrsCoroutineTask(SrsCoroutineTask&& v) : ops_(v.ops_) {
+        if (ops_) {
+            ops_->move(buf_, v.buf_);
+            v.ops_ = NULL;
+        }
+    }
+    SrsCoroutineTask& operator=(SrsCoroutineTask&& v) {
+        if (this != &v) {
+            reset();
+            if ((ops_ = v.ops_) != NULL) {
+                ops_->move(buf_, v.buf_);
+                v.ops_ = NULL;
+            }
+        }
+        return *this;
+    }
+    ~SrsCoroutineTask() {
+        reset();
+    }
+private:
+    SrsCoroutineTask(const SrsCoroutineTask&);
+    SrsCoroutineTask& operator=(const SrsCoroutineTask&);
+    template<typename T, typename F>
+    void init(F&& f, std::true_type /*inline*/) {
+        new (buf_) T(std::forward<F>(f));
+        ops_ = &SrsInlineOps<T>::ops;
+    }
+    template<typename T, typename F>
+    void init(F&& f, std::false_type /*inline*/) {
+        *(T**)buf_ = new T(std::forward<F>(f));
+        ops_ = &SrsHeapOps<T>::ops;
+    }
+public:
+    void operator()() {
+        ops_->invoke(buf_);
+    }
+    explicit operator bool() const {
+        return ops_ != NULL;
+    }
+    // Destroy the closure, for example, to free the captured objects after run.
+    void reset() {
+        if (ops_) {
+            ops_->destroy(buf_);
+            ops_ = NULL;
+        }
+    }
+};
+
+template<typename F>
+const SrsCoroutineTask::SrsTaskOps SrsCoroutineTask::SrsInlineOps<F>::ops = {invoke, move, destroy};
+template<typename F>
+const SrsCoroutineTask::SrsTaskOps SrsCoroutineTask::SrsHeapOps<F>::ops = {invoke, move, destroy};
+
+class SrsCoroutinePoolWorker;
 
+// The stat of coroutine pool.
+struct SrsCoroutinePoolStat
+{
+    // The number of workers, and the parked ones.
+    int nn_workers;
+    int nn_idle;
+    // The tasks queued when all workers are busy.
+    int nn_pending;
+    // The number of tasks spawned and done.
+    uint64_t nn_spawned;
+    uint64_t nn_done;
+    // The number of workers created and retired, by growing and shrinking.
+    uint64_t nn_created;
+    uint64_t nn_retired;
+};
+
+// The pool of parked coroutines to run the short tasks, so spawning a task only wakes up an idle
+// worker, without creating coroutine or allocation in the steady state. The pool grows to max
+// workers when all workers are busy, and shrinks to min workers when they are idle for a while.
+// Usage:
+//      SrsCoroutinePool* pool = new SrsCoroutinePool("task", 4, 64);
+//      if ((err = pool->start()) != srs_success) {
+//          return err;
+//      }
+//      pool->spawn([=]() { ... });
+// @remark The tasks are queued when all max workers are busy, and run in order of spawn.
+// @remark The tasks run with the cid of worker, and never stop the pool in task.
+// @remark The pool must be used in the ST thread(VP) which starts it.
+class SrsCoroutinePool
+{
+    friend class SrsCoroutinePoolWorker;
+private:
+    std::string name_;
+    int min_workers_;
+    int max_workers_;
+    int stack_size_;
+    srs_utime_t idle_timeout_;
+    bool started_;
+    bool disposed_;
+private:
+    // All workers, and the parked ones, the last parked is reused first because its stack is hot.
+    std::vector<SrsCoroutinePoolWorker*> workers_;
+    std::vector<SrsCoroutinePoolWorker*> idle_;
+    // The workers retired by shrinking, which quit and should be joined.
+    std::vector<SrsCoroutinePoolWorker*> zombies_;
+    std::deque<SrsCoroutineTask> pending_;
+    SrsCoroutinePoolStat stat_;
+public:
+    SrsCoroutinePool(std::string name, int min_workers, int max_workers);
+    virtual ~SrsCoroutinePool();
+public:
+    // Set the stack size of workers, default to 0(the default of ST).
+    void set_stack_size(int v);
+    // Set the time a worker parks before retired, if there are more than min workers.
+    void set_idle_timeout(srs_utime_t v);
+public:
+    // Start the min workers, which park for tasks.
+    virtual srs_error_t start();
+    // Interrupt all workers and join them, the pending tasks are dropped.
+    virtual void stop();
+    // Run the task on an idle worker, or a new worker if none is idle, or queue it if the
+    // pool reaches the max workers.
+    virtual srs_error_t spawn(SrsCoroutineTask task);
+    virtual void stat(SrsCoroutinePoolStat* v);
+private:
+    srs_error_t create_worker();
+    srs_error_t do_cycle(SrsCoroutinePoolWorker* worker);
+    // Free the retired workers.
+    void reap();
+};
+
+
+class SrsCoroutineGroupChild;
+
+// The group owns the child coroutines, for structured concurrency, so the children never outlive
+// the group. The group interrupts all children in one pass and then joins them. The interrupted
+// children quit in the same round of scheduler, so stopping thousands of children costs about the
+// same as stopping one. The first child which fails cancels its siblings, and the error is
+// returned by wait.
+// Usage:
+//      SrsCoroutineGroup* group = new SrsCoroutineGroup("session");
+//      if ((err = group->spawn("recv", recv_handler, &recv_handler->trd)) != srs_success) {
+//          return err;
+//      }
+//      if ((err = group->spawn("send", send_handler, &send_handler->trd)) != srs_success) {
+//          return err;
+//      }
+//      // Wait for all children to quit, or the first error.
+//      if ((err = group->wait()) != srs_success) {
+//          return err;
+//      }
+// @remark The group must be used in the ST thread(VP) which creates it, and never stop the group
+//      in its child, which deadlocks by joining itself.
+class SrsCoroutineGroup
+{
+    friend class SrsCoroutineGroupChild;
+private:
+    std::string name_;
+    int stack_size_;
+    // Whether interrupted by user or the first error of children.
+    bool canceled_;
+    bool disposed_;
+    // The first error of children, before the group is canceled.
+    srs_error_t err_;
+    // Signaled when all children are done.
+    srs_cond_t cond_;
+private:
+    // The running children, and the done ones which quit and should be joined.
+    std::vector<SrsCoroutineGroupChild*> children_;
+    std::vector<SrsCoroutineGroupChild*> zombies_;
+public:
+    SrsCoroutineGroup(std::string name);
+    virtual ~SrsCoroutineGroup();
+public:
+    // Set the stack size of children, default to 0(the default of ST).
+    void set_stack_size(int v);
+public:
+    // Create and start a child coroutine to run the handler, which is owned by group.
+    // @param ptrd Output the coroutine of child, for handler to pull it. Optional.
+    // @remark The handler should outlive the child, that is, the group is stopped.
+    virtual srs_error_t spawn(std::string name, ISrsCoroutineHandler* h, SrsCoroutine** ptrd = NULL);
+    // Interrupt all children in one pass, and never block. The new children are rejected.
+    virtual void interrupt();
+    // Wait for all children to quit.
+    // @return A copy of the first error of children, which should be freed by user, or
+    //      ERROR_THREAD_INTERRUPED if the waiting coroutine is interrupted.
+    virtual srs_error_t wait();
+    // Interrupt all children, then join them.
+    virtual void stop();
+    // The number of running children.
+    virtual int size();
+private:
+    // When the cycle of child is done, with its error.
+    void on_child_done(SrsCoroutineGroupChild* child, srs_error_t err);
+    // Free the done children.
+    void reap();
+};
+
+#endif
@@ -1,51 +1,50 @@
 #pragma once
 
 #include "srs_kernel_utility.hpp"
-#include "srs_app_ringbuf.hpp"
+#include "srs_app_mailbox.hpp"
+#include "srs_app_channel.hpp"
 
-template<typename T, unsigned int N=1024>
+// The condition to notify the coroutines of a VP from foreign threads, for example, a
+// std::thread. The notify posts the value to the mailbox of VP, which sends it to the channel
+// and wakes up the waiter directly, so there is no polling.
+// @remark The condition must outlive the notifies posted to the mailbox.
+template<typename T>
 class StCondition
 {
 public:
-    StCondition() {
-        notify_ringbuf_ = new SrsRingBuffer<T>(N);
+    StCondition(SrsMailbox* mailbox) {
+        mailbox_ = mailbox;
+    };
+    ~StCondition() {
     };
-    ~StCondition() {};
 
-    void notify() {
-        T* notify_pkg = new T();
-        notify_ringbuf_->Write_Packet_RingBuffer(notify_pkg);
+    // Notify a waiter with the value, it's safe to call it from any thread.
+    srs_error_t notify(const T& v = T()) {
+        return mailbox_->post([this, v]() {
+            T value = v;
+            values_.try_send(std::move(value));
+        });
     }
 
-    int wait() {
-        T* notify_pkg = nullptr;
-        while (notify_ringbuf_->Read_Packet_RingBuffer(&notify_pkg) != E_RET_BUF_OK)
-        {
-            srs_usleep(10 * 1000);
-            srs_thread_yield();
+    // Wait for a notify in the coroutine of VP.
+    // @param pv Output the notified value if not NULL.
+    // @return 0 if notified, or -1 if timeout or interrupted.
+    int wait(srs_utime_t timeout = SRS_UTIME_NO_TIMEOUT, T* pv = NULL) {
+        T v;
+        srs_error_t err = values_.recv(&v, timeout);
+        if (err != srs_success) {
+            srs_freep(err);
+            return -1;
         }
-        delete notify_pkg;
-        return 0;
-    }
 
-    int wait(srs_utime_t timeout) {
-        srs_utime_t us_beg = srs_get_system_startup_time();
-        T* notify_pkg = nullptr;
-        while (notify_ringbuf_->Read_Packet_RingBuffer(&notify_pkg) != E_RET_BUF_OK)
-        {
-            if( srs_get_system_startup_time() - us_beg >= timeout ) {
-                return -1;
-            }
-            srs_usleep(10 * 1000);
-            srs_thread_yield();
+        if (pv) {
+            *pv = std::move(v);
         }
-        delete notify_pkg;
         return 0;
-        
     }
-    
+
 private:
-    SrsRingBuffer<T> *notify_ringbuf_;
+    SrsMailbox* mailbox_;
+    // The notified values, only accessed by the VP.
+    SrsChannel<T> values_;
 };
-
-
@@ -0,0 +1,314 @@
+//
+// Copyright (c) 2013-2021 The SRS Authors
+//
+// SPDX-License-Identifier: MIT
+//
+
+#include <srs_app_vp.hpp>
+
+#include <unistd.h>
+#include <string.h>
+#include <sched.h>
+
+using namespace std;
+
+#include <srs_kernel_error.hpp>
+#include <srs_kernel_log.hpp>
+#include <srs_service_st.hpp>
+#include <srs_kernel_utility.hpp>
+
+// The index and mailbox of current VP, -1 and NULL for the pthreads not in VP group.
+static thread_local int _srs_vp_index = -1;
+static thread_local SrsMailbox* _srs_vp_mailbox = NULL;
+
+int srs_vp_index()
+{
+    return _srs_vp_index;
+}
+
+SrsMailbox* srs_vp_mailbox()
+{
+    return _srs_vp_mailbox;
+}
+
+int srs_vp_ncpus()
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n > 0)? (int)n : 1;
+}
+
+void srs_vp_stat(SrsVpStat* v)
+{
+    st_vp_stats(NULL, v);
+}
+
+uint64_t srs_vp_hist_percentile(const unsigned long long* hist, double ratio)
+{
+    unsigned long long total = 0;
+    for (int i = 0; i < ST_VP_HIST_BUCKETS; i++) {
+        total += hist[i];
+    }
+    if (!total) {
+        return 0;
+    }
+
+    // The bucket i is [2^(i-1), 2^i), so the upper bound is 2^i-1.
+    unsigned long long sum = 0;
+    for (int i = 0; i < ST_VP_HIST_BUCKETS; i++) {
+        sum += hist[i];
+        if (sum >= total * ratio) {
+            return (1ULL << i) - 1;
+        }
+    }
+    return (1ULL << (ST_VP_HIST_BUCKETS - 1)) - 1;
+}
+
+ISrsVpHandler::ISrsVpHandler()
+{
+}
+
+ISrsVpHandler::~ISrsVpHandler()
+{
+}
+
+void ISrsVpHandler::on_vp_stop(int /*index*/)
+{
+}
+
+SrsVp::SrsVp(SrsVpGroup* g, int i)
+{
+    group = g;
+    index = i;
+    joinable = false;
+    err = srs_success;
+    ready = false;
+    mailbox = new SrsMailbox("vp" + srs_int2str(i));
+    quit_cond = NULL;
+    quit = false;
+    memset(&stat, 0, sizeof(stat));
+}
+
+SrsVp::~SrsVp()
+{
+    srs_freep(err);
+    srs_freep(mailbox);
+}
+
+SrsVpGroup::SrsVpGroup(ISrsVpHandler* h)
+{
+    handler_ = h;
+    affinity_ = false;
+    stopping_ = false;
+
+    pthread_mutex_init(&lock_, NULL);
+    pthread_cond_init(&cond_, NULL);
+}
+
+SrsVpGroup::~SrsVpGroup()
+{
+    stop();
+
+    pthread_cond_destroy(&cond_);
+    pthread_mutex_destroy(&lock_);
+}
+
+void SrsVpGroup::set_affinity(bool v)
+{
+    affinity_ = v;
+}
+
+srs_error_t SrsVpGroup::start(int nn)
+{
+    srs_error_t err = srs_success;
+
+    if (!vps_.empty()) {
+        return srs_error_new(ERROR_THREAD_STARTED, "vps started");
+    }
+
+    if (nn <= 0) {
+        nn = srs_vp_ncpus();
+    }
+
+    stopping_ = false;
+    for (int i = 0; i < nn; i++) {
+        SrsVp* vp = new SrsVp(this, i);
+        vps_.push_back(vp);
+
+        int r0 = pthread_create(&vp->tid, NULL, vp_pthread, vp);
+        if (r0 != 0) {
+            err = srs_error_new(ERROR_THREAD_CREATE, "create vp=%d, r0=%d", i, r0);
+            break;
+        }
+        vp->joinable = true;
+    }
+
+    // Wait for the VPs to initialize ST and start the handler.
+    pthread_mutex_lock(&lock_);
+    for (int i = 0; i < (int)vps_.size(); i++) {
+        SrsVp* vp = vps_.at(i);
+        while (vp->joinable && !vp->ready) {
+            pthread_cond_wait(&cond_, &lock_);
+        }
+        if (err == srs_success && vp->err != srs_success) {
+            err = srs_error_wrap(vp->err, "start vp=%d", i);
+            vp->err = srs_success;
+        }
+    }
+    pthread_mutex_unlock(&lock_);
+
+    if (err != srs_success) {
+        stop();
+        return err;
+    }
+
+    srs_trace("vps started, nn=%d, affinity=%d", nn, affinity_);
+    return err;
+}
+
+void SrsVpGroup::stop()
+{
+    pthread_mutex_lock(&lock_);
+    stopping_ = true;
+    pthread_cond_broadcast(&cond_);
+    pthread_mutex_unlock(&lock_);
+
+    // Wakeup the VPs to quit, the closure runs in VP so no lock is required.
+    for (int i = 0; i < (int)vps_.size(); i++) {
+        SrsVp* vp = vps_.at(i);
+        srs_error_t err = vp->mailbox->post([vp]() {
+            vp->quit = true;
+            srs_cond_signal(vp->quit_cond);
+        });
+        if (err != srs_success) {
+            srs_warn("vp=%d notify quit, err %s", i, srs_error_desc(err).c_str());
+            srs_freep(err);
+        }
+    }
+
+    for (int i = 0; i < (int)vps_.size(); i++) {
+        SrsVp* vp = vps_.at(i);
+        if (vp->joinable) {
+            pthread_join(vp->tid, NULL);
+        }
+        srs_freep(vp);
+    }
+    vps_.clear();
+}
+
+void SrsVpGroup::wait()
+{
+    pthread_mutex_lock(&lock_);
+    while (!stopping_) {
+        pthread_cond_wait(&cond_, &lock_);
+    }
+    pthread_mutex_unlock(&lock_);
+}
+
+srs_error_t SrsVpGroup::post(int index, SrsMailbox::SrsMailboxFunc func)
+{
+    if (index < 0 || index >= (int)vps_.size()) {
+        return srs_error_new(ERROR_SYSTEM_IO_INVALID, "invalid vp=%d, size=%d", index, (int)vps_.size());
+    }
+
+    return vps_.at(index)->mailbox->post(func);
+}
+
+int SrsVpGroup::size()
+{
+    return (int)vps_.size();
+}
+
+srs_error_t SrsVpGroup::stat(int index, SrsVpStat* v)
+{
+    if (index < 0 || index >= (int)vps_.size()) {
+        return srs_error_new(ERROR_SYSTEM_IO_INVALID, "invalid vp=%d, size=%d", index, (int)vps_.size());
+    }
+
+    st_vp_stats(&vps_.at(index)->stat, v);
+    return srs_success;
+}
+
+void* SrsVpGroup::vp_pthread(void* arg)
+{
+    SrsVp* vp = (SrsVp*)arg;
+    SrsVpGroup* group = vp->group;
+
+    _srs_vp_index = vp->index;
+    _srs_vp_mailbox = vp->mailbox;
+
+    srs_error_t err = group->do_vp(vp);
+    if (err != srs_success) {
+        srs_warn("vp=%d quit, err %s", vp->index, srs_error_desc(err).c_str());
+        srs_freep(err);
+    }
+
+    return NULL;
+}
+
+srs_error_t SrsVpGroup::do_vp(SrsVp* vp)
+{
+    srs_error_t err = srs_success;
+
+#if defined(__linux__)
+    if (affinity_) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(vp->index % srs_vp_ncpus(), &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+            srs_warn("vp=%d bind cpu failed", vp->index);
+        }
+    }
+#endif
+
+    // Each VP has its own ST scheduler and event system.
+    if ((err = srs_st_init()) != srs_success) {
+        on_vp_ready(vp, srs_error_wrap(err, "st init"));
+        return srs_success;
+    }
+
+    // Publish the stat of event loop, for other threads to read it.
+    st_set_vp_stats(&vp->stat);
+
+    vp->quit_cond = srs_cond_new();
+    if ((err = vp->mailbox->start()) != srs_success) {
+        srs_cond_destroy(vp->quit_cond);
+        srs_st_destroy();
+        on_vp_ready(vp, srs_error_wrap(err, "start mailbox"));
+        return srs_success;
+    }
+    srs_mailbox_set_self(vp->mailbox);
+
+    if ((err = handler_->on_vp_start(vp->index)) != srs_success) {
+        handler_->on_vp_stop(vp->index);
+        srs_mailbox_set_self(NULL);
+        vp->mailbox->stop();
+        srs_cond_destroy(vp->quit_cond);
+        srs_st_destroy();
+        on_vp_ready(vp, srs_error_wrap(err, "vp start"));
+        return srs_success;
+    }
+    on_vp_ready(vp, srs_success);
+
+    // The primordial coroutine of VP, run the coroutines of handler until stop posts quit.
+    while (!vp->quit) {
+        srs_cond_wait(vp->quit_cond);
+    }
+
+    handler_->on_vp_stop(vp->index);
+    srs_mailbox_set_self(NULL);
+    vp->mailbox->stop();
+    srs_cond_destroy(vp->quit_cond);
+    srs_st_destroy();
+
+    return err;
+}
+
+void SrsVpGroup::on_vp_ready(SrsVp* vp, srs_error_t err)
+{
+    pthread_mutex_lock(&lock_);
+    vp->err = err;
+    vp->ready = true;
+    pthread_cond_broadcast(&cond_);
+    pthread_mutex_unlock(&lock_);
+}
+
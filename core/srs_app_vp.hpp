@@ -0,0 +1,129 @@
+//
+// Copyright (c) 2013-2021 The SRS Authors
+//
+// SPDX-License-Identifier: MIT
+//
+
+#ifndef SRS_APP_VP_HPP
+#define SRS_APP_VP_HPP
+
+#include <srs_core.hpp>
+
+#include <pthread.h>
+
+#include <vector>
+
+#include <srs_app_mailbox.hpp>
+
+class SrsVpGroup;
+
+// The stat of event loop of VP, the histograms of loop lag, wait time, events per wakeup and
+// runnable coroutines, see st_vp_stats_t.
+typedef st_vp_stats_t SrsVpStat;
+
+// The handler for VP(virtual processor), which is a pthread running its own ST scheduler,
+// event system, log buffer and context. The coroutines and netfds belong to the VP which
+// creates them, never pass them to other VPs.
+class ISrsVpHandler
+{
+public:
+    ISrsVpHandler();
+    virtual ~ISrsVpHandler();
+public:
+    // Called in the VP thread after ST is initialized, start the listeners and coroutines of VP.
+    // For example, create a SrsUdpListener or SrsTcpListener in each VP on the same port, the
+    // listeners use SO_REUSEPORT so the kernel balances the packets or clients between VPs.
+    // @param index The index of VP in group, in [0, size).
+    // @remark The handler is shared by all VPs, so it must be thread-safe.
+    virtual srs_error_t on_vp_start(int index) = 0;
+    // Called in the VP thread when group stops, free the listeners and coroutines of VP.
+    virtual void on_vp_stop(int index);
+};
+
+// The VP in group.
+class SrsVp
+{
+public:
+    SrsVpGroup* group;
+    int index;
+    pthread_t tid;
+    bool joinable;
+    // The error of on_vp_start, we take it when group start.
+    srs_error_t err;
+    bool ready;
+    // To post work to VP, and wakeup the VP to quit.
+    SrsMailbox* mailbox;
+    srs_cond_t quit_cond;
+    bool quit;
+    // The stat of event loop, updated by VP and read by any thread without lock.
+    SrsVpStat stat;
+public:
+    SrsVp(SrsVpGroup* g, int i);
+    virtual ~SrsVp();
+};
+
+// A group of N VPs on N pthreads, to use more than one CPU.
+// Usage:
+//      SrsVpGroup* vps = new SrsVpGroup(handler);
+//      // Start one VP per CPU, the handler->on_vp_start(index) is called in each VP.
+//      if ((err = vps->start(0)) != srs_success) {
+//          return err;
+//      }
+//      // Block until stop() is called by other thread.
+//      vps->wait();
+class SrsVpGroup
+{
+private:
+    ISrsVpHandler* handler_;
+    std::vector<SrsVp*> vps_;
+    // Whether bind VP to CPU, VP i is bound to CPU i%ncpus.
+    bool affinity_;
+    bool stopping_;
+    pthread_mutex_t lock_;
+    pthread_cond_t cond_;
+public:
+    SrsVpGroup(ISrsVpHandler* h);
+    virtual ~SrsVpGroup();
+public:
+    // Bind each VP to a CPU, must be called before start.
+    virtual void set_affinity(bool v);
+    // Start the VPs, and wait for all VPs to call on_vp_start.
+    // @param nn The number of VPs, use the number of CPUs if not positive.
+    // @remark Return the first error of VPs, and the started VPs are stopped.
+    virtual srs_error_t start(int nn);
+    // Stop all VPs and join the pthreads, it's safe to call it from any thread except VPs.
+    virtual void stop();
+    // Post the closure to run in the VP, it's safe to call it from any thread.
+    virtual srs_error_t post(int index, SrsMailbox::SrsMailboxFunc func);
+    // Block until stop() is called by other thread.
+    virtual void wait();
+    // The number of VPs.
+    virtual int size();
+    // Get the snapshot of event loop stat of VP, it's safe to call it from any thread, for
+    // example, to alert on the lag of event loop.
+    virtual srs_error_t stat(int index, SrsVpStat* v);
+private:
+    static void* vp_pthread(void* arg);
+    srs_error_t do_vp(SrsVp* vp);
+    void on_vp_ready(SrsVp* vp, srs_error_t err);
+};
+
+// Get the index of current VP, -1 if current pthread is not a VP.
+extern int srs_vp_index();
+
+// Get the mailbox of current VP, NULL if current pthread is not a VP.
+extern SrsMailbox* srs_vp_mailbox();
+
+// Get the number of CPUs online.
+extern int srs_vp_ncpus();
+
+// Get the snapshot of event loop stat of current ST thread.
+extern void srs_vp_stat(SrsVpStat* v);
+
+// Get the value which the ratio of samples are not larger than, in the histogram of SrsVpStat,
+// for example, the p99 of loop lag is srs_vp_hist_percentile(stat.loop, 0.99).
+// @return The upper bound of bucket, in the unit of histogram, or 0 if no sample.
+extern uint64_t srs_vp_hist_percentile(const unsigned long long* hist, double ratio);
+
+#endif
+
@@ -108,7 +108,7 @@ SrsCplxError* SrsCplxError::create(const char* func, const char* file, int line,
 
     va_list ap;
     va_start(ap, fmt);
-    static char buffer[4096];
+    static thread_local char buffer[4096];
     vsnprintf(buffer, sizeof(buffer), fmt, ap);
     va_end(ap);
     
@@ -133,7 +133,7 @@ SrsCplxError* SrsCplxError::wrap(const char* func, const char* file, int line, S
     
     va_list ap;
     va_start(ap, fmt);
-    static char buffer[4096];
+    static thread_local char buffer[4096];
     vsnprintf(buffer, sizeof(buffer), fmt, ap);
     va_end(ap);
     
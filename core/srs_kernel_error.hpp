@@ -102,6 +102,15 @@
 #define ERROR_SOCKET_SETCLOSEEXEC           1080
 #define ERROR_SOCKET_ACCEPT                 1081
 #define ERROR_SOCKET_RCVBUF                 1082
+#define ERROR_THREAD_CREATE                 1083
+#define ERROR_SYSTEM_SIGNAL                 1084
+#define ERROR_THREAD_STATS                  1085
+#define ERROR_CHANNEL_CLOSED                1086
+#define ERROR_CHANNEL_TIMEOUT               1087
+#define ERROR_SEMAPHORE_TIMEOUT             1088
+#define ERROR_FUTURE_TIMEOUT                1089
+#define ERROR_FUTURE_CANCELED               1090
+#define ERROR_FUTURE_BROKEN                 1091
 ///////////////////////////////////////////////////////
 // RTMP protocol error.
 ///////////////////////////////////////////////////////
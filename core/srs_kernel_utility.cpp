@@ -37,8 +37,9 @@ using namespace std;
 // @see SRS_SYS_TIME_RESOLUTION_MS_TIMES
 #define SYS_TIME_RESOLUTION_US 300*1000
 
-srs_utime_t _srs_system_time_us_cache = 0;
-srs_utime_t _srs_system_time_startup_time = 0;
+// The cache of time is updated by each VP in its own pthread, so it's per pthread.
+static thread_local srs_utime_t _srs_system_time_us_cache = 0;
+static thread_local srs_utime_t _srs_system_time_startup_time = 0;
 
 srs_utime_t srs_get_system_time()
 {
@@ -100,7 +101,7 @@ srs_utime_t srs_update_system_time()
     return _srs_system_time_us_cache;
 }
 
-// TODO: FIXME: Replace by ST dns resolve.
+// @remark It blocks the ST thread, use srs_dns_resolve_async in coroutine.
 string srs_dns_resolve(string host, int& family)
 {
     addrinfo hints;
@@ -31,6 +31,7 @@ extern srs_utime_t srs_update_system_time();
 extern std::string srs_any_address_for_listener();
 
 // The dns resolve utility, return the resolved ip address.
+// @remark It blocks the ST thread, use srs_dns_resolve_async in coroutine.
 extern std::string srs_dns_resolve(std::string host, int& family);
 
 // Split the host:port to host and port.
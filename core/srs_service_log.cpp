@@ -9,6 +9,7 @@
 #include <stdarg.h>
 #include <sys/time.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <sstream>
 using namespace std;
 
@@ -31,14 +32,23 @@ SrsContextId SrsThreadContext::generate_id()
     return cid.set_value(srs_random_str(8));
 }
 
-static SrsContextId _srs_context_default;
+// The default cid of each VP(pthread), used when not in a coroutine.
+static thread_local SrsContextId _srs_context_default;
+// The ST key is shared by all VPs, so create it once.
 static int _srs_context_key = -1;
+static pthread_once_t _srs_context_key_once = PTHREAD_ONCE_INIT;
 void _srs_context_destructor(void* arg)
 {
     SrsContextId* cid = (SrsContextId*)arg;
     srs_freep(cid);
 }
 
+static void _srs_context_key_create()
+{
+    int r0 = srs_key_create(&_srs_context_key, _srs_context_destructor);
+    srs_assert(r0 == 0);
+}
+
 const SrsContextId& SrsThreadContext::get_id()
 {
 
@@ -65,10 +75,7 @@ const SrsContextId& SrsThreadContext::set_id(const SrsContextId& v)
     SrsContextId* cid = new SrsContextId();
     *cid = v;
 
-    if (_srs_context_key < 0) {
-        int r0 = srs_key_create(&_srs_context_key, _srs_context_destructor);
-        srs_assert(r0 == 0);
-    }
+    pthread_once(&_srs_context_key_once, _srs_context_key_create);
 
     int r0 = srs_thread_setspecific(_srs_context_key, cid);
     srs_assert(r0 == 0);
@@ -91,17 +98,17 @@ impl_SrsContextRestore::~impl_SrsContextRestore()
 }
 
 // LCOV_EXCL_START
+// The log buffer of each VP(pthread).
+static thread_local char buffer[SRS_BASIC_LOG_SIZE];
+
 SrsConsoleLog::SrsConsoleLog(SrsLogLevel l, bool u)
 {
     level = l;
     utc = u;
-    
-    buffer = new char[SRS_BASIC_LOG_SIZE];
 }
 
 SrsConsoleLog::~SrsConsoleLog()
 {
-    srs_freepa(buffer);
 }
 
 srs_error_t SrsConsoleLog::initialize()
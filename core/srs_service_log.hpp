@@ -46,13 +46,12 @@ public:
 };
 
 // The basic console log, which write log to console.
+// @remark The log buffer is per thread, so it's safe to share the log between VPs.
 class SrsConsoleLog : public ISrsLog
 {
 private:
     SrsLogLevel level;
     bool utc;
-private:
-    char* buffer;
 public:
     SrsConsoleLog(SrsLogLevel l, bool u);
     virtual ~SrsConsoleLog();
@@ -2,6 +2,7 @@
 
 #include <srs_kernel_error.hpp>
 #include <srs_kernel_log.hpp>
+#include <srs_kernel_utility.hpp>
 #include <srs_core_autofree.hpp>
 
 ////////////////////////////////
@@ -14,35 +15,18 @@ using namespace std;
 // nginx also set to 512
 #define SERVER_LISTEN_BACKLOG 512
 
-// #ifdef __linux__
-// #include <sys/epoll.h>
-
-// bool srs_st_epoll_is_supported(void)
-// {
-//     struct epoll_event ev;
-    
-//     ev.events = EPOLLIN;
-//     ev.data.ptr = NULL;
-//     /* Guaranteed to fail */
-//     epoll_ctl(-1, EPOLL_CTL_ADD, -1, &ev);
-    
-//     return (errno != ENOSYS);
-// }
-// #endif
-
 srs_error_t srs_st_init()
 {
-// #ifdef __linux__
-//     // check epoll, some old linux donot support epoll.
-//     if (!srs_st_epoll_is_supported()) {
-//         return srs_error_new(ERROR_ST_SET_EPOLL, "linux epoll disabled");
-//     }
-// #endif
-    
     // Select the best event system available on the OS. In Linux this is
-    // epoll(). On BSD it will be kqueue.
-    if (st_set_eventsys(ST_EVENTSYS_SELECT) == -1) {
-        return srs_error_new(ERROR_ST_SET_EPOLL, "st enable st failed, current is %s", st_get_eventsys_name());
+    // io_uring, which reads and writes sockets natively, or epoll() before
+    // linux 5.11, on BSD it will be kqueue. ST probes the kernel for us, for
+    // example some old linux donot support epoll, so we fallback to select,
+    // which is also the only choice on QNX.
+    if (st_set_eventsys(ST_EVENTSYS_IOURING) == -1 && st_set_eventsys(ST_EVENTSYS_ALT) == -1) {
+        if (st_set_eventsys(ST_EVENTSYS_SELECT) == -1) {
+            return srs_error_new(ERROR_ST_SET_EPOLL, "st set eventsys failed, current is %s", st_get_eventsys_name());
+        }
+        srs_warn("st alternative eventsys unavailable, fallback to %s", st_get_eventsys_name());
     }
 
     // Before ST init, we might have already initialized the background cid.
@@ -58,11 +42,16 @@ srs_error_t srs_st_init()
 
     // Switch to the background cid.
     _srs_context->set_id(cid);
-    srs_info("st_init success, use %s", st_get_eventsys_name());
+    srs_trace("st_init success, use %s", st_get_eventsys_name());
     
     return srs_success;
 }
 
+void srs_st_destroy()
+{
+    st_destroy();
+}
+
 void srs_close_stfd(srs_netfd_t& stfd)
 {
     if (stfd) {
@@ -183,6 +172,26 @@ void srs_thread_yield()
     st_thread_yield();
 }
 
+void srs_thread_interrupt(srs_thread_t thread)
+{
+    st_thread_interrupt((st_thread_t)thread);
+}
+
+int srs_thread_set_priority(srs_thread_t thread, SrsCoroutinePriority priority)
+{
+    return st_thread_set_prio((st_thread_t)thread, (int)priority);
+}
+
+srs_utime_t srs_set_timer_slack(srs_utime_t slack)
+{
+    return (srs_utime_t)st_set_timer_slack((st_utime_t)slack);
+}
+
+srs_utime_t srs_thread_set_slack(srs_thread_t thread, srs_utime_t slack)
+{
+    return (srs_utime_t)st_thread_set_slack((st_thread_t)thread, (st_utime_t)slack);
+}
+
 srs_error_t srs_tcp_connect(string server, int port, srs_utime_t tm, srs_netfd_t* pstfd)
 {
     st_utime_t timeout = ST_UTIME_NO_TIMEOUT;
@@ -454,6 +463,21 @@ int srs_cond_timedwait(srs_cond_t cond, srs_utime_t timeout)
     return st_cond_timedwait((st_cond_t)cond, (st_utime_t)timeout);
 }
 
+int srs_cond_wait_until(srs_cond_t cond, srs_utime_t deadline)
+{
+    if (!deadline) {
+        return srs_cond_wait(cond);
+    }
+
+    srs_utime_t now = srs_update_system_time();
+    if (now >= deadline) {
+        errno = ETIME;
+        return -1;
+    }
+
+    return srs_cond_timedwait(cond, deadline - now);
+}
+
 int srs_cond_signal(srs_cond_t cond)
 {
     return st_cond_signal((st_cond_t)cond);
@@ -487,6 +511,74 @@ int srs_mutex_unlock(srs_mutex_t mutex)
     return st_mutex_unlock((st_mutex_t)mutex);
 }
 
+srs_rwlock_t srs_rwlock_new()
+{
+    return (srs_rwlock_t)st_rwlock_new();
+}
+
+int srs_rwlock_destroy(srs_rwlock_t lock)
+{
+    if (!lock) {
+        return 0;
+    }
+    return st_rwlock_destroy((st_rwlock_t)lock);
+}
+
+int srs_rwlock_rdlock(srs_rwlock_t lock)
+{
+    return st_rwlock_rdlock((st_rwlock_t)lock);
+}
+
+int srs_rwlock_wrlock(srs_rwlock_t lock)
+{
+    return st_rwlock_wrlock((st_rwlock_t)lock);
+}
+
+int srs_rwlock_unlock(srs_rwlock_t lock)
+{
+    return st_rwlock_unlock((st_rwlock_t)lock);
+}
+
+int srs_rwlock_lock_uninterruptible(srs_rwlock_t lock, bool writer)
+{
+    int r0 = 0;
+    bool interrupted = false;
+
+    // The interrupt is consumed by the lock, so wait again and interrupt the thread after locked.
+    while ((r0 = (writer ? srs_rwlock_wrlock(lock) : srs_rwlock_rdlock(lock))) != 0 && errno == EINTR) {
+        interrupted = true;
+    }
+
+    if (interrupted) {
+        srs_thread_interrupt(srs_thread_self());
+    }
+
+    return r0;
+}
+
+srs_sema_t srs_sema_new(int value)
+{
+    return (srs_sema_t)st_sema_new(value);
+}
+
+int srs_sema_destroy(srs_sema_t sema)
+{
+    if (!sema) {
+        return 0;
+    }
+    return st_sema_destroy((st_sema_t)sema);
+}
+
+int srs_sema_acquire(srs_sema_t sema, srs_utime_t timeout)
+{
+    return st_sema_acquire((st_sema_t)sema, (st_utime_t)timeout);
+}
+
+int srs_sema_release(srs_sema_t sema)
+{
+    return st_sema_release((st_sema_t)sema);
+}
+
 int srs_key_create(int *keyp, void (*destructor)(void *))
 {
     return st_key_create(keyp, destructor);
@@ -557,6 +649,38 @@ bool srs_is_never_timeout(srs_utime_t tm)
     return tm == SRS_UTIME_NO_TIMEOUT;
 }
 
+SrsSemaphoreGuard::SrsSemaphoreGuard(srs_sema_t sema)
+{
+    sema_ = sema;
+    acquired_ = false;
+}
+
+SrsSemaphoreGuard::~SrsSemaphoreGuard()
+{
+    if (acquired_) {
+        srs_sema_release(sema_);
+    }
+}
+
+srs_error_t SrsSemaphoreGuard::acquire(srs_utime_t timeout)
+{
+    srs_error_t err = srs_success;
+
+    if (acquired_) {
+        return err;
+    }
+
+    if (srs_sema_acquire(sema_, timeout) != 0) {
+        if (errno == ETIME) {
+            return srs_error_new(ERROR_SEMAPHORE_TIMEOUT, "semaphore timeout");
+        }
+        return srs_error_new(ERROR_THREAD_INTERRUPED, "semaphore interrupted");
+    }
+    acquired_ = true;
+
+    return err;
+}
+
 SrsStSocket::SrsStSocket()
 {
     stfd = NULL;
@@ -12,10 +12,15 @@ typedef void* srs_netfd_t;
 typedef void* srs_thread_t;
 typedef void* srs_cond_t;
 typedef void* srs_mutex_t;
+typedef void* srs_rwlock_t;
+typedef void* srs_sema_t;
 
-// Initialize st, requires epoll.
+// Initialize st, use io_uring when available, otherwise epoll(or kqueue), finally fallback to select.
 extern srs_error_t srs_st_init();
 
+// Destroy the event system of current ST, the coroutines should be stopped.
+extern void srs_st_destroy();
+
 // Close the netfd, and close the underlayer fd.
 // @remark when close, user must ensure io completed.
 extern void srs_close_stfd(srs_netfd_t& stfd);
@@ -48,6 +53,29 @@ extern srs_error_t srs_fd_get_rcvbuf(int fd, int& actual_rcvbuf);
 extern srs_thread_t srs_thread_self();
 extern void srs_thread_exit(void* retval);
 extern void srs_thread_yield();
+// Interrupt the coroutine, to wakeup it from the blocking calls, which fail with EINTR.
+extern void srs_thread_interrupt(srs_thread_t thread);
+
+// The priority classes of coroutine, the runnable coroutines of a higher class always run
+// before the lower ones, so the timers and control coroutines are responsive even when the
+// bulk coroutines, for example, forwarding media, saturate the loop, see st_thread_set_prio.
+enum SrsCoroutinePriority
+{
+    SrsCoroutinePriorityHigh = 0,
+    SrsCoroutinePriorityNormal = 1,
+    SrsCoroutinePriorityLow = 2,
+};
+// Set the priority class of coroutine, the new coroutines are normal.
+// @return The previous priority, or -1 if invalid.
+extern int srs_thread_set_priority(srs_thread_t thread, SrsCoroutinePriority priority);
+
+// Set the default timer slack of current ST thread, the timers due in [due, due+slack] are
+// batched into one wakeup, to avoid the wakeup storm for lots of heartbeats.
+// @return The previous default slack.
+extern srs_utime_t srs_set_timer_slack(srs_utime_t slack);
+// Set the timer slack of coroutine, or SRS_UTIME_NO_TIMEOUT to use the default one.
+// @return The previous slack of coroutine, or SRS_UTIME_NO_TIMEOUT if not set.
+extern srs_utime_t srs_thread_set_slack(srs_thread_t thread, srs_utime_t slack);
 
 // For client, to open socket and connect to server.
 // @param tm The timeout in srs_utime_t.
@@ -65,6 +93,9 @@ extern srs_cond_t srs_cond_new();
 extern int srs_cond_destroy(srs_cond_t cond);
 extern int srs_cond_wait(srs_cond_t cond);
 extern int srs_cond_timedwait(srs_cond_t cond, srs_utime_t timeout);
+// Wait on the condition until the deadline, which is 0 for no timeout.
+// @return 0 if signaled, or -1 with errno ETIME if timeout, or EINTR if interrupted.
+extern int srs_cond_wait_until(srs_cond_t cond, srs_utime_t deadline);
 extern int srs_cond_signal(srs_cond_t cond);
 extern int srs_cond_broadcast(srs_cond_t cond);
 
@@ -73,6 +104,22 @@ extern int srs_mutex_destroy(srs_mutex_t mutex);
 extern int srs_mutex_lock(srs_mutex_t mutex);
 extern int srs_mutex_unlock(srs_mutex_t mutex);
 
+// The reader-writer lock, a waiting writer blocks new readers, and readers which wait for the
+// writer are woken together when it unlocks.
+extern srs_rwlock_t srs_rwlock_new();
+extern int srs_rwlock_destroy(srs_rwlock_t lock);
+extern int srs_rwlock_rdlock(srs_rwlock_t lock);
+extern int srs_rwlock_wrlock(srs_rwlock_t lock);
+extern int srs_rwlock_unlock(srs_rwlock_t lock);
+// Lock for reader or writer, which ignores the interrupt while waiting, and keeps it for the next blocking call.
+extern int srs_rwlock_lock_uninterruptible(srs_rwlock_t lock, bool writer);
+
+// The counting semaphore, the permits are handed to waiters in FIFO order.
+extern srs_sema_t srs_sema_new(int value);
+extern int srs_sema_destroy(srs_sema_t sema);
+extern int srs_sema_acquire(srs_sema_t sema, srs_utime_t timeout);
+extern int srs_sema_release(srs_sema_t sema);
+
 extern int srs_key_create(int* keyp, void (*destructor)(void*));
 extern int srs_thread_setspecific(int key, void* value);
 extern void* srs_thread_getspecific(int key);
@@ -115,6 +162,64 @@ public:
     }
 };
 
+// The reader and writer locker of rwlock.
+#define SrsRdLocker(instance) \
+    impl__SrsRdLocker _SRS_free_##instance(&instance)
+#define SrsWrLocker(instance) \
+    impl__SrsWrLocker _SRS_free_##instance(&instance)
+
+class impl__SrsRdLocker
+{
+private:
+    srs_rwlock_t* lock;
+public:
+    impl__SrsRdLocker(srs_rwlock_t* l) {
+        lock = l;
+        int r0 = srs_rwlock_lock_uninterruptible(*lock, false);
+        srs_assert(!r0);
+    }
+    virtual ~impl__SrsRdLocker() {
+        int r0 = srs_rwlock_unlock(*lock);
+        srs_assert(!r0);
+    }
+};
+
+class impl__SrsWrLocker
+{
+private:
+    srs_rwlock_t* lock;
+public:
+    impl__SrsWrLocker(srs_rwlock_t* l) {
+        lock = l;
+        int r0 = srs_rwlock_lock_uninterruptible(*lock, true);
+        srs_assert(!r0);
+    }
+    virtual ~impl__SrsWrLocker() {
+        int r0 = srs_rwlock_unlock(*lock);
+        srs_assert(!r0);
+    }
+};
+
+// Acquire a permit of semaphore, which is released when guard is freed.
+// Usage:
+//      SrsSemaphoreGuard guard(sema);
+//      if ((err = guard.acquire(5 * SRS_UTIME_SECONDS)) != srs_success) {
+//          return err;
+//      }
+class SrsSemaphoreGuard
+{
+private:
+    srs_sema_t sema_;
+    bool acquired_;
+public:
+    SrsSemaphoreGuard(srs_sema_t sema);
+    virtual ~SrsSemaphoreGuard();
+public:
+    // @param timeout The timeout to wait, or SRS_UTIME_NO_TIMEOUT to wait for ever.
+    // @return ERROR_SEMAPHORE_TIMEOUT if timeout, or ERROR_THREAD_INTERRUPED if interrupted.
+    srs_error_t acquire(srs_utime_t timeout = SRS_UTIME_NO_TIMEOUT);
+};
+
 // the socket provides TCP socket over st,
 // that is, the sync socket mechanism.
 class SrsStSocket : public ISrsProtocolReadWriter
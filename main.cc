@@ -157,6 +157,12 @@ public:
         struct mallinfo info = mallinfo();
         srs_trace("system bytes     =     %ld", info.arena + info.hblkhd);
         srs_trace("in use bytes     =     %ld", info.uordblks + info.hblkhd);
+
+        std::map<std::string, SrsCoroutineStackStat> stacks = srs_coroutine_stack_stats();
+        for (std::map<std::string, SrsCoroutineStackStat>::iterator it = stacks.begin(); it != stacks.end(); ++it) {
+            SrsCoroutineStackStat& stat = it->second;
+            srs_trace("stack %s used %d/%d bytes, coroutines=%d", it->first.c_str(), stat.max_used, stat.stack_size, (int)stat.nn_coroutines);
+        }
         return err;
     };
 private:
@@ -190,23 +196,6 @@ void do_main(const std::string& ip, int port1, int port2, int testWorkPort)
     // Wait for all server to quit.
 }
 
-class IAsynCallTask
-{
-public:
-    IAsynCallTask();
-    virtual ~IAsynCallTask();
-public:
-    virtual int call() = 0;
-};
-
-class AsynCallWorker : public ISrsCoroutineHandler
-{
-public:
-
-};
-
-
-
 int main_1(int argc, const char* argv[])
 {
 
@@ -276,7 +265,7 @@ private:
     int data_;
 };
 
-StCondition<int> st_cond;
+StCondition<int>* st_cond = NULL;
 
 class Notifier  : public ISrsCoroutineHandler
 {
@@ -314,7 +303,9 @@ public:
                 return srs_error_wrap(err, "udp worker");
             }
             srs_usleep(2 * 1000 * 1000);
-            st_cond.notify();
+            if ((err = st_cond->notify()) != srs_success) {
+                return srs_error_wrap(err, "notify");
+            }
             srs_error("... notify %d", num++);
         }
         return err;
@@ -353,13 +344,14 @@ public:
         srs_error_t err = srs_success;
         int num = 1;
         while (true) {
-            st_cond.wait();
+            st_cond->wait();
             srs_error("... wait %d", num++);
         }
         return err;
     }
 };
 
+#include <thread>
 void run()
 {
     _srs_log = new SrsFileLog();
@@ -373,6 +365,18 @@ void run()
     }
 
     srs_info("start ...");
+
+    // Sample the stack usage of coroutines, printed by the timer.
+    srs_coroutine_stack_stat(true);
+
+    // The std::thread notifies the coroutines by the mailbox.
+    SrsMailbox* mailbox = new SrsMailbox("main");
+    if ((err = mailbox->start()) != srs_success) {
+        srs_error( "start mailbox failed [%s]", srs_error_desc(err).c_str() );
+        return;
+    }
+    srs_mailbox_set_self(mailbox);
+    st_cond = new StCondition<int>(mailbox);
     
     TimerTest tt;
     tt.run();
@@ -383,22 +387,28 @@ void run()
     W.run();
     // N.run();
 
-    srs_usleep(SRS_UTIME_NO_TIMEOUT);
-}
-
-#include <thread>
-int main(int argc, const char* argv[])
-{
     thread t( []() {
         int i=1;
         while (true)
         {
             sleep(3);
             printf("sleep %d\n", i++);
-            st_cond.notify();
+
+            // Not in a coroutine, so there is no context to log, print the error and ignore it.
+            srs_error_t err = st_cond->notify();
+            if (err != srs_success) {
+                printf("notify failed, %s\n", srs_error_desc(err).c_str());
+                srs_freep(err);
+            }
         }
     });
+    t.detach();
+
+    srs_usleep(SRS_UTIME_NO_TIMEOUT);
+}
 
+int main(int argc, const char* argv[])
+{
     run();
 
     return 0;
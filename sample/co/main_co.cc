@@ -0,0 +1,138 @@
+#include <string>
+
+#include <arpa/inet.h>
+
+#include "srs_service_st.hpp"
+#include "srs_core.hpp"
+#include "srs_kernel_error.hpp"
+#include "srs_kernel_log.hpp"
+#include "srs_kernel_utility.hpp"
+#include "srs_app_log.hpp"
+#include "srs_service_log.hpp"
+#include "srs_app_cotask.hpp"
+
+using namespace std;
+
+ISrsLog* _srs_log = NULL;
+ISrsContext* _srs_context = NULL;
+
+// The udp echo server by stackless tasks, a tiny task for each packet, without ST stack.
+static int nn_echoes = 0;
+
+SrsCoTask on_packet(srs_netfd_t stfd, string msg, sockaddr_in from)
+{
+    // Simulate the async work of packet.
+    co_await srs_co_usleep(1 * SRS_UTIME_MILLISECONDS);
+
+    // The udp sendto never blocks in practice, so it's ok to call it in task.
+    int nn = srs_sendto(stfd, (void*)msg.data(), (int)msg.size(), (sockaddr*)&from, sizeof(from), SRS_UTIME_NO_TIMEOUT);
+    if (nn <= 0) {
+        co_return srs_error_new(ERROR_SOCKET_WRITE, "sendto nn=%d", nn);
+    }
+
+    nn_echoes++;
+    co_return srs_success;
+}
+
+SrsCoTask serve(srs_netfd_t stfd)
+{
+    srs_error_t err = srs_success;
+
+    char buf[1500];
+    while (true) {
+        sockaddr_in from;
+        int fromlen = sizeof(from);
+        int nn = co_await srs_co_recvfrom(stfd, buf, sizeof(buf), (sockaddr*)&from, &fromlen, SRS_UTIME_NO_TIMEOUT);
+        if (nn <= 0) {
+            co_return srs_error_new(ERROR_SOCKET_READ, "recvfrom nn=%d", nn);
+        }
+
+        if ((err = SrsCoScheduler::current()->spawn(on_packet(stfd, string(buf, nn), from))) != srs_success) {
+            co_return srs_error_wrap(err, "spawn");
+        }
+    }
+
+    co_return err;
+}
+
+// The task waits for the stackful coroutine, then notifies it back.
+SrsCoTask pong(SrsCoCondition* ping, SrsCoCondition* pong)
+{
+    if (co_await ping->co_wait(1 * SRS_UTIME_SECONDS) != 0) {
+        co_return srs_error_new(ERROR_SOCKET_TIMEOUT, "ping timeout");
+    }
+
+    pong->signal();
+    co_return srs_success;
+}
+
+int main(int argc, const char* argv[])
+{
+    int port = (argc > 1)? atoi(argv[1]) : 14000;
+    int nn = (argc > 2)? atoi(argv[2]) : 1000;
+
+    _srs_log = new SrsConsoleLog(SrsLogLevelTrace, false);
+    _srs_context = new SrsThreadContext();
+
+    srs_error_t err = srs_success;
+    if ((err = srs_st_init()) != srs_success) {
+        srs_error("init st failed [%s]", srs_error_desc(err).c_str());
+        srs_freep(err);
+        return -1;
+    }
+
+    SrsCoScheduler* scheduler = new SrsCoScheduler("demo");
+    srs_netfd_t server = NULL;
+    srs_netfd_t client = NULL;
+    if ((err = scheduler->start()) != srs_success) {
+        srs_error("start scheduler failed [%s]", srs_error_desc(err).c_str());
+        srs_freep(err);
+        return -1;
+    }
+
+    if ((err = srs_udp_listen("127.0.0.1", port, &server)) != srs_success
+        || (err = srs_udp_listen("127.0.0.1", 0, &client)) != srs_success
+        || (err = scheduler->spawn(serve(server))) != srs_success) {
+        srs_error("listen port=%d failed [%s]", port, srs_error_desc(err).c_str());
+        srs_freep(err);
+        return -1;
+    }
+
+    // The main coroutine is stackful, which sends to the tasks and receives the echoes.
+    sockaddr_in to;
+    to.sin_family = AF_INET;
+    to.sin_port = htons(port);
+    to.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    srs_utime_t starttime = srs_update_system_time();
+    int nn_recv = 0;
+    for (int i = 0; i < nn; i++) {
+        string msg = "ping " + to_string(i);
+        if (srs_sendto(client, (void*)msg.data(), (int)msg.size(), (sockaddr*)&to, sizeof(to), SRS_UTIME_NO_TIMEOUT) <= 0) {
+            break;
+        }
+
+        char buf[1500];
+        if (srs_recvfrom(client, buf, sizeof(buf), NULL, NULL, 1 * SRS_UTIME_SECONDS) > 0) {
+            nn_recv++;
+        }
+    }
+    srs_trace("echo %d/%d packets by %d tasks, cost=%dms", nn_recv, nn, nn_echoes,
+        srsu2msi(srs_update_system_time() - starttime));
+
+    // The stackful coroutine and the task notify each other.
+    SrsCoCondition ping, pong_cond;
+    if ((err = scheduler->spawn(pong(&ping, &pong_cond))) == srs_success) {
+        // The signal is lost if no waiter, so wait for the task to run.
+        srs_usleep(10 * SRS_UTIME_MILLISECONDS);
+        ping.signal();
+        srs_trace("pong from task, r0=%d", pong_cond.wait(1 * SRS_UTIME_SECONDS));
+    }
+    srs_freep(err);
+
+    srs_trace("demo exit, tasks=%d", scheduler->size());
+    srs_freep(scheduler);
+    srs_close_stfd(server);
+    srs_close_stfd(client);
+    return 0;
+}
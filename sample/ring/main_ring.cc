@@ -0,0 +1,123 @@
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <thread>
+#include <vector>
+
+#include "srs_core.hpp"
+#include "srs_kernel_log.hpp"
+#include "srs_kernel_utility.hpp"
+#include "srs_app_log.hpp"
+#include "srs_service_log.hpp"
+#include "srs_app_ringbuf.hpp"
+
+using namespace std;
+
+ISrsLog* _srs_log = NULL;
+ISrsContext* _srs_context = NULL;
+
+// The number of values to push or pop in a batch.
+#define RING_BATCH 64
+
+// The producers push the values 1..nn, and the consumer checks the sum, so we never lose values.
+template<typename Ring>
+static void produce(Ring* ring, uint64_t nn, bool batch)
+{
+    uint64_t v = 1;
+    uint64_t vs[RING_BATCH];
+    while (v <= nn) {
+        if (!batch) {
+            if (ring->push(v)) {
+                v++;
+            } else {
+                sched_yield();
+            }
+            continue;
+        }
+
+        int n = (int)srs_min((uint64_t)RING_BATCH, nn - v + 1);
+        for (int i = 0; i < n; i++) {
+            vs[i] = v + i;
+        }
+
+        for (int pushed = 0; pushed < n;) {
+            int r0 = ring->push_batch(vs + pushed, n - pushed);
+            if (r0 == 0) {
+                sched_yield();
+            }
+            pushed += r0;
+        }
+        v += n;
+    }
+}
+
+template<typename Ring>
+static void bench(const char* name, Ring* ring, int producers, uint64_t nn, bool batch)
+{
+    uint64_t per_producer = nn / producers;
+    uint64_t total = per_producer * producers;
+    uint64_t expect = producers * (per_producer * (per_producer + 1) / 2);
+
+    srs_utime_t starttime = srs_update_system_time();
+
+    vector<thread*> threads;
+    for (int i = 0; i < producers; i++) {
+        threads.push_back(new thread(produce<Ring>, ring, per_producer, batch));
+    }
+
+    uint64_t sum = 0;
+    uint64_t vs[RING_BATCH];
+    for (uint64_t received = 0; received < total;) {
+        int r0 = 0;
+        if (batch) {
+            r0 = ring->pop_batch(vs, RING_BATCH);
+        } else {
+            r0 = ring->pop(vs)? 1 : 0;
+        }
+
+        if (r0 == 0) {
+            sched_yield();
+        }
+        for (int i = 0; i < r0; i++) {
+            sum += vs[i];
+        }
+        received += r0;
+    }
+
+    for (int i = 0; i < (int)threads.size(); i++) {
+        thread* trd = threads.at(i);
+        trd->join();
+        delete trd;
+    }
+
+    srs_utime_t cost = srs_max(srs_update_system_time() - starttime, 1);
+    srs_trace("%s producers=%d, batch=%d, ops=%llu, cost=%dms, %.2f Mops/s%s", name, producers, batch,
+        (unsigned long long)total, srsu2msi(cost), total * 1.0 / cost, (sum == expect)? "" : ", CORRUPTED");
+}
+
+int main(int argc, const char* argv[])
+{
+    uint64_t nn = (argc > 1)? strtoull(argv[1], NULL, 10) : 10000000;
+    int capacity = (argc > 2)? atoi(argv[2]) : 4096;
+
+    _srs_log = new SrsConsoleLog(SrsLogLevelTrace, false);
+    _srs_context = new SrsThreadContext();
+
+    srs_trace("ring benchmark, ops=%llu, capacity=%d, cpus=%d", (unsigned long long)nn, capacity,
+        (int)thread::hardware_concurrency());
+
+    for (int batch = 0; batch <= 1; batch++) {
+        SrsSpscRing<uint64_t> spsc(capacity);
+        bench("spsc", &spsc, 1, nn, batch);
+
+        int producers[] = {1, 2, 4};
+        for (int i = 0; i < (int)(sizeof(producers) / sizeof(int)); i++) {
+            SrsMpscRing<uint64_t> mpsc(capacity);
+            bench("mpsc", &mpsc, producers[i], nn, batch);
+        }
+    }
+
+    return 0;
+}
+
@@ -0,0 +1,30 @@
+//
+// Copyright (c) 2013-2021 The SRS Authors
+//
+// SPDX-License-Identifier: MIT
+//
+
+#include <srs_utest.hpp>
+
+#include <srs_service_log.hpp>
+
+ISrsLog* _srs_log = NULL;
+ISrsContext* _srs_context = NULL;
+
+// The tests run in the coroutines of the primordial ST thread.
+GTEST_API_ int main(int argc, char **argv)
+{
+    _srs_log = new SrsConsoleLog(SrsLogLevelError, false);
+    _srs_context = new SrsThreadContext();
+
+    srs_error_t err = srs_st_init();
+    if (err != srs_success) {
+        fprintf(stderr, "init st failed, %s\n", srs_error_desc(err).c_str());
+        srs_freep(err);
+        return -1;
+    }
+
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
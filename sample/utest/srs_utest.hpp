@@ -0,0 +1,35 @@
+//
+// Copyright (c) 2013-2021 The SRS Authors
+//
+// SPDX-License-Identifier: MIT
+//
+
+#ifndef SRS_UTEST_HPP
+#define SRS_UTEST_HPP
+
+// Include gtest before the headers of SRS, see st_utest.hpp.
+#include <gtest/gtest.h>
+
+#include <srs_core.hpp>
+
+#include <srs_kernel_error.hpp>
+#include <srs_kernel_log.hpp>
+#include <srs_service_st.hpp>
+
+#define VOID
+
+// Expect the call succeeds, print and free the error if not. The err must be declared.
+#define HELPER_EXPECT_SUCCESS(x) \
+    if ((err = x) != srs_success) fprintf(stderr, "err %s\n", srs_error_desc(err).c_str()); \
+    EXPECT_TRUE(srs_success == err); \
+    srs_freep(err)
+
+// Expect the call fails with the code, and free the error. The err must be declared.
+#define HELPER_EXPECT_FAILED_CODE(code, x) \
+    err = x; \
+    EXPECT_TRUE(srs_success != err); \
+    EXPECT_EQ(code, srs_error_code(err)); \
+    srs_freep(err)
+
+#endif
+
@@ -0,0 +1,197 @@
+//
+// Copyright (c) 2013-2021 The SRS Authors
+//
+// SPDX-License-Identifier: MIT
+//
+
+#include <srs_utest.hpp>
+
+#include <unistd.h>
+
+#include <srs_kernel_utility.hpp>
+#include <srs_core_autofree.hpp>
+#include <srs_app_st.hpp>
+#include <srs_app_mailbox.hpp>
+#include <srs_app_async_call.hpp>
+
+// The task which blocks the worker for a while, and fails with the code if not 0.
+class MockAsyncCallTask : public ISrsAsyncCallTask
+{
+public:
+    srs_utime_t delay_;
+    int error_code_;
+    bool called_;
+public:
+    MockAsyncCallTask(srs_utime_t delay = 0, int error_code = 0) {
+        delay_ = delay;
+        error_code_ = error_code;
+        called_ = false;
+    }
+    virtual ~MockAsyncCallTask() {
+    }
+public:
+    virtual srs_error_t call() {
+        // Block the worker pthread, never use the ST API.
+        ::usleep((useconds_t)delay_);
+        called_ = true;
+        if (error_code_) {
+            return srs_error_new(error_code_, "mock");
+        }
+        return srs_success;
+    }
+    virtual std::string to_string() {
+        return "mock";
+    }
+};
+
+// The mailbox of current ST thread, for the worker to deliver the completion.
+class MockAsyncCallMailbox
+{
+public:
+    SrsMailbox* mailbox_;
+public:
+    MockAsyncCallMailbox() {
+        mailbox_ = new SrsMailbox("utest");
+        srs_mailbox_set_self(mailbox_);
+    }
+    virtual ~MockAsyncCallMailbox() {
+        srs_mailbox_set_self(NULL);
+        srs_freep(mailbox_);
+    }
+};
+
+// The mailbox is stopped when the task is running, the coroutine still gets the result.
+VOID TEST(AsyncCallTest, MailboxStopped)
+{
+    srs_error_t err = srs_success;
+
+    MockAsyncCallMailbox mb;
+    HELPER_EXPECT_SUCCESS(mb.mailbox_->start());
+
+    SrsAsyncCallWorker worker("utest", 1);
+    HELPER_EXPECT_SUCCESS(worker.start());
+
+    SrsCoroutinePool pool("utest", 0, 1);
+    HELPER_EXPECT_SUCCESS(pool.start());
+
+    bool done = false;
+    int code = -1;
+    MockAsyncCallTask* task = new MockAsyncCallTask(20 * SRS_UTIME_MILLISECONDS, ERROR_SOCKET_TIMEOUT);
+    SrsAutoFree(MockAsyncCallTask, task);
+    HELPER_EXPECT_SUCCESS(pool.spawn([&]() {
+        srs_error_t r0 = worker.execute(task);
+        code = srs_error_code(r0);
+        srs_freep(r0);
+        done = true;
+    }));
+
+    // Let the coroutine park, then stop the mailbox while the task is running.
+    srs_usleep(1 * SRS_UTIME_MILLISECONDS);
+    mb.mailbox_->stop();
+
+    // The worker can't post the completion, so the coroutine sees it lost.
+    srs_utime_t starttime = srs_update_system_time();
+    while (!done && srs_update_system_time() - starttime < 1 * SRS_UTIME_SECONDS) {
+        srs_usleep(10 * SRS_UTIME_MILLISECONDS);
+    }
+    EXPECT_TRUE(done);
+    EXPECT_TRUE(task->called_);
+    EXPECT_EQ(ERROR_SOCKET_TIMEOUT, code);
+
+    // The stopped mailbox rejects the posts.
+    HELPER_EXPECT_FAILED_CODE(ERROR_THREAD_DISPOSED, mb.mailbox_->post([]() {}));
+
+    worker.stop();
+}
+
+// The task runs in the worker, and the coroutine resumes with its error.
+VOID TEST(AsyncCallTest, ExecuteRoundTrip)
+{
+    srs_error_t err = srs_success;
+
+    MockAsyncCallMailbox mb;
+    HELPER_EXPECT_SUCCESS(mb.mailbox_->start());
+
+    SrsAsyncCallWorker worker("utest", 2);
+    HELPER_EXPECT_SUCCESS(worker.start());
+
+    MockAsyncCallTask* task = new MockAsyncCallTask();
+    SrsAutoFree(MockAsyncCallTask, task);
+    HELPER_EXPECT_SUCCESS(worker.execute(task));
+    EXPECT_TRUE(task->called_);
+
+    MockAsyncCallTask* failer = new MockAsyncCallTask(1 * SRS_UTIME_MILLISECONDS, ERROR_SOCKET_TIMEOUT);
+    SrsAutoFree(MockAsyncCallTask, failer);
+    HELPER_EXPECT_FAILED_CODE(ERROR_SOCKET_TIMEOUT, worker.execute(failer));
+    EXPECT_TRUE(failer->called_);
+
+    SrsAsyncCallStat s;
+    worker.stat(&s);
+    EXPECT_EQ(2ULL, s.nn_submitted);
+    EXPECT_EQ(2ULL, s.nn_done);
+    EXPECT_EQ(0, s.depth);
+
+    // The coroutine needs the mailbox of its ST thread.
+    srs_mailbox_set_self(NULL);
+    HELPER_EXPECT_FAILED_CODE(ERROR_SYSTEM_CREATE_PIPE, worker.execute(task));
+    srs_mailbox_set_self(mb.mailbox_);
+
+    worker.stop();
+}
+
+// Stop the worker with queued tasks, which are all done before the workers quit.
+VOID TEST(AsyncCallTest, StopWithQueuedTasks)
+{
+    srs_error_t err = srs_success;
+
+    MockAsyncCallMailbox mb;
+    HELPER_EXPECT_SUCCESS(mb.mailbox_->start());
+
+    SrsAsyncCallWorker worker("utest", 1);
+    HELPER_EXPECT_SUCCESS(worker.start());
+
+    SrsCoroutinePool pool("utest", 0, 4);
+    HELPER_EXPECT_SUCCESS(pool.start());
+
+    const int nn = 4;
+    MockAsyncCallTask* tasks[nn];
+    int nn_done = 0;
+    for (int i = 0; i < nn; i++) {
+        MockAsyncCallTask* task = tasks[i] = new MockAsyncCallTask(5 * SRS_UTIME_MILLISECONDS);
+        HELPER_EXPECT_SUCCESS(pool.spawn([&worker, &nn_done, task]() {
+            srs_error_t r0 = worker.execute(task);
+            if (r0 == srs_success) {
+                nn_done++;
+            }
+            srs_freep(r0);
+        }));
+    }
+
+    // Let the coroutines submit the tasks, which are queued for the only worker.
+    srs_usleep(1 * SRS_UTIME_MILLISECONDS);
+    SrsAsyncCallStat s;
+    worker.stat(&s);
+    EXPECT_EQ((uint64_t)nn, s.nn_submitted);
+    EXPECT_GT(s.depth, 0);
+
+    // The workers drain the queue before quit, then the coroutines resume by the mailbox.
+    worker.stop();
+    worker.stat(&s);
+    EXPECT_EQ((uint64_t)nn, s.nn_done);
+    EXPECT_EQ(0, s.depth);
+
+    srs_utime_t starttime = srs_update_system_time();
+    while (nn_done < nn && srs_update_system_time() - starttime < 1 * SRS_UTIME_SECONDS) {
+        srs_usleep(1 * SRS_UTIME_MILLISECONDS);
+    }
+    EXPECT_EQ(nn, nn_done);
+    for (int i = 0; i < nn; i++) {
+        EXPECT_TRUE(tasks[i]->called_);
+        srs_freep(tasks[i]);
+    }
+
+    // The stopped worker rejects new tasks.
+    MockAsyncCallTask* task = new MockAsyncCallTask();
+    SrsAutoFree(MockAsyncCallTask, task);
+    HELPER_EXPECT_FAILED_CODE(ERROR_THREAD_DISPOSED, worker.execute(task));
+}
@@ -0,0 +1,124 @@
+//
+// Copyright (c) 2013-2021 The SRS Authors
+//
+// SPDX-License-Identifier: MIT
+//
+
+#include <srs_utest.hpp>
+
+#include <srs_app_st.hpp>
+#include <srs_app_channel.hpp>
+
+// The coroutine to send a value to channel, after a delay.
+class MockChannelSender : public ISrsCoroutineHandler
+{
+public:
+    SrsChannel<int, 1>* ch_;
+    int v_;
+    srs_utime_t delay_;
+    // The error of send, which is set when done.
+    srs_error_t err_;
+    bool done_;
+public:
+    MockChannelSender(SrsChannel<int, 1>* ch, int v, srs_utime_t delay = 0) {
+        ch_ = ch;
+        v_ = v;
+        delay_ = delay;
+        err_ = srs_success;
+        done_ = false;
+    }
+    virtual ~MockChannelSender() {
+        srs_freep(err_);
+    }
+public:
+    virtual srs_error_t cycle() {
+        if (delay_ > 0) {
+            srs_usleep(delay_);
+        }
+        err_ = ch_->send(v_);
+        done_ = true;
+        return srs_success;
+    }
+};
+
+// The blocked sender fails when channel is closed, while the sent values are still received.
+VOID TEST(ChannelTest, CloseWhileSenderBlocked)
+{
+    srs_error_t err = srs_success;
+
+    SrsChannel<int, 1> ch;
+    HELPER_EXPECT_SUCCESS(ch.send(100));
+
+    // The channel is full, so the sender blocks.
+    MockChannelSender sender(&ch, 200);
+    SrsSTCoroutine trd("sender", &sender);
+    HELPER_EXPECT_SUCCESS(trd.start());
+    srs_usleep(1 * SRS_UTIME_MILLISECONDS);
+    EXPECT_FALSE(sender.done_);
+
+    // Wakeup the blocked sender, which fails without sending the value.
+    ch.close();
+    srs_usleep(1 * SRS_UTIME_MILLISECONDS);
+    EXPECT_TRUE(sender.done_);
+    EXPECT_EQ(ERROR_CHANNEL_CLOSED, srs_error_code(sender.err_));
+    EXPECT_EQ(1, ch.size());
+
+    // Drain the value sent before close, then fails.
+    int v = 0;
+    HELPER_EXPECT_SUCCESS(ch.recv(&v));
+    EXPECT_EQ(100, v);
+    HELPER_EXPECT_FAILED_CODE(ERROR_CHANNEL_CLOSED, ch.recv(&v));
+    HELPER_EXPECT_FAILED_CODE(ERROR_CHANNEL_CLOSED, ch.send(300));
+}
+
+// The sender of full channel fails on timeout.
+VOID TEST(ChannelTest, SendTimeout)
+{
+    srs_error_t err = srs_success;
+
+    SrsChannel<int, 1> ch;
+    HELPER_EXPECT_SUCCESS(ch.send(100));
+
+    srs_utime_t starttime = srs_update_system_time();
+    HELPER_EXPECT_FAILED_CODE(ERROR_CHANNEL_TIMEOUT, ch.send(200, 10 * SRS_UTIME_MILLISECONDS));
+    EXPECT_GE(srs_update_system_time() - starttime, 9 * SRS_UTIME_MILLISECONDS);
+    EXPECT_EQ(1, ch.size());
+}
+
+// The select fails on timeout if no channel is readable, or picks the channel when sent.
+VOID TEST(ChannelTest, SelectTimeout)
+{
+    srs_error_t err = srs_success;
+
+    SrsChannel<int, 1> ch0;
+    SrsChannel<int, 1> ch1;
+
+    SrsChannelSelect select;
+    select.add(&ch0);
+    select.add(&ch1);
+
+    SrsChannelBase* ch = NULL;
+    srs_utime_t starttime = srs_update_system_time();
+    HELPER_EXPECT_FAILED_CODE(ERROR_CHANNEL_TIMEOUT, select.wait(&ch, 10 * SRS_UTIME_MILLISECONDS));
+    EXPECT_GE(srs_update_system_time() - starttime, 9 * SRS_UTIME_MILLISECONDS);
+    EXPECT_TRUE(ch == NULL);
+
+    // Wakeup the select before timeout.
+    MockChannelSender sender(&ch1, 200, 5 * SRS_UTIME_MILLISECONDS);
+    SrsSTCoroutine trd("sender", &sender);
+    HELPER_EXPECT_SUCCESS(trd.start());
+
+    starttime = srs_update_system_time();
+    HELPER_EXPECT_SUCCESS(select.wait(&ch, 100 * SRS_UTIME_MILLISECONDS));
+    EXPECT_LT(srs_update_system_time() - starttime, 100 * SRS_UTIME_MILLISECONDS);
+    EXPECT_TRUE(ch == &ch1);
+
+    int v = 0;
+    EXPECT_TRUE(ch1.try_recv(&v));
+    EXPECT_EQ(200, v);
+
+    // The closed channel is readable, so select never blocks.
+    ch0.close();
+    HELPER_EXPECT_SUCCESS(select.wait(&ch, 10 * SRS_UTIME_MILLISECONDS));
+    EXPECT_TRUE(ch == &ch0);
+}
@@ -0,0 +1,127 @@
+//
+// Copyright (c) 2013-2021 The SRS Authors
+//
+// SPDX-License-Identifier: MIT
+//
+
+#include <srs_utest.hpp>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <srs_kernel_utility.hpp>
+#include <srs_app_cotask.hpp>
+
+// The pairs of unix sockets, the first is read by tasks and the second is written by test.
+class MockCoSocketPairs
+{
+public:
+    std::vector<int> writers_;
+    std::vector<srs_netfd_t> readers_;
+public:
+    MockCoSocketPairs(int nn) {
+        for (int i = 0; i < nn; i++) {
+            int fds[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+                break;
+            }
+            readers_.push_back(srs_netfd_open_socket(fds[0]));
+            writers_.push_back(fds[1]);
+        }
+    }
+    virtual ~MockCoSocketPairs() {
+        for (int i = 0; i < (int)readers_.size(); i++) {
+            srs_close_stfd(readers_.at(i));
+            ::close(writers_.at(i));
+        }
+    }
+};
+
+// Read one byte from the fd, and save the byte or the errno.
+static SrsCoTask mock_co_read(srs_netfd_t stfd, srs_utime_t timeout, int* pv)
+{
+    char v = 0;
+    ssize_t nn = co_await srs_co_read(stfd, &v, 1, timeout);
+    *pv = (nn == 1)? v : -errno;
+    co_return srs_success;
+}
+
+// Wait for the tasks of scheduler to quit, or timeout.
+static void mock_co_wait(SrsCoScheduler* scheduler, int nn)
+{
+    srs_utime_t starttime = srs_update_system_time();
+    while (scheduler->size() > nn && srs_update_system_time() - starttime < 1 * SRS_UTIME_SECONDS) {
+        srs_usleep(1 * SRS_UTIME_MILLISECONDS);
+    }
+}
+
+// The parked tasks are woken up only by their fds, whatever the order.
+VOID TEST(CoTaskTest, ParkedFds)
+{
+    srs_error_t err = srs_success;
+
+    SrsCoScheduler scheduler("utest");
+    HELPER_EXPECT_SUCCESS(scheduler.start());
+
+    const int nn = 100;
+    MockCoSocketPairs pairs(nn);
+    EXPECT_EQ(nn, (int)pairs.readers_.size());
+
+    std::vector<int> values(nn, 0);
+    for (int i = 0; i < nn; i++) {
+        HELPER_EXPECT_SUCCESS(scheduler.spawn(mock_co_read(pairs.readers_.at(i), SRS_UTIME_NO_TIMEOUT, &values.at(i))));
+    }
+
+    // Let the tasks run and park.
+    srs_usleep(1 * SRS_UTIME_MILLISECONDS);
+    EXPECT_EQ(nn, scheduler.size());
+
+    // Wakeup the tasks in reverse order, one by one.
+    for (int i = nn - 1; i >= 0; i--) {
+        char v = (char)(i % 100 + 1);
+        EXPECT_EQ(1, (int)::write(pairs.writers_.at(i), &v, 1));
+
+        mock_co_wait(&scheduler, i);
+        EXPECT_EQ(i, scheduler.size());
+        EXPECT_EQ(i % 100 + 1, values.at(i));
+        if (i > 0) {
+            EXPECT_EQ(0, values.at(i - 1));
+        }
+    }
+}
+
+// The tasks parked on the same fd, and the timeout of parked task.
+VOID TEST(CoTaskTest, SharedFdAndTimeout)
+{
+    srs_error_t err = srs_success;
+
+    SrsCoScheduler scheduler("utest");
+    HELPER_EXPECT_SUCCESS(scheduler.start());
+
+    MockCoSocketPairs pairs(2);
+    EXPECT_EQ(2, (int)pairs.readers_.size());
+
+    int v0 = 0, v1 = 0, v2 = 0;
+    HELPER_EXPECT_SUCCESS(scheduler.spawn(mock_co_read(pairs.readers_.at(0), SRS_UTIME_NO_TIMEOUT, &v0)));
+    HELPER_EXPECT_SUCCESS(scheduler.spawn(mock_co_read(pairs.readers_.at(0), SRS_UTIME_NO_TIMEOUT, &v1)));
+    HELPER_EXPECT_SUCCESS(scheduler.spawn(mock_co_read(pairs.readers_.at(1), 10 * SRS_UTIME_MILLISECONDS, &v2)));
+    srs_usleep(1 * SRS_UTIME_MILLISECONDS);
+    EXPECT_EQ(3, scheduler.size());
+
+    // Only one of the tasks on the same fd gets the byte, the other one keeps parked.
+    char v = 'a';
+    EXPECT_EQ(1, (int)::write(pairs.writers_.at(0), &v, 1));
+    mock_co_wait(&scheduler, 2);
+    EXPECT_EQ(2, scheduler.size());
+    EXPECT_EQ('a', v0 + v1);
+
+    v = 'b';
+    EXPECT_EQ(1, (int)::write(pairs.writers_.at(0), &v, 1));
+    mock_co_wait(&scheduler, 1);
+    EXPECT_EQ('a' + 'b', v0 + v1);
+
+    // The task without data quits by timeout.
+    mock_co_wait(&scheduler, 0);
+    EXPECT_EQ(0, scheduler.size());
+    EXPECT_EQ(-ETIME, v2);
+}
@@ -0,0 +1,209 @@
+//
+// Copyright (c) 2013-2021 The SRS Authors
+//
+// SPDX-License-Identifier: MIT
+//
+
+#include <srs_utest.hpp>
+
+#include <srs_kernel_utility.hpp>
+#include <srs_app_st.hpp>
+#include <srs_app_future.hpp>
+
+#include <string.h>
+#include <st.h>
+
+// The future fails if the promise is freed without result.
+VOID TEST(FutureTest, BrokenPromise)
+{
+    srs_error_t err = srs_success;
+
+    // The promise is freed before get.
+    SrsFuture<int> f0;
+    if (true) {
+        SrsPromise<int> promise;
+        f0 = promise.get_future();
+        EXPECT_FALSE(f0.ready());
+    }
+    EXPECT_TRUE(f0.ready());
+
+    int v = 0;
+    HELPER_EXPECT_FAILED_CODE(ERROR_FUTURE_BROKEN, f0.get(&v));
+
+    // The producer quits without result, which wakes up the waiter.
+    SrsCoroutinePool pool("utest", 0, 1);
+    HELPER_EXPECT_SUCCESS(pool.start());
+
+    SrsPromise<int> promise;
+    SrsFuture<int> f1 = promise.get_future();
+    HELPER_EXPECT_SUCCESS(pool.spawn([promise = std::move(promise)]() mutable {
+        srs_usleep(5 * SRS_UTIME_MILLISECONDS);
+    }));
+
+    srs_utime_t starttime = srs_update_system_time();
+    HELPER_EXPECT_FAILED_CODE(ERROR_FUTURE_BROKEN, f1.get(&v, 100 * SRS_UTIME_MILLISECONDS));
+    EXPECT_LT(srs_update_system_time() - starttime, 100 * SRS_UTIME_MILLISECONDS);
+
+    // The copies of future share the result.
+    SrsFuture<int> f2 = f1;
+    HELPER_EXPECT_FAILED_CODE(ERROR_FUTURE_BROKEN, f2.get(&v));
+}
+
+// Cancel the future, which interrupts the producer blocked in sleep.
+VOID TEST(FutureTest, CancelInterruptsProducer)
+{
+    srs_error_t err = srs_success;
+
+    SrsCoroutinePool pool("utest", 0, 1);
+    HELPER_EXPECT_SUCCESS(pool.start());
+
+    bool done = false;
+    int r0 = 0;
+    bool set = true;
+    srs_utime_t cost = 0;
+
+    SrsPromise<int> promise;
+    SrsFuture<int> future = promise.get_future();
+    HELPER_EXPECT_SUCCESS(pool.spawn([promise = std::move(promise), &done, &r0, &set, &cost]() mutable {
+        promise.bind();
+
+        srs_utime_t starttime = srs_update_system_time();
+        r0 = srs_usleep(1 * SRS_UTIME_SECONDS);
+        cost = srs_update_system_time() - starttime;
+
+        // The canceled future ignores the value.
+        set = promise.set_value(100);
+        done = true;
+    }));
+
+    // Let the producer run and block.
+    srs_usleep(1 * SRS_UTIME_MILLISECONDS);
+    EXPECT_FALSE(done);
+
+    future.cancel();
+    EXPECT_TRUE(future.ready());
+
+    int v = 0;
+    HELPER_EXPECT_FAILED_CODE(ERROR_FUTURE_CANCELED, future.get(&v));
+
+    srs_usleep(1 * SRS_UTIME_MILLISECONDS);
+    EXPECT_TRUE(done);
+    EXPECT_EQ(-1, r0);
+    EXPECT_LT(cost, 500 * SRS_UTIME_MILLISECONDS);
+    EXPECT_FALSE(set);
+
+    // The result is not changed by the cancel after ready.
+    future.cancel();
+    HELPER_EXPECT_FAILED_CODE(ERROR_FUTURE_CANCELED, future.get(&v));
+}
+
+// The combinators fail on timeout, or return when the futures are ready.
+VOID TEST(FutureTest, WhenAnyTimeout)
+{
+    srs_error_t err = srs_success;
+
+    SrsCoroutinePool pool("utest", 0, 1);
+    HELPER_EXPECT_SUCCESS(pool.start());
+
+    SrsPromise<int> p0;
+    SrsPromise<int> p1;
+    SrsFuture<int> f0 = p0.get_future();
+    SrsFuture<int> f1 = p1.get_future();
+
+    std::vector<SrsFutureBase*> futures;
+    futures.push_back(&f0);
+    futures.push_back(&f1);
+
+    int index = -1;
+    srs_utime_t starttime = srs_update_system_time();
+    HELPER_EXPECT_FAILED_CODE(ERROR_FUTURE_TIMEOUT, srs_when_any(futures, &index, 10 * SRS_UTIME_MILLISECONDS));
+    EXPECT_GE(srs_update_system_time() - starttime, 9 * SRS_UTIME_MILLISECONDS);
+
+    // Wakeup the waiter before timeout, by the second future.
+    HELPER_EXPECT_SUCCESS(pool.spawn([promise = std::move(p1)]() mutable {
+        srs_usleep(5 * SRS_UTIME_MILLISECONDS);
+        promise.set_value(200);
+    }));
+
+    starttime = srs_update_system_time();
+    HELPER_EXPECT_SUCCESS(srs_when_any(futures, &index, 100 * SRS_UTIME_MILLISECONDS));
+    EXPECT_LT(srs_update_system_time() - starttime, 100 * SRS_UTIME_MILLISECONDS);
+    EXPECT_EQ(1, index);
+
+    int v = 0;
+    HELPER_EXPECT_SUCCESS(f1.get(&v));
+    EXPECT_EQ(200, v);
+
+    // Wait for all, which fails on timeout until the first future is ready.
+    HELPER_EXPECT_FAILED_CODE(ERROR_FUTURE_TIMEOUT, srs_when_all(futures, 10 * SRS_UTIME_MILLISECONDS));
+
+    p0.set_value(100);
+    HELPER_EXPECT_SUCCESS(srs_when_all(futures, 10 * SRS_UTIME_MILLISECONDS));
+    HELPER_EXPECT_SUCCESS(f0.get(&v));
+    EXPECT_EQ(100, v);
+}
+
+struct MockFutureArgs
+{
+    std::vector<SrsFutureBase*> futures;
+    SrsPromise<int>* promise;
+    int index;
+    srs_error_t err;
+};
+
+static void* mock_future_when_any(void* arg)
+{
+    MockFutureArgs* args = (MockFutureArgs*)arg;
+    args->err = srs_when_any(args->futures, &args->index, 100 * SRS_UTIME_MILLISECONDS);
+    return NULL;
+}
+
+static void* mock_future_producer(void* arg)
+{
+    MockFutureArgs* args = (MockFutureArgs*)arg;
+
+    // Overwrite the shared stack, where the frames of waiter were.
+    char stack_data[4096];
+    memset(stack_data, 0xff, sizeof(stack_data));
+
+    srs_usleep(1 * SRS_UTIME_MILLISECONDS);
+    args->promise->set_value(stack_data[0] == (char)0xff ? 100 : 0);
+    return NULL;
+}
+
+// The combinators work in copy-stack mode, where the producer runs on the stack of the waiter.
+VOID TEST(FutureTest, WhenAnyCopyStack)
+{
+    srs_error_t err = srs_success;
+
+    EXPECT_EQ(0, st_set_copy_stack(1, 256 * 1024));
+
+    SrsPromise<int> p0;
+    SrsPromise<int> p1;
+    SrsFuture<int> f0 = p0.get_future();
+    SrsFuture<int> f1 = p1.get_future();
+
+    MockFutureArgs args;
+    args.futures.push_back(&f0);
+    args.futures.push_back(&f1);
+    args.promise = &p1;
+    args.index = -1;
+    args.err = srs_success;
+
+    st_thread_t waiter = st_thread_create(mock_future_when_any, &args, 1, 64 * 1024);
+    st_thread_t producer = st_thread_create(mock_future_producer, &args, 1, 64 * 1024);
+    EXPECT_TRUE(waiter != NULL && producer != NULL);
+    st_thread_join(waiter, NULL);
+    st_thread_join(producer, NULL);
+
+    HELPER_EXPECT_SUCCESS(args.err);
+    EXPECT_EQ(1, args.index);
+
+    int v = 0;
+    HELPER_EXPECT_SUCCESS(f1.get(&v));
+    EXPECT_EQ(100, v);
+
+    // The joined coroutines free the stacks when they run again.
+    srs_usleep(0);
+    EXPECT_EQ(0, st_set_copy_stack(0, 0));
+}
@@ -0,0 +1,135 @@
+//
+// Copyright (c) 2013-2021 The SRS Authors
+//
+// SPDX-License-Identifier: MIT
+//
+
+#include <srs_utest.hpp>
+
+#include <srs_kernel_utility.hpp>
+#include <srs_app_st.hpp>
+
+// The child which blocks until interrupted, or fails after a delay.
+class MockGroupChild : public ISrsCoroutineHandler
+{
+public:
+    SrsCoroutine* trd_;
+    // Fails with the error code after delay, or 0 to block until interrupted.
+    int error_code_;
+    srs_utime_t delay_;
+    // The code of error when quit.
+    int quit_code_;
+    bool done_;
+public:
+    MockGroupChild(int error_code = 0, srs_utime_t delay = 0) {
+        trd_ = NULL;
+        error_code_ = error_code;
+        delay_ = delay;
+        quit_code_ = 0;
+        done_ = false;
+    }
+    virtual ~MockGroupChild() {
+    }
+public:
+    virtual srs_error_t cycle() {
+        srs_error_t err = do_cycle();
+        quit_code_ = srs_error_code(err);
+        done_ = true;
+        return err;
+    }
+private:
+    srs_error_t do_cycle() {
+        if (error_code_) {
+            srs_usleep(delay_);
+            return srs_error_new(error_code_, "mock");
+        }
+
+        srs_error_t err = srs_success;
+        while (true) {
+            if ((err = trd_->pull()) != srs_success) {
+                return srs_error_wrap(err, "mock");
+            }
+            srs_usleep(1 * SRS_UTIME_SECONDS);
+        }
+        return err;
+    }
+};
+
+// The first child which fails cancels its blocked siblings, and the error is returned by wait.
+VOID TEST(CoroutineGroupTest, FirstErrorCancels)
+{
+    srs_error_t err = srs_success;
+
+    SrsCoroutineGroup group("utest");
+
+    MockGroupChild c0;
+    MockGroupChild c1;
+    MockGroupChild failer(ERROR_SOCKET_TIMEOUT, 5 * SRS_UTIME_MILLISECONDS);
+    HELPER_EXPECT_SUCCESS(group.spawn("c0", &c0, &c0.trd_));
+    HELPER_EXPECT_SUCCESS(group.spawn("c1", &c1, &c1.trd_));
+    HELPER_EXPECT_SUCCESS(group.spawn("failer", &failer));
+    EXPECT_EQ(3, group.size());
+
+    srs_utime_t starttime = srs_update_system_time();
+    HELPER_EXPECT_FAILED_CODE(ERROR_SOCKET_TIMEOUT, group.wait());
+    EXPECT_LT(srs_update_system_time() - starttime, 500 * SRS_UTIME_MILLISECONDS);
+    EXPECT_EQ(0, group.size());
+
+    // The siblings quit by interrupted, while blocked in sleep.
+    EXPECT_TRUE(c0.done_);
+    EXPECT_TRUE(c1.done_);
+    EXPECT_EQ(ERROR_THREAD_INTERRUPED, c0.quit_code_);
+    EXPECT_EQ(ERROR_THREAD_INTERRUPED, c1.quit_code_);
+
+    // The canceled group rejects new children.
+    MockGroupChild c2;
+    HELPER_EXPECT_FAILED_CODE(ERROR_THREAD_INTERRUPED, group.spawn("c2", &c2, &c2.trd_));
+}
+
+// The interrupt by user is not an error of children.
+VOID TEST(CoroutineGroupTest, InterruptByUser)
+{
+    srs_error_t err = srs_success;
+
+    SrsCoroutineGroup group("utest");
+
+    MockGroupChild c0;
+    HELPER_EXPECT_SUCCESS(group.spawn("c0", &c0, &c0.trd_));
+    srs_usleep(1 * SRS_UTIME_MILLISECONDS);
+
+    group.interrupt();
+    HELPER_EXPECT_SUCCESS(group.wait());
+    EXPECT_TRUE(c0.done_);
+}
+
+// Stop the group while all children are blocked, which interrupts and joins them.
+VOID TEST(CoroutineGroupTest, StopWhileBlocked)
+{
+    srs_error_t err = srs_success;
+
+    SrsCoroutineGroup group("utest");
+
+    const int nn = 100;
+    MockGroupChild children[nn];
+    for (int i = 0; i < nn; i++) {
+        HELPER_EXPECT_SUCCESS(group.spawn("child", &children[i], &children[i].trd_));
+    }
+
+    // Let the children run and block in sleep.
+    srs_usleep(1 * SRS_UTIME_MILLISECONDS);
+    EXPECT_EQ(nn, group.size());
+
+    srs_utime_t starttime = srs_update_system_time();
+    group.stop();
+    EXPECT_LT(srs_update_system_time() - starttime, 500 * SRS_UTIME_MILLISECONDS);
+    EXPECT_EQ(0, group.size());
+
+    for (int i = 0; i < nn; i++) {
+        EXPECT_TRUE(children[i].done_);
+        EXPECT_EQ(ERROR_THREAD_INTERRUPED, children[i].quit_code_);
+    }
+
+    // The stopped group rejects new children.
+    MockGroupChild c0;
+    HELPER_EXPECT_FAILED_CODE(ERROR_THREAD_DISPOSED, group.spawn("c0", &c0, &c0.trd_));
+}
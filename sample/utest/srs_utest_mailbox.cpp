@@ -0,0 +1,99 @@
+//
+// Copyright (c) 2013-2021 The SRS Authors
+//
+// SPDX-License-Identifier: MIT
+//
+
+#include <srs_utest.hpp>
+
+#include <thread>
+#include <vector>
+
+#include <srs_kernel_utility.hpp>
+#include <srs_app_mailbox.hpp>
+
+// Wait for the mailbox to drain the closures, or timeout.
+static void mock_mailbox_wait(SrsMailbox* mailbox, uint64_t nn_msgs)
+{
+    srs_utime_t starttime = srs_update_system_time();
+    while (mailbox->nn_msgs() < nn_msgs && srs_update_system_time() - starttime < 1 * SRS_UTIME_SECONDS) {
+        srs_usleep(1 * SRS_UTIME_MILLISECONDS);
+    }
+}
+
+// The closures posted by other pthreads run in the VP, in order of post for each producer.
+VOID TEST(MailboxTest, CrossThreadOrder)
+{
+    srs_error_t err = srs_success;
+
+    SrsMailbox mailbox("utest");
+    HELPER_EXPECT_SUCCESS(mailbox.start());
+
+    // The closures run in the VP, so it's safe to update the vectors without lock.
+    const int nn = 1000;
+    std::vector<int> seqs[2];
+    std::thread producers[2];
+    for (int i = 0; i < 2; i++) {
+        producers[i] = std::thread([&mailbox, &seqs, i]() {
+            for (int j = 0; j < nn; j++) {
+                srs_error_t r0 = mailbox.post([&seqs, i, j]() {
+                    seqs[i].push_back(j);
+                });
+                srs_freep(r0);
+            }
+        });
+    }
+    for (int i = 0; i < 2; i++) {
+        producers[i].join();
+    }
+
+    mock_mailbox_wait(&mailbox, 2 * nn);
+    EXPECT_EQ((uint64_t)(2 * nn), mailbox.nn_msgs());
+    for (int i = 0; i < 2; i++) {
+        EXPECT_EQ(nn, (int)seqs[i].size());
+        for (int j = 0; j < (int)seqs[i].size(); j++) {
+            EXPECT_EQ(j, seqs[i].at(j));
+        }
+    }
+
+    mailbox.stop();
+}
+
+// The closures posted before the VP wakes up are drained as a batch, by one wakeup.
+VOID TEST(MailboxTest, OneWakeupPerBatch)
+{
+    srs_error_t err = srs_success;
+
+    SrsMailbox mailbox("utest");
+    HELPER_EXPECT_SUCCESS(mailbox.start());
+
+    // Let the mailbox coroutine park on the fd.
+    srs_usleep(1 * SRS_UTIME_MILLISECONDS);
+
+    int nn_runs = 0;
+    std::thread producer([&mailbox, &nn_runs]() {
+        for (int i = 0; i < 100; i++) {
+            srs_error_t r0 = mailbox.post([&nn_runs]() {
+                nn_runs++;
+            });
+            srs_freep(r0);
+        }
+    });
+    producer.join();
+
+    mock_mailbox_wait(&mailbox, 100);
+    EXPECT_EQ(100, nn_runs);
+    EXPECT_EQ(1ULL, mailbox.nn_wakeups());
+
+    // The next batch wakes up the VP again.
+    for (int i = 0; i < 10; i++) {
+        HELPER_EXPECT_SUCCESS(mailbox.post([&nn_runs]() {
+            nn_runs++;
+        }));
+    }
+    mock_mailbox_wait(&mailbox, 110);
+    EXPECT_EQ(110, nn_runs);
+    EXPECT_EQ(2ULL, mailbox.nn_wakeups());
+
+    mailbox.stop();
+}
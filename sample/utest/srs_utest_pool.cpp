@@ -0,0 +1,151 @@
+//
+// Copyright (c) 2013-2021 The SRS Authors
+//
+// SPDX-License-Identifier: MIT
+//
+
+#include <srs_utest.hpp>
+
+#include <srs_app_st.hpp>
+
+// The pool grows to max workers for the busy tasks, and queues the rest.
+VOID TEST(CoroutinePoolTest, GrowAndQueue)
+{
+    srs_error_t err = srs_success;
+
+    SrsCoroutinePool pool("utest", 1, 4);
+    HELPER_EXPECT_SUCCESS(pool.start());
+
+    // Let the worker run and park.
+    srs_usleep(1 * SRS_UTIME_MILLISECONDS);
+
+    SrsCoroutinePoolStat s;
+    pool.stat(&s);
+    EXPECT_EQ(1, s.nn_workers);
+    EXPECT_EQ(1, s.nn_idle);
+    EXPECT_EQ(1ULL, s.nn_created);
+
+    int nn_done = 0;
+    for (int i = 0; i < 6; i++) {
+        HELPER_EXPECT_SUCCESS(pool.spawn([&nn_done]() {
+            srs_usleep(10 * SRS_UTIME_MILLISECONDS);
+            nn_done++;
+        }));
+    }
+
+    // The first task wakes up the parked worker, and each of the next three creates one, which
+    // has not run yet, so the tasks are still queued.
+    pool.stat(&s);
+    EXPECT_EQ(4, s.nn_workers);
+    EXPECT_EQ(0, s.nn_idle);
+    EXPECT_EQ(5, s.nn_pending);
+    EXPECT_EQ(6ULL, s.nn_spawned);
+
+    // Each new worker picks a queued task when it runs.
+    srs_usleep(1 * SRS_UTIME_MILLISECONDS);
+    pool.stat(&s);
+    EXPECT_EQ(2, s.nn_pending);
+    EXPECT_EQ(0, nn_done);
+
+    // The queued tasks are picked by the busy workers when done.
+    srs_usleep(50 * SRS_UTIME_MILLISECONDS);
+    EXPECT_EQ(6, nn_done);
+
+    pool.stat(&s);
+    EXPECT_EQ(4, s.nn_workers);
+    EXPECT_EQ(4, s.nn_idle);
+    EXPECT_EQ(0, s.nn_pending);
+    EXPECT_EQ(6ULL, s.nn_done);
+
+    // Reuse the parked workers, never create new one.
+    HELPER_EXPECT_SUCCESS(pool.spawn([&nn_done]() {
+        nn_done++;
+    }));
+    srs_usleep(1 * SRS_UTIME_MILLISECONDS);
+    EXPECT_EQ(7, nn_done);
+
+    pool.stat(&s);
+    EXPECT_EQ(4ULL, s.nn_created);
+
+    pool.stop();
+    HELPER_EXPECT_FAILED_CODE(ERROR_THREAD_DISPOSED, pool.spawn([]() {}));
+}
+
+// The idle workers more than min are retired on idle timeout, and the pool grows again.
+VOID TEST(CoroutinePoolTest, ShrinkOnIdleTimeout)
+{
+    srs_error_t err = srs_success;
+
+    SrsCoroutinePool pool("utest", 1, 3);
+    pool.set_idle_timeout(20 * SRS_UTIME_MILLISECONDS);
+    HELPER_EXPECT_SUCCESS(pool.start());
+    srs_usleep(1 * SRS_UTIME_MILLISECONDS);
+
+    int nn_done = 0;
+    for (int i = 0; i < 3; i++) {
+        HELPER_EXPECT_SUCCESS(pool.spawn([&nn_done]() {
+            srs_usleep(5 * SRS_UTIME_MILLISECONDS);
+            nn_done++;
+        }));
+    }
+
+    SrsCoroutinePoolStat s;
+    pool.stat(&s);
+    EXPECT_EQ(3, s.nn_workers);
+
+    // The tasks are done in 5ms, then the workers park for 20ms and retire, except the min one.
+    srs_usleep(100 * SRS_UTIME_MILLISECONDS);
+    EXPECT_EQ(3, nn_done);
+
+    pool.stat(&s);
+    EXPECT_EQ(1, s.nn_workers);
+    EXPECT_EQ(1, s.nn_idle);
+    EXPECT_EQ(2ULL, s.nn_retired);
+
+    // The retired workers are freed by spawn, and the pool grows again.
+    for (int i = 0; i < 2; i++) {
+        HELPER_EXPECT_SUCCESS(pool.spawn([&nn_done]() {
+            srs_usleep(5 * SRS_UTIME_MILLISECONDS);
+            nn_done++;
+        }));
+    }
+
+    pool.stat(&s);
+    EXPECT_EQ(2, s.nn_workers);
+    EXPECT_EQ(4ULL, s.nn_created);
+
+    srs_usleep(10 * SRS_UTIME_MILLISECONDS);
+    EXPECT_EQ(5, nn_done);
+}
+
+// The pool with no min workers retires all of them, and creates one for the next task.
+VOID TEST(CoroutinePoolTest, RetireAll)
+{
+    srs_error_t err = srs_success;
+
+    SrsCoroutinePool pool("utest", 0, 2);
+    pool.set_idle_timeout(10 * SRS_UTIME_MILLISECONDS);
+    HELPER_EXPECT_SUCCESS(pool.start());
+
+    SrsCoroutinePoolStat s;
+    pool.stat(&s);
+    EXPECT_EQ(0, s.nn_workers);
+
+    int nn_done = 0;
+    HELPER_EXPECT_SUCCESS(pool.spawn([&nn_done]() {
+        nn_done++;
+    }));
+    srs_usleep(50 * SRS_UTIME_MILLISECONDS);
+    EXPECT_EQ(1, nn_done);
+
+    pool.stat(&s);
+    EXPECT_EQ(0, s.nn_workers);
+    EXPECT_EQ(1ULL, s.nn_retired);
+
+    HELPER_EXPECT_SUCCESS(pool.spawn([&nn_done]() {
+        nn_done++;
+    }));
+    srs_usleep(1 * SRS_UTIME_MILLISECONDS);
+    EXPECT_EQ(2, nn_done);
+}
+
@@ -0,0 +1,192 @@
+//
+// Copyright (c) 2013-2021 The SRS Authors
+//
+// SPDX-License-Identifier: MIT
+//
+
+#include <srs_utest.hpp>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <srs_app_ringbuf.hpp>
+
+// Push and pop the values of a ring in one thread, to check the full, empty and wraparound.
+template<typename R>
+void mock_ring_laps(R& ring)
+{
+    // The capacity is rounded up to the power of two.
+    EXPECT_EQ(8, ring.capacity());
+
+    std::string v;
+    EXPECT_FALSE(ring.pop(&v));
+    EXPECT_EQ(0, ring.pop_batch(&v, 1));
+
+    // The value is not moved when full.
+    for (int i = 0; i < 8; i++) {
+        EXPECT_TRUE(ring.push(std::to_string(i)));
+    }
+    std::string full = "full";
+    EXPECT_FALSE(ring.push(std::move(full)));
+    EXPECT_EQ("full", full);
+    EXPECT_EQ(0, ring.push_batch(&full, 1));
+    EXPECT_EQ(8, ring.size());
+
+    std::string vs[8];
+    EXPECT_EQ(8, ring.pop_batch(vs, 8));
+    for (int i = 0; i < 8; i++) {
+        EXPECT_EQ(std::to_string(i), vs[i]);
+    }
+    EXPECT_EQ(0, ring.size());
+
+    // Mix push_batch and push for many laps, the batch wraps around the end of slots, and is
+    // partly moved in when no room.
+    int next_push = 0, next_pop = 0;
+    for (int lap = 0; lap < 10; lap++) {
+        std::string batch[5];
+        for (int i = 0; i < 5; i++) {
+            batch[i] = std::to_string(next_push + i);
+        }
+        int nn = ring.push_batch(batch, 5);
+        EXPECT_EQ(5, nn);
+        next_push += nn;
+
+        EXPECT_TRUE(ring.push(std::to_string(next_push++)));
+
+        // Only 2 slots left, so the batch is partly moved in.
+        for (int i = 0; i < 5; i++) {
+            batch[i] = std::to_string(next_push + i);
+        }
+        nn = ring.push_batch(batch, 5);
+        EXPECT_EQ(2, nn);
+        next_push += nn;
+        EXPECT_EQ(8, ring.size());
+
+        // Pop all, by one and by batch.
+        EXPECT_TRUE(ring.pop(&v));
+        EXPECT_EQ(std::to_string(next_pop++), v);
+        EXPECT_EQ(7, ring.pop_batch(vs, 8));
+        for (int i = 0; i < 7; i++) {
+            EXPECT_EQ(std::to_string(next_pop++), vs[i]);
+        }
+        EXPECT_FALSE(ring.pop(&v));
+    }
+    EXPECT_EQ(80, next_pop);
+}
+
+VOID TEST(RingTest, SpscLaps)
+{
+    SrsSpscRing<std::string> ring(5);
+    mock_ring_laps(ring);
+}
+
+VOID TEST(RingTest, MpscLaps)
+{
+    SrsMpscRing<std::string> ring(5);
+    mock_ring_laps(ring);
+}
+
+// The consumer gets the values of a producer pthread in order.
+VOID TEST(RingTest, SpscCrossThread)
+{
+    SrsSpscRing<int> ring(64);
+
+    const int nn = 100000;
+    std::thread producer([&ring]() {
+        int v = 0;
+        while (v < nn) {
+            int n = 0;
+            if (v % 2) {
+                int vs[7];
+                n = std::min(7, nn - v);
+                for (int i = 0; i < n; i++) {
+                    vs[i] = v + i;
+                }
+                n = ring.push_batch(vs, n);
+            } else {
+                n = ring.push(v)? 1 : 0;
+            }
+            v += n;
+            // Full, let the consumer run, for the box with a CPU.
+            if (!n) {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    int expect = 0;
+    bool ordered = true;
+    while (expect < nn) {
+        int vs[16];
+        int n = ring.pop_batch(vs, 16);
+        if (!n) {
+            std::this_thread::yield();
+        }
+        for (int i = 0; i < n; i++) {
+            ordered = ordered && (vs[i] == expect);
+            expect++;
+        }
+    }
+    producer.join();
+
+    EXPECT_TRUE(ordered);
+    EXPECT_EQ(0, ring.size());
+}
+
+// The consumer gets all values of producer pthreads, in order for each producer.
+VOID TEST(RingTest, MpscCrossThread)
+{
+    SrsMpscRing<int> ring(64);
+
+    // The value is the id of producer in high bits, and the sequence in low bits.
+    const int nn = 50000;
+    const int nn_producers = 3;
+    std::vector<std::thread> producers;
+    for (int id = 0; id < nn_producers; id++) {
+        producers.push_back(std::thread([&ring, id]() {
+            int seq = 0;
+            while (seq < nn) {
+                int n = 0;
+                if (seq % 3) {
+                    int vs[5];
+                    n = std::min(5, nn - seq);
+                    for (int i = 0; i < n; i++) {
+                        vs[i] = (id << 20) | (seq + i);
+                    }
+                    n = ring.push_batch(vs, n);
+                } else {
+                    n = ring.push((id << 20) | seq)? 1 : 0;
+                }
+                seq += n;
+                if (!n) {
+                    std::this_thread::yield();
+                }
+            }
+        }));
+    }
+
+    int nexts[nn_producers] = {0};
+    int total = 0;
+    bool ordered = true;
+    while (total < nn * nn_producers) {
+        int vs[16];
+        int n = ring.pop_batch(vs, 16);
+        if (!n) {
+            std::this_thread::yield();
+        }
+        for (int i = 0; i < n; i++) {
+            int id = vs[i] >> 20;
+            ordered = ordered && (vs[i] & 0xfffff) == nexts[id];
+            nexts[id]++;
+        }
+        total += n;
+    }
+    for (int id = 0; id < nn_producers; id++) {
+        producers.at(id).join();
+        EXPECT_EQ(nn, nexts[id]);
+    }
+
+    EXPECT_TRUE(ordered);
+    EXPECT_EQ(0, ring.size());
+}
@@ -0,0 +1,52 @@
+//
+// Copyright (c) 2013-2021 The SRS Authors
+//
+// SPDX-License-Identifier: MIT
+//
+
+#include <srs_utest.hpp>
+
+#include <srs_service_st.hpp>
+#include <srs_app_st.hpp>
+
+// The locker waits for the lock even if interrupted, and the interrupt is kept for the next blocking call.
+VOID TEST(StTest, RdLockerInterrupted)
+{
+    srs_error_t err = srs_success;
+
+    SrsCoroutinePool pool("utest", 0, 1);
+    HELPER_EXPECT_SUCCESS(pool.start());
+
+    srs_rwlock_t lock = srs_rwlock_new();
+    EXPECT_EQ(0, srs_rwlock_wrlock(lock));
+
+    srs_thread_t reader = NULL;
+    bool locked = false;
+    int r0 = 0;
+    HELPER_EXPECT_SUCCESS(pool.spawn([&]() {
+        reader = srs_thread_self();
+        if (true) {
+            SrsRdLocker(lock);
+            locked = true;
+        }
+        r0 = srs_usleep(1 * SRS_UTIME_SECONDS);
+    }));
+
+    // Let the reader run and block on the lock, then interrupt it.
+    srs_usleep(1 * SRS_UTIME_MILLISECONDS);
+    EXPECT_TRUE(reader != NULL);
+    srs_thread_interrupt(reader);
+    srs_usleep(1 * SRS_UTIME_MILLISECONDS);
+    EXPECT_FALSE(locked);
+
+    EXPECT_EQ(0, srs_rwlock_unlock(lock));
+    srs_usleep(1 * SRS_UTIME_MILLISECONDS);
+    EXPECT_TRUE(locked);
+    EXPECT_EQ(-1, r0);
+
+    // The writer locker also gets the lock, after the reader releases it.
+    if (true) {
+        SrsWrLocker(lock);
+    }
+    srs_rwlock_destroy(lock);
+}
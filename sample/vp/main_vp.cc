@@ -0,0 +1,120 @@
+#include <string>
+
+#include <arpa/inet.h>
+
+#include "srs_service_st.hpp"
+#include "srs_core.hpp"
+#include "srs_kernel_error.hpp"
+#include "srs_kernel_log.hpp"
+#include "srs_app_log.hpp"
+#include "srs_service_log.hpp"
+#include "srs_app_listener.hpp"
+#include "srs_app_vp.hpp"
+
+using namespace std;
+
+ISrsLog* _srs_log = NULL;
+ISrsContext* _srs_context = NULL;
+
+// The udp echo server, each VP has its own listener on the same port.
+class UdpEchoServer : public ISrsUdpHandler
+{
+public:
+    UdpEchoServer() {
+        listener_ = NULL;
+        nn_packets_ = 0;
+    }
+    ~UdpEchoServer() {
+        srs_freep(listener_);
+    }
+
+    srs_error_t listen(string ip, int port) {
+        srs_error_t err = srs_success;
+        listener_ = new SrsUdpListener(this, ip, port);
+        if ((err = listener_->listen()) != srs_success) {
+            return srs_error_wrap(err, "listen %s:%d", ip.c_str(), port);
+        }
+        return err;
+    }
+
+public:
+    srs_error_t on_udp_packet(const sockaddr* from, const int fromlen, char* buf, int nb_buf) {
+        nn_packets_++;
+        srs_info("vp=%d echo %d bytes, packets=%d", srs_vp_index(), nb_buf, nn_packets_);
+
+        if (srs_sendto(listener_->stfd(), buf, nb_buf, (sockaddr*)from, fromlen, SRS_UTIME_NO_TIMEOUT) <= 0) {
+            return srs_error_new(ERROR_SOCKET_WRITE, "udp echo");
+        }
+        return srs_success;
+    }
+
+private:
+    SrsUdpListener* listener_;
+    int nn_packets_;
+};
+
+class EchoVpHandler : public ISrsVpHandler
+{
+public:
+    EchoVpHandler(string ip, int port, int nn) {
+        ip_ = ip;
+        port_ = port;
+        servers_ = new UdpEchoServer*[nn];
+        for (int i = 0; i < nn; i++) {
+            servers_[i] = NULL;
+        }
+    }
+    ~EchoVpHandler() {
+        srs_freepa(servers_);
+    }
+
+public:
+    // Each VP only touches its own slot, so no lock is required.
+    srs_error_t on_vp_start(int index) {
+        srs_error_t err = srs_success;
+        UdpEchoServer* server = servers_[index] = new UdpEchoServer();
+        if ((err = server->listen(ip_, port_)) != srs_success) {
+            return srs_error_wrap(err, "vp=%d", index);
+        }
+        srs_trace("vp=%d listen at %s:%d", index, ip_.c_str(), port_);
+        return err;
+    }
+    void on_vp_stop(int index) {
+        srs_freep(servers_[index]);
+    }
+
+private:
+    string ip_;
+    int port_;
+    UdpEchoServer** servers_;
+};
+
+int main(int argc, const char* argv[])
+{
+    int port = (argc > 1)? atoi(argv[1]) : 14000;
+    int nn = (argc > 2)? atoi(argv[2]) : srs_vp_ncpus();
+
+    _srs_log = new SrsFileLog();
+    _srs_log->initialize();
+    _srs_context = new SrsThreadContext();
+
+    EchoVpHandler handler("0.0.0.0", port, nn);
+    SrsVpGroup* vps = new SrsVpGroup(&handler);
+    vps->set_affinity(true);
+
+    srs_error_t err = vps->start(nn);
+    if (err != srs_success) {
+        srs_error("start vps failed [%s]", srs_error_desc(err).c_str());
+        srs_freep(err);
+        srs_freep(vps);
+        return -1;
+    }
+
+    // The main thread is not a VP, it just waits for the VPs.
+    vps->wait();
+    srs_freep(vps);
+
+    srs_trace("demo exit");
+    return 0;
+}
+